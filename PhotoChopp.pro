@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui concurrent network
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -28,11 +28,25 @@ DEFINES += QT_DEPRECATED_WARNINGS
 SOURCES += \
         src\main.cpp \
         src\mainwindow.cpp \
-    src/image_operations.cpp
+    src/job_protocol.cpp \
+    src/job_server.cpp \
+    src/operation_graph.cpp \
+    src/preview_panel.cpp \
+    src/thumbnail_browser.cpp \
+    src/thumbnail_cache.cpp \
+    src/tiled_image_view.cpp
 
 HEADERS += \
         include\mainwindow.hpp \
-    include/image_operations.hpp
+    include/job_protocol.hpp \
+    include/job_server.hpp \
+    include/operation_graph.hpp \
+    include/preview_panel.hpp \
+    include/thumbnail_browser.hpp \
+    include/thumbnail_cache.hpp \
+    include/tiled_image_view.hpp
+
+include(src/core.pri)
 
 FORMS += \
         res\mainwindow.ui
@@ -0,0 +1,20 @@
+#-------------------------------------------------
+#
+# Microbenchmarks of the image operations
+#
+#-------------------------------------------------
+
+QT       += core gui concurrent
+
+TARGET = photochopp_bench
+TEMPLATE = app
+
+CONFIG += console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../src/core.pri)
+
+SOURCES += \
+    main.cpp
@@ -0,0 +1,346 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <QThreadPool>
+
+#include "include/cpu_features.hpp"
+#include "include/image_buffer_pool.hpp"
+#include "include/operation_registry.hpp"
+#include "include/pixel_formats.hpp"
+#include "include/tile_pipeline.hpp"
+
+namespace {
+
+struct FormatEntry
+{
+  const char* name;
+  QImage::Format format;
+};
+
+// The operations run natively on these, see include/pixel_formats.hpp,
+// premultiplied alpha measures the conversion the other formats go through
+const FormatEntry kFormats[] = {
+  { "gray8", QImage::Format_Grayscale8 },
+#ifdef PHOTOCHOPP_HAS_GRAY16
+  { "gray16", QImage::Format_Grayscale16 },
+#endif
+  { "rgb32", QImage::Format_RGB32 },
+  { "argb32", QImage::Format_ARGB32 },
+  { "argb32_premultiplied", QImage::Format_ARGB32_Premultiplied },
+#ifdef PHOTOCHOPP_HAS_RGBA64
+  { "rgba64", QImage::Format_RGBA64 },
+#endif
+};
+
+struct BenchmarkResult
+{
+  QString operation;
+  QString format;
+  int width;
+  int height;
+  // Threads of the global pool the operation splits its work over
+  int threads;
+  int repetitions;
+  double median_ms;
+  double min_ms;
+  double megapixels_per_second;
+  double gigabytes_per_second;
+};
+
+/**
+ * Parameters that make each operation do representative work
+ * Operations not listed get the minimum of each parameter
+ */
+QVariantList benchmarkParameters(const image_op::OperationInfo& operation)
+{
+  if (operation.name == "quantize")
+    return { 16 };
+  if (operation.name == "brightness")
+    return { 32 };
+  if (operation.name == "contrast")
+    return { 2 };
+  if (operation.name == "zoom_out")
+    return { 2, 2 };
+  if (operation.name == "convolution")
+    return { 0.0625, 0.125, 0.0625, 0.125, 0.25, 0.125, 0.0625, 0.125, 0.0625, false };
+  if (operation.name == "erode" || operation.name == "dilate" || operation.name == "open" || operation.name == "close")
+    return { 15, 15 };
+  if (operation.name == "box_blur")
+    return { 15, 15 };
+  if (operation.name == "sauvola_threshold")
+    return { 15, 0.34 };
+  if (operation.name == "bradley_threshold")
+    return { 15, 0.15 };
+  if (operation.name == "otsu_threshold")
+    return { 4 };
+  if (operation.name == "nlm_denoise")
+    return { 5, 2, 10.0 };
+
+  QVariantList parameters;
+  for (const auto& parameter : operation.parameters)
+    parameters.append(parameter.minimum);
+  return parameters;
+}
+
+/**
+ * Deterministic image with gradients and noise, so histogram based
+ * operations see every tone
+ */
+QImage createTestImage(int width, int height, QImage::Format format)
+{
+  QImage image(width, height, QImage::Format_ARGB32);
+  quint32 seed = 12345;
+
+  for (int row_index = 0; row_index < height; row_index++) {
+    auto* row = reinterpret_cast<QRgb*>(image.scanLine(row_index));
+
+    for (int col_index = 0; col_index < width; col_index++) {
+      seed = seed * 1664525u + 1013904223u;
+      int noise = static_cast<int>(seed >> 27);
+      int red = (col_index * 255 / std::max(1, width - 1) + noise) & 0xff;
+      int green = (row_index * 255 / std::max(1, height - 1) + noise) & 0xff;
+      int blue = ((col_index + row_index) & 0xff) ^ noise;
+      row[col_index] = qRgba(red, green, blue, 255);
+    }
+  }
+
+  return image.convertToFormat(format);
+}
+
+qint64 imageBytes(const QImage& image)
+{
+  return static_cast<qint64>(image.bytesPerLine()) * image.height();
+}
+
+QList<int> parseIntegerList(const QString& text)
+{
+  QList<int> values;
+
+  for (const auto& value : text.split(',', QString::SkipEmptyParts)) {
+    bool ok;
+    int number = value.trimmed().toInt(&ok);
+    if (ok && number > 0)
+      values.append(number);
+  }
+
+  return values;
+}
+
+/**
+ * Runs apply with the global thread pool, which the operations split
+ * their work over, limited to threads, until min_time_ms elapsed and at
+ * least min_repetitions were made
+ */
+BenchmarkResult runBenchmark(const QString& name, const std::function<QImage()>& apply,
+                             const QVector<QImage>& inputs, const QString& format_name,
+                             int threads, int min_time_ms, int min_repetitions)
+{
+  QThreadPool* pool = QThreadPool::globalInstance();
+  int previous_thread_count = pool->maxThreadCount();
+  pool->setMaxThreadCount(threads);
+
+  // Warm up caches and the thread pool, and learn the output size
+  QImage output = apply();
+
+  std::vector<double> times_ms;
+  QElapsedTimer total_timer;
+  total_timer.start();
+
+  while (total_timer.elapsed() < min_time_ms || static_cast<int>(times_ms.size()) < min_repetitions) {
+    QElapsedTimer timer;
+    timer.start();
+    apply();
+    times_ms.push_back(timer.nsecsElapsed() / 1e6);
+  }
+
+  pool->setMaxThreadCount(previous_thread_count);
+
+  std::sort(times_ms.begin(), times_ms.end());
+
+  qint64 bytes = imageBytes(output);
+  for (const auto& input : inputs)
+    bytes += imageBytes(input);
+
+  BenchmarkResult result;
+  result.operation = name;
+  result.format = format_name;
+  result.width = inputs[0].width();
+  result.height = inputs[0].height();
+  result.threads = threads;
+  result.repetitions = static_cast<int>(times_ms.size());
+  result.median_ms = times_ms[times_ms.size() / 2];
+  result.min_ms = times_ms.front();
+
+  double seconds = std::max(result.median_ms, 1e-6) / 1000.0;
+  result.megapixels_per_second = (result.width * static_cast<double>(result.height) / 1e6) / seconds;
+  result.gigabytes_per_second = (bytes / 1e9) / seconds;
+
+  return result;
+}
+
+QJsonObject toJson(const BenchmarkResult& result)
+{
+  QJsonObject object;
+  object["operation"] = result.operation;
+  object["format"] = result.format;
+  object["width"] = result.width;
+  object["height"] = result.height;
+  object["megapixels"] = result.width * static_cast<double>(result.height) / 1e6;
+  object["threads"] = result.threads;
+  object["repetitions"] = result.repetitions;
+  object["median_ms"] = result.median_ms;
+  object["min_ms"] = result.min_ms;
+  object["megapixels_per_second"] = result.megapixels_per_second;
+  object["gigabytes_per_second"] = result.gigabytes_per_second;
+  return object;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("photochopp_bench");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Measures the throughput of every image operation");
+  parser.addHelpOption();
+
+  QCommandLineOption sizes_option("sizes", "Comma separated image sizes in megapixels.", "list", "1,10,100");
+  QCommandLineOption formats_option("formats", "Comma separated pixel formats: gray8, gray16, rgb32, argb32, "
+                                    "argb32_premultiplied, rgba64.", "list", "rgb32,argb32");
+  QCommandLineOption threads_option("threads", "Comma separated counts of threads each operation splits "
+                                    "its work over.", "list", QString("1,%1").arg(QThread::idealThreadCount()));
+  QCommandLineOption operations_option("operations", "Comma separated operation names, all if empty.", "list");
+  QCommandLineOption min_time_option("min-time", "Minimum time measuring each case, in milliseconds.",
+                                     "ms", "500");
+  QCommandLineOption output_option("output", "Writes the results as JSON to the file.", "file");
+  QCommandLineOption pipeline_option("pipeline", "Also measures this comma separated chain of operations "
+                                     "applied one at a time and fused tile by tile.", "list");
+  parser.addOptions({ sizes_option, formats_option, threads_option, operations_option,
+                      min_time_option, output_option, pipeline_option });
+  parser.process(app);
+
+  QList<int> sizes = parseIntegerList(parser.value(sizes_option));
+  QList<int> thread_counts = parseIntegerList(parser.value(threads_option));
+  QStringList format_names = parser.value(formats_option).split(',', QString::SkipEmptyParts);
+  QStringList operation_names = parser.value(operations_option).split(',', QString::SkipEmptyParts);
+
+  int min_time_ms = std::max(0, parser.value(min_time_option).toInt());
+  constexpr int kMinRepetitions = 3;
+
+  std::sort(thread_counts.begin(), thread_counts.end());
+  thread_counts.erase(std::unique(thread_counts.begin(), thread_counts.end()), thread_counts.end());
+
+  QVector<image_op::PipelineStage> pipeline_stages;
+  for (const auto& name : parser.value(pipeline_option).split(',', QString::SkipEmptyParts)) {
+    auto* operation = image_op::findOperation(name.trimmed());
+    if (!operation || operation->input_count != 1) {
+      std::fprintf(stderr, "Cannot use %s on a pipeline\n", qPrintable(name));
+      return 1;
+    }
+    pipeline_stages.append(image_op::PipelineStage{ operation->name, benchmarkParameters(*operation) });
+  }
+
+  QJsonArray json_results;
+  auto record = [&json_results](const BenchmarkResult& result) {
+    json_results.append(toJson(result));
+
+    std::printf("%-26s %-22s %8.2f %7d %10.2f %10.1f %9.2f\n",
+                qPrintable(result.operation), qPrintable(result.format),
+                result.width * static_cast<double>(result.height) / 1e6, result.threads,
+                result.median_ms, result.megapixels_per_second, result.gigabytes_per_second);
+    std::fflush(stdout);
+  };
+
+  std::printf("Kernels for %s\n", cpu::isaLevelName(cpu::activeIsaLevel()));
+  std::printf("%-26s %-22s %8s %7s %10s %10s %9s\n",
+              "operation", "format", "MP", "threads", "median ms", "MP/s", "GB/s");
+
+  for (int megapixels : sizes) {
+    // 4:3 images of the requested area
+    int width = static_cast<int>(std::lround(std::sqrt(megapixels * 1e6 * 4.0 / 3.0)));
+    int height = static_cast<int>(std::lround(megapixels * 1e6 / width));
+
+    for (const auto& format : kFormats) {
+      if (!format_names.contains(format.name))
+        continue;
+
+      QImage image = createTestImage(width, height, format.format);
+      QImage target_image = image.mirrored(true, false);
+
+      for (const auto& operation : image_op::availableOperations()) {
+        if (!operation_names.isEmpty() && !operation_names.contains(operation.name))
+          continue;
+
+        QVector<QImage> inputs = { image };
+        if (operation.input_count > 1)
+          inputs.append(target_image);
+
+        QVariantList parameters = benchmarkParameters(operation);
+        auto apply = [&]() { return image_op::applyOperation(operation.name, inputs, parameters); };
+
+        for (int threads : thread_counts)
+          record(runBenchmark(operation.name, apply, inputs, format.name, threads,
+                              min_time_ms, kMinRepetitions));
+      }
+
+      if (pipeline_stages.isEmpty())
+        continue;
+
+      // The same chain applied one operation at a time and fused tile by tile
+      auto apply_sequentially = [&]() {
+        QImage output = image;
+        for (const auto& stage : pipeline_stages)
+          output = image_op::applyOperation(stage.name, { output }, stage.parameters);
+        return output;
+      };
+      auto apply_fused = [&]() { return image_op::applyPipeline(image, pipeline_stages); };
+
+      for (int threads : thread_counts) {
+        record(runBenchmark("pipeline", apply_sequentially, { image }, format.name, threads,
+                            min_time_ms, kMinRepetitions));
+        record(runBenchmark("pipeline fused", apply_fused, { image }, format.name, threads,
+                            min_time_ms, kMinRepetitions));
+      }
+    }
+  }
+
+  if (parser.isSet(output_option)) {
+    QJsonObject report;
+    report["qt_version"] = QString(qVersion());
+    report["ideal_thread_count"] = QThread::idealThreadCount();
+    report["isa_level"] = cpu::isaLevelName(cpu::activeIsaLevel());
+    report["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["results"] = json_results;
+
+    auto pool_statistics = image_op::imageBufferPoolStatistics();
+    QJsonObject buffer_pool;
+    buffer_pool["allocations"] = static_cast<double>(pool_statistics.allocations);
+    buffer_pool["reuses"] = static_cast<double>(pool_statistics.reuses);
+    report["buffer_pool"] = buffer_pool;
+
+    QFile file(parser.value(output_option));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+      std::fprintf(stderr, "Could not write %s\n", qPrintable(file.fileName()));
+      return 1;
+    }
+
+    file.write(QJsonDocument(report).toJson());
+  }
+
+  return 0;
+}
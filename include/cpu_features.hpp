@@ -0,0 +1,49 @@
+#pragma once
+
+namespace cpu {
+
+/**
+ * Instruction set levels kernels are compiled for, each one implying
+ * the ones before it
+ */
+enum class IsaLevel
+{
+  Scalar,
+  Sse2,
+  Avx2,
+  // AVX-512 foundation and byte/word instructions
+  Avx512
+};
+
+/**
+ * Highest level supported by the processor and the operating system
+ */
+IsaLevel detectIsaLevel();
+
+/**
+ * Level used by the kernels, detected once on the first call
+ *
+ * The PHOTOCHOPP_CPU_LEVEL environment variable (scalar, sse2, avx2 or
+ * avx512) forces a lower level for testing and benchmarking, levels the
+ * processor does not support are ignored
+ */
+IsaLevel activeIsaLevel();
+
+const char* isaLevelName(IsaLevel level);
+
+} // namespace cpu
+
+/**
+ * Marks a function to be compiled for the given instruction set, e.g.
+ * PHOTOCHOPP_TARGET("avx2"), so its intrinsics do not need global flags
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define PHOTOCHOPP_TARGET(isa) __attribute__((target(isa)))
+#else
+// MSVC allows any intrinsic without flags
+#define PHOTOCHOPP_TARGET(isa)
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define PHOTOCHOPP_X86 1
+#endif
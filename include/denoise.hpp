@@ -0,0 +1,23 @@
+#pragma once
+
+#include <QImage>
+
+namespace image_op {
+
+/**
+ * Non-local means denoising: each pixel becomes the average of the pixels
+ * within search_radius of it, each weighted by how much the patch of
+ * patch_radius around it looks like the patch around the pixel,
+ * exp(-d / strength^2) for a mean squared difference d between the two
+ * patches over every color channel. The strength is on the 0 to 255 scale,
+ * around the standard deviation of the noise, and alpha is kept
+ *
+ * The image is extended past its edges by repeating them. Distances are
+ * computed one search offset at a time for the whole band of rows a task
+ * takes, as summed-area tables of the squared differences between the
+ * image and itself shifted by the offset, so each patch distance is four
+ * lookups and the cost does not depend on the patch size
+ */
+QImage nonLocalMeansDenoise(QImage image, int search_radius, int patch_radius, double strength);
+
+} // namespace image_op
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <QByteArray>
+#include <QImage>
+#include <QRect>
+#include <QString>
+#include <QTemporaryDir>
+#include <QVariant>
+#include <QVector>
+
+/**
+ * Undo/redo history of an image storing each edit as compressed deltas of
+ * the tiles it changed
+ *
+ * Each entry only keeps the side of the edit that is not on the image at the
+ * moment: the previous tiles while it can be undone and the modified tiles
+ * after undoing, so undo and redo are the same swap of tiles. Entries over the
+ * memory limit are spilled to disk starting from the oldest ones
+ *
+ * An optional state can be attached to each entry, it is swapped with the
+ * caller state on undo and redo the same way as the tiles
+ */
+class EditHistory
+{
+public:
+  explicit EditHistory(qint64 memory_limit = kDefaultMemoryLimit);
+
+  /**
+   * Sets the maximum memory used by the entries kept in memory
+   */
+  void setMemoryLimit(qint64 bytes);
+
+  qint64 memoryLimit() const;
+
+  /**
+   * Drops every entry, including the ones spilled to disk
+   */
+  void clear();
+
+  /**
+   * Records the edit from before to after, discarding undone entries
+   * Only tiles that differ are stored, if the image changed size, format
+   * or color table the whole previous image is stored instead
+   * @param region Part of the image the edit may have changed, only the
+   * tiles over it are compared, null to compare the whole image
+   * @return Region of the image the edit changed, null if none
+   */
+  QRect record(const QImage& before, const QImage& after, const QString& description,
+              const QVariant& state_before = QVariant(), const QRect& region = QRect());
+
+  bool canUndo() const;
+  bool canRedo() const;
+
+  QString undoDescription() const;
+  QString redoDescription() const;
+
+  /**
+   * States attached to the entries that can be undone and redone
+   */
+  QVector<QVariant> states() const;
+
+  /**
+   * Reverts the last edit on the image, touching only the tiles it changed
+   * @param restored_region Set to the region of the image that was restored
+   * @param state Current state, replaced by the state before the edit
+   * @return false, leaving the image and the state as they are, if there
+   * is nothing to undo or the entry spilled to disk cannot be read back
+   */
+  bool undo(QImage& image, QRect* restored_region, QVariant* state = nullptr);
+
+  /**
+   * Applies again the last undone edit on the image
+   * @param restored_region Set to the region of the image that was restored
+   * @param state Current state, replaced by the state after the edit
+   * @return false, leaving the image and the state as they are, if there
+   * is nothing to redo or the entry spilled to disk cannot be read back
+   */
+  bool redo(QImage& image, QRect* restored_region, QVariant* state = nullptr);
+
+  static constexpr qint64 kDefaultMemoryLimit = 256 * 1024 * 1024;
+  static constexpr int kTileSize = 256;
+
+private:
+  struct TileDelta
+  {
+    QRect rect;
+    QByteArray data;
+  };
+
+  struct Entry
+  {
+    QString description;
+    // The single tile holds the whole image, the edit changed its size,
+    // format or color table
+    bool whole_image;
+    QSize size;
+    QImage::Format format;
+    QVector<QRgb> color_table;
+    std::vector<TileDelta> tiles;
+    QVariant state;
+    qint64 cost;
+    QString spill_file_name;
+  };
+
+  /**
+   * Swaps the tiles of the entry with the ones on the image
+   */
+  QRect swapTiles(Entry& entry, QImage& image, QVariant* state);
+
+  /**
+   * Writes entries to disk until the memory used is below the limit
+   */
+  void enforceMemoryLimit();
+
+  bool spill(Entry& entry);
+  bool restore(Entry& entry);
+
+  std::vector<Entry> entries_;
+  // Entries before this position can be undone, the others redone
+  size_t position_;
+  qint64 memory_used_;
+  qint64 memory_limit_;
+  int spill_count_;
+  std::unique_ptr<QTemporaryDir> spill_dir_;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <functional>
+
+#include <QImage>
+#include <QString>
+#include <QVector>
+
+#include "include/tile_pipeline.hpp"
+
+namespace image_op {
+
+/**
+ * Chain of operations applied to every frame of a numbered sequence
+ */
+struct FrameSequenceJob
+{
+  // File names with a run of # standing for the zero padded frame number,
+  // like frames/shot_####.png
+  QString input_pattern;
+  QString output_pattern;
+  // Frames found outside of this range are skipped, -1 for no bound
+  int first_frame;
+  int last_frame;
+  // Single input operations of the registry, plus match_histogram without
+  // parameters, which matches each frame to the reference image, both
+  // grayscale
+  QVector<PipelineStage> stages;
+  QImage reference;
+  // Frames waiting between the decoding, processing and encoding stages
+  int queue_capacity;
+};
+
+/**
+ * Name of a frame, the run of # of the pattern replaced by its number
+ * padded with zeros to the length of the run
+ * @return Empty string if the pattern has no #
+ */
+QString frameFileName(const QString& pattern, int frame);
+
+/**
+ * Numbers of the frames of the pattern found on disk, in increasing order
+ */
+QVector<int> findSequenceFrames(const QString& pattern);
+
+/**
+ * Applies the stages of the job to each frame of the sequence, decoding,
+ * processing and encoding on three threads that hand the frames over
+ * through bounded queues, so frame N+1 is read while frame N is processed,
+ * over the global thread pool, and frame N-1 written
+ *
+ * State that does not change between frames, like the cumulative histogram
+ * of the reference image, is computed once before the first frame
+ *
+ * @param progress Called from the encoding thread after each frame is
+ * written, with the frame and how many of the total were written
+ * @param error Set to the reason when the sequence fails
+ * @return false if a stage is invalid, no frame is found or a frame cannot
+ * be read, processed or written, the frames before it being written
+ */
+bool processFrameSequence(const FrameSequenceJob& job,
+                          const std::function<void(int frame, int written, int total)>& progress,
+                          QString* error);
+
+} // namespace image_op
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+#include <QImage>
+
+namespace image_op {
+
+/**
+ * Histogram of an image with what is known about its content
+ */
+struct HistogramInfo
+{
+  // Same data as generateGrayscaleHistogramData
+  std::vector<int> histogram;
+  // Whether every pixel has equal red, green and blue
+  bool grayscale;
+};
+
+/**
+ * Histogram of the image, scanned once and then kept for the image data,
+ * identified by QImage::cacheKey, so copies of the image share it
+ */
+HistogramInfo cachedHistogram(const QImage& image);
+
+/**
+ * Looks up the histogram of the image without scanning it
+ * @return false if it is not cached
+ */
+bool findCachedHistogram(const QImage& image, HistogramInfo* info);
+
+/**
+ * Caches a histogram known without scanning the image, like one
+ * carried forward from the input of a point operation
+ */
+void cacheHistogram(const QImage& image, const HistogramInfo& info);
+
+/**
+ * Histogram of an image after replacing each tone by its value on the
+ * tone curve, a 256 position vector on the 0 to 255 scale
+ */
+std::vector<int> mapHistogram(const std::vector<int>& histogram_data, const std::vector<int>& tone_curve);
+
+} // namespace image_op
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <QImage>
+
+namespace image_op {
+
+/**
+ * Counters of the buffer pool since the program started
+ */
+struct ImageBufferPoolStatistics
+{
+  // Buffers taken from the system
+  qint64 allocations;
+  // Buffers handed out again after an image released them
+  qint64 reuses;
+  // Bytes of the released buffers kept for reuse
+  qint64 idle_bytes;
+};
+
+/**
+ * Same as QImage(width, height, format), uninitialized, but the pixels live
+ * in a buffer of a pool shared by every thread. Once the last copy of the
+ * image is destroyed the buffer goes back to the pool, so operations giving
+ * images of the same size over and over reuse memory that is already mapped
+ * instead of faulting in fresh pages
+ *
+ * Buffers are grouped in eight sizes per power of two and aligned, as is
+ * each row, to 64 bytes. Images smaller than the heap serves without
+ * mapping pages of its own are allocated as usual
+ */
+QImage pooledImage(int width, int height, QImage::Format format);
+
+ImageBufferPoolStatistics imageBufferPoolStatistics();
+
+} // namespace image_op
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QImage>
+
+namespace image_op {
+
+/**
+ * Differences between two images of the same size, over the color
+ * channels on the 0 to 255 scale whatever the bit depth. Alpha is left
+ * out, like the reference operations leave every pixel opaque
+ */
+struct ImageComparison
+{
+  // Zero when the images cannot be compared, having different sizes
+  qint64 pixel_count;
+  // Mean of the squared differences of every color channel
+  double mean_squared_error;
+  // Peak signal-to-noise ratio in dB, infinite for equal images
+  double peak_signal_to_noise_ratio;
+  // Mean SSIM of the luminance over 11 x 11 Gaussian windows with a
+  // standard deviation of 1.5, clipped to the image, 1 for equal images
+  double structural_similarity;
+  // Largest difference of any color channel
+  int maximum_difference;
+};
+
+/**
+ * Compares the second image with the first one, converted to the format
+ * of the first if it differs. Rows are compared in bands over the global
+ * thread pool, 8-bit color formats with the vector kernels, and the
+ * Gaussian windows of SSIM are separable so each band filters its rows
+ * then its columns
+ */
+ImageComparison compareImages(const QImage& first_image, const QImage& second_image);
+
+/**
+ * Image of the differences of each color channel, multiplied by
+ * amplification so small ones show, in the format of the first image.
+ * Opaque, and null if the sizes differ
+ */
+QImage differenceImage(const QImage& first_image, const QImage& second_image, int amplification);
+
+} // namespace image_op
@@ -7,6 +7,9 @@
 
 namespace image_op {
 
+// The operations run natively on the formats of include/pixel_formats.hpp
+// and keep them, other formats are converted to RGB32 or ARGB32 first
+
 /**
  * Mirrors image horizontally swapping
  * the values on each bit
@@ -26,16 +29,31 @@ QImage mirrorVertically(QImage image);
  */
 QImage convertColoredToGrayscale(QImage image);
 
+/**
+ * Sets L = R = G = B to the luminance of every pixel
+ * like convertColoredToGrayscale, even if the image
+ * is already gray, for parts of a colored image
+ */
+QImage convertToLuminance(QImage image);
+
 /**
  * Quantize a grayscale image by defining num_colors - 1
- * intervals and aligning each pixel color to the closest
+ * intervals between the darkest and the lightest tone of the
+ * image and aligning each pixel color to the closest
  * separator of the intervals
- * Assumes 8-bit image
  */
 QImage quantizeGrayscale(QImage image, int num_colors);
 
 /**
- * Generates the histogram data of a grayscale 8-bit image
+ * Quantize a grayscale image with intervals between minimum
+ * and maximum, on the 0 to 255 scale whatever the bit depth,
+ * for parts of an image quantized by the range of the whole
+ */
+QImage quantizeGrayscale(QImage image, int num_colors, int minimum, int maximum);
+
+/**
+ * Generates the histogram data of a grayscale image, deeper
+ * formats are binned on the 0 to 255 scale
  * @return 256 position vector with density of tones
  */
 std::vector<int> generateGrayscaleHistogramData(QImage image);
@@ -70,12 +88,65 @@ QImage getNegativeImage(QImage image);
  */
 QImage equalizeHistogram(QImage image);
 
+/**
+ * Tone curve equalizeHistogram applies to each channel given the
+ * luminance histogram of the image
+ * @return 256 position vector with the new value of each tone
+ */
+std::vector<int> equalizationCurve(const std::vector<int>& histogram_data);
+
 /**
  * Matches the histogram of the original image with the target image,
  * assuming both grayscale 8-bit images
  */
 QImage matchGrayscaleHistogram(QImage original_image, QImage target_image);
 
+/**
+ * Cumulative histogram of a grayscale image scaled to 0 to 255, what
+ * matchGrayscaleHistogram compares, so the one of a fixed target can be
+ * computed once and matched against many images
+ */
+std::vector<int> cumulativeGrayscaleHistogram(const QImage& image);
+
+/**
+ * Tone curve matchGrayscaleHistogram applies, mapping each tone to the
+ * one of the target with the nearest cumulative histogram value
+ * @return 256 position vector with the new value of each tone
+ */
+std::vector<int> histogramMatchingCurve(const std::vector<int>& original_cumulative_histogram,
+                                        const std::vector<int>& target_cumulative_histogram);
+
+/**
+ * Segments the luminance in class_count classes of tones with Otsu's
+ * method, picking the thresholds from the histogram then mapping each
+ * class to a gray level evenly spaced from black to white, so two
+ * classes binarize the image. Keeps alpha
+ */
+QImage otsuThreshold(QImage image, int class_count);
+
+/**
+ * Thresholds splitting the tones of a histogram in class_count classes
+ * with the largest variance between classes, found by dynamic programming
+ * over the histogram so the cost does not depend on the image size. Ties
+ * go to the lowest thresholds
+ * @return class_count - 1 increasing thresholds, each the last tone of
+ * its class
+ */
+std::vector<int> otsuThresholds(const std::vector<int>& histogram_data, int class_count);
+
+/**
+ * Tone curve otsuThreshold applies given the luminance histogram
+ * @return 256 position vector with the gray level of the class of each tone
+ */
+std::vector<int> otsuCurve(const std::vector<int>& histogram_data, int class_count);
+
+/**
+ * Replaces each pixel by the gray level the tone curve gives its tone on
+ * the 0 to 255 scale, the luminance or, for grayscale images, the red
+ * channel. Keeps alpha
+ */
+QImage mapGrayTones(QImage image, const std::vector<int>& tone_curve, bool use_luminance);
+
 /**
  * Zooms out the image using the factor sx and sy creating rectangles of these
  * dimensions and taking the medium of the pixels on each rectangle
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include <QImage>
+
+namespace image_op {
+
+/**
+ * Statistics of one channel, on the 0 to 255 scale whatever the bit depth
+ */
+struct ChannelStatistics
+{
+  // 256 position vector with density of tones
+  std::vector<int> histogram;
+  int minimum;
+  int maximum;
+  double mean;
+  double variance;
+};
+
+/**
+ * Statistics of every channel of an image, luminance being the value
+ * convertColoredToGrayscale gives each pixel
+ */
+struct ImageStatistics
+{
+  qint64 pixel_count;
+  // Whether every pixel has equal red, green and blue
+  bool grayscale;
+  ChannelStatistics red;
+  ChannelStatistics green;
+  ChannelStatistics blue;
+  ChannelStatistics alpha;
+  ChannelStatistics luminance;
+};
+
+/**
+ * Statistics of the image, computed in a single pass split in bands of
+ * rows over the global thread pool, then kept for the image data,
+ * identified by QImage::cacheKey, until it changes
+ *
+ * Also caches the histogram returned by cachedHistogram
+ */
+ImageStatistics imageStatistics(const QImage& image);
+
+} // namespace image_op
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vector>
+
+#include <QImage>
+
+namespace image_op {
+
+/**
+ * Summed-area table of one channel of an image: the 64-bit sum, and
+ * optionally the sum of squares, of the values above and to the left of
+ * each position, so sums over any rectangle take four lookups whatever
+ * its size
+ *
+ * Values are on the scale of the format. The tables have one more row and
+ * column than the image, the first ones zero. They are built in bands of
+ * rows over the global thread pool, each band starting from the column
+ * sums of the bands above it, so the tables are written once
+ */
+class IntegralImage
+{
+public:
+  enum Channel { Red, Green, Blue, Alpha, Luminance };
+
+  IntegralImage();
+
+  /**
+   * Builds the tables of a channel of the image. Luminance is the value
+   * convertColoredToGrayscale gives each pixel, exactly the gray value on
+   * pixels that are already gray
+   */
+  IntegralImage(const QImage& image, Channel channel, bool with_squares = false);
+
+  bool isNull() const { return sums_.empty(); }
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+  /**
+   * Sum over columns left to right - 1 and rows top to bottom - 1, which
+   * must be within the image
+   */
+  qint64 sum(int left, int top, int right, int bottom) const
+  {
+    return rectangleSum(sums_, left, top, right, bottom);
+  }
+
+  /**
+   * Sum of squares over the same rectangle, only if built with squares
+   */
+  qint64 sumOfSquares(int left, int top, int right, int bottom) const
+  {
+    return rectangleSum(squares_, left, top, right, bottom);
+  }
+
+  double mean(int left, int top, int right, int bottom) const
+  {
+    return static_cast<double>(sum(left, top, right, bottom)) / area(left, top, right, bottom);
+  }
+
+  double variance(int left, int top, int right, int bottom) const;
+
+private:
+  qint64 rectangleSum(const std::vector<qint64>& table, int left, int top, int right, int bottom) const
+  {
+    auto stride = static_cast<size_t>(width_) + 1;
+    auto top_offset = static_cast<size_t>(top) * stride;
+    auto bottom_offset = static_cast<size_t>(bottom) * stride;
+    return table[bottom_offset + right] - table[bottom_offset + left] - table[top_offset + right] + table[top_offset + left];
+  }
+
+  static qint64 area(int left, int top, int right, int bottom)
+  {
+    return static_cast<qint64>(right - left) * (bottom - top);
+  }
+
+  int width_;
+  int height_;
+  std::vector<qint64> sums_;
+  std::vector<qint64> squares_;
+};
+
+// Local operations on windows centered on each pixel like the structuring
+// elements of morphology.hpp and clipped to the image, so each window sum
+// takes constant time on an IntegralImage
+
+/**
+ * Replaces each channel of each pixel by its mean over a box of
+ * box_width x box_height pixels, rounded to the nearest value
+ */
+QImage boxBlur(QImage image, int box_width, int box_height);
+
+/**
+ * Binarizes the luminance with Sauvola's threshold, mean * (1 + k * (s / R - 1))
+ * over a window_size square window, s being the local standard deviation
+ * and R half of the range of the channel, 128 for 8-bit images. Pixels over
+ * the threshold turn white and the others black, keeping alpha
+ */
+QImage sauvolaThreshold(QImage image, int window_size, double k);
+
+/**
+ * Binarizes the luminance with Bradley's threshold, pixels turning black
+ * when they are at least a fraction t darker than the mean over a
+ * window_size square window and white otherwise, keeping alpha
+ */
+QImage bradleyThreshold(QImage image, int window_size, double t);
+
+} // namespace image_op
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <QByteArray>
+#include <QImage>
+#include <QJsonObject>
+#include <QString>
+
+class QLocalSocket;
+
+/**
+ * Messages between the job server and its clients over a local socket
+ *
+ * Each message is a JSON object followed by a binary payload, both written
+ * as QByteArray with QDataStream so they can be read back in one piece.
+ * A job names its operations as a chain for image_op::parsePipelineStages
+ * and takes its input from a file, "input", or from a shared memory
+ * segment, "shared_memory", holding the pixels described by the image
+ * fields. The reply echoes the "id" of the job with "ok", or "error", and
+ * the image fields of the result, whose pixels are the payload unless the
+ * job named an "output" file to write it to
+ */
+namespace job_protocol {
+
+// Server name used when none is given
+extern const char kDefaultServerName[];
+
+/**
+ * Reads a whole message if it has arrived, leaving the socket untouched
+ * otherwise
+ * @return false if the message is still incomplete
+ */
+bool readMessage(QLocalSocket* socket, QJsonObject* message, QByteArray* payload);
+
+/**
+ * Blocks until a whole message arrives
+ * @return false if the socket closes or timeout_ms elapses first
+ */
+bool waitForMessage(QLocalSocket* socket, QJsonObject* message, QByteArray* payload, int timeout_ms);
+
+void writeMessage(QLocalSocket* socket, const QJsonObject& message, const QByteArray& payload = QByteArray());
+
+/**
+ * Adds the width, height, format and bytes per line of the image to a
+ * message, describing the pixels sent along
+ */
+void describeImage(const QImage& image, QJsonObject* message);
+
+/**
+ * Bytes of the pixels of an image described in a message
+ * @return -1 if the description is invalid
+ */
+qint64 describedImageBytes(const QJsonObject& message);
+
+/**
+ * Copies the pixels of an image described in a message into a new image
+ * @return Null image if the description is invalid, size is too small or
+ * the image cannot be allocated
+ */
+QImage copyDescribedImage(const QJsonObject& message, const uchar* pixels, qint64 size);
+
+/**
+ * Copies the pixels of the image, rows bytesPerLine apart, as described
+ */
+QByteArray imagePixels(const QImage& image);
+
+} // namespace job_protocol
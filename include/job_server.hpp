@@ -0,0 +1,48 @@
+#pragma once
+
+#include <QJsonObject>
+#include <QLocalServer>
+#include <QObject>
+#include <QThreadPool>
+
+class QLocalSocket;
+
+/**
+ * Daemon running chains of operations for clients on the same machine,
+ * so each image skips the startup of a process: plugins stay loaded, the
+ * threads of the pools stay alive and the buffer pool keeps the pixels of
+ * earlier jobs mapped for the next ones
+ *
+ * Jobs, see include/job_protocol.hpp, run at most concurrent_jobs at once,
+ * each spreading its bands over the global thread pool, and their replies
+ * are sent as they finish, matched to the jobs by their id
+ */
+class JobServer : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit JobServer(int concurrent_jobs, QObject* parent = nullptr);
+
+  ~JobServer() override;
+
+  /**
+   * Starts accepting clients on the local socket of the name, replacing
+   * one left behind by a server that crashed
+   * @return false, with the reason in error, if a server is already
+   * running on the name or the socket cannot be created
+   */
+  bool listen(const QString& name, QString* error);
+
+private:
+  void acceptClients();
+
+  /**
+   * Starts the jobs that arrived whole on the socket
+   */
+  void readJobs(QLocalSocket* socket);
+
+  QLocalServer server_;
+  // Runs the jobs themselves, apart from the global pool their bands use
+  QThreadPool pool_;
+};
@@ -2,15 +2,22 @@
 
 #include <QMainWindow>
 #include <QAction>
+#include <QDockWidget>
 #include <QImage>
 #include <QLabel>
+#include <QListWidget>
+#include <QMenu>
 #include <QPixmap>
-#include <QScrollArea>
 #include <QFileDialog>
 #include <QHBoxLayout>
 #include <QVBoxLayout>
 #include <QPointer>
 
+#include "include/edit_history.hpp"
+#include "include/operation_graph.hpp"
+#include "include/thumbnail_browser.hpp"
+#include "include/tiled_image_view.hpp"
+
 class MainWindow : public QMainWindow
 {
   Q_OBJECT
@@ -70,6 +77,100 @@ private:
    */
   void initializeImageFileDialog(QFileDialog& dialog, QFileDialog::AcceptMode accept_mode);
 
+  /**
+   * Applies an operation of the registry on the current image, adding it
+   * to the operation graph after the current head
+   */
+  void applyOperation(const QString& name, const QVariantList& parameters,
+                      const QVector<int>& extra_inputs = QVector<int>());
+
+  /**
+   * Replaces the current image with the result of an operation, recording
+   * the change on the undo history along with the new operation graph head
+   * @param region Part of the image the operation was restricted to, null
+   * if it may have changed any pixel
+   */
+  void commitImage(const QImage& new_image, const QString& description, int new_head,
+                   const QRect& region = QRect());
+
+  /**
+   * Shows the current image on the right view after an edit, rendering
+   * again only the changed region when the view still holds the image
+   * before the edit, and all of it when it holds a comparison or a preview
+   * @param previous_key Cache key of the image before the edit
+   */
+  void showEditedImage(qint64 previous_key, const QRect& changed_region);
+
+  /**
+   * Shows a message on the status bar, followed by the time spent on each
+   * phase of the current action when operation timings are enabled
+   */
+  void showStatusMessage(const QString& message);
+
+  /**
+   * Lists the operations from the opened image up to the current one
+   */
+  void updateOperationsList();
+
+  /**
+   * Shows the statistics of the current image on the statistics panel
+   */
+  void updateStatisticsPanel();
+
+  /**
+   * Asks new parameters for an operation on the list, evaluating again
+   * only the operations that come after it
+   */
+  void editOperation(QListWidgetItem* item);
+
+  /**
+   * Reverts the last operation applied on the image
+   */
+  void undo();
+
+  /**
+   * Applies again the last reverted operation
+   */
+  void redo();
+
+  /**
+   * Asks the user for the memory kept by the undo history
+   */
+  void setHistoryMemoryLimit();
+
+  /**
+   * Lets the user drag over the modified image to select the region the
+   * next operations apply to, or stops it
+   */
+  void selectRegion(bool enabled);
+
+  /**
+   * Makes the next operations apply to the whole image again
+   */
+  void deselect();
+
+  /**
+   * Updates actions and the status bar after the selection changed
+   */
+  void selectionChanged(const QRect& selection);
+
+  /**
+   * Asks the user for a folder to show in the thumbnail browser
+   */
+  void browseFolder();
+
+  /**
+   * Saves the recorded profiling events as a Chrome trace file
+   */
+  void exportTrace();
+
+  /**
+   * Shows the amplified difference between the original and the current
+   * image in the right pane until the image changes, with the comparison
+   * metrics in the status bar
+   */
+  void compareWithOriginal();
+
   /**
    * Applies horizontal mirroring operation on the current image
    */
@@ -90,6 +191,20 @@ private:
    */
   void quantizeImage();
 
+  /**
+   * Segments the current image in tone classes with Otsu's method,
+   * previewing the number of classes
+   */
+  void otsuThreshold();
+
+  /**
+   * Shows a slider panel previewing a single parameter operation on a
+   * reduced copy of the image, applying it on the full image once the
+   * value is committed
+   */
+  void openPreviewPanel(const QString& operation_name, const QString& title, const QString& label,
+                        int value, int minimum, int maximum, const QString& message);
+
   /**
    * Generates and shows the histogram of the current image
    */
@@ -153,22 +268,47 @@ private:
   void applyConvolution();
 
   /**
-   * Window resize event, updates image size
+   * Applies a morphological operation with a rectangular structuring
+   * element whose size is input by the user, a line if either side is 1
+   */
+  void applyMorphology(const QString& operation_name, const QString& title);
+
+  /**
+   * Blurs the image with a box whose size is input by the user
+   */
+  void applyBoxBlur();
+
+  /**
+   * Removes noise with non-local means, asking the user for the search
+   * and patch radii and the strength, around the deviation of the noise
+   */
+  void applyDenoise();
+
+  /**
+   * Binarizes the image with an adaptive threshold, asking the user for
+   * the window size and the factor of the method, starting at factor
    */
-  void resizeEvent(QResizeEvent* event);
+  void applyAdaptiveThreshold(const QString& operation_name, const QString& title,
+                              const QString& factor_label, double factor);
 
   bool is_first_dialog_;
 
   QImage image_;
-  QPixmap pixmap_left_;
-  QPixmap pixmap_right_;
+  EditHistory history_;
+  OperationGraph graph_;
+  int graph_head_;
+  // Node applied by the open preview panel, replaced by its next value
+  int preview_node_;
 
   QPointer<QLabel> image_title_left_;
   QPointer<QLabel> image_title_right_;
-  QPointer<QLabel> image_label_left_;
-  QPointer<QLabel> image_label_right_;
-  QPointer<QScrollArea> scroll_area_left_;
-  QPointer<QScrollArea> scroll_area_right_;
+  QPointer<TiledImageView> image_view_left_;
+  QPointer<TiledImageView> image_view_right_;
+  QPointer<QListWidget> operations_list_;
+  QPointer<QLabel> statistics_label_;
+  QPointer<QDockWidget> statistics_dock_;
+  QPointer<ThumbnailBrowser> thumbnail_browser_;
+  QPointer<QDockWidget> browser_dock_;
 
   QWidget central_widget_;
   QHBoxLayout horizontal_layout_;
@@ -176,6 +316,10 @@ private:
   QVBoxLayout vertical_layout_right_;
 
   QAction* save_as_action_;
+  QAction* undo_action_;
+  QAction* redo_action_;
+  QAction* select_region_action_;
+  QAction* deselect_action_;
   QAction* mirror_horizontally_action_;
   QAction* mirror_vertically_action_;
   QAction* convert_to_monochrome_action_;
@@ -191,5 +335,11 @@ private:
   QAction* rotate_clockwise_action_;
   QAction* rotate_counter_clockwise_action_;
   QAction* apply_convolution_action_;
+  QMenu* morphology_menu_;
+  QAction* box_blur_action_;
+  QAction* denoise_action_;
+  QMenu* threshold_menu_;
   QAction* fit_to_window_action_;
+  QAction* show_timings_action_;
+  QAction* compare_action_;
 };
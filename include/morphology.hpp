@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QImage>
+
+namespace image_op {
+
+// Morphological operations with a flat rectangular structuring element of
+// element_width x element_height pixels, a line when either side is 1,
+// centered on each pixel (the center being the left or upper one of the
+// two middle pixels of even sides). Each channel, alpha included, is taken
+// on its own, so on the grayscale images given by convertColoredToGrayscale
+// and quantizeGrayscale they act on the gray tones. Pixels outside of the
+// image are ignored
+//
+// Rectangles are separable, so each runs as a horizontal and a vertical
+// van Herk/Gil-Werman pass, three comparisons per channel whatever the size
+
+/**
+ * Replaces each pixel by the darkest one under the structuring element,
+ * shrinking light areas
+ */
+QImage erodeImage(QImage image, int element_width, int element_height);
+
+/**
+ * Replaces each pixel by the lightest one under the structuring element,
+ * growing light areas
+ */
+QImage dilateImage(QImage image, int element_width, int element_height);
+
+/**
+ * Erodes then dilates the image, removing light details smaller than the
+ * structuring element
+ */
+QImage openImage(QImage image, int element_width, int element_height);
+
+/**
+ * Dilates then erodes the image, filling dark details smaller than the
+ * structuring element
+ */
+QImage closeImage(QImage image, int element_width, int element_height);
+
+} // namespace image_op
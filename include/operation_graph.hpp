@@ -0,0 +1,132 @@
+#pragma once
+
+#include <vector>
+
+#include <QCache>
+#include <QImage>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+
+#include "include/tile_pipeline.hpp"
+
+/**
+ * Directed acyclic graph of named image operations evaluated lazily
+ *
+ * Nodes are immutable, changing the parameters of a node creates a new
+ * version of it and of the nodes that depend on it, leaving the previous
+ * versions in the graph. Results are memoized by a hash of the operation,
+ * its parameters and the hashes of its inputs, so nodes upstream of a change
+ * and versions that were already evaluated are not computed again. The
+ * memoized results are kept on a cache bounded by memory, except the last
+ * one, which the next operations usually build on, kept even when it is
+ * larger than the whole cache
+ *
+ * Chains of single input nodes evaluated together, like the ones after a
+ * changed node, run as one pipeline of image_op::applyPipeline, memoizing
+ * only the result of the last node
+ */
+class OperationGraph
+{
+public:
+  explicit OperationGraph(qint64 cache_limit = kDefaultCacheLimit);
+
+  /**
+   * Sets the maximum memory used by memoized results
+   */
+  void setCacheLimit(qint64 bytes);
+
+  /**
+   * Removes every node and memoized result
+   */
+  void clear();
+
+  /**
+   * Adds an image loaded from outside the graph
+   * @return Id of the new node
+   */
+  int addSource(const QImage& image);
+
+  /**
+   * Adds an operation of the registry applied over the given nodes,
+   * the first input is the image being edited
+   * @param selection Part of the first input the operation is restricted to
+   * @return Id of the new node, or -1 if the inputs are invalid
+   */
+  int addOperation(const QString& name, const QVariantList& parameters, const QVector<int>& inputs,
+                   const image_op::Selection& selection = image_op::Selection());
+
+  /**
+   * Gets the result of a node, evaluating only the nodes
+   * on its ancestry that are not memoized
+   */
+  QImage evaluate(int node);
+
+  /**
+   * Memoizes an already known result of a node
+   */
+  void setResult(int node, const QImage& image);
+
+  /**
+   * Drops the nodes none of the heads depends on, along with the images of
+   * the dropped sources. The ids of the nodes kept do not change, the ones
+   * of the dropped nodes are given to the nodes added after
+   */
+  void removeUnreachable(const QVector<int>& heads);
+
+  /**
+   * Changes the parameters of a node on the chain that ends at head,
+   * creating new versions of it and of every node after it on the chain
+   * @return Id of the new version of head
+   */
+  int setParameters(int head, int node, const QVariantList& parameters);
+
+  /**
+   * Follows the first input of each node from head up to its source
+   * @return Node ids from the source to head
+   */
+  QVector<int> chain(int head) const;
+
+  bool isSource(int node) const;
+  QString name(int node) const;
+  QVariantList parameters(int node) const;
+  QVector<int> inputs(int node) const;
+  image_op::Selection selection(int node) const;
+
+  static constexpr qint64 kDefaultCacheLimit = 512 * 1024 * 1024;
+
+private:
+  struct Node
+  {
+    QString name;
+    QVariantList parameters;
+    QVector<int> inputs;
+    image_op::Selection selection;
+    // Only set for source nodes, which are never evicted
+    QImage source;
+    quint64 hash;
+    bool removed;
+  };
+
+  bool isValid(int node) const;
+
+  /**
+   * Stores the node in the slot of a removed one if there is any
+   * @return Id of the node
+   */
+  int insertNode(Node node);
+
+  /**
+   * Memoized result of the node with the hash
+   * @return Null image if it is not memoized
+   */
+  QImage memoizedResult(quint64 hash) const;
+
+  std::vector<Node> nodes_;
+  // Slots of removed nodes, reused by the next ones
+  std::vector<int> free_nodes_;
+  QCache<quint64, QImage> results_;
+  quint64 last_result_hash_;
+  QImage last_result_;
+  int source_count_;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <QImage>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+
+namespace image_op {
+
+/**
+ * Description of a parameter of an operation
+ */
+struct OperationParameter
+{
+  enum Type { Integer, Real, Boolean };
+
+  QString label;
+  Type type;
+  double minimum;
+  double maximum;
+};
+
+/**
+ * Description of an operation that can be applied by name
+ */
+struct OperationInfo
+{
+  QString name;
+  QString title;
+  // Number of input images, the first one is the image being edited
+  int input_count;
+  // Parameters in the order they are expected
+  QVector<OperationParameter> parameters;
+};
+
+/**
+ * Lists every operation that can be applied by name
+ */
+const QVector<OperationInfo>& availableOperations();
+
+/**
+ * Finds the description of an operation
+ * @return nullptr if there is no operation with the name
+ */
+const OperationInfo* findOperation(const QString& name);
+
+/**
+ * Applies the operation with the given name to the inputs
+ * @return Null image if the operation does not exist or the
+ * inputs and parameters do not match what it expects
+ */
+QImage applyOperation(const QString& name, const QVector<QImage>& inputs, const QVariantList& parameters);
+
+/**
+ * Applies the operation with the reference implementations, the ones
+ * in reference_operations.hpp, to check the optimized ones against
+ * Inputs in formats other than RGB32 and ARGB32 are converted first, and
+ * the results are always opaque
+ */
+QImage applyReferenceOperation(const QString& name, const QVector<QImage>& inputs, const QVariantList& parameters);
+
+/**
+ * Largest difference allowed on any color channel between the results of
+ * applyOperation and applyReferenceOperation, 0 if they must be equal
+ */
+int referenceTolerance(const QString& name);
+
+/**
+ * Describes an operation and its parameters for display, e.g. "Brightness (20)"
+ */
+QString describeOperation(const QString& name, const QVariantList& parameters);
+
+} // namespace image_op
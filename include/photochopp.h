@@ -0,0 +1,104 @@
+#ifndef PHOTOCHOPP_H
+#define PHOTOCHOPP_H
+
+/*
+ * C interface of the PhotoChopp image operations, working on pixel buffers
+ * owned by the caller, like NumPy arrays or memory mapped frames, without
+ * encoding them to an image file in between
+ */
+
+#include <stddef.h>
+
+#if defined(PHOTOCHOPP_STATIC)
+#define PHOTOCHOPP_API
+#elif defined(_WIN32)
+#if defined(PHOTOCHOPP_BUILD_LIBRARY)
+#define PHOTOCHOPP_API __declspec(dllexport)
+#else
+#define PHOTOCHOPP_API __declspec(dllimport)
+#endif
+#else
+#define PHOTOCHOPP_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Layout of the pixels of a buffer, in memory order on little endian machines */
+typedef enum photochopp_format
+{
+  /* One byte per pixel */
+  PHOTOCHOPP_FORMAT_GRAY8 = 0,
+  /* Native endian 16-bit value per pixel */
+  PHOTOCHOPP_FORMAT_GRAY16 = 1,
+  /* Bytes blue, green, red and an ignored one, opaque */
+  PHOTOCHOPP_FORMAT_BGRX8 = 2,
+  /* Bytes blue, green, red and alpha, not premultiplied */
+  PHOTOCHOPP_FORMAT_BGRA8 = 3,
+  /* Bytes red, green, blue and alpha, not premultiplied */
+  PHOTOCHOPP_FORMAT_RGBA8 = 4,
+  /* Native endian 16-bit red, green, blue and alpha, not premultiplied */
+  PHOTOCHOPP_FORMAT_RGBA16 = 5
+} photochopp_format;
+
+typedef enum photochopp_status
+{
+  PHOTOCHOPP_OK = 0,
+  /* A null pointer, a size below 1 or a stride too short for the width */
+  PHOTOCHOPP_ERROR_INVALID_ARGUMENT = 1,
+  /* The format is not known or not supported by the Qt version built against */
+  PHOTOCHOPP_ERROR_UNSUPPORTED_FORMAT = 2,
+  /* An operation of the chain does not exist or has invalid parameters */
+  PHOTOCHOPP_ERROR_INVALID_OPERATIONS = 3,
+  /* The result has another size than the output, which is set to it */
+  PHOTOCHOPP_ERROR_OUTPUT_SIZE = 4
+} photochopp_status;
+
+/*
+ * Pixels of an image, rows stride bytes apart. Strides and data aligned to
+ * 4 bytes are used where they are, others are copied to aligned buffers
+ */
+typedef struct photochopp_image
+{
+  void* data;
+  int width;
+  int height;
+  ptrdiff_t stride;
+  photochopp_format format;
+} photochopp_image;
+
+/*
+ * Applies a comma separated chain of operations, each name followed by its
+ * parameters separated by colons, like "equalize,box_blur:5:5", reading
+ * the input and writing the result to the output, converted to its format
+ *
+ * The output must be as large as the result, the size of the input for
+ * most operations. When it is not, PHOTOCHOPP_ERROR_OUTPUT_SIZE is returned
+ * with the width and height of the output set to the size needed. Output
+ * and input may be the same buffer. Safe to call from several threads
+ */
+PHOTOCHOPP_API photochopp_status photochopp_apply(const char* operations, const photochopp_image* input,
+                                                  photochopp_image* output);
+
+/*
+ * Number of operations a chain can use
+ */
+PHOTOCHOPP_API int photochopp_operation_count(void);
+
+/*
+ * Name of an operation for the chains and how many parameters it takes
+ * @return NULL if index is out of range, otherwise a string that stays valid
+ */
+PHOTOCHOPP_API const char* photochopp_operation_name(int index, int* parameter_count);
+
+/*
+ * Description of a status, a string that stays valid
+ */
+PHOTOCHOPP_API const char* photochopp_status_message(photochopp_status status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PHOTOCHOPP_H */
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <QImage>
+#include <QRgb>
+#include <QtGlobal>
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+#include <QRgba64>
+#define PHOTOCHOPP_HAS_RGBA64 1
+#endif
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+#define PHOTOCHOPP_HAS_GRAY16 1
+#endif
+
+namespace image_op {
+
+/**
+ * Compile-time descriptions of the pixel formats the operations run on
+ *
+ * Each format describes how a pixel is stored and how to read and write
+ * its channels, so an operation written once against these traits is
+ * instantiated as a specialized inner loop per format. Channel values are
+ * in the range of the format, 0 to maximum(); byte scale values, like the
+ * parameters of the operations, are converted with fromByteScale
+ */
+namespace pixel_format {
+
+/**
+ * Shared conversions of formats with integer channels
+ */
+template<typename ChannelType, int kMaximum>
+struct IntegerChannels
+{
+  using Channel = ChannelType;
+  // Sums of channels, wide enough for any image
+  using Accumulator = qint64;
+
+  static constexpr Channel maximum() { return kMaximum; }
+
+  /**
+   * Clamps to the range of the channel, truncating the fraction
+   */
+  static Channel clamp(double value)
+  {
+    return static_cast<Channel>(value > kMaximum ? kMaximum : value < 0 ? 0 : value);
+  }
+
+  /**
+   * Converts a value on the 0 to 255 scale to the channel scale
+   */
+  static double fromByteScale(double value) { return value * (kMaximum / 255.0); }
+
+  static int toByte(Channel value) { return (value * 255 + kMaximum / 2) / kMaximum; }
+  static Channel fromByte(int value) { return static_cast<Channel>(value * (kMaximum / 255)); }
+};
+
+/**
+ * 8-bit grayscale, Format_Grayscale8
+ */
+struct Gray8 : IntegerChannels<quint8, 255>
+{
+  using Pixel = quint8;
+  static constexpr bool isGray() { return true; }
+  static constexpr bool hasAlpha() { return false; }
+
+  static Channel red(Pixel pixel) { return pixel; }
+  static Channel green(Pixel pixel) { return pixel; }
+  static Channel blue(Pixel pixel) { return pixel; }
+  static Channel alpha(Pixel) { return maximum(); }
+
+  // Only gray values are written to gray formats, so red is kept
+  static Pixel pixel(Channel red, Channel, Channel, Channel) { return red; }
+};
+
+#ifdef PHOTOCHOPP_HAS_GRAY16
+/**
+ * 16-bit grayscale, Format_Grayscale16
+ */
+struct Gray16 : IntegerChannels<quint16, 65535>
+{
+  using Pixel = quint16;
+  static constexpr bool isGray() { return true; }
+  static constexpr bool hasAlpha() { return false; }
+
+  static Channel red(Pixel pixel) { return pixel; }
+  static Channel green(Pixel pixel) { return pixel; }
+  static Channel blue(Pixel pixel) { return pixel; }
+  static Channel alpha(Pixel) { return maximum(); }
+
+  static Pixel pixel(Channel red, Channel, Channel, Channel) { return red; }
+};
+#endif
+
+/**
+ * 32-bit RGB with opaque alpha, Format_RGB32
+ */
+struct Rgb32 : IntegerChannels<quint8, 255>
+{
+  using Pixel = QRgb;
+  static constexpr bool isGray() { return false; }
+  static constexpr bool hasAlpha() { return false; }
+
+  static Channel red(Pixel pixel) { return static_cast<Channel>(qRed(pixel)); }
+  static Channel green(Pixel pixel) { return static_cast<Channel>(qGreen(pixel)); }
+  static Channel blue(Pixel pixel) { return static_cast<Channel>(qBlue(pixel)); }
+  static Channel alpha(Pixel) { return maximum(); }
+
+  static Pixel pixel(Channel red, Channel green, Channel blue, Channel) { return qRgb(red, green, blue); }
+};
+
+/**
+ * 32-bit ARGB with straight alpha, Format_ARGB32
+ */
+struct Argb32 : IntegerChannels<quint8, 255>
+{
+  using Pixel = QRgb;
+  static constexpr bool isGray() { return false; }
+  static constexpr bool hasAlpha() { return true; }
+
+  static Channel red(Pixel pixel) { return static_cast<Channel>(qRed(pixel)); }
+  static Channel green(Pixel pixel) { return static_cast<Channel>(qGreen(pixel)); }
+  static Channel blue(Pixel pixel) { return static_cast<Channel>(qBlue(pixel)); }
+  static Channel alpha(Pixel pixel) { return static_cast<Channel>(qAlpha(pixel)); }
+
+  static Pixel pixel(Channel red, Channel green, Channel blue, Channel alpha)
+  {
+    return qRgba(red, green, blue, alpha);
+  }
+};
+
+#ifdef PHOTOCHOPP_HAS_RGBA64
+/**
+ * 64-bit RGBA with straight alpha, Format_RGBA64 and Format_RGBX64
+ */
+struct Rgba64 : IntegerChannels<quint16, 65535>
+{
+  using Pixel = QRgba64;
+  static constexpr bool isGray() { return false; }
+  static constexpr bool hasAlpha() { return true; }
+
+  static Channel red(Pixel pixel) { return pixel.red(); }
+  static Channel green(Pixel pixel) { return pixel.green(); }
+  static Channel blue(Pixel pixel) { return pixel.blue(); }
+  static Channel alpha(Pixel pixel) { return pixel.alpha(); }
+
+  static Pixel pixel(Channel red, Channel green, Channel blue, Channel alpha)
+  {
+    return QRgba64::fromRgba64(red, green, blue, alpha);
+  }
+};
+#endif
+
+template<typename Format>
+typename Format::Pixel* row(QImage& image, int row_index)
+{
+  return reinterpret_cast<typename Format::Pixel*>(image.scanLine(row_index));
+}
+
+template<typename Format>
+const typename Format::Pixel* constRow(const QImage& image, int row_index)
+{
+  return reinterpret_cast<const typename Format::Pixel*>(image.constScanLine(row_index));
+}
+
+} // namespace pixel_format
+
+/**
+ * Calls function with the traits of the image format, e.g.
+ * visitPixelFormat(image, [&](auto format) { using Format = decltype(format); ... })
+ *
+ * Images in formats without traits are converted in place first, to ARGB32
+ * if they have alpha and to RGB32 otherwise
+ */
+template<typename Function>
+auto visitPixelFormat(QImage& image, Function function) -> decltype(function(pixel_format::Rgb32()))
+{
+  switch (image.format()) {
+  case QImage::Format_Grayscale8:
+    return function(pixel_format::Gray8());
+#ifdef PHOTOCHOPP_HAS_GRAY16
+  case QImage::Format_Grayscale16:
+    return function(pixel_format::Gray16());
+#endif
+  case QImage::Format_RGB32:
+    return function(pixel_format::Rgb32());
+  case QImage::Format_ARGB32:
+    return function(pixel_format::Argb32());
+#ifdef PHOTOCHOPP_HAS_RGBA64
+  case QImage::Format_RGBA64:
+  case QImage::Format_RGBX64:
+    return function(pixel_format::Rgba64());
+#endif
+  default:
+    break;
+  }
+
+  if (image.hasAlphaChannel()) {
+    image = image.convertToFormat(QImage::Format_ARGB32);
+    return function(pixel_format::Argb32());
+  }
+
+  image = image.convertToFormat(QImage::Format_RGB32);
+  return function(pixel_format::Rgb32());
+}
+
+} // namespace image_op
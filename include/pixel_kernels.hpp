@@ -0,0 +1,54 @@
+#pragma once
+
+#include <QRgb>
+
+#include "include/cpu_features.hpp"
+
+namespace image_op {
+
+namespace kernels {
+
+/**
+ * Row kernels of the per-pixel operations, each one compiled for every
+ * instruction set level and giving the same results as the reference
+ * implementation on all of them
+ *
+ * Like the reference, the kernels treat pixels as QRgb and set the alpha
+ * of the pixels they write to 255, except the byte kernels which work on
+ * every byte alike, whatever the format
+ */
+struct RowKernels
+{
+  void (*mirror)(QRgb* row, int width);
+  void (*adjustBrightness)(QRgb* row, int width, int brightness_value);
+  void (*adjustContrast)(QRgb* row, int width, int contrast_factor);
+  void (*negate)(QRgb* row, int width);
+  // result[i] = min(first[i], second[i]) on count bytes, result may be either input
+  void (*minimumBytes)(const uchar* first, const uchar* second, uchar* result, int count);
+  void (*maximumBytes)(const uchar* first, const uchar* second, uchar* result, int count);
+  // Adds the squared differences of the color channels of count pixels to
+  // squared_sum and raises maximum_difference to the largest difference,
+  // alpha left out
+  void (*compareColors)(const QRgb* first, const QRgb* second, int count,
+                        quint64* squared_sum, int* maximum_difference);
+  // Splits count pixels into planes of red, green, blue and, unless its
+  // plane is null, alpha bytes
+  void (*deinterleave)(const QRgb* row, uchar* red, uchar* green, uchar* blue, uchar* alpha, int count);
+  // Packs planes back into count pixels, with alpha 255 if its plane is null
+  void (*interleave)(const uchar* red, const uchar* green, const uchar* blue, const uchar* alpha, QRgb* row,
+                     int count);
+};
+
+/**
+ * Kernels for cpu::activeIsaLevel(), selected once
+ */
+const RowKernels& rowKernels();
+
+/**
+ * Kernels for a given level, which the processor must support
+ */
+const RowKernels& rowKernels(cpu::IsaLevel level);
+
+} // namespace kernels
+
+} // namespace image_op
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <QImage>
+
+namespace image_op {
+
+/**
+ * Working copy of an 8-bit color image with each channel in a plane of its
+ * own, so per channel kernels run over contiguous bytes at full vector
+ * width instead of shifting and masking the channels out of every pixel
+ *
+ * Only RGB32 and ARGB32, the formats whose pixels are QRgb, are split, by
+ * the vector kernels of the active instruction set. Images without alpha
+ * have no alpha plane and come back opaque. The planes are rows of a single
+ * pooled Grayscale8 buffer, so each row is aligned to 64 bytes
+ */
+class PlanarImage
+{
+public:
+  enum Channel { Red, Green, Blue, Alpha };
+
+  PlanarImage();
+
+  /**
+   * Planes of the size, uninitialized
+   */
+  PlanarImage(int width, int height, bool has_alpha);
+
+  /**
+   * Splits the channels of an image in RGB32 or ARGB32
+   */
+  static PlanarImage fromImage(const QImage& image);
+
+  /**
+   * Interleaves the planes into a new image in RGB32 or ARGB32
+   */
+  QImage toImage(QImage::Format format) const;
+
+  bool isNull() const { return planes_.isNull(); }
+  int width() const { return width_; }
+  int height() const { return height_; }
+  bool hasAlpha() const { return has_alpha_; }
+
+  /**
+   * Channels with a plane, the color ones followed by alpha if there is one
+   */
+  int channelCount() const { return has_alpha_ ? 4 : 3; }
+
+  uchar* row(int channel, int row_index) { return planes_.scanLine(channel * height_ + row_index); }
+
+  const uchar* constRow(int channel, int row_index) const
+  {
+    return planes_.constScanLine(channel * height_ + row_index);
+  }
+
+private:
+  int width_;
+  int height_;
+  bool has_alpha_;
+  QImage planes_;
+};
+
+} // namespace image_op
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <functional>
+
+#include <QAtomicInt>
+#include <QDialog>
+#include <QFutureWatcher>
+#include <QImage>
+#include <QPointer>
+#include <QSlider>
+#include <QSpinBox>
+#include <QTimer>
+
+#include "include/tiled_image_view.hpp"
+
+/**
+ * Panel with a slider that previews a per-pixel operation while the slider
+ * moves, modal so the image does not change under the preview
+ *
+ * Previews are computed in the background on a proxy of the image reduced
+ * to the display size, in strips so that a preview still running when the
+ * slider moves again is cancelled between strips. The value is only
+ * committed, so the full resolution operation runs, when the slider is
+ * released or the value is typed. Only the region of the proxy the
+ * operation is restricted to is previewed, the rest is shown unchanged
+ */
+class PreviewPanel : public QDialog
+{
+  Q_OBJECT
+
+public:
+  using PreviewFunction = std::function<QImage(const QImage& strip, int value)>;
+
+  /**
+   * @param region Part of the proxy previewed, null for all of it
+   */
+  PreviewPanel(const QString& title, const QString& label, int minimum, int maximum, int value,
+               const QImage& proxy, const QRect& region, PreviewFunction preview_function,
+               TiledImageView* view, QWidget* parent = nullptr);
+
+  ~PreviewPanel() override;
+
+  /**
+   * Reduces image to fit the given size, to be used as proxy
+   */
+  static QImage createProxy(const QImage& image, const QSize& display_size);
+
+signals:
+  /**
+   * Emitted when the value should be applied on the full resolution image
+   */
+  void valueCommitted(int value);
+
+private:
+  /**
+   * Starts a preview of the current value, cancelling the one in progress
+   */
+  void schedulePreview();
+
+  /**
+   * Shows a finished preview unless a newer one was requested
+   */
+  void previewFinished();
+
+  /**
+   * Commits the current value if it was not committed yet
+   */
+  void commitValue();
+
+  /**
+   * Applies the operation on the region of the proxy strip by strip,
+   * stopping early if the generation changed
+   * @return Null image if cancelled
+   */
+  static QImage computePreview(QImage proxy, QRect region, int value, int generation,
+                               const QAtomicInt* current_generation,
+                               const PreviewFunction& preview_function);
+
+  QImage proxy_;
+  QRect region_;
+  PreviewFunction preview_function_;
+  QPointer<TiledImageView> view_;
+
+  QPointer<QSlider> slider_;
+  QPointer<QSpinBox> spin_box_;
+  QTimer commit_timer_;
+
+  QFutureWatcher<QImage> preview_watcher_;
+  QAtomicInt generation_;
+  bool preview_pending_;
+  int committed_value_;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+
+#include <QString>
+#include <QtGlobal>
+
+namespace profiler {
+
+/**
+ * Timed region of the code recorded by a ScopedTrace
+ */
+struct TraceEvent
+{
+  // Names and categories are string literals, never copied
+  const char* name;
+  const char* category;
+  qint64 start_ns;
+  qint64 duration_ns;
+  int thread_index;
+};
+
+/**
+ * Nanoseconds since the profiler started, shared by every thread
+ */
+qint64 timestamp();
+
+/**
+ * Enables or disables recording, scopes opened while disabled are not recorded
+ */
+void setEnabled(bool enabled);
+
+bool isEnabled();
+
+/**
+ * Adds an event to the ring buffer, overwriting the oldest one when full
+ */
+void record(const char* name, const char* category, qint64 start_ns, qint64 duration_ns);
+
+/**
+ * Copies the events in the ring buffer, oldest first
+ */
+std::vector<TraceEvent> events();
+
+void clear();
+
+/**
+ * Start of the outermost scope open on the calling thread
+ * @return Current timestamp if no scope is open
+ */
+qint64 outermostScopeStart();
+
+/**
+ * Sums the time of the events started since the timestamp by category,
+ * e.g. "total 120.5 ms: compute 98.1 ms, rescale 12.0 ms"
+ */
+QString breakdown(qint64 since_ns);
+
+/**
+ * Writes the events in the Chrome trace_event format, which can be opened
+ * in chrome://tracing or Perfetto
+ */
+bool writeChromeTrace(const QString& file_name);
+
+/**
+ * Records the time between its construction and destruction
+ */
+class ScopedTrace
+{
+public:
+  ScopedTrace(const char* name, const char* category);
+  ~ScopedTrace();
+
+  ScopedTrace(const ScopedTrace&) = delete;
+  ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+private:
+  const char* name_;
+  const char* category_;
+  qint64 start_ns_;
+  bool enabled_;
+};
+
+} // namespace profiler
+
+#define PROFILE_SCOPE_CONCAT_INNER(a, b) a##b
+#define PROFILE_SCOPE_CONCAT(a, b) PROFILE_SCOPE_CONCAT_INNER(a, b)
+
+/**
+ * Traces the rest of the enclosing scope, categories in use are "decode",
+ * "compute", "convert", "rescale", "encode" and "ui"
+ */
+#define PROFILE_SCOPE(name, category) \
+  profiler::ScopedTrace PROFILE_SCOPE_CONCAT(profile_scope_, __LINE__)(name, category)
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include <QImage>
+#include <QVector>
+
+namespace image_op {
+
+/**
+ * Scalar implementations of the image operations as they were before any
+ * optimization, kept unchanged as the reference the functions of the same
+ * name in image_operations.hpp are checked against. Operations added since
+ * are written the straightforward way, like the morphological ones of
+ * morphology.hpp or the local ones of integral_image.hpp looking up every
+ * pixel under their window
+ */
+namespace reference {
+
+QImage mirrorHorizontally(QImage image);
+QImage mirrorVertically(QImage image);
+QImage convertColoredToGrayscale(QImage image);
+QImage quantizeGrayscale(QImage image, int num_colors);
+std::vector<int> generateGrayscaleHistogramData(QImage image);
+QImage adjustBrightness(QImage image, int brightness_value);
+QImage adjustContrast(QImage image, int contrast_factor);
+QImage getNegativeImage(QImage image);
+QImage equalizeHistogram(QImage image);
+QImage matchGrayscaleHistogram(QImage original_image, QImage target_image);
+QImage zoomOutByFactors(QImage image, int sx, int sy);
+QImage zoomIn2x2(QImage image);
+QImage rotate90DegreesClockwise(QImage image);
+QImage rotate90DegreesCounterClockwise(QImage image);
+QImage applyConvolutionWith3x3Kernel(QImage image, QVector<QVector<double>> kernel, bool add_bias);
+QImage erodeImage(QImage image, int element_width, int element_height);
+QImage dilateImage(QImage image, int element_width, int element_height);
+QImage openImage(QImage image, int element_width, int element_height);
+QImage closeImage(QImage image, int element_width, int element_height);
+QImage boxBlur(QImage image, int box_width, int box_height);
+QImage sauvolaThreshold(QImage image, int window_size, double k);
+QImage bradleyThreshold(QImage image, int window_size, double t);
+QImage otsuThreshold(QImage image, int class_count);
+QImage nonLocalMeansDenoise(QImage image, int search_radius, int patch_radius, double strength);
+
+} // namespace reference
+
+} // namespace image_op
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <QAtomicInt>
+#include <QImage>
+#include <QLabel>
+#include <QListWidget>
+#include <QPointer>
+#include <QThreadPool>
+#include <QWidget>
+
+#include "include/thumbnail_cache.hpp"
+
+/**
+ * Grid of the thumbnails of the images in a folder
+ *
+ * Files are listed at once with a placeholder, and their thumbnails are
+ * filled in as a pool of worker threads, apart from the global one the
+ * operations use, reads them from the ThumbnailCache. Changing the folder
+ * drops the thumbnails still pending
+ */
+class ThumbnailBrowser : public QWidget
+{
+  Q_OBJECT
+
+public:
+  explicit ThumbnailBrowser(QWidget* parent = nullptr);
+
+  ~ThumbnailBrowser() override;
+
+  /**
+   * Lists the images of the folder, loading their thumbnails
+   */
+  void setFolder(const QString& folder);
+
+  QString folder() const { return folder_; }
+
+signals:
+  /**
+   * Emitted when a thumbnail is double clicked or activated from the keyboard
+   */
+  void fileActivated(const QString& file_name);
+
+  /**
+   * Emitted from the worker threads, delivered in the thread of the browser
+   */
+  void thumbnailLoaded(int generation, int row, const QImage& thumbnail);
+
+private:
+  /**
+   * Shows a loaded thumbnail unless its folder was replaced since
+   */
+  void showThumbnail(int generation, int row, const QImage& thumbnail);
+
+  QString folder_;
+  QPointer<QLabel> folder_label_;
+  QPointer<QListWidget> list_;
+
+  QThreadPool pool_;
+  ThumbnailCache cache_;
+  // Incremented with each folder, so pending loads of older ones stop
+  QAtomicInt generation_;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+
+class QFileInfo;
+
+/**
+ * Thumbnails of image files, decoded at reduced resolution and kept on
+ * disk under a hash of the file content, so they are read back instead of
+ * decoded again, even after the file is renamed or copied
+ *
+ * The hash covers the whole file, so any edit changes it. An index from
+ * the path, size and modification time of each file to its hash spares
+ * reading the files again when a folder is reopened. Safe to use from
+ * several threads
+ */
+class ThumbnailCache
+{
+public:
+  /**
+   * @param directory Where the thumbnails and the index are kept
+   * @param size Largest side of the thumbnails
+   */
+  ThumbnailCache(const QString& directory, int size);
+
+  /**
+   * Thumbnail of the file, from the disk cache or decoded and stored
+   * @return Null image if the file cannot be read
+   */
+  QImage thumbnail(const QString& file_name);
+
+private:
+  /**
+   * Hash of the content of the file, from the index when it is unchanged
+   */
+  QByteArray contentHash(const QFileInfo& file_info);
+
+  /**
+   * Reads the index once, leaving out the entries of files changed or
+   * removed since, and rewrites it without them
+   */
+  void loadIndex();
+
+  /**
+   * Replaces the index file by the entries in memory
+   */
+  void writeIndex();
+
+  QString directory_;
+  int size_;
+
+  QMutex mutex_;
+  bool index_loaded_;
+  // Path, size and modification time of each file to the hash of its content
+  QHash<QString, QByteArray> index_;
+};
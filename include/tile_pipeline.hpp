@@ -0,0 +1,90 @@
+#pragma once
+
+#include <QImage>
+#include <QRect>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+
+namespace image_op {
+
+/**
+ * Part of an image an operation is restricted to
+ */
+struct Selection
+{
+  // Bounds of the selection in pixels of the image, null for the whole image
+  QRect rect;
+  // Optional Format_Grayscale8 image of the size of rect weighting how much
+  // of the result each pixel takes, from 0, none, to 255, all of it
+  QImage mask;
+};
+
+/**
+ * Operation of the registry applied as a stage of a pipeline
+ */
+struct PipelineStage
+{
+  QString name;
+  QVariantList parameters;
+  // Stages with a selection run on their own, after the fused ones before
+  Selection selection = {};
+};
+
+/**
+ * Applies a chain of single input operations of the registry, giving the
+ * same result as applying them one after the other
+ *
+ * Consecutive stages that only read the pixels near each output pixel are
+ * fused: the image goes through all of them one tile at a time, with tiles
+ * sized to stay in the L2 cache and spread over the global thread pool. Each
+ * tile is read with a halo as wide as the neighborhoods of the fused stages
+ * added up. Stages that need the whole image, like rotations or histogram
+ * equalization, run on their own between the fused segments
+ *
+ * @param tile_size Side of the tiles in pixels, 0 to fit them to the cache
+ * @return Null image if a stage does not exist, takes more than one input
+ * or its parameters do not match what it expects
+ */
+QImage applyPipeline(const QImage& image, const QVector<PipelineStage>& stages, int tile_size = 0);
+
+/**
+ * Same as applyPipeline, but when the chain ends with fused stages giving
+ * an image of the size and format of destination, like a buffer of the
+ * caller wrapped in a QImage, the tiles are written straight to its pixels
+ * instead of to a new image. It must not share pixels with the input,
+ * nor be shared with another QImage, which would make writing copy them
+ * @return Result, sharing the pixels of destination when written there
+ */
+QImage applyPipelineTo(const QImage& image, const QVector<PipelineStage>& stages, QImage* destination,
+                       int tile_size = 0);
+
+/**
+ * Applies an operation of the registry to the selected part of its first
+ * input, leaving the rest untouched, with work proportional to the size of
+ * the selection: only the selected pixels, and the ones around them that
+ * operations like convolutions read, are copied and processed. Operations
+ * on the statistics of the image, like equalization, take them from the
+ * selection
+ *
+ * The result is written over the pixels of the first input, so a caller
+ * that moves in an image no other QImage shares gets it back edited in
+ * place, without copying the rest of it. A shared input is left as is and
+ * only the pixels around the selection are copied to the new image
+ *
+ * @return Null image if the operation changes the size of the image, like
+ * rotations, or the mask does not match the selection
+ */
+QImage applyOperationInSelection(const QString& name, QVector<QImage> inputs, const QVariantList& parameters,
+                                 const Selection& selection);
+
+/**
+ * Stages of a comma separated chain, each the name of an operation of the
+ * registry followed by its parameters separated by colons, like
+ * equalize,box_blur:5:5. Parameter counts are checked when the chain runs
+ * @return false, with the reason in error, if an operation does not exist
+ * or a parameter is not a number
+ */
+bool parsePipelineStages(const QString& text, QVector<PipelineStage>* stages, QString* error);
+
+} // namespace image_op
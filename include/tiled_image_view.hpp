@@ -0,0 +1,144 @@
+#pragma once
+
+#include <QAbstractScrollArea>
+#include <QCache>
+#include <QImage>
+#include <QPixmap>
+#include <QPointer>
+#include <QRect>
+#include <QRubberBand>
+
+/**
+ * Scrollable image viewer that splits the image in fixed size tiles and only
+ * converts to pixmap the tiles visible at the current zoom level
+ *
+ * Zooming out renders tiles from power of two reduced levels sampled straight
+ * from the source image, so no full size pixmap nor full size reduced copy of
+ * the image is ever created. Rendered tiles are kept on a LRU cache bounded
+ * by memory cost
+ *
+ * While selecting is enabled, dragging over the image draws a rubber band
+ * that is kept as the selection, outlined over the image
+ */
+class TiledImageView : public QAbstractScrollArea
+{
+  Q_OBJECT
+
+public:
+  explicit TiledImageView(QWidget* parent = nullptr);
+
+  /**
+   * Shows a new image, dropping every cached tile of the previous one
+   */
+  void setImage(const QImage& image);
+
+  /**
+   * Shows a new version of the image whose pixels only changed inside the
+   * dirty rectangle, rendering again just the cached tiles over it
+   *
+   * Falls back to setImage when the size or format changed
+   */
+  void updateImage(const QImage& image, const QRect& dirty_rect);
+
+  /**
+   * Removes the image from the view
+   */
+  void clear();
+
+  const QImage& image() const;
+
+  /**
+   * Scales the image to the available space keeping its aspect ratio,
+   * follows view resizes while enabled
+   */
+  void setFitToWindow(bool fit_to_window);
+
+  /**
+   * Sets the zoom factor, disabling fit to window
+   */
+  void setZoom(double zoom);
+
+  double zoom() const;
+
+  /**
+   * Sets the maximum memory used by cached tiles on each view
+   */
+  void setTileCacheLimit(int kilobytes);
+
+  /**
+   * Lets the user drag over the image to select a rectangle of it
+   */
+  void setSelectionEnabled(bool enabled);
+
+  /**
+   * Rectangle selected on the image, in its pixels, null if none
+   */
+  QRect selection() const;
+
+  /**
+   * Sets the selection, clipped to the image, a null rectangle clears it
+   */
+  void setSelection(const QRect& selection);
+
+  static constexpr int kTileSize = 256;
+
+signals:
+  void selectionChanged(const QRect& selection);
+
+protected:
+  void paintEvent(QPaintEvent* event) override;
+  void resizeEvent(QResizeEvent* event) override;
+  void wheelEvent(QWheelEvent* event) override;
+  void scrollContentsBy(int dx, int dy) override;
+  void mousePressEvent(QMouseEvent* event) override;
+  void mouseMoveEvent(QMouseEvent* event) override;
+  void mouseReleaseEvent(QMouseEvent* event) override;
+
+private:
+  /**
+   * Reduction level used to render tiles for the current zoom, level n
+   * has 1/2^n of the original size on each axis
+   */
+  int levelForZoom() const;
+
+  /**
+   * Gets tile from cache or renders it if missing
+   */
+  const QPixmap* tile(int level, int tile_column, int tile_row);
+
+  /**
+   * Renders tile of the given level from the source image
+   */
+  QImage renderTile(int level, int tile_column, int tile_row) const;
+
+  /**
+   * Rectangle of the viewport showing a rectangle of the image
+   */
+  QRect mapFromImage(const QRect& rect) const;
+
+  /**
+   * Updates zoom when fitting to window, then scroll bar ranges
+   */
+  void updateScrollBars();
+
+  /**
+   * Position of the top left corner of the image on the viewport
+   */
+  QPointF imageOrigin() const;
+
+  /**
+   * Pixel of the image under a point of the viewport, not clamped to it
+   */
+  QPoint mapToImage(const QPoint& point) const;
+
+  QImage image_;
+  QCache<quint64, QPixmap> tile_cache_;
+  double zoom_;
+  bool fit_to_window_;
+
+  bool selection_enabled_;
+  QRect selection_;
+  // Where the drag started on the viewport, shown by the rubber band
+  QPoint drag_start_;
+  QPointer<QRubberBand> rubber_band_;
+};
@@ -0,0 +1,29 @@
+#-------------------------------------------------
+#
+# Image processing core as a library with a C interface,
+# include/photochopp.h, over buffers of the caller
+#
+# Shared by default, qmake "CONFIG+=staticlib" builds
+# it static, in which case its users define
+# PHOTOCHOPP_STATIC before including the header
+#
+#-------------------------------------------------
+
+QT       += core gui concurrent
+
+TARGET = photochopp
+TEMPLATE = lib
+
+# Only the functions of the C interface are exported
+CONFIG += hide_symbols
+
+DEFINES += QT_DEPRECATED_WARNINGS PHOTOCHOPP_BUILD_LIBRARY
+staticlib: DEFINES += PHOTOCHOPP_STATIC
+
+include(../src/core.pri)
+
+SOURCES += \
+    ../src/c_api.cpp
+
+HEADERS += \
+    ../include/photochopp.h
@@ -0,0 +1,223 @@
+#include "include/photochopp.h"
+
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include <QByteArray>
+#include <QImage>
+
+#include "include/image_buffer_pool.hpp"
+#include "include/operation_registry.hpp"
+#include "include/pixel_formats.hpp"
+#include "include/tile_pipeline.hpp"
+
+namespace {
+
+/**
+ * Format of QImage with the layout of the buffer
+ * @return Format_Invalid if Qt has none
+ */
+QImage::Format imageFormat(photochopp_format format)
+{
+  switch (format) {
+  case PHOTOCHOPP_FORMAT_GRAY8:
+    return QImage::Format_Grayscale8;
+#ifdef PHOTOCHOPP_HAS_GRAY16
+  case PHOTOCHOPP_FORMAT_GRAY16:
+    return QImage::Format_Grayscale16;
+#endif
+  case PHOTOCHOPP_FORMAT_BGRX8:
+    return QImage::Format_RGB32;
+  case PHOTOCHOPP_FORMAT_BGRA8:
+    return QImage::Format_ARGB32;
+  case PHOTOCHOPP_FORMAT_RGBA8:
+    return QImage::Format_RGBA8888;
+#ifdef PHOTOCHOPP_HAS_RGBA64
+  case PHOTOCHOPP_FORMAT_RGBA16:
+    return QImage::Format_RGBA64;
+#endif
+  default:
+    return QImage::Format_Invalid;
+  }
+}
+
+/**
+ * Bytes of the pixels of a row, without the padding up to the stride
+ */
+qint64 rowBytes(const photochopp_image& image, QImage::Format format)
+{
+  return (static_cast<qint64>(image.width) * QImage::toPixelFormat(format).bitsPerPixel() + 7) / 8;
+}
+
+/**
+ * Checks the buffer can hold the image it describes
+ */
+photochopp_status checkImage(const photochopp_image* image, QImage::Format* format)
+{
+  if (!image || !image->data || image->width < 1 || image->height < 1)
+    return PHOTOCHOPP_ERROR_INVALID_ARGUMENT;
+
+  *format = imageFormat(image->format);
+  if (*format == QImage::Format_Invalid)
+    return PHOTOCHOPP_ERROR_UNSUPPORTED_FORMAT;
+
+  // QImage keeps the stride in an int
+  if (image->stride < rowBytes(*image, *format) || image->stride > std::numeric_limits<int>::max())
+    return PHOTOCHOPP_ERROR_INVALID_ARGUMENT;
+
+  return PHOTOCHOPP_OK;
+}
+
+/**
+ * Whether QImage can use the pixels in place, which needs each row aligned
+ * to 4 bytes
+ */
+bool isAligned(const photochopp_image& image)
+{
+  return reinterpret_cast<quintptr>(image.data) % 4 == 0 && image.stride % 4 == 0;
+}
+
+/**
+ * Read only QImage over the pixels of the buffer, copied to an aligned one
+ * only when they cannot be used in place
+ */
+QImage wrapInput(const photochopp_image& input, QImage::Format format)
+{
+  const auto* pixels = static_cast<const uchar*>(input.data);
+
+  if (isAligned(input))
+    return QImage(pixels, input.width, input.height, static_cast<int>(input.stride), format);
+
+  QImage copy = image_op::pooledImage(input.width, input.height, format);
+  auto row_bytes = static_cast<size_t>(rowBytes(input, format));
+  for (int row_index = 0; row_index < input.height; row_index++)
+    std::memcpy(copy.scanLine(row_index), pixels + row_index * input.stride, row_bytes);
+
+  return copy;
+}
+
+/**
+ * Whether the pixels of the two buffers share memory
+ */
+bool overlaps(const photochopp_image& first, const photochopp_image& second)
+{
+  const auto* first_begin = static_cast<const uchar*>(first.data);
+  const auto* second_begin = static_cast<const uchar*>(second.data);
+  const uchar* first_end = first_begin + first.stride * first.height;
+  const uchar* second_end = second_begin + second.stride * second.height;
+  return first_begin < second_end && second_begin < first_end;
+}
+
+struct OperationName
+{
+  QByteArray name;
+  int parameter_count;
+};
+
+/**
+ * Operations a chain can use, with their names kept as UTF-8 for the
+ * lifetime of the program
+ */
+const std::vector<OperationName>& chainOperations()
+{
+  static const std::vector<OperationName> operations = []() {
+    std::vector<OperationName> operations;
+    for (const auto& operation : image_op::availableOperations()) {
+      if (operation.input_count == 1)
+        operations.push_back({ operation.name.toUtf8(), operation.parameters.size() });
+    }
+    return operations;
+  }();
+
+  return operations;
+}
+
+} // namespace
+
+photochopp_status photochopp_apply(const char* operations, const photochopp_image* input,
+                                   photochopp_image* output)
+{
+  QImage::Format input_format, output_format;
+  photochopp_status status = checkImage(input, &input_format);
+  if (status == PHOTOCHOPP_OK)
+    status = checkImage(output, &output_format);
+  if (status != PHOTOCHOPP_OK)
+    return status;
+
+  if (!operations)
+    return PHOTOCHOPP_ERROR_INVALID_ARGUMENT;
+
+  QVector<image_op::PipelineStage> stages;
+  QString error;
+  if (!image_op::parsePipelineStages(QString::fromUtf8(operations), &stages, &error))
+    return PHOTOCHOPP_ERROR_INVALID_OPERATIONS;
+
+  QImage source = wrapInput(*input, input_format);
+
+  // The last stages write their tiles straight to the output, unless they
+  // would overwrite pixels still to be read
+  QImage destination;
+  if (isAligned(*output) && !overlaps(*input, *output))
+    destination = QImage(static_cast<uchar*>(output->data), output->width, output->height,
+                         static_cast<int>(output->stride), output_format);
+
+  QImage result = image_op::applyPipelineTo(source, stages, destination.isNull() ? nullptr : &destination);
+  if (result.isNull())
+    return PHOTOCHOPP_ERROR_INVALID_OPERATIONS;
+
+  if (result.width() != output->width || result.height() != output->height) {
+    output->width = result.width();
+    output->height = result.height();
+    return PHOTOCHOPP_ERROR_OUTPUT_SIZE;
+  }
+
+  // Written in place, or an empty chain on the same buffer
+  if (result.constBits() == output->data && result.bytesPerLine() == output->stride
+      && result.format() == output_format)
+    return PHOTOCHOPP_OK;
+
+  if (result.format() != output_format)
+    result = result.convertToFormat(output_format);
+
+  auto row_bytes = static_cast<size_t>(rowBytes(*output, output_format));
+  for (int row_index = 0; row_index < output->height; row_index++)
+    std::memcpy(static_cast<uchar*>(output->data) + row_index * output->stride, result.constScanLine(row_index),
+                row_bytes);
+
+  return PHOTOCHOPP_OK;
+}
+
+int photochopp_operation_count(void)
+{
+  return static_cast<int>(chainOperations().size());
+}
+
+const char* photochopp_operation_name(int index, int* parameter_count)
+{
+  const auto& operations = chainOperations();
+  if (index < 0 || index >= static_cast<int>(operations.size()))
+    return nullptr;
+
+  if (parameter_count)
+    *parameter_count = operations[static_cast<size_t>(index)].parameter_count;
+  return operations[static_cast<size_t>(index)].name.constData();
+}
+
+const char* photochopp_status_message(photochopp_status status)
+{
+  switch (status) {
+  case PHOTOCHOPP_OK:
+    return "No error";
+  case PHOTOCHOPP_ERROR_INVALID_ARGUMENT:
+    return "Invalid argument";
+  case PHOTOCHOPP_ERROR_UNSUPPORTED_FORMAT:
+    return "Unsupported pixel format";
+  case PHOTOCHOPP_ERROR_INVALID_OPERATIONS:
+    return "Invalid operations";
+  case PHOTOCHOPP_ERROR_OUTPUT_SIZE:
+    return "The output has another size than the result";
+  default:
+    return "Unknown status";
+  }
+}
@@ -0,0 +1,46 @@
+# Image processing core shared by the application and the tools built
+# on top of it, independent of any widget
+
+INCLUDEPATH += $$PWD/..
+
+# Generic lambdas dispatch the pixel format traits
+CONFIG += c++14
+
+SOURCES += \
+    $$PWD/cpu_features.cpp \
+    $$PWD/denoise.cpp \
+    $$PWD/edit_history.cpp \
+    $$PWD/frame_sequence.cpp \
+    $$PWD/histogram_cache.cpp \
+    $$PWD/image_buffer_pool.cpp \
+    $$PWD/image_comparison.cpp \
+    $$PWD/image_operations.cpp \
+    $$PWD/image_statistics.cpp \
+    $$PWD/integral_image.cpp \
+    $$PWD/morphology.cpp \
+    $$PWD/operation_registry.cpp \
+    $$PWD/pixel_kernels.cpp \
+    $$PWD/planar_image.cpp \
+    $$PWD/profiler.cpp \
+    $$PWD/reference_operations.cpp \
+    $$PWD/tile_pipeline.cpp
+
+HEADERS += \
+    $$PWD/../include/cpu_features.hpp \
+    $$PWD/../include/denoise.hpp \
+    $$PWD/../include/edit_history.hpp \
+    $$PWD/../include/frame_sequence.hpp \
+    $$PWD/../include/histogram_cache.hpp \
+    $$PWD/../include/image_buffer_pool.hpp \
+    $$PWD/../include/image_comparison.hpp \
+    $$PWD/../include/image_operations.hpp \
+    $$PWD/../include/image_statistics.hpp \
+    $$PWD/../include/integral_image.hpp \
+    $$PWD/../include/morphology.hpp \
+    $$PWD/../include/operation_registry.hpp \
+    $$PWD/../include/pixel_formats.hpp \
+    $$PWD/../include/pixel_kernels.hpp \
+    $$PWD/../include/planar_image.hpp \
+    $$PWD/../include/profiler.hpp \
+    $$PWD/../include/reference_operations.hpp \
+    $$PWD/../include/tile_pipeline.hpp
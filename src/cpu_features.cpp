@@ -0,0 +1,129 @@
+#include "include/cpu_features.hpp"
+
+#include <QByteArray>
+#include <QtGlobal>
+
+#if defined(PHOTOCHOPP_X86) && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace cpu {
+
+namespace {
+
+#if defined(PHOTOCHOPP_X86) && defined(_MSC_VER)
+
+IsaLevel detectWithCpuid()
+{
+  int registers[4];
+  __cpuid(registers, 0);
+  int max_leaf = registers[0];
+
+  __cpuid(registers, 1);
+  bool sse2 = registers[3] & (1 << 26);
+  bool osxsave = registers[2] & (1 << 27);
+  bool avx = registers[2] & (1 << 28);
+
+  if (!sse2)
+    return IsaLevel::Scalar;
+
+  // The operating system must save the wider registers on context switches
+  unsigned long long enabled_state = osxsave ? _xgetbv(0) : 0;
+  bool ymm_enabled = (enabled_state & 0x6) == 0x6;
+  bool zmm_enabled = (enabled_state & 0xe6) == 0xe6;
+
+  if (max_leaf < 7 || !avx || !ymm_enabled)
+    return IsaLevel::Sse2;
+
+  __cpuidex(registers, 7, 0);
+  bool avx2 = registers[1] & (1 << 5);
+  bool avx512f = registers[1] & (1 << 16);
+  bool avx512bw = registers[1] & (1 << 30);
+
+  if (avx2 && avx512f && avx512bw && zmm_enabled)
+    return IsaLevel::Avx512;
+
+  return avx2 ? IsaLevel::Avx2 : IsaLevel::Sse2;
+}
+
+#endif
+
+IsaLevel levelFromName(const QByteArray& name, IsaLevel fallback)
+{
+  QByteArray lower_name = name.trimmed().toLower();
+
+  if (lower_name == "scalar")
+    return IsaLevel::Scalar;
+  if (lower_name == "sse2")
+    return IsaLevel::Sse2;
+  if (lower_name == "avx2")
+    return IsaLevel::Avx2;
+  if (lower_name == "avx512")
+    return IsaLevel::Avx512;
+
+  return fallback;
+}
+
+} // namespace
+
+IsaLevel detectIsaLevel()
+{
+#if defined(PHOTOCHOPP_X86) && defined(_MSC_VER)
+  return detectWithCpuid();
+#elif defined(PHOTOCHOPP_X86) && (defined(__GNUC__) || defined(__clang__))
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+    return IsaLevel::Avx512;
+  if (__builtin_cpu_supports("avx2"))
+    return IsaLevel::Avx2;
+  if (__builtin_cpu_supports("sse2"))
+    return IsaLevel::Sse2;
+
+  return IsaLevel::Scalar;
+#else
+  return IsaLevel::Scalar;
+#endif
+}
+
+IsaLevel activeIsaLevel()
+{
+  static const IsaLevel level = [] {
+    IsaLevel detected_level = detectIsaLevel();
+    QByteArray forced_name = qgetenv("PHOTOCHOPP_CPU_LEVEL");
+
+    if (forced_name.isEmpty())
+      return detected_level;
+
+    IsaLevel forced_level = levelFromName(forced_name, detected_level);
+
+    if (forced_level > detected_level) {
+      qWarning("PHOTOCHOPP_CPU_LEVEL=%s is not supported by this processor, using %s",
+               forced_name.constData(), isaLevelName(detected_level));
+      return detected_level;
+    }
+
+    return forced_level;
+  }();
+
+  return level;
+}
+
+const char* isaLevelName(IsaLevel level)
+{
+  switch (level) {
+  case IsaLevel::Scalar:
+    return "scalar";
+  case IsaLevel::Sse2:
+    return "sse2";
+  case IsaLevel::Avx2:
+    return "avx2";
+  case IsaLevel::Avx512:
+    return "avx512";
+  }
+
+  return "unknown";
+}
+
+} // namespace cpu
@@ -0,0 +1,228 @@
+#include "include/denoise.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <QThread>
+#include <QtConcurrent>
+
+#include "include/image_buffer_pool.hpp"
+#include "include/pixel_formats.hpp"
+#include "include/profiler.hpp"
+
+namespace image_op {
+
+namespace {
+
+// Fewer rows than this are not worth a task of their own, nor the rows of
+// the patches above and below them
+constexpr int kMinimumBandHeight = 32;
+
+// Offsets whose weight is below exp(-kWeightCutoff) are skipped, they
+// could not move the average by a representable amount
+constexpr double kWeightCutoff = 36;
+
+/**
+ * Bands of rows spread over the global thread pool
+ */
+std::vector<int> bandStarts(int height, int* band_height)
+{
+  int band_count = std::max(1, std::min(QThread::idealThreadCount() * 4, height / kMinimumBandHeight));
+  *band_height = (height + band_count - 1) / band_count;
+
+  std::vector<int> starts;
+  for (int row_index = 0; row_index < height; row_index += *band_height)
+    starts.push_back(row_index);
+  return starts;
+}
+
+/**
+ * Color channels of an image extended by padding pixels on every side
+ * repeating its edges, one plane after the other, so patches and search
+ * windows read past the borders without bounds checks
+ */
+template<typename Format>
+class PaddedPlanes
+{
+public:
+  using Channel = typename Format::Channel;
+
+  PaddedPlanes(const QImage& image, int padding):
+    padding_(padding),
+    stride_(image.width() + 2 * padding),
+    rows_(image.height() + 2 * padding),
+    channel_count_(Format::isGray() ? 1 : 3),
+    values_(static_cast<size_t>(stride_) * rows_ * channel_count_)
+  {
+    int width = image.width();
+    int height = image.height();
+
+    for (int row_index = -padding; row_index < height + padding; row_index++) {
+      auto* line = pixel_format::constRow<Format>(image, std::min(height - 1, std::max(0, row_index)));
+
+      for (int channel = 0; channel < channel_count_; channel++) {
+        Channel* target = row(channel, row_index);
+
+        for (int column_index = -padding; column_index < width + padding; column_index++) {
+          auto pixel = line[std::min(width - 1, std::max(0, column_index))];
+          target[column_index] = channel == 0 ? Format::red(pixel)
+                                 : channel == 1 ? Format::green(pixel)
+                                 : Format::blue(pixel);
+        }
+      }
+    }
+  }
+
+  int channelCount() const { return channel_count_; }
+
+  /**
+   * Row of a channel, indexed by the column of the image, from -padding
+   * to width + padding - 1
+   */
+  const Channel* row(int channel, int row_index) const
+  {
+    return values_.data() + (static_cast<size_t>(channel) * rows_ + (row_index + padding_)) * stride_ + padding_;
+  }
+
+private:
+  Channel* row(int channel, int row_index)
+  {
+    return values_.data() + (static_cast<size_t>(channel) * rows_ + (row_index + padding_)) * stride_ + padding_;
+  }
+
+  int padding_;
+  int stride_;
+  int rows_;
+  int channel_count_;
+  std::vector<Channel> values_;
+};
+
+template<typename Format>
+QImage denoiseChannels(const QImage& image, int search_radius, int patch_radius, double strength)
+{
+  using Channel = typename Format::Channel;
+  using Accumulator = typename Format::Accumulator;
+
+  int width = image.width();
+  int height = image.height();
+
+  const PaddedPlanes<Format> planes(image, search_radius + patch_radius);
+  int channel_count = planes.channelCount();
+
+  // Distances are means over the values of the patches, so the strength
+  // does not depend on their size
+  int patch_size = 2 * patch_radius + 1;
+  double format_strength = Format::fromByteScale(strength);
+  double distance_scale = 1.0 / (static_cast<double>(patch_size) * patch_size * channel_count
+                                 * format_strength * format_strength);
+
+  QImage target_image = pooledImage(width, height, image.format());
+  // Taken once, scanLine would detach from every thread
+  uchar* target_bits = target_image.bits();
+  int target_bytes_per_line = target_image.bytesPerLine();
+
+  int band_height;
+  std::vector<int> bands = bandStarts(height, &band_height);
+
+  QtConcurrent::blockingMap(bands, [&](int first_row) {
+    int rows = std::min(height, first_row + band_height) - first_row;
+    auto pixel_count = static_cast<size_t>(rows) * width;
+
+    // Summed-area table of the squared differences over the band and the
+    // reach of its patches, with a first row and column of zeros
+    int table_width = width + 2 * patch_radius + 1;
+    int table_height = rows + 2 * patch_radius + 1;
+    std::vector<Accumulator> table(static_cast<size_t>(table_width) * table_height, 0);
+
+    std::vector<double> weight_sums(pixel_count, 0.0);
+    std::vector<double> value_sums(pixel_count * channel_count, 0.0);
+
+    const Channel* lines[3];
+    const Channel* shifted_lines[3];
+
+    for (int dy = -search_radius; dy <= search_radius; dy++) {
+      for (int dx = -search_radius; dx <= search_radius; dx++) {
+        for (int table_row = 1; table_row < table_height; table_row++) {
+          int row_index = first_row - patch_radius + table_row - 1;
+          for (int channel = 0; channel < channel_count; channel++) {
+            lines[channel] = planes.row(channel, row_index) - patch_radius;
+            shifted_lines[channel] = planes.row(channel, row_index + dy) + dx - patch_radius;
+          }
+
+          Accumulator* table_line = table.data() + static_cast<size_t>(table_row) * table_width + 1;
+          const Accumulator* previous_line = table_line - table_width;
+          Accumulator running_sum = 0;
+
+          for (int table_column = 0; table_column < table_width - 1; table_column++) {
+            for (int channel = 0; channel < channel_count; channel++) {
+              Accumulator difference = static_cast<Accumulator>(lines[channel][table_column])
+                  - shifted_lines[channel][table_column];
+              running_sum += difference * difference;
+            }
+            table_line[table_column] = previous_line[table_column] + running_sum;
+          }
+        }
+
+        for (int band_row = 0; band_row < rows; band_row++) {
+          const Accumulator* top_line = table.data() + static_cast<size_t>(band_row) * table_width;
+          const Accumulator* bottom_line = top_line + static_cast<size_t>(patch_size) * table_width;
+          for (int channel = 0; channel < channel_count; channel++)
+            shifted_lines[channel] = planes.row(channel, first_row + band_row + dy) + dx;
+
+          double* weights = weight_sums.data() + static_cast<size_t>(band_row) * width;
+          double* values = value_sums.data() + static_cast<size_t>(band_row) * width;
+
+          for (int column_index = 0; column_index < width; column_index++) {
+            Accumulator distance = bottom_line[column_index + patch_size] - bottom_line[column_index]
+                - top_line[column_index + patch_size] + top_line[column_index];
+            double exponent = static_cast<double>(distance) * distance_scale;
+            if (exponent > kWeightCutoff)
+              continue;
+
+            double weight = std::exp(-exponent);
+            weights[column_index] += weight;
+            for (int channel = 0; channel < channel_count; channel++)
+              values[channel * pixel_count + column_index] += weight * shifted_lines[channel][column_index];
+          }
+        }
+      }
+    }
+
+    for (int band_row = 0; band_row < rows; band_row++) {
+      int row_index = first_row + band_row;
+      auto* original_line = pixel_format::constRow<Format>(image, row_index);
+      auto* target_line = reinterpret_cast<typename Format::Pixel*>(target_bits + static_cast<qint64>(row_index) * target_bytes_per_line);
+      const double* weights = weight_sums.data() + static_cast<size_t>(band_row) * width;
+      const double* values = value_sums.data() + static_cast<size_t>(band_row) * width;
+
+      for (int column_index = 0; column_index < width; column_index++) {
+        // The offset of the pixel itself has weight 1, the sum is never 0
+        Channel channels[3];
+        for (int channel = 0; channel < channel_count; channel++)
+          channels[channel] = Format::clamp(values[channel * pixel_count + column_index] / weights[column_index]);
+
+        if (channel_count == 1)
+          target_line[column_index] = Format::pixel(channels[0], channels[0], channels[0], Format::maximum());
+        else
+          target_line[column_index] = Format::pixel(channels[0], channels[1], channels[2],
+                                                    Format::alpha(original_line[column_index]));
+      }
+    }
+  });
+
+  return target_image;
+}
+
+} // namespace
+
+QImage nonLocalMeansDenoise(QImage image, int search_radius, int patch_radius, double strength)
+{
+  PROFILE_SCOPE("image_op::nonLocalMeansDenoise", "compute");
+
+  return visitPixelFormat(image, [&](auto format) {
+    return denoiseChannels<decltype(format)>(image, search_radius, patch_radius, strength);
+  });
+}
+
+} // namespace image_op
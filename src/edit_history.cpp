@@ -0,0 +1,361 @@
+#include "include/edit_history.hpp"
+
+#include <cstring>
+
+#include <QDataStream>
+#include <QFile>
+
+namespace {
+
+// Fastest zlib level, deltas are compressed on every edit
+constexpr int kCompressionLevel = 1;
+
+// Bookkeeping cost of an entry besides the compressed tiles
+constexpr qint64 kEntryOverhead = 256;
+
+int rowBytes(const QImage& image, const QRect& rect)
+{
+  return (rect.width() * image.depth() + 7) / 8;
+}
+
+int rowOffset(const QImage& image, const QRect& rect)
+{
+  return rect.x() * image.depth() / 8;
+}
+
+/**
+ * Splits the image in tiles, images with less than 8 bits per
+ * pixel are handled as a single tile
+ */
+std::vector<QRect> tileRects(const QImage& image, int tile_size)
+{
+  std::vector<QRect> rects;
+
+  if (image.depth() < 8) {
+    rects.push_back(image.rect());
+    return rects;
+  }
+
+  for (int y = 0; y < image.height(); y += tile_size)
+    for (int x = 0; x < image.width(); x += tile_size)
+      rects.push_back(QRect(x, y, tile_size, tile_size).intersected(image.rect()));
+
+  return rects;
+}
+
+bool tileChanged(const QImage& before, const QImage& after, const QRect& rect)
+{
+  int row_bytes = rowBytes(before, rect);
+  int offset = rowOffset(before, rect);
+
+  for (int row_index = rect.top(); row_index <= rect.bottom(); row_index++) {
+    if (std::memcmp(before.constScanLine(row_index) + offset,
+                    after.constScanLine(row_index) + offset,
+                    static_cast<size_t>(row_bytes)) != 0)
+      return true;
+  }
+
+  return false;
+}
+
+QByteArray extractTile(const QImage& image, const QRect& rect)
+{
+  int row_bytes = rowBytes(image, rect);
+  int offset = rowOffset(image, rect);
+
+  QByteArray data;
+  data.reserve(row_bytes * rect.height());
+
+  for (int row_index = rect.top(); row_index <= rect.bottom(); row_index++)
+    data.append(reinterpret_cast<const char*>(image.constScanLine(row_index) + offset), row_bytes);
+
+  return qCompress(data, kCompressionLevel);
+}
+
+void writeTile(QImage& image, const QRect& rect, const QByteArray& compressed_data)
+{
+  int row_bytes = rowBytes(image, rect);
+  int offset = rowOffset(image, rect);
+  QByteArray data = qUncompress(compressed_data);
+
+  for (int i = 0; i < rect.height(); i++)
+    std::memcpy(image.scanLine(rect.top() + i) + offset,
+                data.constData() + i * row_bytes,
+                static_cast<size_t>(row_bytes));
+}
+
+} // namespace
+
+EditHistory::EditHistory(qint64 memory_limit):
+  position_(0),
+  memory_used_(0),
+  memory_limit_(memory_limit),
+  spill_count_(0)
+{
+}
+
+void EditHistory::setMemoryLimit(qint64 bytes)
+{
+  memory_limit_ = bytes;
+  enforceMemoryLimit();
+}
+
+qint64 EditHistory::memoryLimit() const
+{
+  return memory_limit_;
+}
+
+void EditHistory::clear()
+{
+  entries_.clear();
+  position_ = 0;
+  memory_used_ = 0;
+
+  // Removes spilled entries along with the directory
+  spill_dir_.reset();
+}
+
+QRect EditHistory::record(const QImage& before, const QImage& after, const QString& description,
+                          const QVariant& state_before, const QRect& region)
+{
+  Entry entry;
+  entry.description = description;
+  entry.state = state_before;
+  entry.whole_image = before.size() != after.size() || before.format() != after.format()
+                      || before.colorTable() != after.colorTable();
+  entry.size = before.size();
+  entry.format = before.format();
+  entry.cost = kEntryOverhead;
+
+  QRect changed_region;
+
+  if (entry.whole_image) {
+    entry.color_table = before.colorTable();
+    entry.tiles.push_back({ before.rect(), extractTile(before, before.rect()) });
+    changed_region = after.rect();
+  } else {
+    for (const auto& rect : tileRects(before, kTileSize)) {
+      if (!region.isNull() && !rect.intersects(region))
+        continue;
+
+      if (tileChanged(before, after, rect)) {
+        entry.tiles.push_back({ rect, extractTile(before, rect) });
+        changed_region = changed_region.united(rect);
+      }
+    }
+
+    // Nothing changed, nothing to undo
+    if (entry.tiles.empty())
+      return QRect();
+  }
+
+  for (const auto& tile : entry.tiles)
+    entry.cost += tile.data.size();
+
+  // Recording after undoing drops the redo entries
+  for (size_t i = position_; i < entries_.size(); i++) {
+    if (entries_[i].spill_file_name.isEmpty())
+      memory_used_ -= entries_[i].cost;
+    else
+      QFile::remove(entries_[i].spill_file_name);
+  }
+
+  entries_.resize(position_);
+  entries_.push_back(std::move(entry));
+  position_++;
+  memory_used_ += entries_.back().cost;
+
+  enforceMemoryLimit();
+  return changed_region;
+}
+
+bool EditHistory::canUndo() const
+{
+  return position_ > 0;
+}
+
+bool EditHistory::canRedo() const
+{
+  return position_ < entries_.size();
+}
+
+QString EditHistory::undoDescription() const
+{
+  return canUndo() ? entries_[position_ - 1].description : QString();
+}
+
+QString EditHistory::redoDescription() const
+{
+  return canRedo() ? entries_[position_].description : QString();
+}
+
+QVector<QVariant> EditHistory::states() const
+{
+  QVector<QVariant> entry_states;
+  entry_states.reserve(static_cast<int>(entries_.size()));
+
+  for (const auto& entry : entries_)
+    entry_states.append(entry.state);
+
+  return entry_states;
+}
+
+bool EditHistory::undo(QImage& image, QRect* restored_region, QVariant* state)
+{
+  if (!canUndo())
+    return false;
+
+  auto& entry = entries_[position_ - 1];
+
+  if (!entry.spill_file_name.isEmpty() && !restore(entry))
+    return false;
+
+  *restored_region = swapTiles(entry, image, state);
+  position_--;
+  enforceMemoryLimit();
+
+  return true;
+}
+
+bool EditHistory::redo(QImage& image, QRect* restored_region, QVariant* state)
+{
+  if (!canRedo())
+    return false;
+
+  auto& entry = entries_[position_];
+
+  if (!entry.spill_file_name.isEmpty() && !restore(entry))
+    return false;
+
+  *restored_region = swapTiles(entry, image, state);
+  position_++;
+  enforceMemoryLimit();
+
+  return true;
+}
+
+QRect EditHistory::swapTiles(Entry& entry, QImage& image, QVariant* state)
+{
+  if (state)
+    std::swap(entry.state, *state);
+
+  memory_used_ -= entry.cost;
+  entry.cost = kEntryOverhead;
+
+  QRect restored_region;
+
+  if (entry.whole_image) {
+    // Edit changed the image geometry or colors, swap the whole image
+    QImage restored_image(entry.size, entry.format);
+    restored_image.setColorTable(entry.color_table);
+    writeTile(restored_image, restored_image.rect(), entry.tiles.front().data);
+
+    entry.tiles.front() = { image.rect(), extractTile(image, image.rect()) };
+    entry.size = image.size();
+    entry.format = image.format();
+    entry.color_table = image.colorTable();
+
+    image = restored_image;
+    restored_region = image.rect();
+  } else {
+    for (auto& tile : entry.tiles) {
+      QByteArray current_data = extractTile(image, tile.rect);
+      writeTile(image, tile.rect, tile.data);
+      tile.data = current_data;
+      restored_region = restored_region.united(tile.rect);
+    }
+  }
+
+  for (const auto& tile : entry.tiles)
+    entry.cost += tile.data.size();
+
+  memory_used_ += entry.cost;
+  return restored_region;
+}
+
+void EditHistory::enforceMemoryLimit()
+{
+  while (memory_used_ > memory_limit_) {
+    // Spills the in-memory entry furthest from the current position
+    Entry* furthest_entry = nullptr;
+    size_t furthest_distance = 0;
+
+    for (size_t i = 0; i < entries_.size(); i++) {
+      if (!entries_[i].spill_file_name.isEmpty())
+        continue;
+
+      size_t distance = i < position_ ? position_ - 1 - i : i - position_;
+
+      if (!furthest_entry || distance > furthest_distance) {
+        furthest_entry = &entries_[i];
+        furthest_distance = distance;
+      }
+    }
+
+    if (!furthest_entry || !spill(*furthest_entry))
+      break;
+  }
+}
+
+bool EditHistory::spill(Entry& entry)
+{
+  if (!spill_dir_)
+    spill_dir_.reset(new QTemporaryDir());
+
+  if (!spill_dir_->isValid())
+    return false;
+
+  QString file_name = spill_dir_->filePath(QString("entry_%1.bin").arg(spill_count_++));
+  QFile file(file_name);
+
+  if (!file.open(QIODevice::WriteOnly))
+    return false;
+
+  QDataStream stream(&file);
+  stream << static_cast<quint32>(entry.tiles.size());
+
+  for (const auto& tile : entry.tiles)
+    stream << tile.rect << tile.data;
+
+  if (stream.status() != QDataStream::Ok) {
+    file.close();
+    QFile::remove(file_name);
+    return false;
+  }
+
+  entry.tiles.clear();
+  entry.tiles.shrink_to_fit();
+  entry.spill_file_name = file_name;
+  memory_used_ -= entry.cost;
+
+  return true;
+}
+
+bool EditHistory::restore(Entry& entry)
+{
+  QFile file(entry.spill_file_name);
+
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+
+  QDataStream stream(&file);
+  quint32 tile_count;
+  stream >> tile_count;
+
+  std::vector<TileDelta> tiles(tile_count);
+
+  for (auto& tile : tiles)
+    stream >> tile.rect >> tile.data;
+
+  if (stream.status() != QDataStream::Ok)
+    return false;
+
+  file.close();
+  QFile::remove(entry.spill_file_name);
+
+  entry.tiles = std::move(tiles);
+  entry.spill_file_name.clear();
+  memory_used_ += entry.cost;
+
+  return true;
+}
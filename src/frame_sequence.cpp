@@ -0,0 +1,344 @@
+#include "include/frame_sequence.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include <QAtomicInt>
+#include <QDir>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRegularExpression>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <QtConcurrent>
+
+#include "include/image_operations.hpp"
+#include "include/operation_registry.hpp"
+#include "include/profiler.hpp"
+
+namespace image_op {
+
+namespace {
+
+struct Frame
+{
+  int number;
+  QImage image;
+};
+
+/**
+ * Queue handing frames from one thread to the next, blocking the producer
+ * while full so a slow stage bounds the frames held in memory
+ */
+class FrameQueue
+{
+public:
+  explicit FrameQueue(int capacity): capacity_(std::max(1, capacity)), closed_(false) {}
+
+  /**
+   * Waits for room then adds the frame
+   * @return false if the queue was closed, dropping the frame
+   */
+  bool push(Frame frame)
+  {
+    QMutexLocker locker(&mutex_);
+    while (!closed_ && static_cast<int>(frames_.size()) >= capacity_)
+      not_full_.wait(&mutex_);
+
+    if (closed_)
+      return false;
+
+    frames_.push_back(std::move(frame));
+    not_empty_.wakeOne();
+    return true;
+  }
+
+  /**
+   * Waits for a frame, the ones pushed before closing are still given
+   * @return false once the queue is closed and empty
+   */
+  bool pop(Frame* frame)
+  {
+    QMutexLocker locker(&mutex_);
+    while (!closed_ && frames_.empty())
+      not_empty_.wait(&mutex_);
+
+    if (frames_.empty())
+      return false;
+
+    *frame = std::move(frames_.front());
+    frames_.pop_front();
+    not_full_.wakeOne();
+    return true;
+  }
+
+  /**
+   * Ends the queue, waking the threads waiting on it
+   */
+  void close()
+  {
+    QMutexLocker locker(&mutex_);
+    closed_ = true;
+    not_empty_.wakeAll();
+    not_full_.wakeAll();
+  }
+
+private:
+  const int capacity_;
+
+  QMutex mutex_;
+  QWaitCondition not_empty_;
+  QWaitCondition not_full_;
+  std::deque<Frame> frames_;
+  bool closed_;
+};
+
+// Returns a null image on failure, setting the error when it knows why
+using FrameStep = std::function<QImage(const QImage& frame, QString* error)>;
+
+/**
+ * Splits the stages in steps: runs of registry operations go through
+ * applyPipeline, fusing them over tiles, and histogram matching uses the
+ * cumulative histogram of the reference computed here once
+ * @return false if a stage cannot run on frames
+ */
+bool makeFrameSteps(const FrameSequenceJob& job, std::vector<FrameStep>* steps, QString* error)
+{
+  QVector<PipelineStage> pending;
+
+  auto flush = [&]() {
+    if (!pending.isEmpty())
+      steps->push_back([pending](const QImage& frame, QString*) { return applyPipeline(frame, pending); });
+    pending.clear();
+  };
+
+  for (const auto& stage : job.stages) {
+    if (stage.name == "match_histogram") {
+      if (job.reference.isNull() || !stage.parameters.isEmpty()) {
+        *error = "match_histogram needs a reference image and no parameters";
+        return false;
+      }
+      // Its tones are read from a single channel, as in the editor
+      if (!job.reference.isGrayscale()) {
+        *error = "match_histogram needs a grayscale reference image";
+        return false;
+      }
+
+      flush();
+      auto target_cumulative_histogram = cumulativeGrayscaleHistogram(job.reference);
+      steps->push_back([target_cumulative_histogram](const QImage& frame, QString* error) {
+        if (!frame.isGrayscale()) {
+          *error = "match_histogram needs grayscale frames";
+          return QImage();
+        }
+
+        auto map_function = histogramMatchingCurve(cumulativeGrayscaleHistogram(frame), target_cumulative_histogram);
+        return mapGrayTones(frame, map_function, false);
+      });
+      continue;
+    }
+
+    auto* operation = findOperation(stage.name);
+    if (!operation || operation->input_count != 1) {
+      *error = QString("%1 cannot run on the frames of a sequence").arg(stage.name);
+      return false;
+    }
+    if (operation->parameters.size() != stage.parameters.size()) {
+      *error = QString("%1 takes %2 parameter(s)").arg(stage.name).arg(operation->parameters.size());
+      return false;
+    }
+
+    pending.append(stage);
+  }
+
+  flush();
+  return true;
+}
+
+/**
+ * Position and length of the run of # of a pattern
+ * @return false if the pattern has none
+ */
+bool findFrameNumber(const QString& pattern, int* position, int* length)
+{
+  int end = pattern.lastIndexOf('#');
+  if (end < 0)
+    return false;
+
+  int start = end;
+  while (start > 0 && pattern[start - 1] == '#')
+    start--;
+
+  *position = start;
+  *length = end - start + 1;
+  return true;
+}
+
+} // namespace
+
+QString frameFileName(const QString& pattern, int frame)
+{
+  int position, length;
+  if (!findFrameNumber(pattern, &position, &length))
+    return QString();
+
+  QString name = pattern;
+  return name.replace(position, length, QString("%1").arg(frame, length, 10, QChar('0')));
+}
+
+QVector<int> findSequenceFrames(const QString& pattern)
+{
+  QVector<int> frames;
+
+  QFileInfo pattern_info(pattern);
+  QString file_pattern = pattern_info.fileName();
+
+  int position, length;
+  if (!findFrameNumber(file_pattern, &position, &length))
+    return frames;
+
+  // Numbers wider than the run are kept, as frameFileName writes them
+  QRegularExpression expression(QString("^%1(\\d{%2,})%3$")
+                                .arg(QRegularExpression::escape(file_pattern.left(position)))
+                                .arg(length)
+                                .arg(QRegularExpression::escape(file_pattern.mid(position + length))));
+
+  for (const QString& file_name : pattern_info.dir().entryList(QDir::Files)) {
+    auto match = expression.match(file_name);
+    if (!match.hasMatch())
+      continue;
+
+    bool ok;
+    int frame = match.captured(1).toInt(&ok);
+    if (ok)
+      frames.append(frame);
+  }
+
+  std::sort(frames.begin(), frames.end());
+  return frames;
+}
+
+bool processFrameSequence(const FrameSequenceJob& job,
+                          const std::function<void(int frame, int written, int total)>& progress,
+                          QString* error)
+{
+  PROFILE_SCOPE("image_op::processFrameSequence", "compute");
+
+  if (frameFileName(job.output_pattern, 0).isEmpty()) {
+    *error = "The output pattern needs a run of # for the frame number";
+    return false;
+  }
+
+  std::vector<FrameStep> steps;
+  if (!makeFrameSteps(job, &steps, error))
+    return false;
+
+  QVector<int> frames;
+  for (int frame : findSequenceFrames(job.input_pattern)) {
+    if ((job.first_frame < 0 || frame >= job.first_frame) && (job.last_frame < 0 || frame <= job.last_frame))
+      frames.append(frame);
+  }
+
+  if (frames.isEmpty()) {
+    *error = QString("No frame matches %1").arg(job.input_pattern);
+    return false;
+  }
+
+  FrameQueue decoded(job.queue_capacity);
+  FrameQueue processed(job.queue_capacity);
+
+  // First failure of any thread. Frames queued before a frame that cannot
+  // be read or processed are still processed and written, so the frames
+  // on disk are the ones before it
+  QAtomicInt failed(0);
+  auto fail = [&](const QString& reason) {
+    if (failed.testAndSetOrdered(0, 1))
+      *error = reason;
+  };
+
+  // Reading and writing block on the disk, so they get threads of their
+  // own instead of ones of the global pool the operations run on
+  QThreadPool io_pool;
+  io_pool.setMaxThreadCount(2);
+
+  QFuture<void> decoder = QtConcurrent::run(&io_pool, [&]() {
+    for (int frame : frames) {
+      QString file_name = frameFileName(job.input_pattern, frame);
+      QImage image;
+      QImageReader reader(file_name);
+      {
+        PROFILE_SCOPE("QImageReader::read", "decode");
+        image = reader.read();
+      }
+
+      if (image.isNull()) {
+        fail(QString("Cannot read %1: %2").arg(file_name, reader.errorString()));
+        break;
+      }
+
+      if (!decoded.push({ frame, std::move(image) }))
+        return;
+    }
+
+    decoded.close();
+  });
+
+  QFuture<void> encoder = QtConcurrent::run(&io_pool, [&]() {
+    Frame frame;
+    int written = 0;
+
+    while (processed.pop(&frame)) {
+      QString file_name = frameFileName(job.output_pattern, frame.number);
+      QImageWriter writer(file_name);
+      bool ok;
+      {
+        PROFILE_SCOPE("QImageWriter::write", "encode");
+        ok = writer.write(frame.image);
+      }
+
+      if (!ok) {
+        // Later frames cannot be written in order anymore
+        fail(QString("Cannot write %1: %2").arg(file_name, writer.errorString()));
+        processed.close();
+        return;
+      }
+
+      written++;
+      if (progress)
+        progress(frame.number, written, frames.size());
+    }
+  });
+
+  Frame frame;
+  while (decoded.pop(&frame)) {
+    QString step_error;
+    for (const auto& step : steps) {
+      frame.image = step(frame.image, &step_error);
+      if (frame.image.isNull())
+        break;
+    }
+
+    if (frame.image.isNull()) {
+      fail(step_error.isEmpty() ? QString("Cannot process frame %1").arg(frame.number)
+                                : QString("Cannot process frame %1: %2").arg(frame.number).arg(step_error));
+      break;
+    }
+
+    if (!processed.push(std::move(frame)))
+      break;
+  }
+
+  // Releases the decoder when processing stopped early
+  decoded.close();
+  processed.close();
+  decoder.waitForFinished();
+  encoder.waitForFinished();
+
+  return !failed.load();
+}
+
+} // namespace image_op
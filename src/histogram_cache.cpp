@@ -0,0 +1,110 @@
+#include "include/histogram_cache.hpp"
+
+#include <QCache>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include "include/pixel_formats.hpp"
+#include "include/profiler.hpp"
+
+namespace image_op {
+
+namespace {
+
+// Histograms kept, a few per image of the edit history
+constexpr int kCachedHistograms = 64;
+
+struct HistogramCache
+{
+  HistogramCache()
+  {
+    histograms.setMaxCost(kCachedHistograms);
+  }
+
+  QMutex mutex;
+  QCache<qint64, HistogramInfo> histograms;
+};
+
+HistogramCache& cache()
+{
+  static HistogramCache histogram_cache;
+  return histogram_cache;
+}
+
+/**
+ * Histogram of the red channel and whether the image is grayscale,
+ * in a single pass
+ */
+template<typename Format>
+HistogramInfo scanHistogram(const QImage& image)
+{
+  HistogramInfo info = { std::vector<int>(256), true };
+  int width = image.width();
+  int height = image.height();
+
+  for (int row_index = 0; row_index < height; row_index++) {
+    auto* line = pixel_format::constRow<Format>(image, row_index);
+    for (int column_index = 0; column_index < width; column_index++) {
+      auto red = Format::red(line[column_index]);
+      info.histogram[static_cast<size_t>(Format::toByte(red))]++;
+
+      if (!Format::isGray())
+        info.grayscale = info.grayscale && red == Format::green(line[column_index])
+                         && red == Format::blue(line[column_index]);
+    }
+  }
+
+  return info;
+}
+
+} // namespace
+
+HistogramInfo cachedHistogram(const QImage& image)
+{
+  HistogramInfo info;
+  if (findCachedHistogram(image, &info))
+    return info;
+
+  PROFILE_SCOPE("image_op::cachedHistogram", "compute");
+
+  QImage scanned_image = image;
+  info = visitPixelFormat(scanned_image, [&](auto format) {
+    return scanHistogram<decltype(format)>(scanned_image);
+  });
+
+  cacheHistogram(image, info);
+  return info;
+}
+
+bool findCachedHistogram(const QImage& image, HistogramInfo* info)
+{
+  QMutexLocker locker(&cache().mutex);
+  auto* cached_info = cache().histograms.object(image.cacheKey());
+
+  if (!cached_info)
+    return false;
+
+  *info = *cached_info;
+  return true;
+}
+
+void cacheHistogram(const QImage& image, const HistogramInfo& info)
+{
+  if (image.isNull())
+    return;
+
+  QMutexLocker locker(&cache().mutex);
+  cache().histograms.insert(image.cacheKey(), new HistogramInfo(info));
+}
+
+std::vector<int> mapHistogram(const std::vector<int>& histogram_data, const std::vector<int>& tone_curve)
+{
+  std::vector<int> mapped_histogram(256);
+
+  for (size_t i = 0; i < 256; i++)
+    mapped_histogram[static_cast<size_t>(tone_curve[i])] += histogram_data[i];
+
+  return mapped_histogram;
+}
+
+} // namespace image_op
@@ -0,0 +1,130 @@
+#include "include/image_buffer_pool.hpp"
+
+#include <limits>
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+
+namespace image_op {
+
+namespace {
+
+// Alignment of the buffers and their rows, a cache line
+constexpr qint64 kAlignment = 64;
+
+// Smaller buffers are left to malloc, which keeps them in its heap
+// instead of mapping and unmapping pages
+constexpr qint64 kMinimumPooledBytes = 128 * 1024;
+
+// Released buffers kept beyond this are freed
+constexpr qint64 kMaximumIdleBytes = 256 * 1024 * 1024;
+
+struct BufferPool
+{
+  QMutex mutex;
+  // Released buffers by capacity
+  QHash<qint64, QVector<uchar*>> idle_buffers;
+  qint64 idle_bytes = 0;
+  qint64 allocations = 0;
+  qint64 reuses = 0;
+};
+
+BufferPool& pool()
+{
+  // Never destroyed, images still alive while static objects are
+  // destroyed give their buffers back to it
+  static BufferPool* buffer_pool = new BufferPool;
+  return *buffer_pool;
+}
+
+/**
+ * Smallest bucket holding the bytes, eight per power of two so at most an
+ * eighth of a buffer is wasted
+ */
+qint64 bucketCapacity(qint64 bytes)
+{
+  qint64 step = kAlignment;
+  while (step * 8 <= bytes)
+    step *= 2;
+
+  return (bytes + step - 1) / step * step;
+}
+
+/**
+ * Cleanup function of the pooled images. The capacity of a buffer is kept
+ * in its first kAlignment bytes, before the pixels
+ */
+void releaseBuffer(void* info)
+{
+  auto* block = static_cast<uchar*>(info);
+  qint64 capacity = *reinterpret_cast<qint64*>(block);
+
+  BufferPool& buffer_pool = pool();
+  QMutexLocker locker(&buffer_pool.mutex);
+
+  if (buffer_pool.idle_bytes + capacity > kMaximumIdleBytes) {
+    locker.unlock();
+    qFreeAligned(block);
+    return;
+  }
+
+  buffer_pool.idle_buffers[capacity].append(block);
+  buffer_pool.idle_bytes += capacity;
+}
+
+} // namespace
+
+QImage pooledImage(int width, int height, QImage::Format format)
+{
+  int bits_per_pixel = QImage::toPixelFormat(format).bitsPerPixel();
+
+  // Indexed formats need a color table set up by QImage itself
+  if (width <= 0 || height <= 0 || bits_per_pixel < 8 || format == QImage::Format_Indexed8)
+    return QImage(width, height, format);
+
+  qint64 row_bytes = (static_cast<qint64>(width) * bits_per_pixel + 7) / 8;
+  qint64 bytes_per_line = (row_bytes + kAlignment - 1) / kAlignment * kAlignment;
+  qint64 bytes = bytes_per_line * height;
+
+  if (bytes < kMinimumPooledBytes || bytes_per_line > std::numeric_limits<int>::max())
+    return QImage(width, height, format);
+
+  qint64 capacity = bucketCapacity(bytes) + kAlignment;
+  uchar* block = nullptr;
+
+  {
+    BufferPool& buffer_pool = pool();
+    QMutexLocker locker(&buffer_pool.mutex);
+
+    QVector<uchar*>& idle_buffers = buffer_pool.idle_buffers[capacity];
+    if (!idle_buffers.isEmpty()) {
+      block = idle_buffers.takeLast();
+      buffer_pool.idle_bytes -= capacity;
+      buffer_pool.reuses++;
+    } else {
+      buffer_pool.allocations++;
+    }
+  }
+
+  if (!block) {
+    block = static_cast<uchar*>(qMallocAligned(static_cast<size_t>(capacity), kAlignment));
+    if (!block)
+      return QImage();
+
+    *reinterpret_cast<qint64*>(block) = capacity;
+  }
+
+  return QImage(block + kAlignment, width, height, static_cast<int>(bytes_per_line), format, releaseBuffer, block);
+}
+
+ImageBufferPoolStatistics imageBufferPoolStatistics()
+{
+  BufferPool& buffer_pool = pool();
+  QMutexLocker locker(&buffer_pool.mutex);
+
+  return { buffer_pool.allocations, buffer_pool.reuses, buffer_pool.idle_bytes };
+}
+
+} // namespace image_op
@@ -0,0 +1,351 @@
+#include "include/image_comparison.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <QThread>
+#include <QtConcurrent>
+
+#include "include/image_buffer_pool.hpp"
+#include "include/pixel_formats.hpp"
+#include "include/pixel_kernels.hpp"
+#include "include/profiler.hpp"
+
+namespace image_op {
+
+namespace {
+
+// Fewer rows than this are not worth a task of their own
+constexpr int kMinimumBandHeight = 32;
+
+// Gaussian window of SSIM, the one of Wang et al.
+constexpr int kWindowRadius = 5;
+constexpr double kWindowSigma = 1.5;
+
+// Keep SSIM stable on flat areas, for a range of 255
+constexpr double kC1 = (0.01 * 255) * (0.01 * 255);
+constexpr double kC2 = (0.03 * 255) * (0.03 * 255);
+
+// Planes filtered for SSIM: x, y, x^2, y^2 and xy
+constexpr int kMomentCount = 5;
+
+struct ComparisonBand
+{
+  int first_row;
+  int last_row;
+  double squared_sum;
+  int maximum_difference;
+  double similarity_sum;
+};
+
+/**
+ * Adds the squared differences of the color channels of a row to
+ * squared_sum, on the 0 to 255 scale
+ */
+template<typename Format>
+void compareRow(const typename Format::Pixel* first, const typename Format::Pixel* second, int width,
+                double* squared_sum, int* maximum_difference)
+{
+  double scale = 255.0 / Format::maximum();
+  double sum = 0;
+  double maximum = 0;
+
+  auto add = [&](double first_value, double second_value) {
+    double difference = std::abs(first_value - second_value) * scale;
+    sum += difference * difference;
+    maximum = std::max(maximum, difference);
+  };
+
+  for (int column_index = 0; column_index < width; column_index++) {
+    add(Format::red(first[column_index]), Format::red(second[column_index]));
+    if (Format::isGray())
+      continue;
+
+    add(Format::green(first[column_index]), Format::green(second[column_index]));
+    add(Format::blue(first[column_index]), Format::blue(second[column_index]));
+  }
+
+  *squared_sum += sum;
+  *maximum_difference = std::max(*maximum_difference, static_cast<int>(std::lround(maximum)));
+}
+
+template<>
+void compareRow<pixel_format::Gray8>(const quint8* first, const quint8* second, int width,
+                                     double* squared_sum, int* maximum_difference)
+{
+  quint64 sum = 0;
+  int maximum = *maximum_difference;
+
+  for (int column_index = 0; column_index < width; column_index++) {
+    int difference = std::abs(first[column_index] - second[column_index]);
+    sum += static_cast<quint64>(difference * difference);
+    maximum = std::max(maximum, difference);
+  }
+
+  *squared_sum += static_cast<double>(sum);
+  *maximum_difference = maximum;
+}
+
+void compareColorRow(const QRgb* first, const QRgb* second, int width, double* squared_sum, int* maximum_difference)
+{
+  quint64 sum = 0;
+  kernels::rowKernels().compareColors(first, second, width, &sum, maximum_difference);
+  *squared_sum += static_cast<double>(sum);
+}
+
+template<>
+void compareRow<pixel_format::Rgb32>(const QRgb* first, const QRgb* second, int width,
+                                     double* squared_sum, int* maximum_difference)
+{
+  compareColorRow(first, second, width, squared_sum, maximum_difference);
+}
+
+template<>
+void compareRow<pixel_format::Argb32>(const QRgb* first, const QRgb* second, int width,
+                                      double* squared_sum, int* maximum_difference)
+{
+  compareColorRow(first, second, width, squared_sum, maximum_difference);
+}
+
+/**
+ * Luminance of a row on the 0 to 255 scale, exactly the gray value on
+ * pixels that are already gray
+ */
+template<typename Format>
+void readLuminance(const typename Format::Pixel* line, int width, float* values)
+{
+  double scale = 255.0 / Format::maximum();
+
+  for (int column_index = 0; column_index < width; column_index++) {
+    auto pixel = line[column_index];
+    double value = Format::red(pixel);
+    if (Format::red(pixel) != Format::green(pixel) || Format::green(pixel) != Format::blue(pixel))
+      value = 0.299 * Format::red(pixel) + 0.587 * Format::green(pixel) + 0.114 * Format::blue(pixel);
+    values[column_index] = static_cast<float>(value * scale);
+  }
+}
+
+std::vector<float> windowWeights()
+{
+  std::vector<float> weights(2 * kWindowRadius + 1);
+  for (int offset = -kWindowRadius; offset <= kWindowRadius; offset++)
+    weights[static_cast<size_t>(offset + kWindowRadius)] =
+        static_cast<float>(std::exp(-offset * offset / (2 * kWindowSigma * kWindowSigma)));
+  return weights;
+}
+
+/**
+ * Sum of the weights of the window around each position of a line, the
+ * positions outside of it left out
+ */
+std::vector<float> clippedWeightSums(int length, const std::vector<float>& weights)
+{
+  std::vector<float> weight_sums(static_cast<size_t>(length));
+
+  for (int index = 0; index < length; index++) {
+    for (int offset = -kWindowRadius; offset <= kWindowRadius; offset++) {
+      if (index + offset >= 0 && index + offset < length)
+        weight_sums[static_cast<size_t>(index)] += weights[static_cast<size_t>(offset + kWindowRadius)];
+    }
+  }
+
+  return weight_sums;
+}
+
+/**
+ * Weighted mean of the window around each value of a line, one offset at
+ * a time so the inner loops run over contiguous values and vectorize
+ */
+void filterLine(const float* values, int length, const std::vector<float>& weights, const float* weight_sums,
+                float* result)
+{
+  std::fill(result, result + length, 0.0f);
+
+  for (int offset = -kWindowRadius; offset <= kWindowRadius; offset++) {
+    float weight = weights[static_cast<size_t>(offset + kWindowRadius)];
+    int first = std::max(0, -offset);
+    int last = std::min(length, length - offset);
+    for (int index = first; index < last; index++)
+      result[index] += weight * values[index + offset];
+  }
+
+  for (int index = 0; index < length; index++)
+    result[index] /= weight_sums[index];
+}
+
+/**
+ * Sum of the SSIM of the pixels of a band. The moments of the rows its
+ * windows reach are filtered along the rows first, then combined along
+ * the columns for each row of the band
+ */
+template<typename Format>
+double bandSimilarity(const QImage& first_image, const QImage& second_image, const ComparisonBand& band,
+                      const std::vector<float>& weights, const std::vector<float>& column_weight_sums)
+{
+  int width = first_image.width();
+  int height = first_image.height();
+  int top = std::max(0, band.first_row - kWindowRadius);
+  int bottom = std::min(height, band.last_row + kWindowRadius);
+  auto plane_size = static_cast<size_t>(width);
+  size_t row_size = kMomentCount * plane_size;
+
+  std::vector<float> row_moments(static_cast<size_t>(bottom - top) * row_size);
+  std::vector<float> first_values(plane_size);
+  std::vector<float> second_values(plane_size);
+  std::vector<float> products(plane_size);
+
+  for (int row_index = top; row_index < bottom; row_index++) {
+    readLuminance<Format>(pixel_format::constRow<Format>(first_image, row_index), width, first_values.data());
+    readLuminance<Format>(pixel_format::constRow<Format>(second_image, row_index), width, second_values.data());
+    float* moments = &row_moments[static_cast<size_t>(row_index - top) * row_size];
+
+    filterLine(first_values.data(), width, weights, column_weight_sums.data(), moments);
+    filterLine(second_values.data(), width, weights, column_weight_sums.data(), moments + plane_size);
+
+    for (size_t i = 0; i < plane_size; i++)
+      products[i] = first_values[i] * first_values[i];
+    filterLine(products.data(), width, weights, column_weight_sums.data(), moments + 2 * plane_size);
+
+    for (size_t i = 0; i < plane_size; i++)
+      products[i] = second_values[i] * second_values[i];
+    filterLine(products.data(), width, weights, column_weight_sums.data(), moments + 3 * plane_size);
+
+    for (size_t i = 0; i < plane_size; i++)
+      products[i] = first_values[i] * second_values[i];
+    filterLine(products.data(), width, weights, column_weight_sums.data(), moments + 4 * plane_size);
+  }
+
+  std::vector<float> moments(row_size);
+  double similarity_sum = 0;
+
+  for (int row_index = band.first_row; row_index < band.last_row; row_index++) {
+    std::fill(moments.begin(), moments.end(), 0.0f);
+    float weight_sum = 0;
+
+    for (int offset = -kWindowRadius; offset <= kWindowRadius; offset++) {
+      int source_row = row_index + offset;
+      if (source_row < 0 || source_row >= height)
+        continue;
+
+      float weight = weights[static_cast<size_t>(offset + kWindowRadius)];
+      const float* source = &row_moments[static_cast<size_t>(source_row - top) * row_size];
+      weight_sum += weight;
+      for (size_t i = 0; i < row_size; i++)
+        moments[i] += weight * source[i];
+    }
+
+    for (size_t column = 0; column < plane_size; column++) {
+      double first_mean = moments[column] / weight_sum;
+      double second_mean = moments[plane_size + column] / weight_sum;
+      double first_variance = moments[2 * plane_size + column] / weight_sum - first_mean * first_mean;
+      double second_variance = moments[3 * plane_size + column] / weight_sum - second_mean * second_mean;
+      double covariance = moments[4 * plane_size + column] / weight_sum - first_mean * second_mean;
+
+      similarity_sum += (2 * first_mean * second_mean + kC1) * (2 * covariance + kC2)
+                        / ((first_mean * first_mean + second_mean * second_mean + kC1)
+                           * (first_variance + second_variance + kC2));
+    }
+  }
+
+  return similarity_sum;
+}
+
+template<typename Format>
+ImageComparison compare(const QImage& first_image, const QImage& second_image)
+{
+  int width = first_image.width();
+  int height = first_image.height();
+  int band_count = std::max(1, std::min(QThread::idealThreadCount() * 4, height / kMinimumBandHeight));
+  int band_height = (height + band_count - 1) / band_count;
+
+  std::vector<ComparisonBand> bands;
+  for (int row_index = 0; row_index < height; row_index += band_height)
+    bands.push_back({ row_index, std::min(height, row_index + band_height), 0, 0, 0 });
+
+  auto weights = windowWeights();
+  auto column_weight_sums = clippedWeightSums(width, weights);
+
+  QtConcurrent::blockingMap(bands, [&](ComparisonBand& band) {
+    for (int row_index = band.first_row; row_index < band.last_row; row_index++)
+      compareRow<Format>(pixel_format::constRow<Format>(first_image, row_index),
+                         pixel_format::constRow<Format>(second_image, row_index),
+                         width, &band.squared_sum, &band.maximum_difference);
+
+    band.similarity_sum = bandSimilarity<Format>(first_image, second_image, band, weights, column_weight_sums);
+  });
+
+  double squared_sum = 0;
+  double similarity_sum = 0;
+  int maximum_difference = 0;
+  for (const auto& band : bands) {
+    squared_sum += band.squared_sum;
+    similarity_sum += band.similarity_sum;
+    maximum_difference = std::max(maximum_difference, band.maximum_difference);
+  }
+
+  qint64 pixel_count = static_cast<qint64>(width) * height;
+  int channel_count = Format::isGray() ? 1 : 3;
+  double mean_squared_error = squared_sum / (static_cast<double>(pixel_count) * channel_count);
+  double peak_signal_to_noise_ratio = mean_squared_error > 0 ? 10 * std::log10(255.0 * 255.0 / mean_squared_error)
+                                                             : std::numeric_limits<double>::infinity();
+
+  return { pixel_count, mean_squared_error, peak_signal_to_noise_ratio,
+           similarity_sum / pixel_count, maximum_difference };
+}
+
+} // namespace
+
+ImageComparison compareImages(const QImage& first_image, const QImage& second_image)
+{
+  if (first_image.isNull() || first_image.size() != second_image.size())
+    return { 0, 0, 0, 0, 0 };
+
+  PROFILE_SCOPE("image_op::compareImages", "compute");
+
+  QImage first = first_image;
+  return visitPixelFormat(first, [&](auto format) {
+    QImage second = second_image.format() == first.format() ? second_image : second_image.convertToFormat(first.format());
+    return compare<decltype(format)>(first, second);
+  });
+}
+
+QImage differenceImage(const QImage& first_image, const QImage& second_image, int amplification)
+{
+  if (first_image.isNull() || first_image.size() != second_image.size())
+    return QImage();
+
+  PROFILE_SCOPE("image_op::differenceImage", "compute");
+
+  QImage first = first_image;
+  return visitPixelFormat(first, [&](auto format) {
+    using Format = decltype(format);
+
+    QImage second = second_image.format() == first.format() ? second_image : second_image.convertToFormat(first.format());
+    QImage target_image = pooledImage(first.width(), first.height(), first.format());
+
+    auto difference = [amplification](double first_value, double second_value) {
+      return Format::clamp(std::abs(first_value - second_value) * amplification);
+    };
+
+    for (int row_index = 0; row_index < first.height(); row_index++) {
+      auto* first_line = pixel_format::constRow<Format>(first, row_index);
+      auto* second_line = pixel_format::constRow<Format>(second, row_index);
+      auto* target_line = pixel_format::row<Format>(target_image, row_index);
+
+      for (int column_index = 0; column_index < first.width(); column_index++) {
+        auto first_pixel = first_line[column_index];
+        auto second_pixel = second_line[column_index];
+        target_line[column_index] = Format::pixel(difference(Format::red(first_pixel), Format::red(second_pixel)),
+                                                  difference(Format::green(first_pixel), Format::green(second_pixel)),
+                                                  difference(Format::blue(first_pixel), Format::blue(second_pixel)),
+                                                  Format::maximum());
+      }
+    }
+
+    return target_image;
+  });
+}
+
+} // namespace image_op
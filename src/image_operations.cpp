@@ -1,109 +1,568 @@
 #include "include/image_operations.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 #include <QPainter>
 
+#include "include/histogram_cache.hpp"
+#include "include/image_buffer_pool.hpp"
+#include "include/image_statistics.hpp"
+#include "include/pixel_formats.hpp"
+#include "include/pixel_kernels.hpp"
+#include "include/planar_image.hpp"
+#include "include/profiler.hpp"
+
 namespace image_op {
 
-QImage mirrorHorizontally(QImage image)
+namespace {
+
+template<typename Format>
+double luminance(typename Format::Pixel pixel)
+{
+  return 0.299 * Format::red(pixel) + 0.587 * Format::green(pixel) + 0.114 * Format::blue(pixel);
+}
+
+template<typename Format>
+typename Format::Pixel grayPixel(typename Format::Channel value, typename Format::Pixel alpha_source)
+{
+  return Format::pixel(value, value, value, Format::alpha(alpha_source));
+}
+
+/**
+ * Replaces each pixel of the image by function(pixel)
+ */
+template<typename Format, typename Function>
+void mapPixels(QImage& image, Function function)
 {
   int width = image.width();
   int height = image.height();
 
   for (int row_index = 0; row_index < height; row_index++) {
-    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
-    for (int column_index = 0; column_index < width / 2; column_index++) {
-      std::swap(line[column_index], line[width - 1 - column_index]);
+    auto* line = pixel_format::row<Format>(image, row_index);
+    for (int column_index = 0; column_index < width; column_index++)
+      line[column_index] = function(line[column_index]);
+  }
+}
+
+/**
+ * Replaces each color channel of the image by function(channel), keeping alpha
+ */
+template<typename Format, typename Function>
+void mapColorChannels(QImage& image, Function function)
+{
+  mapPixels<Format>(image, [&](typename Format::Pixel pixel) {
+    return Format::pixel(function(Format::red(pixel)), function(Format::green(pixel)),
+                         function(Format::blue(pixel)), Format::alpha(pixel));
+  });
+}
+
+// Row operations, specialized for the formats with vector kernels
+
+template<typename Format>
+void mirrorRow(typename Format::Pixel* line, int width)
+{
+  std::reverse(line, line + width);
+}
+
+template<>
+void mirrorRow<pixel_format::Rgb32>(QRgb* line, int width)
+{
+  kernels::rowKernels().mirror(line, width);
+}
+
+template<>
+void mirrorRow<pixel_format::Argb32>(QRgb* line, int width)
+{
+  kernels::rowKernels().mirror(line, width);
+}
+
+template<typename Format>
+void adjustBrightnessRows(QImage& image, int brightness_value)
+{
+  double step = Format::fromByteScale(brightness_value);
+
+  mapColorChannels<Format>(image, [step](typename Format::Channel channel) {
+    return Format::clamp(channel + step);
+  });
+}
+
+template<>
+void adjustBrightnessRows<pixel_format::Rgb32>(QImage& image, int brightness_value)
+{
+  const auto& row_kernels = kernels::rowKernels();
+
+  for (int row_index = 0; row_index < image.height(); row_index++)
+    row_kernels.adjustBrightness(pixel_format::row<pixel_format::Rgb32>(image, row_index),
+                                 image.width(), brightness_value);
+}
+
+template<typename Format>
+void adjustContrastRows(QImage& image, int contrast_factor)
+{
+  mapColorChannels<Format>(image, [contrast_factor](typename Format::Channel channel) {
+    return Format::clamp(static_cast<double>(channel) * contrast_factor);
+  });
+}
+
+template<>
+void adjustContrastRows<pixel_format::Rgb32>(QImage& image, int contrast_factor)
+{
+  const auto& row_kernels = kernels::rowKernels();
+
+  for (int row_index = 0; row_index < image.height(); row_index++)
+    row_kernels.adjustContrast(pixel_format::row<pixel_format::Rgb32>(image, row_index),
+                               image.width(), contrast_factor);
+}
+
+template<typename Format>
+void negateRows(QImage& image)
+{
+  mapColorChannels<Format>(image, [](typename Format::Channel channel) {
+    return static_cast<typename Format::Channel>(Format::maximum() - channel);
+  });
+}
+
+template<>
+void negateRows<pixel_format::Rgb32>(QImage& image)
+{
+  const auto& row_kernels = kernels::rowKernels();
+
+  for (int row_index = 0; row_index < image.height(); row_index++)
+    row_kernels.negate(pixel_format::row<pixel_format::Rgb32>(image, row_index), image.width());
+}
+
+/**
+ * Replaces each color channel by its tone on the curve, keeping alpha
+ */
+template<typename Format>
+void mapColorTones(QImage& image, const std::vector<int>& tone_curve)
+{
+  mapColorChannels<Format>(image, [&](typename Format::Channel channel) {
+    return Format::fromByte(tone_curve[static_cast<size_t>(Format::toByte(channel))]);
+  });
+}
+
+/**
+ * Maps the color planes of an 8-bit image through the curve as a table of
+ * bytes, one lookup per byte with nothing to extract
+ */
+void mapColorPlaneTones(QImage& image, const std::vector<int>& tone_curve)
+{
+  uchar table[256];
+  for (size_t tone = 0; tone < 256; tone++)
+    table[tone] = static_cast<uchar>(tone_curve[tone]);
+
+  PlanarImage planes = PlanarImage::fromImage(image);
+
+  for (int channel = PlanarImage::Red; channel <= PlanarImage::Blue; channel++) {
+    for (int row_index = 0; row_index < planes.height(); row_index++) {
+      uchar* line = planes.row(channel, row_index);
+      for (int column_index = 0; column_index < planes.width(); column_index++)
+        line[column_index] = table[line[column_index]];
     }
   }
 
-  return image;
+  image = planes.toImage(image.format());
 }
 
-QImage mirrorVertically(QImage image)
+template<>
+void mapColorTones<pixel_format::Rgb32>(QImage& image, const std::vector<int>& tone_curve)
 {
-  auto width = static_cast<size_t>(image.width());
-  auto height = image.height();
-  QRgb* buffer = new QRgb[width * sizeof(QRgb)];
-
-  try {
-    for (int row_index = 0; row_index < height / 2; row_index++) {
-      QRgb* first_line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
-      QRgb* second_line = reinterpret_cast<QRgb*>(image.scanLine(height - 1 - row_index));
-      std::memcpy(buffer, first_line, width * sizeof(QRgb));
-      std::memcpy(first_line, second_line, width * sizeof(QRgb));
-      std::memcpy(second_line, buffer, width * sizeof(QRgb));
+  mapColorPlaneTones(image, tone_curve);
+}
+
+template<>
+void mapColorTones<pixel_format::Argb32>(QImage& image, const std::vector<int>& tone_curve)
+{
+  mapColorPlaneTones(image, tone_curve);
+}
+
+/**
+ * Averages blocks of sx x sy pixels, the blocks on the right and bottom
+ * edges cut by the image
+ */
+template<typename Format>
+QImage zoomOutPixels(const QImage& image, int sx, int sy)
+{
+  using Accumulator = typename Format::Accumulator;
+  using Channel = typename Format::Channel;
+
+  int original_width = image.width();
+  int original_height = image.height();
+
+  int target_width = static_cast<int>(ceil(original_width * 1.0 / sx));
+  int target_height = static_cast<int>(ceil(original_height * 1.0 / sy));
+
+  QImage target_image = pooledImage(target_width, target_height, image.format());
+
+  for (int row_index = 0, target_row = 0; row_index < original_height; row_index += sy, target_row++) {
+    int rows_read = std::min(sy, original_height - row_index);
+    auto* target_line = pixel_format::row<Format>(target_image, target_row);
+
+    for (int column_index = 0, target_column = 0; column_index < original_width; column_index += sx, target_column++) {
+      Accumulator red = 0;
+      Accumulator green = 0;
+      Accumulator blue = 0;
+      Accumulator alpha = 0;
+      int num_pixels = 0;
+
+      for (int column = column_index; column < column_index + sx && column < original_width; column++) {
+        for (int row = 0; row < rows_read; row++) {
+          auto pixel = pixel_format::constRow<Format>(image, row_index + row)[column];
+          num_pixels++;
+          red += Format::red(pixel);
+          green += Format::green(pixel);
+          blue += Format::blue(pixel);
+          alpha += Format::alpha(pixel);
+        }
+      }
+
+      target_line[target_column] = Format::pixel(static_cast<Channel>(red / num_pixels),
+                                                 static_cast<Channel>(green / num_pixels),
+                                                 static_cast<Channel>(blue / num_pixels),
+                                                 static_cast<Channel>(alpha / num_pixels));
     }
-  } catch (...) {
-    delete[] buffer;
-    throw;
   }
 
-  delete[] buffer;
-  return image;
+  return target_image;
 }
 
-QImage convertColoredToGrayscale(QImage image)
+/**
+ * Same as zoomOutPixels on the planes of an 8-bit image: the rows of each
+ * block are first added up column by column, over contiguous bytes
+ */
+QImage zoomOutPlanes(const QImage& image, int sx, int sy)
 {
-  if (image.isGrayscale())
-    return image;
+  PlanarImage source = PlanarImage::fromImage(image);
 
-  int width = image.width();
-  int height = image.height();
+  int original_width = source.width();
+  int original_height = source.height();
 
-  for (int row_index = 0; row_index < height; row_index++) {
-    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
-    for (int column_index = 0; column_index < width; column_index++) {
-      auto* pixel = &line[column_index];
-      auto luminance = static_cast<int>(0.299 * qRed(*pixel) + 0.587 * qGreen(*pixel) + 0.114 * qBlue(*pixel));
-      *pixel = qRgb(luminance, luminance, luminance);
+  int target_width = static_cast<int>(ceil(original_width * 1.0 / sx));
+  int target_height = static_cast<int>(ceil(original_height * 1.0 / sy));
+
+  PlanarImage target(target_width, target_height, source.hasAlpha());
+
+  // A column of a block adds at most 65535 bytes
+  std::vector<quint32> column_sums(static_cast<size_t>(original_width));
+
+  for (int channel = 0; channel < source.channelCount(); channel++) {
+    for (int row_index = 0, target_row = 0; row_index < original_height; row_index += sy, target_row++) {
+      int rows_read = std::min(sy, original_height - row_index);
+
+      std::fill(column_sums.begin(), column_sums.end(), 0);
+      for (int row = 0; row < rows_read; row++) {
+        const uchar* line = source.constRow(channel, row_index + row);
+        for (int column = 0; column < original_width; column++)
+          column_sums[static_cast<size_t>(column)] += line[column];
+      }
+
+      uchar* target_line = target.row(channel, target_row);
+
+      for (int column_index = 0, target_column = 0; column_index < original_width; column_index += sx, target_column++) {
+        int columns_read = std::min(sx, original_width - column_index);
+        qint64 sum = 0;
+        for (int column = column_index; column < column_index + columns_read; column++)
+          sum += column_sums[static_cast<size_t>(column)];
+
+        target_line[target_column] = static_cast<uchar>(sum / (static_cast<qint64>(columns_read) * rows_read));
+      }
     }
   }
 
-  return image;
+  return target.toImage(image.format());
 }
 
-QImage quantizeGrayscale(QImage image, int num_colors)
+template<>
+QImage zoomOutPixels<pixel_format::Rgb32>(const QImage& image, int sx, int sy)
 {
-  int width = image.width();
-  int height = image.height();
+  return zoomOutPlanes(image, sx, sy);
+}
 
-  int step = 0;
-  if (num_colors > 1)
-    step = 255 / (num_colors - 1);
+template<>
+QImage zoomOutPixels<pixel_format::Argb32>(const QImage& image, int sx, int sy)
+{
+  return zoomOutPlanes(image, sx, sy);
+}
 
-  for (int row_index = 0; row_index < height; row_index++) {
-    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
-    for (int column_index = 0; column_index < width; column_index++) {
-      auto* pixel = &line[column_index];
-      auto luminance = 0.299 * qRed(*pixel) + 0.587 * qGreen(*pixel) + 0.114 * qBlue(*pixel);
-      auto color = static_cast<int>(std::round(luminance / step) * step);
-      *pixel = qRgb(color, color, color);
+/**
+ * Doubles the size, filling the new columns and then the new rows with the
+ * average of their neighbors
+ */
+template<typename Format>
+QImage zoomInPixels(const QImage& image)
+{
+  using Pixel = typename Format::Pixel;
+  using Channel = typename Format::Channel;
+  using Accumulator = typename Format::Accumulator;
+
+  int original_width = image.width();
+  int original_height = image.height();
+
+  int target_width = 2 * original_width;
+  int target_height = 2 * original_height;
+
+  QImage target_image = pooledImage(target_width, target_height, image.format());
+
+  // Average of two colors
+  auto average = [](Pixel a, Pixel b) {
+    auto channel_average = [](Channel x, Channel y) {
+      return static_cast<Channel>((static_cast<Accumulator>(x) + y) / 2);
+    };
+    return Format::pixel(channel_average(Format::red(a), Format::red(b)),
+                         channel_average(Format::green(a), Format::green(b)),
+                         channel_average(Format::blue(a), Format::blue(b)),
+                         channel_average(Format::alpha(a), Format::alpha(b)));
+  };
+
+  // Between columns
+  for (int row_index = 0; row_index < original_height; row_index++) {
+    auto* original_line = pixel_format::constRow<Format>(image, row_index);
+    auto* target_line = pixel_format::row<Format>(target_image, row_index * 2);
+
+    for (int column_index = 0; column_index < original_width; column_index++) {
+      int target_column = column_index * 2;
+
+      // First pixel is equal
+      target_line[target_column] = original_line[column_index];
+
+      // Second pixel is the medium between the current and the next (if it exists)
+      if (column_index + 2 < original_width)
+        target_line[target_column + 1] = average(original_line[column_index], original_line[column_index + 2]);
+      else
+        target_line[target_column + 1] = original_line[column_index];
     }
   }
 
-  return image;
+  // Between lines
+  for (int row_index = 0; row_index < target_height; row_index += 2) {
+    auto* current_line = pixel_format::row<Format>(target_image, row_index);
+    auto* target_line = pixel_format::row<Format>(target_image, row_index + 1);
+
+    if (row_index + 2 >= target_height) {
+      std::copy(current_line, current_line + target_width, target_line);
+      break;
+    }
+
+    auto* next_line = pixel_format::row<Format>(target_image, row_index + 2);
+
+    for (int column_index = 0; column_index < target_width; column_index++)
+      target_line[column_index] = average(current_line[column_index], next_line[column_index]);
+  }
+
+  return target_image;
 }
 
-std::vector<int> generateGrayscaleHistogramData(QImage image)
+/**
+ * Same as zoomInPixels on the planes of an 8-bit image, where the rows
+ * in between average contiguous bytes
+ */
+QImage zoomInPlanes(const QImage& image)
+{
+  PlanarImage source = PlanarImage::fromImage(image);
+
+  int original_width = source.width();
+  int original_height = source.height();
+
+  int target_width = 2 * original_width;
+  int target_height = 2 * original_height;
+
+  PlanarImage target(target_width, target_height, source.hasAlpha());
+
+  for (int channel = 0; channel < source.channelCount(); channel++) {
+    // Between columns
+    for (int row_index = 0; row_index < original_height; row_index++) {
+      const uchar* original_line = source.constRow(channel, row_index);
+      uchar* target_line = target.row(channel, row_index * 2);
+
+      for (int column_index = 0; column_index < original_width; column_index++) {
+        int target_column = column_index * 2;
+        target_line[target_column] = original_line[column_index];
+
+        if (column_index + 2 < original_width)
+          target_line[target_column + 1] = static_cast<uchar>((original_line[column_index]
+                                                               + original_line[column_index + 2]) / 2);
+        else
+          target_line[target_column + 1] = original_line[column_index];
+      }
+    }
+
+    // Between lines
+    for (int row_index = 0; row_index < target_height; row_index += 2) {
+      const uchar* current_line = target.constRow(channel, row_index);
+      uchar* target_line = target.row(channel, row_index + 1);
+
+      if (row_index + 2 >= target_height) {
+        std::copy(current_line, current_line + target_width, target_line);
+        break;
+      }
+
+      const uchar* next_line = target.constRow(channel, row_index + 2);
+
+      for (int column_index = 0; column_index < target_width; column_index++)
+        target_line[column_index] = static_cast<uchar>((current_line[column_index] + next_line[column_index]) / 2);
+    }
+  }
+
+  return target.toImage(image.format());
+}
+
+template<>
+QImage zoomInPixels<pixel_format::Rgb32>(const QImage& image)
+{
+  return zoomInPlanes(image);
+}
+
+template<>
+QImage zoomInPixels<pixel_format::Argb32>(const QImage& image)
+{
+  return zoomInPlanes(image);
+}
+
+/**
+ * Histogram on the 0 to 255 scale of the red channel, or of the luminance
+ * if the image is not grayscale
+ */
+template<typename Format>
+std::vector<int> histogram(const QImage& image, bool use_luminance)
 {
-  std::vector<int> histogram(256);
+  std::vector<int> histogram_data(256);
   int width = image.width();
   int height = image.height();
 
   for (int row_index = 0; row_index < height; row_index++) {
-    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
+    auto* line = pixel_format::constRow<Format>(image, row_index);
     for (int column_index = 0; column_index < width; column_index++) {
-      auto* pixel = &line[column_index];
-      // Since it is a grayscale image each channel has the same value
-      histogram[static_cast<size_t>(qRed(*pixel))]++;
+      auto value = use_luminance ? Format::clamp(luminance<Format>(line[column_index])) : Format::red(line[column_index]);
+      histogram_data[static_cast<size_t>(Format::toByte(value))]++;
     }
   }
 
-  return histogram;
+  return histogram_data;
+}
+
+/**
+ * Cumulative histogram scaled to 0 to 255, optionally clamped
+ */
+std::vector<int> cumulativeHistogram(const std::vector<int>& histogram_data, int pixel_count, bool clamp)
+{
+  std::vector<int> cumulative_histogram(256);
+  double alpha = 255.0 / pixel_count;
+
+  cumulative_histogram[0] = static_cast<int>(std::round(alpha * histogram_data[0]));
+
+  for (size_t i = 1; i < 256; i++) {
+    cumulative_histogram[i] = cumulative_histogram[i-1] + static_cast<int>(std::round(alpha * histogram_data[i]));
+    if (clamp)
+      cumulative_histogram[i] = std::min(255, cumulative_histogram[i]);
+  }
+
+  return cumulative_histogram;
+}
+
+} // namespace
+
+QImage mirrorHorizontally(QImage image)
+{
+  PROFILE_SCOPE("image_op::mirrorHorizontally", "compute");
+
+  visitPixelFormat(image, [&](auto format) {
+    using Format = decltype(format);
+
+    for (int row_index = 0; row_index < image.height(); row_index++)
+      mirrorRow<Format>(pixel_format::row<Format>(image, row_index), image.width());
+  });
+
+  return image;
+}
+
+QImage mirrorVertically(QImage image)
+{
+  PROFILE_SCOPE("image_op::mirrorVertically", "compute");
+
+  // Swaps entire lines, whatever the format
+  int height = image.height();
+  int bytes_per_line = image.bytesPerLine();
+
+  for (int row_index = 0; row_index < height / 2; row_index++) {
+    uchar* first_line = image.scanLine(row_index);
+    uchar* second_line = image.scanLine(height - 1 - row_index);
+    std::swap_ranges(first_line, first_line + bytes_per_line, second_line);
+  }
+
+  return image;
+}
+
+QImage convertColoredToGrayscale(QImage image)
+{
+  PROFILE_SCOPE("image_op::convertColoredToGrayscale", "compute");
+
+  if (image.isGrayscale())
+    return image;
+
+  return convertToLuminance(std::move(image));
+}
+
+QImage convertToLuminance(QImage image)
+{
+  visitPixelFormat(image, [&](auto format) {
+    using Format = decltype(format);
+
+    mapPixels<Format>(image, [](typename Format::Pixel pixel) {
+      return grayPixel<Format>(Format::clamp(luminance<Format>(pixel)), pixel);
+    });
+  });
+
+  return image;
+}
+
+QImage quantizeGrayscale(QImage image, int num_colors)
+{
+  // Intervals span the tones the image actually has
+  auto luminance = imageStatistics(image).luminance;
+  return quantizeGrayscale(image, num_colors, luminance.minimum, luminance.maximum);
+}
+
+QImage quantizeGrayscale(QImage image, int num_colors, int minimum, int maximum)
+{
+  PROFILE_SCOPE("image_op::quantizeGrayscale", "compute");
+
+  double step = 0;
+  if (num_colors > 1)
+    step = (maximum - minimum) / (num_colors - 1.0);
+
+  visitPixelFormat(image, [&](auto format) {
+    using Format = decltype(format);
+    double format_minimum = Format::fromByteScale(minimum);
+    double format_step = Format::fromByteScale(step);
+
+    mapPixels<Format>(image, [format_minimum, format_step](typename Format::Pixel pixel) {
+      // A single color leaves every pixel at the minimum
+      double color = format_minimum;
+      if (format_step > 0)
+        color += std::round((luminance<Format>(pixel) - format_minimum) / format_step) * format_step;
+      return grayPixel<Format>(Format::clamp(color), pixel);
+    });
+  });
+
+  return image;
+}
+
+std::vector<int> generateGrayscaleHistogramData(QImage image)
+{
+  PROFILE_SCOPE("image_op::generateGrayscaleHistogramData", "compute");
+
+  // Since it is a grayscale image each channel has the same value
+  return visitPixelFormat(image, [&](auto format) {
+    return histogram<decltype(format)>(image, false);
+  });
 }
 
 QPixmap generate2DHistogramPixmap(std::vector<int> histogram_data)
 {
+  PROFILE_SCOPE("image_op::generate2DHistogramPixmap", "compute");
+
   auto max_histogram = std::max_element(histogram_data.begin(), histogram_data.end());
 
   QPixmap histogram(256, 256);
@@ -122,138 +581,95 @@ QPixmap generate2DHistogramPixmap(std::vector<int> histogram_data)
 
 QImage adjustBrightness(QImage image, int brightness_value)
 {
-  int width = image.width();
-  int height = image.height();
+  PROFILE_SCOPE("image_op::adjustBrightness", "compute");
 
-  for (int row_index = 0; row_index < height; row_index++) {
-    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
-    for (int column_index = 0; column_index < width; column_index++) {
-      auto* pixel = &line[column_index];
-      auto red = qRed(*pixel) + brightness_value;
-      red = red > 255 ? 255 : red < 0 ? 0 : red;
-      auto green = qGreen(*pixel) + brightness_value;
-      green = green > 255 ? 255 : green < 0 ? 0 : green;
-      auto blue = qBlue(*pixel) + brightness_value;
-      blue = blue > 255 ? 255 : blue < 0 ? 0 : blue;
-      *pixel = qRgb(red, green, blue);
-    }
-  }
+  visitPixelFormat(image, [&](auto format) {
+    adjustBrightnessRows<decltype(format)>(image, brightness_value);
+  });
 
   return image;
 }
 
 QImage adjustContrast(QImage image, int contrast_factor)
 {
-  int width = image.width();
-  int height = image.height();
+  PROFILE_SCOPE("image_op::adjustContrast", "compute");
 
-  for (int row_index = 0; row_index < height; row_index++) {
-    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
-    for (int column_index = 0; column_index < width; column_index++) {
-      auto* pixel = &line[column_index];
-      auto red = qRed(*pixel) * contrast_factor;
-      red = red > 255 ? 255 : red < 0 ? 0 : red;
-      auto green = qGreen(*pixel) * contrast_factor;
-      green = green > 255 ? 255 : green < 0 ? 0 : green;
-      auto blue = qBlue(*pixel) * contrast_factor;
-      blue = blue > 255 ? 255 : blue < 0 ? 0 : blue;
-      *pixel = qRgb(red, green, blue);
-    }
-  }
+  visitPixelFormat(image, [&](auto format) {
+    adjustContrastRows<decltype(format)>(image, contrast_factor);
+  });
 
   return image;
 }
 
 QImage getNegativeImage(QImage image)
 {
-  int width = image.width();
-  int height = image.height();
+  PROFILE_SCOPE("image_op::getNegativeImage", "compute");
 
-  for (int row_index = 0; row_index < height; row_index++) {
-    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
-    for (int column_index = 0; column_index < width; column_index++) {
-      auto* pixel = &line[column_index];
-      auto red = 255 - qRed(*pixel);
-      auto green = 255 - qGreen(*pixel);
-      auto blue = 255 - qBlue(*pixel);
-      *pixel = qRgb(red, green, blue);
-    }
-  }
+  visitPixelFormat(image, [&](auto format) {
+    negateRows<decltype(format)>(image);
+  });
 
   return image;
 }
 
 QImage equalizeHistogram(QImage image)
 {
-  // TODO(jfguimaraes) Implement L*a*b color space
-  int width = image.width();
-  int height = image.height();
-  std::vector<int> histogram_data;
+  PROFILE_SCOPE("image_op::equalizeHistogram", "compute");
 
-  if (image.isGrayscale())
-    histogram_data = generateGrayscaleHistogramData(image);
-  else
-    histogram_data = generateGrayscaleHistogramData(convertColoredToGrayscale(image));
+  // TODO(jfguimaraes) Implement L*a*b color space
+  // A cached histogram saves the scans of grayscale images
+  HistogramInfo cached_info;
+  bool is_cached = findCachedHistogram(image, &cached_info);
+  bool is_grayscale = is_cached ? cached_info.grayscale : image.isGrayscale();
 
-  std::vector<int> cumulative_histogram(256);
-  double alpha = 255.0 / (width * height);
+  visitPixelFormat(image, [&](auto format) {
+    using Format = decltype(format);
 
-  // Generate cumulative histogram of luminance channel
-  cumulative_histogram[0] = static_cast<int>(std::round(alpha * histogram_data[0]));
+    // Histogram of the luminance channel
+    auto tone_curve = equalizationCurve(is_cached && is_grayscale ? cached_info.histogram
+                                                                  : histogram<Format>(image, !is_grayscale));
 
-  for (size_t i = 1; i < 256; i++)
-    cumulative_histogram[i] = cumulative_histogram[i-1] + static_cast<int>(std::round(alpha * histogram_data[i]));
-
-  // Update pixel values
-  for (int row_index = 0; row_index < height; row_index++) {
-    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
-    for (int column_index = 0; column_index < width; column_index++) {
-      auto* pixel = &line[column_index];
-      auto red = cumulative_histogram[static_cast<size_t>(qRed(*pixel))];
-      auto green = cumulative_histogram[static_cast<size_t>(qGreen(*pixel))];
-      auto blue = cumulative_histogram[static_cast<size_t>(qBlue(*pixel))];
-      *pixel = qRgb(red, green, blue);
-    }
-  }
+    mapColorTones<Format>(image, tone_curve);
+  });
 
   return image;
 }
 
-QImage matchGrayscaleHistogram(QImage original_image, QImage target_image)
+std::vector<int> equalizationCurve(const std::vector<int>& histogram_data)
 {
-  int width = original_image.width();
-  int height = original_image.height();
+  int pixel_count = 0;
+  for (int count : histogram_data)
+    pixel_count += count;
 
-  // Get histograms
-  auto original_histogram_data = generateGrayscaleHistogramData(original_image);
-  auto target_histogram_data = generateGrayscaleHistogramData(target_image);
+  auto tone_curve = cumulativeHistogram(histogram_data, pixel_count, false);
 
-  // Get cumulative histograms
-  // TODO(jfguimaraes) Function for cumulative histograms
-  std::vector<int> original_cumulative_histogram(256);
-  double original_alpha = 255.0 / (width * height);
+  // Like the original implementation the sums of rounded bins are not
+  // clamped, so tones past 255 wrap around
+  for (auto& tone : tone_curve)
+    tone &= 0xff;
 
-  original_cumulative_histogram[0] = static_cast<int>(std::round(original_alpha * original_histogram_data[0]));
+  return tone_curve;
+}
 
-  for (size_t i = 1; i < 256; i++) {
-    original_cumulative_histogram[i] = original_cumulative_histogram[i-1]
-        + static_cast<int>(std::round(original_alpha * original_histogram_data[i]));
-    original_cumulative_histogram[i] = original_cumulative_histogram[i] > 255 ?
-          255 : original_cumulative_histogram[i];
-  }
+QImage matchGrayscaleHistogram(QImage original_image, QImage target_image)
+{
+  PROFILE_SCOPE("image_op::matchGrayscaleHistogram", "compute");
 
-  std::vector<int> target_cumulative_histogram(256);
-  double target_alpha = 255.0 / (target_image.width() * target_image.height());
+  auto map_function = histogramMatchingCurve(cumulativeGrayscaleHistogram(original_image),
+                                             cumulativeGrayscaleHistogram(target_image));
 
-  target_cumulative_histogram[0] = static_cast<int>(std::round(target_alpha * target_histogram_data[0]));
+  // Since it is a grayscale image each channel has the same value
+  return mapGrayTones(std::move(original_image), map_function, false);
+}
 
-  for (size_t i = 1; i < 256; i++) {
-    target_cumulative_histogram[i] = target_cumulative_histogram[i-1]
-        + static_cast<int>(std::round(target_alpha * target_histogram_data[i]));
-    target_cumulative_histogram[i] = target_cumulative_histogram[i] > 255 ?
-          255 : target_cumulative_histogram[i];
-  }
+std::vector<int> cumulativeGrayscaleHistogram(const QImage& image)
+{
+  return cumulativeHistogram(generateGrayscaleHistogramData(image), image.width() * image.height(), true);
+}
 
+std::vector<int> histogramMatchingCurve(const std::vector<int>& original_cumulative_histogram,
+                                        const std::vector<int>& target_cumulative_histogram)
+{
   // For each shade map the closest on the target image to the map function
   std::vector<int> map_function(256);
 
@@ -278,231 +694,212 @@ QImage matchGrayscaleHistogram(QImage original_image, QImage target_image)
     map_function[static_cast<size_t>(i)] = nearest_shade_index;
   }
 
-  // Match histogram using the map function
-  for (int row_index = 0; row_index < height; row_index++) {
-    QRgb* line = reinterpret_cast<QRgb*>(original_image.scanLine(row_index));
-    for (int column_index = 0; column_index < width; column_index++) {
-      auto* pixel = &line[column_index];
-      // Since it is a grayscale image each channel has the same value
-      auto color = map_function[static_cast<size_t>(qRed(*pixel))];
-      *pixel = qRgb(color, color, color);
-    }
-  }
-
-  return original_image;
+  return map_function;
 }
 
-QImage zoomOutByFactors(QImage image, int sx, int sy)
+QImage otsuThreshold(QImage image, int class_count)
 {
-  int original_width = image.width();
-  int original_height = image.height();
+  PROFILE_SCOPE("image_op::otsuThreshold", "compute");
 
-  int target_width = static_cast<int>(ceil(original_width * 1.0 / sx));
-  int target_height = static_cast<int>(ceil(original_height * 1.0 / sy));
+  // A cached histogram saves the statistics pass on grayscale images
+  HistogramInfo cached_info;
+  if (findCachedHistogram(image, &cached_info) && cached_info.grayscale)
+    return mapGrayTones(image, otsuCurve(cached_info.histogram, class_count), false);
 
-  QImage target_image(target_width, target_height, QImage::Format_RGB32);
-
-  QVector<QRgb*> lines(sy);
-
-  for (int row_index = 0, target_row = 0; row_index < original_height; row_index += sy, target_row++) {
-    int rows_read = 0;
-
-    for (int row = row_index, i = 0; row < row_index + sy && row < original_height; row++, i++) {
-      lines[i] = reinterpret_cast<QRgb*>(image.scanLine(row));
-      rows_read++;
-    }
+  auto statistics = imageStatistics(image);
+  const auto& histogram_data = statistics.grayscale ? statistics.red.histogram : statistics.luminance.histogram;
+  return mapGrayTones(image, otsuCurve(histogram_data, class_count), !statistics.grayscale);
+}
 
-    auto target_line = reinterpret_cast<QRgb*>(target_image.scanLine(target_row));
+std::vector<int> otsuThresholds(const std::vector<int>& histogram_data, int class_count)
+{
+  class_count = std::max(1, std::min(256, class_count));
+
+  // Prefix sums of the pixel counts and of the tones of the pixels
+  std::vector<qint64> counts(257);
+  std::vector<qint64> tone_sums(257);
+  for (size_t tone = 0; tone < 256; tone++) {
+    counts[tone + 1] = counts[tone] + histogram_data[tone];
+    tone_sums[tone + 1] = tone_sums[tone] + static_cast<qint64>(tone) * histogram_data[tone];
+  }
 
-    for (int column_index = 0, target_column = 0; column_index < original_width; column_index += sx, target_column++) {
-      int red = 0;
-      int green = 0;
-      int blue = 0;
-      int num_pixels = 0;
+  // Share of the class of tones first to last in the variance between
+  // classes, leaving out the terms every split has in common
+  auto class_term = [&](int first, int last) {
+    qint64 count = counts[static_cast<size_t>(last) + 1] - counts[static_cast<size_t>(first)];
+    if (count == 0)
+      return 0.0;
+    auto sum = static_cast<double>(tone_sums[static_cast<size_t>(last) + 1] - tone_sums[static_cast<size_t>(first)]);
+    return sum * sum / count;
+  };
 
-      for (int column = column_index; column < column_index + sx && column < original_width; column++) {
-        for (int row = 0; row < rows_read; row++) {
-          num_pixels++;
-          red += qRed(lines[row][column]);
-          green += qGreen(lines[row][column]);
-          blue += qBlue(lines[row][column]);
+  // best[c][last] is the largest sum of terms splitting tones 0 to last in
+  // c + 1 classes, split[c][last] the last tone of the class before the
+  // last one in that split
+  std::vector<std::vector<double>> best(static_cast<size_t>(class_count), std::vector<double>(256));
+  std::vector<std::vector<int>> split(static_cast<size_t>(class_count), std::vector<int>(256));
+
+  for (int last = 0; last < 256; last++)
+    best[0][static_cast<size_t>(last)] = class_term(0, last);
+
+  for (size_t c = 1; c < best.size(); c++) {
+    for (int last = static_cast<int>(c); last < 256; last++) {
+      double best_value = -1;
+      for (int previous = static_cast<int>(c) - 1; previous < last; previous++) {
+        double value = best[c - 1][static_cast<size_t>(previous)] + class_term(previous + 1, last);
+        if (value > best_value) {
+          best_value = value;
+          split[c][static_cast<size_t>(last)] = previous;
         }
       }
-
-      red /= num_pixels;
-      green /= num_pixels;
-      blue /= num_pixels;
-
-      auto* pixel = &target_line[target_column];
-      *pixel = qRgb(red, green, blue);
+      best[c][static_cast<size_t>(last)] = best_value;
     }
   }
 
-  return target_image;
+  std::vector<int> thresholds(static_cast<size_t>(class_count) - 1);
+  int last = 255;
+  for (size_t c = thresholds.size(); c > 0; c--) {
+    last = split[c][static_cast<size_t>(last)];
+    thresholds[c - 1] = last;
+  }
+
+  return thresholds;
 }
 
-QImage zoomIn2x2(QImage image)
+std::vector<int> otsuCurve(const std::vector<int>& histogram_data, int class_count)
 {
-  int original_width = image.width();
-  int original_height = image.height();
+  auto thresholds = otsuThresholds(histogram_data, class_count);
+  int steps = static_cast<int>(thresholds.size());
 
-  int target_width = 2 * original_width;
-  int target_height = 2 * original_height;
-
-  QImage target_image(target_width, target_height, QImage::Format_RGB32);
-
-  // Average of two colors
-  auto average = [](QRgb* a, QRgb* b){
-    auto red = (qRed(*a) + qRed(*b)) / 2;
-    auto green = (qGreen(*a) + qGreen(*b)) / 2;
-    auto blue = (qBlue(*a) + qBlue(*b)) / 2;
-    return qRgb(red, green, blue);
-  };
+  std::vector<int> tone_curve(256);
+  int class_index = 0;
 
-  // Between columns
-  for (int row_index = 0; row_index < original_height; row_index++) {
-    int target_row = row_index * 2;
-    auto original_line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
-    auto target_line = reinterpret_cast<QRgb*>(target_image.scanLine(target_row));
-
-    for (int column_index = 0; column_index < original_width; column_index++) {
-      int target_column = column_index * 2;
+  for (int tone = 0; tone < 256; tone++) {
+    while (class_index < steps && tone > thresholds[static_cast<size_t>(class_index)])
+      class_index++;
+    tone_curve[static_cast<size_t>(tone)] = steps > 0 ? (class_index * 255 + steps / 2) / steps : 0;
+  }
 
-      // First pixel is equal
-      auto* original_pixel = &original_line[column_index];
-      auto* target_pixel = &target_line[target_column];
-      *target_pixel = *original_pixel;
+  return tone_curve;
+}
 
-      // Second pixel is the medium between the current and the next (if it exists)
-      target_pixel = &target_line[target_column + 1];
+QImage mapGrayTones(QImage image, const std::vector<int>& tone_curve, bool use_luminance)
+{
+  PROFILE_SCOPE("image_op::mapGrayTones", "compute");
 
-      if (column_index + 2 < original_width) {
-        auto* next_pixel = &original_line[column_index + 2];
-        *target_pixel = average(original_pixel, next_pixel);
-      } else {
-        *target_pixel = *original_pixel;
-      }
-    }
-  }
+  visitPixelFormat(image, [&](auto format) {
+    using Format = decltype(format);
 
-  // Between lines
-  for (int row_index = 0; row_index < target_height; row_index += 2) {
-    auto current_line = reinterpret_cast<QRgb*>(target_image.scanLine(row_index));
-    auto target_line = reinterpret_cast<QRgb*>(target_image.scanLine(row_index + 1));
+    mapPixels<Format>(image, [&](typename Format::Pixel pixel) {
+      auto value = use_luminance ? Format::clamp(luminance<Format>(pixel)) : Format::red(pixel);
+      return grayPixel<Format>(Format::fromByte(tone_curve[static_cast<size_t>(Format::toByte(value))]), pixel);
+    });
+  });
 
-    if (row_index + 2 >= target_height) {
-      std::memcpy(target_line, current_line, static_cast<size_t>(target_width) * sizeof(QRgb));
-      break;
-    }
+  return image;
+}
 
-    auto next_line = reinterpret_cast<QRgb*>(target_image.scanLine(row_index + 2));
+QImage zoomOutByFactors(QImage image, int sx, int sy)
+{
+  PROFILE_SCOPE("image_op::zoomOutByFactors", "compute");
 
-    for (int column_index = 0; column_index < target_width; column_index++) {
-      auto* current_pixel = &current_line[column_index];
-      auto* target_pixel = &target_line[column_index];
-      auto* next_pixel = &next_line[column_index];
+  return visitPixelFormat(image, [&](auto format) {
+    return zoomOutPixels<decltype(format)>(image, sx, sy);
+  });
+}
 
-      *target_pixel = average(current_pixel, next_pixel);
-    }
-  }
+QImage zoomIn2x2(QImage image)
+{
+  PROFILE_SCOPE("image_op::zoomIn2x2", "compute");
 
-  return target_image;
+  return visitPixelFormat(image, [&](auto format) {
+    return zoomInPixels<decltype(format)>(image);
+  });
 }
 
 QImage rotate90DegreesClockwise(QImage image)
 {
-  int width = image.width();
-  int height = image.height();
-
-  // Target image has inverted dimensions
-  QImage target_image(height, width, QImage::Format_RGB32);
+  PROFILE_SCOPE("image_op::rotate90DegreesClockwise", "compute");
 
-  std::vector<QRgb*> original_image_lines;
-  std::vector<QRgb*> target_image_lines;
+  return visitPixelFormat(image, [&](auto format) {
+    using Format = decltype(format);
 
-  for (int i = 0; i < height; i++)
-    original_image_lines.emplace_back(reinterpret_cast<QRgb*>(image.scanLine(i)));
+    int width = image.width();
+    int height = image.height();
 
-  for (int i = 0; i < width; i++)
-    target_image_lines.emplace_back(reinterpret_cast<QRgb*>(target_image.scanLine(i)));
+    // Target image has inverted dimensions
+    QImage target_image = pooledImage(height, width, image.format());
 
-  for (int row_index = 0; row_index < height; row_index++) {
-    for (int column_index = 0; column_index < width; column_index++) {
-      target_image_lines[static_cast<size_t>(column_index)][height - row_index - 1] =
-          original_image_lines[static_cast<size_t>(row_index)][static_cast<size_t>(column_index)];
+    for (int row_index = 0; row_index < height; row_index++) {
+      auto* original_line = pixel_format::constRow<Format>(image, row_index);
+      for (int column_index = 0; column_index < width; column_index++)
+        pixel_format::row<Format>(target_image, column_index)[height - row_index - 1] = original_line[column_index];
     }
-  }
 
-  return target_image;
+    return target_image;
+  });
 }
 
 QImage rotate90DegreesCounterClockwise(QImage image)
 {
-  int width = image.width();
-  int height = image.height();
-
-  // Target image has inverted dimensions
-  QImage target_image(height, width, QImage::Format_RGB32);
+  PROFILE_SCOPE("image_op::rotate90DegreesCounterClockwise", "compute");
 
-  std::vector<QRgb*> original_image_lines;
-  std::vector<QRgb*> target_image_lines;
+  return visitPixelFormat(image, [&](auto format) {
+    using Format = decltype(format);
 
-  for (int i = 0; i < height; i++)
-    original_image_lines.emplace_back(reinterpret_cast<QRgb*>(image.scanLine(i)));
+    int width = image.width();
+    int height = image.height();
 
-  for (int i = 0; i < width; i++)
-    target_image_lines.emplace_back(reinterpret_cast<QRgb*>(target_image.scanLine(i)));
+    // Target image has inverted dimensions
+    QImage target_image = pooledImage(height, width, image.format());
 
-  for (int row_index = 0; row_index < height; row_index++) {
-    for (int column_index = 0; column_index < width; column_index++) {
-      target_image_lines[static_cast<size_t>(width - column_index - 1)][static_cast<size_t>(row_index)] =
-          original_image_lines[static_cast<size_t>(row_index)][static_cast<size_t>(column_index)];
+    for (int row_index = 0; row_index < height; row_index++) {
+      auto* original_line = pixel_format::constRow<Format>(image, row_index);
+      for (int column_index = 0; column_index < width; column_index++)
+        pixel_format::row<Format>(target_image, width - column_index - 1)[row_index] = original_line[column_index];
     }
-  }
 
-  return target_image;
+    return target_image;
+  });
 }
 
 QImage applyConvolutionWith3x3Kernel(QImage image, QVector<QVector<double>> kernel, bool add_bias)
 {
-  int width = image.width();
-  int height = image.height();
+  PROFILE_SCOPE("image_op::applyConvolutionWith3x3Kernel", "compute");
 
-  QImage target_image(width, height, QImage::Format_RGB32);
-  target_image.fill(Qt::black);
+  return visitPixelFormat(image, [&](auto format) {
+    using Format = decltype(format);
 
-  double sum;
-  QVector<QRgb*> original_image_lines;
-  QVector<QRgb*> target_image_lines;
+    int width = image.width();
+    int height = image.height();
+    double bias = Format::fromByteScale(127);
 
-  for (int i = 0; i < height; i++) {
-    original_image_lines.append(reinterpret_cast<QRgb*>(image.scanLine(i)));
-    target_image_lines.append(reinterpret_cast<QRgb*>(target_image.scanLine(i)));
-  }
+    QImage target_image = pooledImage(width, height, image.format());
+    target_image.fill(Qt::black);
 
-  for (int row = 1; row <= height - 2; row++) {
-    for (int column = 1; column <= width - 2; column++) {
-      sum = 0.0;
+    for (int row = 1; row <= height - 2; row++) {
+      auto* target_line = pixel_format::row<Format>(target_image, row);
 
-      for (int k = -1; k <= 1; k++) {
-        for (int j = -1; j <= 1; j++) {
-          // Since it is a grayscale image each channel has the same value
-          sum += kernel[1+j][1+k] * qRed(original_image_lines[row-j][column-k]);
-        }
-      }
+      for (int column = 1; column <= width - 2; column++) {
+        double sum = 0.0;
 
-      if (add_bias)
-        sum += 127;
+        for (int k = -1; k <= 1; k++) {
+          for (int j = -1; j <= 1; j++) {
+            // Since it is a grayscale image each channel has the same value
+            sum += kernel[1+j][1+k] * Format::red(pixel_format::constRow<Format>(image, row - j)[column - k]);
+          }
+        }
 
-      sum = sum > 255 ? 255 : sum < 0 ? 0 : sum;
-      auto color = static_cast<int>(sum);
+        if (add_bias)
+          sum += bias;
 
-      auto& pixel = target_image_lines[row][column];
-      pixel = qRgb(color, color, color);
+        auto color = Format::clamp(sum);
+        target_line[column] = Format::pixel(color, color, color, Format::maximum());
+      }
     }
-  }
 
-  return target_image;
+    return target_image;
+  });
 }
 
 }
@@ -0,0 +1,235 @@
+#include "include/image_statistics.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#include <QCache>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QtConcurrent>
+
+#include "include/histogram_cache.hpp"
+#include "include/pixel_formats.hpp"
+#include "include/profiler.hpp"
+
+namespace image_op {
+
+namespace {
+
+// Statistics kept, a few per image of the edit history
+constexpr int kCachedStatistics = 64;
+
+// Fewer rows than this are not worth a task of their own
+constexpr int kMinimumBandHeight = 32;
+
+enum ChannelIndex { kRed, kGreen, kBlue, kAlpha, kLuminance, kChannelCount };
+
+/**
+ * Sums of a channel over a band of rows, on the scale of the format
+ */
+struct ChannelSums
+{
+  ChannelSums():
+    histogram(256),
+    minimum(std::numeric_limits<qint64>::max()),
+    maximum(std::numeric_limits<qint64>::min()),
+    sum(0),
+    sum_of_squares(0)
+  {}
+
+  void merge(const ChannelSums& other)
+  {
+    for (size_t i = 0; i < 256; i++)
+      histogram[i] += other.histogram[i];
+    minimum = std::min(minimum, other.minimum);
+    maximum = std::max(maximum, other.maximum);
+    sum += other.sum;
+    sum_of_squares += other.sum_of_squares;
+  }
+
+  std::vector<int> histogram;
+  qint64 minimum;
+  qint64 maximum;
+  qint64 sum;
+  qint64 sum_of_squares;
+};
+
+struct Band
+{
+  int first_row;
+  int last_row;
+  ChannelSums channels[kChannelCount];
+  bool grayscale;
+};
+
+struct StatisticsCache
+{
+  StatisticsCache()
+  {
+    statistics.setMaxCost(kCachedStatistics);
+  }
+
+  QMutex mutex;
+  QCache<qint64, ImageStatistics> statistics;
+};
+
+StatisticsCache& cache()
+{
+  static StatisticsCache statistics_cache;
+  return statistics_cache;
+}
+
+/**
+ * Adds a row of one channel to its sums, the minimum, maximum and sums
+ * in a loop of their own the compiler vectorizes, then the histogram
+ * while the row is still in cache
+ */
+template<typename Format, typename ChannelFunction>
+void accumulateRow(const typename Format::Pixel* line, int width, ChannelFunction channel, ChannelSums& sums)
+{
+  qint64 minimum = sums.minimum;
+  qint64 maximum = sums.maximum;
+  qint64 sum = 0;
+  qint64 sum_of_squares = 0;
+
+  for (int column_index = 0; column_index < width; column_index++) {
+    qint64 value = channel(line[column_index]);
+    minimum = std::min(minimum, value);
+    maximum = std::max(maximum, value);
+    sum += value;
+    sum_of_squares += value * value;
+  }
+
+  sums.minimum = minimum;
+  sums.maximum = maximum;
+  sums.sum += sum;
+  sums.sum_of_squares += sum_of_squares;
+
+  for (int column_index = 0; column_index < width; column_index++)
+    sums.histogram[static_cast<size_t>(Format::toByte(channel(line[column_index])))]++;
+}
+
+template<typename Format>
+void accumulateBand(const QImage& image, Band& band)
+{
+  using Pixel = typename Format::Pixel;
+  int width = image.width();
+
+  for (int row_index = band.first_row; row_index < band.last_row; row_index++) {
+    auto* line = pixel_format::constRow<Format>(image, row_index);
+
+    accumulateRow<Format>(line, width, [](Pixel pixel) { return Format::red(pixel); }, band.channels[kRed]);
+    accumulateRow<Format>(line, width, [](Pixel pixel) {
+      return Format::clamp(0.299 * Format::red(pixel) + 0.587 * Format::green(pixel) + 0.114 * Format::blue(pixel));
+    }, band.channels[kLuminance]);
+
+    // Gray formats have equal channels and no alpha, filled in when done
+    if (Format::isGray())
+      continue;
+
+    accumulateRow<Format>(line, width, [](Pixel pixel) { return Format::green(pixel); }, band.channels[kGreen]);
+    accumulateRow<Format>(line, width, [](Pixel pixel) { return Format::blue(pixel); }, band.channels[kBlue]);
+    accumulateRow<Format>(line, width, [](Pixel pixel) { return Format::alpha(pixel); }, band.channels[kAlpha]);
+
+    bool grayscale = true;
+    for (int column_index = 0; column_index < width; column_index++) {
+      Pixel pixel = line[column_index];
+      grayscale &= Format::red(pixel) == Format::green(pixel) && Format::green(pixel) == Format::blue(pixel);
+    }
+    band.grayscale = band.grayscale && grayscale;
+  }
+}
+
+/**
+ * Converts the sums of a channel to the 0 to 255 scale
+ */
+template<typename Format>
+ChannelStatistics channelStatistics(const ChannelSums& sums, qint64 pixel_count)
+{
+  double scale = 255.0 / Format::maximum();
+  double mean = static_cast<double>(sums.sum) / pixel_count;
+  double variance = static_cast<double>(sums.sum_of_squares) / pixel_count - mean * mean;
+
+  return { sums.histogram,
+           Format::toByte(static_cast<typename Format::Channel>(sums.minimum)),
+           Format::toByte(static_cast<typename Format::Channel>(sums.maximum)),
+           mean * scale,
+           std::max(0.0, variance) * scale * scale };
+}
+
+template<typename Format>
+ImageStatistics computeStatistics(const QImage& image)
+{
+  int height = image.height();
+  int band_count = std::max(1, std::min(QThread::idealThreadCount() * 4, height / kMinimumBandHeight));
+  int band_height = (height + band_count - 1) / band_count;
+
+  std::vector<Band> bands;
+  for (int row_index = 0; row_index < height; row_index += band_height) {
+    bands.emplace_back();
+    bands.back().first_row = row_index;
+    bands.back().last_row = std::min(height, row_index + band_height);
+    bands.back().grayscale = true;
+  }
+
+  QtConcurrent::blockingMap(bands, [&image](Band& band) {
+    accumulateBand<Format>(image, band);
+  });
+
+  Band& total = bands.front();
+  for (size_t i = 1; i < bands.size(); i++) {
+    for (int channel = 0; channel < kChannelCount; channel++)
+      total.channels[channel].merge(bands[i].channels[channel]);
+    total.grayscale = total.grayscale && bands[i].grayscale;
+  }
+
+  qint64 pixel_count = static_cast<qint64>(image.width()) * height;
+  ImageStatistics statistics;
+  statistics.pixel_count = pixel_count;
+  statistics.grayscale = total.grayscale;
+  statistics.red = channelStatistics<Format>(total.channels[kRed], pixel_count);
+  statistics.luminance = channelStatistics<Format>(total.channels[kLuminance], pixel_count);
+
+  if (Format::isGray()) {
+    statistics.green = statistics.red;
+    statistics.blue = statistics.red;
+    statistics.alpha = { std::vector<int>(256), 255, 255, 255.0, 0.0 };
+    statistics.alpha.histogram[255] = static_cast<int>(pixel_count);
+  } else {
+    statistics.green = channelStatistics<Format>(total.channels[kGreen], pixel_count);
+    statistics.blue = channelStatistics<Format>(total.channels[kBlue], pixel_count);
+    statistics.alpha = channelStatistics<Format>(total.channels[kAlpha], pixel_count);
+  }
+
+  return statistics;
+}
+
+} // namespace
+
+ImageStatistics imageStatistics(const QImage& image)
+{
+  {
+    QMutexLocker locker(&cache().mutex);
+    if (auto* cached_statistics = cache().statistics.object(image.cacheKey()))
+      return *cached_statistics;
+  }
+
+  if (image.isNull())
+    return { 0, true, {}, {}, {}, {}, {} };
+
+  PROFILE_SCOPE("image_op::imageStatistics", "compute");
+
+  QImage scanned_image = image;
+  ImageStatistics statistics = visitPixelFormat(scanned_image, [&](auto format) {
+    return computeStatistics<decltype(format)>(scanned_image);
+  });
+
+  cacheHistogram(image, { statistics.red.histogram, statistics.grayscale });
+
+  QMutexLocker locker(&cache().mutex);
+  cache().statistics.insert(image.cacheKey(), new ImageStatistics(statistics));
+  return statistics;
+}
+
+} // namespace image_op
@@ -0,0 +1,342 @@
+#include "include/integral_image.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <QThread>
+#include <QtConcurrent>
+
+#include "include/image_buffer_pool.hpp"
+#include "include/pixel_formats.hpp"
+#include "include/profiler.hpp"
+
+namespace image_op {
+
+namespace {
+
+// Fewer rows than this are not worth a task of their own
+constexpr int kMinimumBandHeight = 32;
+
+/**
+ * Bands of rows spread over the global thread pool
+ */
+std::vector<int> bandStarts(int height, int* band_height)
+{
+  int band_count = std::max(1, std::min(QThread::idealThreadCount() * 4, height / kMinimumBandHeight));
+  *band_height = (height + band_count - 1) / band_count;
+
+  std::vector<int> starts;
+  for (int row_index = 0; row_index < height; row_index += *band_height)
+    starts.push_back(row_index);
+  return starts;
+}
+
+/**
+ * Reads one channel of a row of pixels
+ */
+template<typename Format>
+void readChannel(const typename Format::Pixel* line, int width, IntegralImage::Channel channel, qint64* values)
+{
+  switch (channel) {
+  case IntegralImage::Red:
+    for (int column_index = 0; column_index < width; column_index++)
+      values[column_index] = Format::red(line[column_index]);
+    break;
+  case IntegralImage::Green:
+    for (int column_index = 0; column_index < width; column_index++)
+      values[column_index] = Format::green(line[column_index]);
+    break;
+  case IntegralImage::Blue:
+    for (int column_index = 0; column_index < width; column_index++)
+      values[column_index] = Format::blue(line[column_index]);
+    break;
+  case IntegralImage::Alpha:
+    for (int column_index = 0; column_index < width; column_index++)
+      values[column_index] = Format::alpha(line[column_index]);
+    break;
+  case IntegralImage::Luminance:
+    for (int column_index = 0; column_index < width; column_index++) {
+      auto pixel = line[column_index];
+      auto red = Format::red(pixel);
+      if (red == Format::green(pixel) && red == Format::blue(pixel))
+        values[column_index] = red;
+      else
+        values[column_index] = Format::clamp(0.299 * red + 0.587 * Format::green(pixel) + 0.114 * Format::blue(pixel));
+    }
+    break;
+  }
+}
+
+struct TableBand
+{
+  int first_row;
+  int last_row;
+  // Sums of each column over the band, then over every row above it
+  std::vector<qint64> column_sums;
+  std::vector<qint64> column_squares;
+};
+
+template<typename Format>
+void buildTables(const QImage& image, IntegralImage::Channel channel,
+                 std::vector<qint64>& sums, std::vector<qint64>* squares)
+{
+  int width = image.width();
+  int height = image.height();
+  auto stride = static_cast<size_t>(width) + 1;
+
+  sums.assign(stride * (static_cast<size_t>(height) + 1), 0);
+  if (squares)
+    squares->assign(sums.size(), 0);
+
+  int band_height;
+  std::vector<TableBand> bands;
+  for (int first_row : bandStarts(height, &band_height))
+    bands.push_back({ first_row, std::min(height, first_row + band_height), {}, {} });
+
+  // Column sums of each band, reading only the image
+  QtConcurrent::blockingMap(bands, [&](TableBand& band) {
+    std::vector<qint64> values(static_cast<size_t>(width));
+    band.column_sums.assign(static_cast<size_t>(width), 0);
+    if (squares)
+      band.column_squares.assign(static_cast<size_t>(width), 0);
+
+    for (int row_index = band.first_row; row_index < band.last_row; row_index++) {
+      readChannel<Format>(pixel_format::constRow<Format>(image, row_index), width, channel, values.data());
+      for (size_t i = 0; i < values.size(); i++)
+        band.column_sums[i] += values[i];
+      if (squares) {
+        for (size_t i = 0; i < values.size(); i++)
+          band.column_squares[i] += values[i] * values[i];
+      }
+    }
+  });
+
+  // Turned into the sums of the rows above each band
+  std::vector<qint64> carried_sums(static_cast<size_t>(width));
+  std::vector<qint64> carried_squares(squares ? static_cast<size_t>(width) : 0);
+  for (auto& band : bands) {
+    std::swap(band.column_sums, carried_sums);
+    for (size_t i = 0; i < carried_sums.size(); i++)
+      carried_sums[i] += band.column_sums[i];
+
+    if (squares) {
+      std::swap(band.column_squares, carried_squares);
+      for (size_t i = 0; i < carried_squares.size(); i++)
+        carried_squares[i] += band.column_squares[i];
+    }
+  }
+
+  // Each row of a table is the prefix sum of the column sums up to it
+  QtConcurrent::blockingMap(bands, [&](TableBand& band) {
+    std::vector<qint64> values(static_cast<size_t>(width));
+
+    for (int row_index = band.first_row; row_index < band.last_row; row_index++) {
+      readChannel<Format>(pixel_format::constRow<Format>(image, row_index), width, channel, values.data());
+      qint64* sums_line = sums.data() + (static_cast<size_t>(row_index) + 1) * stride;
+      qint64 running_sum = 0;
+
+      for (size_t i = 0; i < values.size(); i++) {
+        band.column_sums[i] += values[i];
+        running_sum += band.column_sums[i];
+        sums_line[i + 1] = running_sum;
+      }
+
+      if (!squares)
+        continue;
+
+      qint64* squares_line = squares->data() + (static_cast<size_t>(row_index) + 1) * stride;
+      qint64 running_squares = 0;
+
+      for (size_t i = 0; i < values.size(); i++) {
+        band.column_squares[i] += values[i] * values[i];
+        running_squares += band.column_squares[i];
+        squares_line[i + 1] = running_squares;
+      }
+    }
+  });
+}
+
+/**
+ * Clipped extent of a window of size pixels centered on position
+ */
+void windowRange(int position, int size, int length, int* first, int* last)
+{
+  *first = std::max(0, position - size / 2);
+  *last = std::min(length, position - size / 2 + size);
+}
+
+/**
+ * Calls function(line, row_index, top, bottom) for each row of the image,
+ * in bands over the global thread pool, with the rows of the window
+ * centered on it
+ */
+template<typename Format, typename Function>
+void forEachWindowRow(QImage& target_image, int window_height, Function function)
+{
+  int height = target_image.height();
+  // Taken once, scanLine would detach from every thread
+  uchar* target_bits = target_image.bits();
+  int target_bytes_per_line = target_image.bytesPerLine();
+
+  int band_height;
+  std::vector<int> bands = bandStarts(height, &band_height);
+
+  QtConcurrent::blockingMap(bands, [&](int first_row) {
+    for (int row_index = first_row; row_index < std::min(height, first_row + band_height); row_index++) {
+      auto* line = reinterpret_cast<typename Format::Pixel*>(target_bits + static_cast<qint64>(row_index) * target_bytes_per_line);
+      int top;
+      int bottom;
+      windowRange(row_index, window_height, height, &top, &bottom);
+      function(line, row_index, top, bottom);
+    }
+  });
+}
+
+template<typename Format>
+QImage blurChannels(const QImage& image, int box_width, int box_height)
+{
+  using Channel = typename Format::Channel;
+
+  int width = image.width();
+  QImage target_image = pooledImage(width, image.height(), image.format());
+
+  // One table at a time, so memory holds a single channel of sums
+  std::vector<IntegralImage::Channel> channels = { IntegralImage::Red };
+  if (!Format::isGray())
+    channels = { IntegralImage::Red, IntegralImage::Green, IntegralImage::Blue };
+  if (Format::hasAlpha())
+    channels.push_back(IntegralImage::Alpha);
+
+  for (auto channel : channels) {
+    IntegralImage table(image, channel);
+
+    forEachWindowRow<Format>(target_image, box_height, [&](typename Format::Pixel* line, int, int top, int bottom) {
+      for (int column_index = 0; column_index < width; column_index++) {
+        int left;
+        int right;
+        windowRange(column_index, box_width, width, &left, &right);
+
+        qint64 count = static_cast<qint64>(right - left) * (bottom - top);
+        auto mean = static_cast<Channel>((table.sum(left, top, right, bottom) + count / 2) / count);
+        auto pixel = line[column_index];
+
+        switch (channel) {
+        case IntegralImage::Red:
+          line[column_index] = Format::pixel(mean, mean, mean, Format::maximum());
+          break;
+        case IntegralImage::Green:
+          line[column_index] = Format::pixel(Format::red(pixel), mean, Format::blue(pixel), Format::alpha(pixel));
+          break;
+        case IntegralImage::Blue:
+          line[column_index] = Format::pixel(Format::red(pixel), Format::green(pixel), mean, Format::alpha(pixel));
+          break;
+        default:
+          line[column_index] = Format::pixel(Format::red(pixel), Format::green(pixel), Format::blue(pixel), mean);
+          break;
+        }
+      }
+    });
+  }
+
+  return target_image;
+}
+
+/**
+ * Sets each pixel white or black by whether its luminance passes
+ * is_white(value, left, top, right, bottom), keeping alpha
+ */
+template<typename Format, typename ThresholdFunction>
+QImage binarize(const QImage& image, int window_size, ThresholdFunction is_white)
+{
+  int width = image.width();
+  QImage target_image = pooledImage(width, image.height(), image.format());
+
+  forEachWindowRow<Format>(target_image, window_size, [&](typename Format::Pixel* line, int row_index, int top, int bottom) {
+    auto* original_line = pixel_format::constRow<Format>(image, row_index);
+    std::vector<qint64> values(static_cast<size_t>(width));
+    readChannel<Format>(original_line, width, IntegralImage::Luminance, values.data());
+
+    for (int column_index = 0; column_index < width; column_index++) {
+      int left;
+      int right;
+      windowRange(column_index, window_size, width, &left, &right);
+
+      auto color = is_white(values[static_cast<size_t>(column_index)], left, top, right, bottom) ? Format::maximum() : 0;
+      line[column_index] = Format::pixel(color, color, color, Format::alpha(original_line[column_index]));
+    }
+  });
+
+  return target_image;
+}
+
+} // namespace
+
+IntegralImage::IntegralImage():
+  width_(0),
+  height_(0)
+{}
+
+IntegralImage::IntegralImage(const QImage& image, Channel channel, bool with_squares):
+  width_(image.width()),
+  height_(image.height())
+{
+  if (image.isNull())
+    return;
+
+  PROFILE_SCOPE("image_op::IntegralImage", "compute");
+
+  QImage scanned_image = image;
+  visitPixelFormat(scanned_image, [&](auto format) {
+    buildTables<decltype(format)>(scanned_image, channel, sums_, with_squares ? &squares_ : nullptr);
+  });
+}
+
+double IntegralImage::variance(int left, int top, int right, int bottom) const
+{
+  double count = static_cast<double>(area(left, top, right, bottom));
+  double mean = sum(left, top, right, bottom) / count;
+  return std::max(0.0, sumOfSquares(left, top, right, bottom) / count - mean * mean);
+}
+
+QImage boxBlur(QImage image, int box_width, int box_height)
+{
+  PROFILE_SCOPE("image_op::boxBlur", "compute");
+
+  return visitPixelFormat(image, [&](auto format) {
+    return blurChannels<decltype(format)>(image, box_width, box_height);
+  });
+}
+
+QImage sauvolaThreshold(QImage image, int window_size, double k)
+{
+  PROFILE_SCOPE("image_op::sauvolaThreshold", "compute");
+
+  IntegralImage table(image, IntegralImage::Luminance, true);
+
+  return visitPixelFormat(image, [&](auto format) {
+    using Format = decltype(format);
+    double range = (static_cast<double>(Format::maximum()) + 1) / 2;
+
+    return binarize<Format>(image, window_size, [&](qint64 value, int left, int top, int right, int bottom) {
+      double mean = table.mean(left, top, right, bottom);
+      double deviation = std::sqrt(table.variance(left, top, right, bottom));
+      return value > mean * (1 + k * (deviation / range - 1));
+    });
+  });
+}
+
+QImage bradleyThreshold(QImage image, int window_size, double t)
+{
+  PROFILE_SCOPE("image_op::bradleyThreshold", "compute");
+
+  IntegralImage table(image, IntegralImage::Luminance);
+
+  return visitPixelFormat(image, [&](auto format) {
+    return binarize<decltype(format)>(image, window_size, [&](qint64 value, int left, int top, int right, int bottom) {
+      qint64 count = static_cast<qint64>(right - left) * (bottom - top);
+      return value * count > table.sum(left, top, right, bottom) * (1 - t);
+    });
+  });
+}
+
+} // namespace image_op
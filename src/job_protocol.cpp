@@ -0,0 +1,107 @@
+#include "include/job_protocol.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QLocalSocket>
+
+#include "include/image_buffer_pool.hpp"
+
+namespace job_protocol {
+
+const char kDefaultServerName[] = "photochopp";
+
+bool readMessage(QLocalSocket* socket, QJsonObject* message, QByteArray* payload)
+{
+  QDataStream stream(socket);
+  stream.setVersion(QDataStream::Qt_5_6);
+
+  QByteArray json;
+  stream.startTransaction();
+  stream >> json >> *payload;
+  if (!stream.commitTransaction())
+    return false;
+
+  *message = QJsonDocument::fromJson(json).object();
+  return true;
+}
+
+bool waitForMessage(QLocalSocket* socket, QJsonObject* message, QByteArray* payload, int timeout_ms)
+{
+  QElapsedTimer timer;
+  timer.start();
+
+  while (!readMessage(socket, message, payload)) {
+    int remaining_ms = timeout_ms - static_cast<int>(timer.elapsed());
+    if (remaining_ms <= 0 || !socket->waitForReadyRead(remaining_ms))
+      return false;
+  }
+
+  return true;
+}
+
+void writeMessage(QLocalSocket* socket, const QJsonObject& message, const QByteArray& payload)
+{
+  QDataStream stream(socket);
+  stream.setVersion(QDataStream::Qt_5_6);
+  stream << QJsonDocument(message).toJson(QJsonDocument::Compact) << payload;
+}
+
+void describeImage(const QImage& image, QJsonObject* message)
+{
+  (*message)["width"] = image.width();
+  (*message)["height"] = image.height();
+  (*message)["format"] = static_cast<int>(image.format());
+  (*message)["bytes_per_line"] = image.bytesPerLine();
+}
+
+qint64 describedImageBytes(const QJsonObject& message)
+{
+  int width = message["width"].toInt();
+  int height = message["height"].toInt();
+  int format = message["format"].toInt();
+  int bytes_per_line = message["bytes_per_line"].toInt();
+
+  if (width <= 0 || height <= 0 || format <= QImage::Format_Invalid || format >= QImage::NImageFormats)
+    return -1;
+
+  // Each row must hold its pixels
+  int depth = QImage(1, 1, static_cast<QImage::Format>(format)).depth();
+  if (bytes_per_line < (static_cast<qint64>(width) * depth + 7) / 8)
+    return -1;
+
+  return static_cast<qint64>(bytes_per_line) * height;
+}
+
+QImage copyDescribedImage(const QJsonObject& message, const uchar* pixels, qint64 size)
+{
+  qint64 bytes = describedImageBytes(message);
+  if (bytes < 0 || size < bytes)
+    return QImage();
+
+  int height = message["height"].toInt();
+  int bytes_per_line = message["bytes_per_line"].toInt();
+  QImage image = image_op::pooledImage(message["width"].toInt(), height,
+                                       static_cast<QImage::Format>(message["format"].toInt()));
+  if (image.isNull())
+    return image;
+
+  // Rows of the pool are aligned, so they may be wider than the ones sent
+  int row_bytes = std::min(bytes_per_line, image.bytesPerLine());
+  for (int row_index = 0; row_index < height; row_index++)
+    std::memcpy(image.scanLine(row_index), pixels + static_cast<qint64>(row_index) * bytes_per_line,
+                static_cast<size_t>(row_bytes));
+
+  return image;
+}
+
+QByteArray imagePixels(const QImage& image)
+{
+  // Rows follow each other bytesPerLine apart, pooled images included
+  return QByteArray(reinterpret_cast<const char*>(image.constBits()), image.bytesPerLine() * image.height());
+}
+
+} // namespace job_protocol
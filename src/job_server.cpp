@@ -0,0 +1,177 @@
+#include "include/job_server.hpp"
+
+#include <algorithm>
+
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QLocalSocket>
+#include <QPointer>
+#include <QSharedMemory>
+#include <QtConcurrent>
+
+#include "include/job_protocol.hpp"
+#include "include/profiler.hpp"
+#include "include/tile_pipeline.hpp"
+
+namespace {
+
+// Time a running server has to answer before its socket counts as stale
+constexpr int kProbeTimeout = 1000;
+
+struct JobReply
+{
+  QJsonObject message;
+  QByteArray payload;
+};
+
+/**
+ * Input image of a job, from its file or its shared memory segment
+ */
+QImage readJobInput(const QJsonObject& job, QString* error)
+{
+  if (job.contains("input")) {
+    PROFILE_SCOPE("QImageReader::read", "decode");
+
+    QImageReader reader(job["input"].toString());
+    QImage image = reader.read();
+    if (image.isNull())
+      *error = reader.errorString();
+    return image;
+  }
+
+  if (job.contains("shared_memory")) {
+    QSharedMemory shared_memory(job["shared_memory"].toString());
+    if (!shared_memory.attach(QSharedMemory::ReadOnly)) {
+      *error = shared_memory.errorString();
+      return QImage();
+    }
+
+    // Copied so the client may reuse the segment once the job is done
+    shared_memory.lock();
+    QImage image = job_protocol::copyDescribedImage(job, static_cast<const uchar*>(shared_memory.constData()),
+                                                    shared_memory.size());
+    shared_memory.unlock();
+
+    if (image.isNull())
+      *error = "The image described does not fit the shared memory or cannot be allocated";
+    return image;
+  }
+
+  *error = "The job has no input";
+  return QImage();
+}
+
+JobReply runJob(const QJsonObject& job)
+{
+  PROFILE_SCOPE("JobServer::runJob", "compute");
+
+  QElapsedTimer timer;
+  timer.start();
+
+  JobReply reply;
+  reply.message["id"] = job["id"];
+
+  auto fail = [&](const QString& error) {
+    reply.message["ok"] = false;
+    reply.message["error"] = error;
+    return reply;
+  };
+
+  QVector<image_op::PipelineStage> stages;
+  QString error;
+  if (!image_op::parsePipelineStages(job["operations"].toString(), &stages, &error))
+    return fail(error);
+
+  QImage image = readJobInput(job, &error);
+  if (image.isNull())
+    return fail(error);
+
+  image = image_op::applyPipeline(image, stages);
+  if (image.isNull())
+    return fail("The operations do not apply to the image");
+
+  if (job.contains("output")) {
+    PROFILE_SCOPE("QImageWriter::write", "encode");
+
+    QImageWriter writer(job["output"].toString());
+    if (!writer.write(image))
+      return fail(writer.errorString());
+  } else {
+    reply.payload = job_protocol::imagePixels(image);
+  }
+
+  reply.message["ok"] = true;
+  job_protocol::describeImage(image, &reply.message);
+  reply.message["milliseconds"] = timer.nsecsElapsed() / 1e6;
+  return reply;
+}
+
+} // namespace
+
+JobServer::JobServer(int concurrent_jobs, QObject* parent):
+  QObject(parent)
+{
+  pool_.setMaxThreadCount(std::max(1, concurrent_jobs));
+  // Workers stay alive between jobs instead of the default 30 seconds
+  pool_.setExpiryTimeout(-1);
+
+  connect(&server_, &QLocalServer::newConnection, this, &JobServer::acceptClients);
+}
+
+JobServer::~JobServer()
+{
+  server_.close();
+  pool_.waitForDone();
+}
+
+bool JobServer::listen(const QString& name, QString* error)
+{
+  // Only a socket nobody answers on, left behind by a crash, is replaced
+  QLocalSocket probe;
+  probe.connectToServer(name);
+  if (probe.waitForConnected(kProbeTimeout)) {
+    *error = QString("A server is already running on %1").arg(name);
+    return false;
+  }
+
+  QLocalServer::removeServer(name);
+  server_.setSocketOptions(QLocalServer::UserAccessOption);
+
+  if (!server_.listen(name)) {
+    *error = server_.errorString();
+    return false;
+  }
+
+  return true;
+}
+
+void JobServer::acceptClients()
+{
+  while (QLocalSocket* socket = server_.nextPendingConnection()) {
+    connect(socket, &QLocalSocket::readyRead, this, [this, socket]() { readJobs(socket); });
+    connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+  }
+}
+
+void JobServer::readJobs(QLocalSocket* socket)
+{
+  QJsonObject job;
+  QByteArray payload;
+
+  while (job_protocol::readMessage(socket, &job, &payload)) {
+    // The socket may be gone by the time the job finishes
+    QPointer<QLocalSocket> client(socket);
+    auto* watcher = new QFutureWatcher<JobReply>(this);
+
+    connect(watcher, &QFutureWatcher<JobReply>::finished, this, [watcher, client]() {
+      JobReply reply = watcher->result();
+      if (client)
+        job_protocol::writeMessage(client, reply.message, reply.payload);
+      watcher->deleteLater();
+    });
+
+    watcher->setFuture(QtConcurrent::run(&pool_, runJob, job));
+  }
+}
@@ -1,8 +1,138 @@
 #include "include/mainwindow.hpp"
 #include <QApplication>
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QThread>
+
+#include "include/frame_sequence.hpp"
+#include "include/job_protocol.hpp"
+#include "include/job_server.hpp"
+#include "include/tile_pipeline.hpp"
+
+namespace {
+
+/**
+ * Runs a chain of operations over a numbered frame sequence without
+ * opening a window
+ */
+int runSequence(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("PhotoChopp");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Applies a chain of operations to every frame of a numbered sequence");
+    parser.addHelpOption();
+
+    QCommandLineOption sequence_option("sequence", "Input frames, a run of # standing for the frame number, "
+                                       "like shot_####.png.", "pattern");
+    QCommandLineOption output_option("output", "Output frames, named like the input ones.", "pattern");
+    QCommandLineOption operations_option("operations", "Comma separated operations with their parameters "
+                                         "after colons, like equalize,match_histogram,box_blur:5:5.", "list");
+    QCommandLineOption reference_option("reference", "Image every frame is matched to by match_histogram.", "file");
+    QCommandLineOption first_option("first", "First frame processed.", "frame", "-1");
+    QCommandLineOption last_option("last", "Last frame processed.", "frame", "-1");
+    QCommandLineOption queue_option("queue", "Frames held between decoding, processing and encoding.", "frames", "2");
+    parser.addOptions({ sequence_option, output_option, operations_option, reference_option,
+                        first_option, last_option, queue_option });
+    parser.process(app);
+
+    image_op::FrameSequenceJob job;
+    job.input_pattern = parser.value(sequence_option);
+    job.output_pattern = parser.value(output_option);
+    job.first_frame = parser.value(first_option).toInt();
+    job.last_frame = parser.value(last_option).toInt();
+    job.queue_capacity = parser.value(queue_option).toInt();
+
+    QString error;
+    if (!image_op::parsePipelineStages(parser.value(operations_option), &job.stages, &error)) {
+        std::fprintf(stderr, "%s\n", qPrintable(error));
+        return 1;
+    }
+
+    if (parser.isSet(reference_option)) {
+        job.reference = QImage(parser.value(reference_option));
+        if (job.reference.isNull()) {
+            std::fprintf(stderr, "Cannot read %s\n", qPrintable(parser.value(reference_option)));
+            return 1;
+        }
+    }
+
+    bool ok = image_op::processFrameSequence(job, [](int frame, int written, int total) {
+        std::printf("Frame %d written (%d of %d)\n", frame, written, total);
+        std::fflush(stdout);
+    }, &error);
+
+    if (!ok) {
+        std::fprintf(stderr, "%s\n", qPrintable(error));
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Serves jobs on a local socket until the process is stopped
+ */
+int runServer(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("PhotoChopp");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs chains of operations for clients on the same machine");
+    parser.addHelpOption();
+
+    QCommandLineOption serve_option("serve", "Listens for jobs instead of opening a window.");
+    QCommandLineOption name_option("name", "Name of the local socket.", "name", job_protocol::kDefaultServerName);
+    QCommandLineOption jobs_option("jobs", "Jobs running at once, each over all the cores.", "count",
+                                   QString::number(std::max(1, QThread::idealThreadCount() / 4)));
+    parser.addOptions({ serve_option, name_option, jobs_option });
+    parser.process(app);
+
+    JobServer server(parser.value(jobs_option).toInt());
+
+    QString error;
+    if (!server.listen(parser.value(name_option), &error)) {
+        std::fprintf(stderr, "%s\n", qPrintable(error));
+        return 1;
+    }
+
+    std::printf("Listening on %s\n", qPrintable(parser.value(name_option)));
+    std::fflush(stdout);
+    return app.exec();
+}
+
+/**
+ * Whether the option is given, alone or with its value after =, looked up
+ * before the application is created since modes without windows need a
+ * different one
+ */
+bool hasOption(int argc, char *argv[], const char* option)
+{
+    size_t length = std::strlen(option);
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], option, length) == 0 && (argv[i][length] == '\0' || argv[i][length] == '='))
+            return true;
+    }
+
+    return false;
+}
+
+} // namespace
+
 int main(int argc, char *argv[])
 {
+    if (hasOption(argc, argv, "--sequence"))
+        return runSequence(argc, argv);
+    if (hasOption(argc, argv, "--serve"))
+        return runServer(argc, argv);
+
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
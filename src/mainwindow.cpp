@@ -15,56 +15,81 @@
 #include <QImageWriter>
 #include <QScreen>
 #include <QPainter>
-
+#include <QCheckBox>
+#include <QDialogButtonBox>
+#include <QDockWidget>
+#include <QDoubleSpinBox>
+#include <QFormLayout>
+#include <QSpinBox>
+#include <QTransform>
+
+#include "include/histogram_cache.hpp"
+#include "include/image_comparison.hpp"
 #include "include/image_operations.hpp"
+#include "include/image_statistics.hpp"
+#include "include/operation_registry.hpp"
+#include "include/preview_panel.hpp"
+#include "include/profiler.hpp"
 
 MainWindow::MainWindow(QWidget *parent):
   QMainWindow(parent),
   is_first_dialog_(false),
+  graph_head_(-1),
+  preview_node_(-1),
   horizontal_layout_(&central_widget_)
 {
   // Left image
   image_title_left_ = new QLabel;
   image_title_left_->setText("Original image");
 
-  image_label_left_ = new QLabel;
-  image_label_left_->setBackgroundRole(QPalette::Dark);
-  image_label_left_->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
-  image_label_left_->setScaledContents(true);
-  image_label_left_->setMinimumSize(1, 1);
-
-  scroll_area_left_ = new QScrollArea;
-  scroll_area_left_->setBackgroundRole(QPalette::Dark);
-  scroll_area_left_->setWidget(image_label_left_);
-  scroll_area_left_->setAlignment(Qt::AlignHCenter | Qt::AlignVCenter);
+  image_view_left_ = new TiledImageView;
 
   // Right image
   image_title_right_ = new QLabel;
   image_title_right_->setText("Modified image");
 
-  image_label_right_ = new QLabel;
-  image_label_right_->setBackgroundRole(QPalette::Dark);
-  image_label_right_->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
-  image_label_right_->setScaledContents(true);
-  image_label_right_->setMinimumSize(1, 1);
-
-  scroll_area_right_ = new QScrollArea;
-  scroll_area_right_->setBackgroundRole(QPalette::Dark);
-  scroll_area_right_->setWidget(image_label_right_);
-  scroll_area_right_->setAlignment(Qt::AlignHCenter | Qt::AlignVCenter);
+  image_view_right_ = new TiledImageView;
+  connect(image_view_right_, &TiledImageView::selectionChanged, this, &MainWindow::selectionChanged);
 
   // Show images side by side with titles on top
   vertical_layout_left_.addWidget(image_title_left_);
-  vertical_layout_left_.addWidget(scroll_area_left_);
+  vertical_layout_left_.addWidget(image_view_left_);
 
   vertical_layout_right_.addWidget(image_title_right_);
-  vertical_layout_right_.addWidget(scroll_area_right_);
+  vertical_layout_right_.addWidget(image_view_right_);
 
   horizontal_layout_.addLayout(&vertical_layout_left_);
   horizontal_layout_.addLayout(&vertical_layout_right_);
 
   setCentralWidget(&central_widget_);
 
+  // Operations applied to the current image, double click changes parameters
+  operations_list_ = new QListWidget;
+  connect(operations_list_, &QListWidget::itemDoubleClicked, this, &MainWindow::editOperation);
+
+  QDockWidget* operations_dock = new QDockWidget(tr("Operations"), this);
+  operations_dock->setWidget(operations_list_);
+  addDockWidget(Qt::RightDockWidgetArea, operations_dock);
+
+  // Statistics of the current image
+  statistics_label_ = new QLabel;
+  statistics_label_->setAlignment(Qt::AlignTop | Qt::AlignLeft);
+  statistics_label_->setTextInteractionFlags(Qt::TextSelectableByMouse);
+
+  statistics_dock_ = new QDockWidget(tr("Statistics"), this);
+  statistics_dock_->setWidget(statistics_label_);
+  addDockWidget(Qt::RightDockWidgetArea, statistics_dock_);
+  updateStatisticsPanel();
+
+  // Thumbnails of a folder, activating one opens it
+  thumbnail_browser_ = new ThumbnailBrowser;
+  connect(thumbnail_browser_, &ThumbnailBrowser::fileActivated, this, &MainWindow::loadFile);
+
+  browser_dock_ = new QDockWidget(tr("Browser"), this);
+  browser_dock_->setWidget(thumbnail_browser_);
+  addDockWidget(Qt::LeftDockWidgetArea, browser_dock_);
+  browser_dock_->hide();
+
   createActions();
 
   resize(QGuiApplication::primaryScreen()->availableSize() * 3 / 5);
@@ -77,17 +102,46 @@ void MainWindow::createActions()
   QAction *open_action = file_menu->addAction(tr("&Open..."), this, &MainWindow::open);
   open_action->setShortcut(QKeySequence::Open);
 
+  file_menu->addAction(tr("&Browse Folder..."), this, &MainWindow::browseFolder);
+
   save_as_action_ = file_menu->addAction(tr("&Save As..."), this, &MainWindow::saveAs);
   save_as_action_->setShortcut(QKeySequence::Save);
   save_as_action_->setEnabled(false);
 
   file_menu->addSeparator();
 
+  file_menu->addAction(tr("Export Performance &Trace..."), this, &MainWindow::exportTrace);
+
+  file_menu->addSeparator();
+
   QAction *exit_action = file_menu->addAction(tr("E&xit"), this, &QWidget::close);
   exit_action->setShortcut(tr("Ctrl+Q"));
 
   QMenu *edit_menu = menuBar()->addMenu(tr("&Edit"));
 
+  undo_action_ = edit_menu->addAction(tr("&Undo"), this, &MainWindow::undo);
+  undo_action_->setShortcut(QKeySequence::Undo);
+  undo_action_->setEnabled(false);
+
+  redo_action_ = edit_menu->addAction(tr("Re&do"), this, &MainWindow::redo);
+  redo_action_->setShortcut(QKeySequence::Redo);
+  redo_action_->setEnabled(false);
+
+  edit_menu->addAction(tr("History &Memory Limit..."), this, &MainWindow::setHistoryMemoryLimit);
+
+  edit_menu->addSeparator();
+
+  select_region_action_ = edit_menu->addAction(tr("&Select Region"));
+  select_region_action_->setCheckable(true);
+  select_region_action_->setEnabled(false);
+  connect(select_region_action_, &QAction::toggled, this, &MainWindow::selectRegion);
+
+  deselect_action_ = edit_menu->addAction(tr("D&eselect"), this, &MainWindow::deselect);
+  deselect_action_->setShortcut(QKeySequence::Deselect);
+  deselect_action_->setEnabled(false);
+
+  edit_menu->addSeparator();
+
   mirror_horizontally_action_ = edit_menu->addAction(tr("Mirror &Horizontally"), this, &MainWindow::mirrorHorizontally);
   mirror_horizontally_action_->setEnabled(false);
 
@@ -133,12 +187,47 @@ void MainWindow::createActions()
   apply_convolution_action_ = edit_menu->addAction(tr("Apply Convol&ution"), this, &MainWindow::applyConvolution);
   apply_convolution_action_->setEnabled(false);
 
+  morphology_menu_ = edit_menu->addMenu(tr("Mor&phology"));
+  morphology_menu_->setEnabled(false);
+
+  morphology_menu_->addAction(tr("&Erode..."), this, [this]() { applyMorphology("erode", tr("Erode")); });
+  morphology_menu_->addAction(tr("&Dilate..."), this, [this]() { applyMorphology("dilate", tr("Dilate")); });
+  morphology_menu_->addAction(tr("&Open..."), this, [this]() { applyMorphology("open", tr("Open")); });
+  morphology_menu_->addAction(tr("&Close..."), this, [this]() { applyMorphology("close", tr("Close")); });
+
+  box_blur_action_ = edit_menu->addAction(tr("Box B&lur..."), this, &MainWindow::applyBoxBlur);
+  box_blur_action_->setEnabled(false);
+
+  denoise_action_ = edit_menu->addAction(tr("De&noise..."), this, &MainWindow::applyDenoise);
+  denoise_action_->setEnabled(false);
+
+  threshold_menu_ = edit_menu->addMenu(tr("&Threshold"));
+  threshold_menu_->setEnabled(false);
+
+  threshold_menu_->addAction(tr("&Otsu..."), this, &MainWindow::otsuThreshold);
+  threshold_menu_->addSeparator();
+  threshold_menu_->addAction(tr("&Sauvola..."), this, [this]() {
+    applyAdaptiveThreshold("sauvola_threshold", tr("Sauvola threshold"), tr("Sensitivity k:"), 0.34);
+  });
+  threshold_menu_->addAction(tr("&Bradley..."), this, [this]() {
+    applyAdaptiveThreshold("bradley_threshold", tr("Bradley threshold"), tr("Fraction below the mean t:"), 0.15);
+  });
+
   QMenu *view_menu = menuBar()->addMenu(tr("&View"));
 
   fit_to_window_action_ = view_menu->addAction(tr("&Fit to Window"), this, &MainWindow::fitToWindow);
   fit_to_window_action_->setEnabled(false);
   fit_to_window_action_->setCheckable(true);
 
+  show_timings_action_ = view_menu->addAction(tr("Show Operation &Timings"));
+  show_timings_action_->setCheckable(true);
+
+  compare_action_ = view_menu->addAction(tr("&Compare with Original"), this, &MainWindow::compareWithOriginal);
+  compare_action_->setEnabled(false);
+
+  view_menu->addAction(statistics_dock_->toggleViewAction());
+  view_menu->addAction(browser_dock_->toggleViewAction());
+
   QMenu *help_menu = menuBar()->addMenu(tr("&Help"));
 
   help_menu->addAction(tr("&About"), this, &MainWindow::about);
@@ -147,23 +236,37 @@ void MainWindow::createActions()
 
 void MainWindow::updateActions()
 {
+  // Statistics are cached per image, so this scans each image only once
+  bool is_grayscale = !image_.isNull() && image_op::imageStatistics(image_).grayscale;
+
+  undo_action_->setEnabled(history_.canUndo());
+  undo_action_->setText(history_.canUndo() ? tr("&Undo %1").arg(history_.undoDescription()) : tr("&Undo"));
+  redo_action_->setEnabled(history_.canRedo());
+  redo_action_->setText(history_.canRedo() ? tr("Re&do %1").arg(history_.redoDescription()) : tr("Re&do"));
   save_as_action_->setEnabled(!image_.isNull());
+  select_region_action_->setEnabled(!image_.isNull());
+  deselect_action_->setEnabled(!image_view_right_->selection().isNull());
   fit_to_window_action_->setEnabled(!image_.isNull());
+  compare_action_->setEnabled(!image_.isNull());
   mirror_horizontally_action_->setEnabled(!image_.isNull());
   mirror_vertically_action_->setEnabled(!image_.isNull());
   convert_to_monochrome_action_->setEnabled(!image_.isNull());
-  quantize_image_action_->setEnabled(!image_.isNull() && image_.isGrayscale());
-  generate_histogram_action_->setEnabled(!image_.isNull() && image_.isGrayscale());
+  quantize_image_action_->setEnabled(is_grayscale);
+  generate_histogram_action_->setEnabled(is_grayscale);
   adjust_brightness_action_->setEnabled(!image_.isNull());
   adjust_contrast_action_->setEnabled(!image_.isNull());
   get_negative_action_->setEnabled(!image_.isNull());
   equalize_histogram_action_->setEnabled(!image_.isNull());
-  match_histogram_action_->setEnabled(!image_.isNull() && image_.isGrayscale());
+  match_histogram_action_->setEnabled(is_grayscale);
   zoom_out_action_->setEnabled(!image_.isNull());
   zoom_in_action_->setEnabled(!image_.isNull());
   rotate_clockwise_action_->setEnabled(!image_.isNull());
   rotate_counter_clockwise_action_->setEnabled(!image_.isNull());
-  apply_convolution_action_->setEnabled(!image_.isNull() && image_.isGrayscale());
+  apply_convolution_action_->setEnabled(is_grayscale);
+  morphology_menu_->setEnabled(!image_.isNull());
+  box_blur_action_->setEnabled(!image_.isNull());
+  denoise_action_->setEnabled(!image_.isNull());
+  threshold_menu_->setEnabled(!image_.isNull());
 }
 
 void MainWindow::initializeImageFileDialog(QFileDialog& dialog, QFileDialog::AcceptMode accept_mode)
@@ -194,11 +297,34 @@ void MainWindow::open()
   while (dialog.exec() == QDialog::Accepted && !loadFile(dialog.selectedFiles().first()));
 }
 
+void MainWindow::browseFolder()
+{
+  QString start_folder = thumbnail_browser_->folder();
+  if (start_folder.isEmpty()) {
+    const QStringList pictures_locations = QStandardPaths::standardLocations(QStandardPaths::PicturesLocation);
+    start_folder = pictures_locations.isEmpty() ? QDir::currentPath() : pictures_locations.last();
+  }
+
+  QString folder = QFileDialog::getExistingDirectory(this, tr("Browse Folder"), start_folder);
+  if (folder.isEmpty())
+    return;
+
+  thumbnail_browser_->setFolder(folder);
+  browser_dock_->show();
+}
+
 bool MainWindow::loadFile(const QString& file_name)
 {
+  PROFILE_SCOPE("MainWindow::loadFile", "ui");
+
   QImageReader reader(file_name);
   reader.setAutoTransform(true);
-  const QImage new_image = reader.read();
+  QImage new_image;
+
+  {
+    PROFILE_SCOPE("QImageReader::read", "decode");
+    new_image = reader.read();
+  }
 
   if (new_image.isNull()) {
     QMessageBox::information(this, QGuiApplication::applicationDisplayName(),
@@ -212,21 +338,23 @@ bool MainWindow::loadFile(const QString& file_name)
 
   const QString message = tr("Opened \"%1\", %2x%3")
       .arg(QDir::toNativeSeparators(file_name)).arg(image_.width()).arg(image_.height());
-  statusBar()->showMessage(message);
+  showStatusMessage(message);
   return true;
 }
 
 void MainWindow::setImage(const QImage& new_image)
 {
   image_ = new_image;
-  pixmap_left_ = QPixmap::fromImage(image_);
-  image_label_left_->setPixmap(pixmap_left_);
+  image_view_left_->setImage(image_);
+  history_.clear();
+  graph_.clear();
+  graph_head_ = graph_.addSource(image_);
+  updateOperationsList();
 
   // Clear right image
-  pixmap_right_ = QPixmap();
-  image_label_right_->clear();
-  image_label_right_->adjustSize();
+  image_view_right_->clear();
   updateActions();
+  updateStatisticsPanel();
 
   fitToWindow();
 }
@@ -241,9 +369,17 @@ void MainWindow::saveAs()
 
 bool MainWindow::saveFile(const QString& file_name)
 {
+  PROFILE_SCOPE("MainWindow::saveFile", "ui");
+
   QImageWriter writer(file_name);
+  bool written;
 
-  if (!writer.write(image_)) {
+  {
+    PROFILE_SCOPE("QImageWriter::write", "encode");
+    written = writer.write(image_);
+  }
+
+  if (!written) {
     QMessageBox::information(this, QGuiApplication::applicationDisplayName(),
                              tr("Cannot write %1: %2")
                              .arg(QDir::toNativeSeparators(file_name)), writer.errorString());
@@ -251,55 +387,414 @@ bool MainWindow::saveFile(const QString& file_name)
   }
 
   const QString message = tr("Wrote \"%1\"").arg(QDir::toNativeSeparators(file_name));
-  statusBar()->showMessage(message);
+  showStatusMessage(message);
   return true;
 }
 
-void MainWindow::mirrorHorizontally()
+void MainWindow::applyOperation(const QString& name, const QVariantList& parameters,
+                                const QVector<int>& extra_inputs)
 {
-  image_ = image_op::mirrorHorizontally(image_);
-  pixmap_right_ = QPixmap::fromImage(image_);
-  fitToWindow();
-  statusBar()->showMessage("Image mirrored horizontally");
+  QVector<int> inputs = { graph_head_ };
+  inputs.append(extra_inputs);
+
+  // Only the selected pixels change, the rest of the image is kept
+  QRect selection = image_view_right_->selection();
+  int node = graph_.addOperation(name, parameters, inputs, image_op::Selection{ selection, QImage() });
+  QImage result = graph_.evaluate(node);
+
+  QString description = image_op::describeOperation(name, parameters);
+  if (!selection.isNull())
+    description = tr("%1 in Selection").arg(description);
+
+  if (result.isNull()) {
+    QMessageBox::information(this, QGuiApplication::applicationDisplayName(), tr("Cannot apply %1").arg(description));
+    return;
+  }
+
+  commitImage(result, description, node, selection);
 }
 
-void MainWindow::mirrorVertically()
+void MainWindow::commitImage(const QImage& new_image, const QString& description, int new_head,
+                             const QRect& region)
 {
-  image_ = image_op::mirrorVertically(image_);
-  pixmap_right_ = QPixmap::fromImage(image_);
-  fitToWindow();
-  statusBar()->showMessage("Image mirrored vertically");
+  // Only the tiles the operation changed are converted for display again
+  bool size_changed = new_image.size() != image_.size();
+  qint64 previous_key = image_.cacheKey();
+  QRect changed_region = history_.record(image_, new_image, description, graph_head_, region);
+  image_ = new_image;
+  graph_head_ = new_head;
+
+  // Operations of discarded redo entries, failed edits and replaced
+  // previews, with the images they were matched to, are not needed anymore
+  QVector<int> heads = { graph_head_ };
+  for (const auto& state : history_.states())
+    heads.append(state.toInt());
+  graph_.removeUnreachable(heads);
+  showEditedImage(previous_key, changed_region);
+  if (size_changed)
+    fitToWindow();
+  updateActions();
+  updateOperationsList();
+  updateStatisticsPanel();
 }
 
-void MainWindow::convertToGrayscale()
+void MainWindow::showEditedImage(qint64 previous_key, const QRect& changed_region)
 {
-  image_ = image_op::convertColoredToGrayscale(image_);
-  pixmap_right_ = QPixmap::fromImage(image_);
-  fitToWindow();
+  // Undo writes the tiles on a copy of the image the view shares, so the
+  // view keeps the key of the image before the edit
+  if (image_view_right_->image().cacheKey() == previous_key)
+    image_view_right_->updateImage(image_, changed_region);
+  else
+    image_view_right_->setImage(image_);
+}
+
+void MainWindow::undo()
+{
+  PROFILE_SCOPE("MainWindow::undo", "ui");
+
+  const QString description = history_.undoDescription();
+  QVariant head = graph_head_;
+  QSize previous_size = image_.size();
+  qint64 previous_key = image_.cacheKey();
+  QRect restored_region;
+
+  if (!history_.undo(image_, &restored_region, &head)) {
+    QMessageBox::information(this, QGuiApplication::applicationDisplayName(),
+                             tr("Cannot undo \"%1\", the history kept on disk could not be read").arg(description));
+    return;
+  }
+
+  graph_head_ = head.toInt();
+  graph_.setResult(graph_head_, image_);
+  showEditedImage(previous_key, restored_region);
+  if (image_.size() != previous_size)
+    fitToWindow();
   updateActions();
-  statusBar()->showMessage("Image converted to grayscale");
+  updateOperationsList();
+  updateStatisticsPanel();
+  showStatusMessage(tr("Undid \"%1\"").arg(description));
 }
 
-void MainWindow::quantizeImage()
+void MainWindow::redo()
+{
+  PROFILE_SCOPE("MainWindow::redo", "ui");
+
+  const QString description = history_.redoDescription();
+  QVariant head = graph_head_;
+  QSize previous_size = image_.size();
+  qint64 previous_key = image_.cacheKey();
+  QRect restored_region;
+
+  if (!history_.redo(image_, &restored_region, &head)) {
+    QMessageBox::information(this, QGuiApplication::applicationDisplayName(),
+                             tr("Cannot redo \"%1\", the history kept on disk could not be read").arg(description));
+    return;
+  }
+
+  graph_head_ = head.toInt();
+  graph_.setResult(graph_head_, image_);
+  showEditedImage(previous_key, restored_region);
+  if (image_.size() != previous_size)
+    fitToWindow();
+  updateActions();
+  updateOperationsList();
+  updateStatisticsPanel();
+  showStatusMessage(tr("Redid \"%1\"").arg(description));
+}
+
+void MainWindow::updateOperationsList()
+{
+  operations_list_->clear();
+
+  for (auto node : graph_.chain(graph_head_)) {
+    if (graph_.isSource(node))
+      operations_list_->addItem(tr("Opened image"));
+    else if (graph_.selection(node).rect.isNull())
+      operations_list_->addItem(image_op::describeOperation(graph_.name(node), graph_.parameters(node)));
+    else
+      operations_list_->addItem(tr("%1 in Selection")
+                                .arg(image_op::describeOperation(graph_.name(node), graph_.parameters(node))));
+  }
+}
+
+void MainWindow::updateStatisticsPanel()
+{
+  if (image_.isNull()) {
+    statistics_label_->setText(tr("No image"));
+    return;
+  }
+
+  auto statistics = image_op::imageStatistics(image_);
+
+  QString text = tr("%1 x %2, %3<br>").arg(image_.width()).arg(image_.height())
+      .arg(statistics.grayscale ? tr("grayscale") : tr("colored"));
+  text += tr("<table><tr><th></th><th>Min</th><th>Max</th><th>Mean</th><th>Std. dev.</th></tr>");
+
+  auto add_row = [&text](const QString& name, const image_op::ChannelStatistics& channel) {
+    text += QString("<tr><td>%1</td><td>%2</td><td>%3</td><td>%4</td><td>%5</td></tr>")
+        .arg(name).arg(channel.minimum).arg(channel.maximum)
+        .arg(channel.mean, 0, 'f', 1).arg(std::sqrt(channel.variance), 0, 'f', 1);
+  };
+
+  add_row(tr("Red"), statistics.red);
+  add_row(tr("Green"), statistics.green);
+  add_row(tr("Blue"), statistics.blue);
+  add_row(tr("Alpha"), statistics.alpha);
+  add_row(tr("Luminance"), statistics.luminance);
+  text += "</table>";
+
+  statistics_label_->setText(text);
+}
+
+void MainWindow::editOperation(QListWidgetItem* item)
+{
+  auto path = graph_.chain(graph_head_);
+  int node = path.value(operations_list_->row(item), -1);
+  auto* operation = image_op::findOperation(graph_.name(node));
+
+  if (!operation || operation->parameters.isEmpty()) {
+    statusBar()->showMessage(tr("Operation has no parameters to change"));
+    return;
+  }
+
+  // One input per parameter, initialized with the current values
+  QDialog dialog(this);
+  dialog.setWindowTitle(tr("Change %1").arg(operation->title));
+  QFormLayout* form = new QFormLayout(&dialog);
+  QVector<QWidget*> editors;
+  auto parameters = graph_.parameters(node);
+
+  for (int i = 0; i < operation->parameters.size(); i++) {
+    const auto& parameter = operation->parameters[i];
+
+    if (parameter.type == image_op::OperationParameter::Integer) {
+      auto* spin_box = new QSpinBox(&dialog);
+      spin_box->setRange(static_cast<int>(parameter.minimum), static_cast<int>(parameter.maximum));
+      spin_box->setValue(parameters[i].toInt());
+      editors.append(spin_box);
+    } else if (parameter.type == image_op::OperationParameter::Real) {
+      auto* spin_box = new QDoubleSpinBox(&dialog);
+      spin_box->setRange(parameter.minimum, parameter.maximum);
+      spin_box->setDecimals(4);
+      spin_box->setValue(parameters[i].toDouble());
+      editors.append(spin_box);
+    } else {
+      auto* check_box = new QCheckBox(QString(), &dialog);
+      check_box->setChecked(parameters[i].toBool());
+      editors.append(check_box);
+    }
+
+    form->addRow(parameter.label, editors.last());
+  }
+
+  auto* buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
+  connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+  connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+  form->addRow(buttons);
+
+  if (dialog.exec() != QDialog::Accepted)
+    return;
+
+  for (int i = 0; i < editors.size(); i++) {
+    if (auto* spin_box = qobject_cast<QSpinBox*>(editors[i]))
+      parameters[i] = spin_box->value();
+    else if (auto* double_spin_box = qobject_cast<QDoubleSpinBox*>(editors[i]))
+      parameters[i] = double_spin_box->value();
+    else if (auto* check_box = qobject_cast<QCheckBox*>(editors[i]))
+      parameters[i] = check_box->isChecked();
+  }
+
+  PROFILE_SCOPE("MainWindow::editOperation", "ui");
+
+  // Only the changed node and the ones after it are evaluated again
+  int new_head = graph_.setParameters(graph_head_, node, parameters);
+  const QString description = tr("Change %1").arg(image_op::describeOperation(graph_.name(node), parameters));
+  QImage result = graph_.evaluate(new_head);
+
+  // The previous versions of the nodes stay in the graph, so the head and
+  // its parameters are kept as they were
+  if (result.isNull()) {
+    QMessageBox::information(this, QGuiApplication::applicationDisplayName(), tr("Cannot apply %1").arg(description));
+    return;
+  }
+
+  commitImage(result, description, new_head);
+  showStatusMessage(description);
+}
+
+void MainWindow::setHistoryMemoryLimit()
 {
   bool ok;
-  int num_colors = QInputDialog::getInt(this, tr("Convert to Monochrome"),
-                                        tr("How many colors?"), 255, 1, 255, 1, &ok,
-                                        Qt::MSWindowsFixedSizeDialogHint);
+  int limit = QInputDialog::getInt(this, tr("History memory limit"),
+                                   tr("Memory kept for undo/redo, in MB:"),
+                                   static_cast<int>(history_.memoryLimit() / (1024 * 1024)), 1, 65536, 1, &ok,
+                                   Qt::MSWindowsFixedSizeDialogHint);
   if (!ok)
     return;
 
-  image_ = image_op::quantizeGrayscale(image_, num_colors);
-  pixmap_right_ = QPixmap::fromImage(image_);
-  fitToWindow();
-  updateActions();
-  const QString message = tr("Quantized image with %1 color(s)").arg(num_colors);
+  history_.setMemoryLimit(static_cast<qint64>(limit) * 1024 * 1024);
+  const QString message = tr("History memory limited to %1 MB, older entries are kept on disk").arg(limit);
   statusBar()->showMessage(message);
 }
 
+void MainWindow::selectRegion(bool enabled)
+{
+  image_view_right_->setSelectionEnabled(enabled);
+  statusBar()->showMessage(enabled ? tr("Drag over the modified image to select a region") : QString());
+}
+
+void MainWindow::deselect()
+{
+  image_view_right_->setSelection(QRect());
+}
+
+void MainWindow::selectionChanged(const QRect& selection)
+{
+  updateActions();
+
+  if (selection.isNull())
+    statusBar()->showMessage(tr("Operations apply to the whole image"));
+  else
+    statusBar()->showMessage(tr("Selected %1 x %2 pixels at %3, %4")
+                             .arg(selection.width()).arg(selection.height()).arg(selection.x()).arg(selection.y()));
+}
+
+void MainWindow::compareWithOriginal()
+{
+  PROFILE_SCOPE("MainWindow::compareWithOriginal", "ui");
+
+  const QImage& original = image_view_left_->image();
+  auto comparison = image_op::compareImages(original, image_);
+  if (comparison.pixel_count == 0) {
+    statusBar()->showMessage(tr("Cannot compare images of different sizes"));
+    return;
+  }
+
+  // Stretched so the largest difference turns white
+  int amplification = std::max(1, 255 / std::max(1, comparison.maximum_difference));
+  image_view_right_->setImage(image_op::differenceImage(original, image_, amplification));
+
+  if (comparison.maximum_difference == 0) {
+    showStatusMessage(tr("Image is identical to the original"));
+    return;
+  }
+
+  showStatusMessage(tr("Difference from the original x%1: MSE %2, PSNR %3 dB, SSIM %4, largest difference %5")
+                    .arg(amplification)
+                    .arg(comparison.mean_squared_error, 0, 'f', 2)
+                    .arg(comparison.peak_signal_to_noise_ratio, 0, 'f', 2)
+                    .arg(comparison.structural_similarity, 0, 'f', 4)
+                    .arg(comparison.maximum_difference));
+}
+
+void MainWindow::mirrorHorizontally()
+{
+  PROFILE_SCOPE("MainWindow::mirrorHorizontally", "ui");
+
+  applyOperation("mirror_horizontally", {});
+  showStatusMessage("Image mirrored horizontally");
+}
+
+void MainWindow::mirrorVertically()
+{
+  PROFILE_SCOPE("MainWindow::mirrorVertically", "ui");
+
+  applyOperation("mirror_vertically", {});
+  showStatusMessage("Image mirrored vertically");
+}
+
+void MainWindow::convertToGrayscale()
+{
+  PROFILE_SCOPE("MainWindow::convertToGrayscale", "ui");
+
+  applyOperation("grayscale", {});
+  showStatusMessage("Image converted to grayscale");
+}
+
+void MainWindow::quantizeImage()
+{
+  openPreviewPanel("quantize", tr("Convert to Monochrome"), tr("How many colors?"), 255, 1, 255,
+                   tr("Quantized image with %1 color(s)"));
+}
+
+void MainWindow::otsuThreshold()
+{
+  openPreviewPanel("otsu_threshold", tr("Otsu Threshold"), tr("How many classes?"), 2, 2, 16,
+                   tr("Thresholded image in %1 classes"));
+}
+
+void MainWindow::openPreviewPanel(const QString& operation_name, const QString& title, const QString& label,
+                                  int value, int minimum, int maximum, const QString& message)
+{
+  // Previews are computed on a proxy the size of the right pane, over the
+  // part of it that maps to the selection
+  QImage proxy = PreviewPanel::createProxy(image_, image_view_right_->viewport()->size());
+  QRect selection = image_view_right_->selection();
+  QRect proxy_selection;
+  if (!selection.isNull()) {
+    auto to_proxy = QTransform::fromScale(static_cast<double>(proxy.width()) / image_.width(),
+                                          static_cast<double>(proxy.height()) / image_.height());
+    proxy_selection = to_proxy.mapRect(QRectF(selection)).toAlignedRect();
+  }
+
+  // Quantization and Otsu's thresholds span the tones of the whole image,
+  // or of the selection as when the operation is applied, not the ones of
+  // each strip
+  auto statistics = image_op::imageStatistics(selection.isNull() ? image_ : image_.copy(selection));
+  auto luminance = statistics.luminance;
+  bool use_luminance = !statistics.grayscale;
+  auto histogram_data = use_luminance ? statistics.luminance.histogram : statistics.red.histogram;
+
+  auto preview_function = [operation_name, luminance, use_luminance, histogram_data](const QImage& strip,
+                                                                                     int preview_value) {
+    if (operation_name == "quantize")
+      return image_op::quantizeGrayscale(strip, preview_value, luminance.minimum, luminance.maximum);
+    if (operation_name == "otsu_threshold")
+      return image_op::mapGrayTones(strip, image_op::otsuCurve(histogram_data, preview_value), use_luminance);
+    return image_op::applyOperation(operation_name, { strip }, { preview_value });
+  };
+
+  auto* panel = new PreviewPanel(title, label, minimum, maximum, value, proxy, proxy_selection, preview_function,
+                                 image_view_right_, this);
+  panel->setModal(true);
+  preview_node_ = -1;
+  image_view_right_->setFitToWindow(true);
+
+  connect(panel, &PreviewPanel::valueCommitted, this, [this, operation_name, message, selection](int committed_value) {
+    PROFILE_SCOPE("MainWindow::commitPreview", "ui");
+
+    // Later values of the same panel replace the first one instead of stacking on it
+    if (preview_node_ >= 0 && preview_node_ == graph_head_) {
+      undo();
+
+      // Kept on the value before, undo told why
+      if (graph_head_ == preview_node_)
+        return;
+    }
+
+    // Previews of another size than the image clear the selection of the view
+    image_view_right_->setImage(image_);
+    image_view_right_->setSelection(selection);
+    applyOperation(operation_name, { committed_value });
+    preview_node_ = graph_head_;
+    showStatusMessage(message.arg(committed_value));
+  });
+
+  connect(panel, &QDialog::finished, this, [this, selection]() {
+    preview_node_ = -1;
+    image_view_right_->setImage(image_);
+    image_view_right_->setSelection(selection);
+    fitToWindow();
+  });
+
+  panel->show();
+}
+
 void MainWindow::generateHistogram()
 {
-  auto histogram_data = image_op::generateGrayscaleHistogramData(image_);
+  PROFILE_SCOPE("MainWindow::generateHistogram", "ui");
+
+  auto histogram_data = image_op::cachedHistogram(image_).histogram;
   auto histogram = image_op::generate2DHistogramPixmap(histogram_data);
 
   QPointer<QLabel> histogram_label = new QLabel();
@@ -312,68 +807,48 @@ void MainWindow::generateHistogram()
   histogram_label->resize(276, 276);
 
   updateActions();
-  statusBar()->showMessage("Histogram generated");
+  showStatusMessage("Histogram generated");
 }
 
 void MainWindow::adjustBrightness()
 {
-  bool ok;
-  int brightness_value = QInputDialog::getInt(this, tr("Adjust brightness"),
-                                              tr("Add which value?"), 0, -255, 255, 1, &ok,
-                                              Qt::MSWindowsFixedSizeDialogHint);
-  if (!ok)
-    return;
-
-  image_ = image_op::adjustBrightness(image_, brightness_value);
-  pixmap_right_ = QPixmap::fromImage(image_);
-  fitToWindow();
-  updateActions();
-  const QString message = tr("Adjusted image brightness by %1").arg(brightness_value);
-  statusBar()->showMessage(message);
+  openPreviewPanel("brightness", tr("Adjust brightness"), tr("Add which value?"), 0, -255, 255,
+                   tr("Adjusted image brightness by %1"));
 }
 
 void MainWindow::adjustContrast()
 {
-  bool ok;
-  int contrast_factor = QInputDialog::getInt(this, tr("Adjust contrast"),
-                                             tr("By which factor?"), 1, 1, 255, 1, &ok,
-                                             Qt::MSWindowsFixedSizeDialogHint);
-  if (!ok)
-    return;
-
-  image_ = image_op::adjustContrast(image_, contrast_factor);
-  pixmap_right_ = QPixmap::fromImage(image_);
-  fitToWindow();
-  updateActions();
-  const QString message = tr("Adjusted image contrast by a factor of %1").arg(contrast_factor);
-  statusBar()->showMessage(message);
+  openPreviewPanel("contrast", tr("Adjust contrast"), tr("By which factor?"), 1, 1, 255,
+                   tr("Adjusted image contrast by a factor of %1"));
 }
 
 void MainWindow::getNegative()
 {
-  image_ = image_op::getNegativeImage(image_);
-  pixmap_right_ = QPixmap::fromImage(image_);
-  fitToWindow();
-  statusBar()->showMessage("Generated negative image");
+  PROFILE_SCOPE("MainWindow::getNegative", "ui");
+
+  applyOperation("negative", {});
+  showStatusMessage("Generated negative image");
 }
 
 void MainWindow::equalizeHistogram()
 {
+  PROFILE_SCOPE("MainWindow::equalizeHistogram", "ui");
+
   // Update left image to show image before equalization
-  pixmap_left_ = QPixmap::fromImage(image_);
+  image_view_left_->setImage(image_);
+
+  // Original image histogram, kept so equalization carries it forward
+  auto original_info = image_op::cachedHistogram(image_);
 
-  if (image_.isGrayscale()) {
-    // Original image histogram
-    auto histogram_data = image_op::generateGrayscaleHistogramData(image_);
+  if (original_info.grayscale) {
+    auto histogram_data = original_info.histogram;
     auto original_histogram = image_op::generate2DHistogramPixmap(histogram_data);
 
     // Histogram equalization
-    image_ = image_op::equalizeHistogram(image_);
-    pixmap_right_ = QPixmap::fromImage(image_);
-    fitToWindow();
+    applyOperation("equalize", {});
 
-    // Modified image equalization
-    histogram_data = image_op::generateGrayscaleHistogramData(image_);
+    // Modified image histogram, derived from the original one
+    histogram_data = image_op::cachedHistogram(image_).histogram;
     auto modified_histogram = image_op::generate2DHistogramPixmap(histogram_data);
 
     // Show original and modified histogram side by side
@@ -401,12 +876,10 @@ void MainWindow::equalizeHistogram()
     histogram_window->show();
   } else {
     // Histogram equalization
-    image_ = image_op::equalizeHistogram(image_);
-    pixmap_right_ = QPixmap::fromImage(image_);
-    fitToWindow();
+    applyOperation("equalize", {});
   }
 
-  statusBar()->showMessage("Equalized image histogram");
+  showStatusMessage("Equalized image histogram");
 }
 
 bool MainWindow::loadGrayscaleImage(const QString& file_name, QImage& image)
@@ -443,11 +916,10 @@ void MainWindow::matchHistogram()
   if (target_image.isNull())
     return;
 
-  image_ = image_op::matchGrayscaleHistogram(image_, target_image);
-  pixmap_right_ = QPixmap::fromImage(image_);
-  fitToWindow();
+  PROFILE_SCOPE("MainWindow::matchHistogram", "ui");
+  applyOperation("match_histogram", {}, { graph_.addSource(target_image) });
 
-  statusBar()->showMessage("Matched image histogram");
+  showStatusMessage("Matched image histogram");
 }
 
 void MainWindow::zoomOut()
@@ -465,38 +937,37 @@ void MainWindow::zoomOut()
   if (!ok)
     return;
 
-  image_ = image_op::zoomOutByFactors(image_, sx, sy);
-  pixmap_right_ = QPixmap::fromImage(image_);
-  fitToWindow();
+  PROFILE_SCOPE("MainWindow::zoomOut", "ui");
+  applyOperation("zoom_out", { sx, sy });
   const QString message = tr("Zoomed out image by a factor of %1x%2").arg(sx).arg(sy);
-  statusBar()->showMessage(message);
+  showStatusMessage(message);
 }
 
 void MainWindow::zoomIn()
 {
-  image_ = image_op::zoomIn2x2(image_);
-  pixmap_right_ = QPixmap::fromImage(image_);
-  fitToWindow();
+  PROFILE_SCOPE("MainWindow::zoomIn", "ui");
+
+  applyOperation("zoom_in", {});
   const QString message = tr("Zoomed in image by a factor of 2x2");
-  statusBar()->showMessage(message);
+  showStatusMessage(message);
 }
 
 void MainWindow::rotateClockwise()
 {
-  image_ = image_op::rotate90DegreesClockwise(image_);
-  pixmap_right_ = QPixmap::fromImage(image_);
-  fitToWindow();
+  PROFILE_SCOPE("MainWindow::rotateClockwise", "ui");
+
+  applyOperation("rotate_clockwise", {});
   const QString message = tr("Image rotated 90 degrees clockwise");
-  statusBar()->showMessage(message);
+  showStatusMessage(message);
 }
 
 void MainWindow::rotateCounterClockwise()
 {
-  image_ = image_op::rotate90DegreesCounterClockwise(image_);
-  pixmap_right_ = QPixmap::fromImage(image_);
-  fitToWindow();
+  PROFILE_SCOPE("MainWindow::rotateCounterClockwise", "ui");
+
+  applyOperation("rotate_counter_clockwise", {});
   const QString message = tr("Image rotated 90 degrees counter-clockwise");
-  statusBar()->showMessage(message);
+  showStatusMessage(message);
 }
 
 void MainWindow::applyConvolution()
@@ -536,50 +1007,139 @@ void MainWindow::applyConvolution()
     return;
   }
 
-  // Creates and populates kernel
-  QVector<QVector<double>> kernel;
+  // Kernel elements row by row followed by the bias flag
+  QVariantList parameters;
 
-  for (int i = 0; i < 3; i++) {
-    kernel.append(QVector<double>(3));
-    for (int j = 0; j < 3; j++) {
-      kernel[i][j] = kernel_elements[i*3 + j].simplified().toDouble();
-    }
+  for (const auto& element : kernel_elements)
+    parameters.append(element.simplified().toDouble());
+
+  parameters.append(add_bias);
+
+  PROFILE_SCOPE("MainWindow::applyConvolution", "ui");
+  applyOperation("convolution", parameters);
+  showStatusMessage("Convoluted the image with the provided kernel");
+}
+
+void MainWindow::applyMorphology(const QString& operation_name, const QString& title)
+{
+  bool ok;
+  int element_width = QInputDialog::getInt(this, title, tr("Structuring element width:"),
+                                           3, 1, image_.width(), 1, &ok, Qt::MSWindowsFixedSizeDialogHint);
+  if (!ok)
+    return;
+
+  int element_height = QInputDialog::getInt(this, title, tr("Structuring element height:"),
+                                            element_width, 1, image_.height(), 1, &ok,
+                                            Qt::MSWindowsFixedSizeDialogHint);
+  if (!ok)
+    return;
+
+  PROFILE_SCOPE("MainWindow::applyMorphology", "ui");
+  applyOperation(operation_name, { element_width, element_height });
+  showStatusMessage(tr("%1 with a %2x%3 structuring element").arg(title).arg(element_width).arg(element_height));
+}
+
+void MainWindow::applyBoxBlur()
+{
+  bool ok;
+  int box_width = QInputDialog::getInt(this, tr("Box blur"), tr("Box width:"),
+                                       3, 1, image_.width(), 1, &ok, Qt::MSWindowsFixedSizeDialogHint);
+  if (!ok)
+    return;
+
+  int box_height = QInputDialog::getInt(this, tr("Box blur"), tr("Box height:"),
+                                        box_width, 1, image_.height(), 1, &ok, Qt::MSWindowsFixedSizeDialogHint);
+  if (!ok)
+    return;
+
+  PROFILE_SCOPE("MainWindow::applyBoxBlur", "ui");
+  applyOperation("box_blur", { box_width, box_height });
+  showStatusMessage(tr("Blurred image with a %1x%2 box").arg(box_width).arg(box_height));
+}
+
+void MainWindow::applyDenoise()
+{
+  bool ok;
+  int search_radius = QInputDialog::getInt(this, tr("Denoise"), tr("Search radius:"),
+                                           5, 1, 15, 1, &ok, Qt::MSWindowsFixedSizeDialogHint);
+  if (!ok)
+    return;
+
+  int patch_radius = QInputDialog::getInt(this, tr("Denoise"), tr("Patch radius:"),
+                                          2, 0, 7, 1, &ok, Qt::MSWindowsFixedSizeDialogHint);
+  if (!ok)
+    return;
+
+  double strength = QInputDialog::getDouble(this, tr("Denoise"), tr("Strength:"), 10, 0.1, 255, 1, &ok,
+                                            Qt::MSWindowsFixedSizeDialogHint);
+  if (!ok)
+    return;
+
+  PROFILE_SCOPE("MainWindow::applyDenoise", "ui");
+  applyOperation("nlm_denoise", { search_radius, patch_radius, strength });
+  showStatusMessage(tr("Denoised image with a strength of %1").arg(strength));
+}
+
+void MainWindow::applyAdaptiveThreshold(const QString& operation_name, const QString& title,
+                                        const QString& factor_label, double factor)
+{
+  bool ok;
+  int window_size = QInputDialog::getInt(this, title, tr("Window size:"),
+                                         15, 1, std::max(image_.width(), image_.height()), 2, &ok,
+                                         Qt::MSWindowsFixedSizeDialogHint);
+  if (!ok)
+    return;
+
+  factor = QInputDialog::getDouble(this, title, factor_label, factor, 0, 1, 2, &ok,
+                                   Qt::MSWindowsFixedSizeDialogHint);
+  if (!ok)
+    return;
+
+  PROFILE_SCOPE("MainWindow::applyAdaptiveThreshold", "ui");
+  applyOperation(operation_name, { window_size, factor });
+  showStatusMessage(tr("%1 over %2x%2 windows").arg(title).arg(window_size));
+}
+
+void MainWindow::showStatusMessage(const QString& message)
+{
+  if (show_timings_action_->isChecked())
+    statusBar()->showMessage(tr("%1 (%2)").arg(message, profiler::breakdown(profiler::outermostScopeStart())));
+  else
+    statusBar()->showMessage(message);
+}
+
+void MainWindow::exportTrace()
+{
+  QFileDialog dialog(this, tr("Export Performance Trace"));
+  dialog.setAcceptMode(QFileDialog::AcceptSave);
+  dialog.setNameFilter(tr("Chrome trace (*.json)"));
+  dialog.setDefaultSuffix("json");
+
+  if (dialog.exec() != QDialog::Accepted)
+    return;
+
+  const QString file_name = dialog.selectedFiles().first();
+
+  if (!profiler::writeChromeTrace(file_name)) {
+    QMessageBox::information(this, QGuiApplication::applicationDisplayName(),
+                             tr("Cannot write %1").arg(QDir::toNativeSeparators(file_name)));
+    return;
   }
 
-  image_ = image_op::applyConvolutionWith3x3Kernel(image_, kernel, add_bias);
-  pixmap_right_ = QPixmap::fromImage(image_);
-  fitToWindow();
-  updateActions();
-  statusBar()->showMessage("Convoluted the image with the provided kernel");
+  statusBar()->showMessage(tr("Wrote trace of the last %1 events to \"%2\"")
+                           .arg(static_cast<int>(profiler::events().size())).arg(QDir::toNativeSeparators(file_name)));
 }
 
 void MainWindow::fitToWindow()
 {
-  if (fit_to_window_action_->isChecked()) {
-    image_label_left_->setPixmap(pixmap_left_.scaled(scroll_area_left_->width(),
-                                                     scroll_area_left_->height(),
-                                                     Qt::KeepAspectRatio,
-                                                     Qt::SmoothTransformation));
-    image_label_left_->adjustSize();
-
-    if (!pixmap_right_.isNull()) {
-      image_label_right_->setPixmap(pixmap_right_.scaled(scroll_area_right_->width(),
-                                                         scroll_area_right_->height(),
-                                                         Qt::KeepAspectRatio,
-                                                         Qt::SmoothTransformation));
-      image_label_right_->adjustSize();
-    }
+  bool fit_to_window = fit_to_window_action_->isChecked();
+  image_view_left_->setFitToWindow(fit_to_window);
+  image_view_right_->setFitToWindow(fit_to_window);
 
+  if (fit_to_window)
     statusBar()->showMessage("Adjusted image to available space");
-  } else {
-    image_label_left_->setPixmap(pixmap_left_);
-    image_label_left_->adjustSize();
-
-    image_label_right_->setPixmap(pixmap_right_);
-    image_label_right_->adjustSize();
-
+  else
     statusBar()->showMessage("Showing image in original size");
-  }
 }
 
 void MainWindow::about()
@@ -588,11 +1148,3 @@ void MainWindow::about()
                      tr("<p><b>PhotoChopp</b> is a class project for the image processing fundamentals class"
                         "on UFRGS 2018/2. This instance was developed by Jéferson Ferreira Guimarães.</p>"));
 }
-
-void MainWindow::resizeEvent(QResizeEvent *event)
-{
-  QMainWindow::resizeEvent(event);
-
-  if (!image_.isNull())
-    fitToWindow();
-}
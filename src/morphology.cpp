@@ -0,0 +1,247 @@
+#include "include/morphology.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include <QtConcurrent>
+
+#include "include/image_buffer_pool.hpp"
+#include "include/pixel_formats.hpp"
+#include "include/pixel_kernels.hpp"
+#include "include/profiler.hpp"
+
+namespace image_op {
+
+namespace {
+
+// Bytes of each line of the horizontal pass, a strip of rows transposed so
+// every line holds one pixel of each row, a cache line
+constexpr int kStripBytes = 64;
+
+// Bytes of the block of lines filtered at once, which the vertical pass
+// splits its columns by so it stays in the L2 cache
+constexpr int kBlockBytes = 256 * 1024;
+
+/**
+ * Extremum of each lane of two lines, the minimum for erosions and the
+ * maximum for dilations
+ */
+template<typename Lane>
+struct LaneExtremum
+{
+  bool minimum;
+
+  // Value that never wins, taken by the lines outside of the image
+  Lane identity() const
+  {
+    return minimum ? std::numeric_limits<Lane>::max() : std::numeric_limits<Lane>::lowest();
+  }
+
+  void operator()(const Lane* first, const Lane* second, Lane* result, int count) const
+  {
+    if (minimum) {
+      for (int index = 0; index < count; index++)
+        result[index] = std::min(first[index], second[index]);
+    } else {
+      for (int index = 0; index < count; index++)
+        result[index] = std::max(first[index], second[index]);
+    }
+  }
+};
+
+template<>
+void LaneExtremum<quint8>::operator()(const quint8* first, const quint8* second, quint8* result, int count) const
+{
+  const auto& row_kernels = kernels::rowKernels();
+  (minimum ? row_kernels.minimumBytes : row_kernels.maximumBytes)(first, second, result, count);
+}
+
+/**
+ * van Herk/Gil-Werman filter over a sequence of lines, each one an array of
+ * lanes: line i of the result is the extremum of input lines
+ * i - size / 2 to i - size / 2 + size - 1, the ones outside of the
+ * sequence ignored
+ *
+ * The sequence, extended by the lines the windows reach past its ends, is
+ * split in blocks of size lines. The window of the line starting a block
+ * is the whole block, the window of any other is the suffix of its block
+ * from it and the prefix of the next block up to size lines, so with the
+ * suffixes of a block and a running prefix of the next each result line
+ * takes three extremum operations
+ */
+template<typename Lane, typename InputLine, typename OutputLine>
+void vanHerkGilWerman(int line_count, int lanes, int size, const LaneExtremum<Lane>& extremum,
+                      InputLine input_line, OutputLine output_line)
+{
+  int anchor = size / 2;
+  std::vector<Lane> identity_line(static_cast<size_t>(lanes), extremum.identity());
+  std::vector<Lane> suffixes(static_cast<size_t>(size) * lanes);
+  std::vector<Lane> prefix(static_cast<size_t>(lanes));
+
+  // Line of the extended sequence
+  auto extended_line = [&](int index) -> const Lane* {
+    int line_index = index - anchor;
+    return line_index >= 0 && line_index < line_count ? input_line(line_index) : identity_line.data();
+  };
+  auto suffix = [&](int offset) { return suffixes.data() + static_cast<size_t>(offset) * lanes; };
+
+  for (int block_start = 0; block_start < line_count; block_start += size) {
+    std::copy_n(extended_line(block_start + size - 1), lanes, suffix(size - 1));
+    for (int offset = size - 2; offset >= 0; offset--)
+      extremum(suffix(offset + 1), extended_line(block_start + offset), suffix(offset), lanes);
+
+    std::copy_n(suffix(0), lanes, output_line(block_start));
+
+    int next_block_start = block_start + size;
+    for (int offset = 1; offset < size && block_start + offset < line_count; offset++) {
+      const Lane* line = extended_line(next_block_start + offset - 1);
+      if (offset == 1)
+        std::copy_n(line, lanes, prefix.data());
+      else
+        extremum(prefix.data(), line, prefix.data(), lanes);
+
+      extremum(suffix(offset), prefix.data(), output_line(block_start + offset), lanes);
+    }
+  }
+}
+
+/**
+ * Filters the rows with a horizontal line of element_width pixels, each
+ * strip of rows transposed so the filter runs across whole lines
+ */
+template<typename Format>
+QImage filterRows(const QImage& image, int element_width, const LaneExtremum<typename Format::Channel>& extremum)
+{
+  using Pixel = typename Format::Pixel;
+  using Lane = typename Format::Channel;
+  constexpr int kLanesPerPixel = sizeof(Pixel) / sizeof(Lane);
+
+  int width = image.width();
+  int height = image.height();
+  int strip_height = std::max(1, kStripBytes / static_cast<int>(sizeof(Pixel)));
+
+  QImage target_image = pooledImage(width, height, image.format());
+  // Taken once, scanLine would detach from every thread
+  uchar* target_bits = target_image.bits();
+  int target_bytes_per_line = target_image.bytesPerLine();
+
+  std::vector<int> strips;
+  for (int row_index = 0; row_index < height; row_index += strip_height)
+    strips.push_back(row_index);
+
+  QtConcurrent::blockingMap(strips, [&](int first_row) {
+    int rows = std::min(strip_height, height - first_row);
+    int lanes = rows * kLanesPerPixel;
+    std::vector<Lane> columns(static_cast<size_t>(width) * lanes);
+    std::vector<Lane> filtered_columns(columns.size());
+
+    for (int row = 0; row < rows; row++) {
+      auto* line = pixel_format::constRow<Format>(image, first_row + row);
+      for (int column_index = 0; column_index < width; column_index++)
+        std::memcpy(&columns[static_cast<size_t>(column_index * rows + row) * kLanesPerPixel],
+                    &line[column_index], sizeof(Pixel));
+    }
+
+    vanHerkGilWerman(width, lanes, element_width, extremum,
+                     [&](int column_index) { return &columns[static_cast<size_t>(column_index) * lanes]; },
+                     [&](int column_index) { return &filtered_columns[static_cast<size_t>(column_index) * lanes]; });
+
+    for (int row = 0; row < rows; row++) {
+      auto* target_line = target_bits + static_cast<qint64>(first_row + row) * target_bytes_per_line;
+      for (int column_index = 0; column_index < width; column_index++)
+        std::memcpy(target_line + static_cast<size_t>(column_index) * sizeof(Pixel),
+                    &filtered_columns[static_cast<size_t>(column_index * rows + row) * kLanesPerPixel],
+                    sizeof(Pixel));
+    }
+  });
+
+  return target_image;
+}
+
+/**
+ * Filters the columns with a vertical line of element_height pixels, whole
+ * rows being the lines, split in bands of columns filtered in parallel
+ */
+template<typename Format>
+QImage filterColumns(const QImage& image, int element_height, const LaneExtremum<typename Format::Channel>& extremum)
+{
+  using Pixel = typename Format::Pixel;
+  using Lane = typename Format::Channel;
+  constexpr int kLanesPerPixel = sizeof(Pixel) / sizeof(Lane);
+
+  int width = image.width();
+  int height = image.height();
+  int row_lanes = width * kLanesPerPixel;
+  int band_lanes = std::max(kStripBytes, kBlockBytes / element_height) / static_cast<int>(sizeof(Lane));
+
+  QImage target_image = pooledImage(width, height, image.format());
+  uchar* target_bits = target_image.bits();
+  int target_bytes_per_line = target_image.bytesPerLine();
+
+  std::vector<int> bands;
+  for (int lane_index = 0; lane_index < row_lanes; lane_index += band_lanes)
+    bands.push_back(lane_index);
+
+  QtConcurrent::blockingMap(bands, [&](int first_lane) {
+    int lanes = std::min(band_lanes, row_lanes - first_lane);
+
+    vanHerkGilWerman(height, lanes, element_height, extremum,
+                     [&](int row_index) {
+                       return reinterpret_cast<const Lane*>(image.constScanLine(row_index)) + first_lane;
+                     },
+                     [&](int row_index) {
+                       return reinterpret_cast<Lane*>(target_bits + static_cast<qint64>(row_index) * target_bytes_per_line)
+                              + first_lane;
+                     });
+  });
+
+  return target_image;
+}
+
+template<typename Format>
+QImage filterRectangle(const QImage& image, int element_width, int element_height, bool minimum)
+{
+  LaneExtremum<typename Format::Channel> extremum = { minimum };
+
+  QImage filtered_image = image;
+  if (element_width > 1)
+    filtered_image = filterRows<Format>(filtered_image, element_width, extremum);
+  if (element_height > 1)
+    filtered_image = filterColumns<Format>(filtered_image, element_height, extremum);
+
+  return filtered_image;
+}
+
+} // namespace
+
+QImage erodeImage(QImage image, int element_width, int element_height)
+{
+  PROFILE_SCOPE("image_op::erodeImage", "compute");
+
+  return visitPixelFormat(image, [&](auto format) {
+    return filterRectangle<decltype(format)>(image, element_width, element_height, true);
+  });
+}
+
+QImage dilateImage(QImage image, int element_width, int element_height)
+{
+  PROFILE_SCOPE("image_op::dilateImage", "compute");
+
+  return visitPixelFormat(image, [&](auto format) {
+    return filterRectangle<decltype(format)>(image, element_width, element_height, false);
+  });
+}
+
+QImage openImage(QImage image, int element_width, int element_height)
+{
+  return dilateImage(erodeImage(image, element_width, element_height), element_width, element_height);
+}
+
+QImage closeImage(QImage image, int element_width, int element_height)
+{
+  return erodeImage(dilateImage(image, element_width, element_height), element_width, element_height);
+}
+
+} // namespace image_op
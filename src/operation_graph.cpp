@@ -0,0 +1,281 @@
+#include "include/operation_graph.hpp"
+
+#include <cstring>
+
+#include <QCryptographicHash>
+#include <QDataStream>
+
+#include "include/operation_registry.hpp"
+#include "include/tile_pipeline.hpp"
+
+namespace {
+
+quint64 hashNode(const QString& name, const QVariantList& parameters, const QVector<quint64>& input_hashes,
+                 const image_op::Selection& selection = image_op::Selection())
+{
+  QByteArray key;
+  QDataStream stream(&key, QIODevice::WriteOnly);
+  stream << name << parameters;
+
+  // The mask is hashed by content, it is as small as the selection
+  if (!selection.rect.isNull()) {
+    stream << selection.rect;
+    for (int row_index = 0; row_index < selection.mask.height(); row_index++)
+      stream.writeRawData(reinterpret_cast<const char*>(selection.mask.constScanLine(row_index)),
+                          selection.mask.width());
+  }
+
+  for (auto input_hash : input_hashes)
+    stream << input_hash;
+
+  QByteArray digest = QCryptographicHash::hash(key, QCryptographicHash::Sha1);
+
+  quint64 hash;
+  std::memcpy(&hash, digest.constData(), sizeof(hash));
+  return hash;
+}
+
+int costOf(const QImage& image)
+{
+  return static_cast<int>(std::max<qint64>(1, image.sizeInBytes() / 1024));
+}
+
+} // namespace
+
+OperationGraph::OperationGraph(qint64 cache_limit):
+  results_(static_cast<int>(cache_limit / 1024)),
+  last_result_hash_(0),
+  source_count_(0)
+{
+}
+
+void OperationGraph::setCacheLimit(qint64 bytes)
+{
+  results_.setMaxCost(static_cast<int>(bytes / 1024));
+}
+
+void OperationGraph::clear()
+{
+  nodes_.clear();
+  free_nodes_.clear();
+  results_.clear();
+  last_result_ = QImage();
+}
+
+int OperationGraph::addSource(const QImage& image)
+{
+  Node node;
+  node.source = image;
+  // Sources are told apart by the order they were added
+  node.hash = hashNode("source", { source_count_++ }, {});
+  node.removed = false;
+
+  return insertNode(std::move(node));
+}
+
+int OperationGraph::addOperation(const QString& name, const QVariantList& parameters, const QVector<int>& inputs,
+                                 const image_op::Selection& selection)
+{
+  auto* operation = image_op::findOperation(name);
+
+  if (!operation || inputs.size() != operation->input_count)
+    return -1;
+
+  QVector<quint64> input_hashes;
+
+  for (auto input : inputs) {
+    if (!isValid(input))
+      return -1;
+    input_hashes.append(nodes_[static_cast<size_t>(input)].hash);
+  }
+
+  Node node;
+  node.name = name;
+  node.parameters = parameters;
+  node.inputs = inputs;
+  node.selection = selection;
+  node.hash = hashNode(name, parameters, input_hashes, selection);
+  node.removed = false;
+
+  return insertNode(std::move(node));
+}
+
+QImage OperationGraph::evaluate(int node)
+{
+  if (!isValid(node))
+    return QImage();
+
+  const auto& current = nodes_[static_cast<size_t>(node)];
+
+  if (!current.source.isNull())
+    return current.source;
+
+  QImage memoized_result = memoizedResult(current.hash);
+  if (!memoized_result.isNull())
+    return memoized_result;
+
+  // A chain of single input operations none of which is memoized, like the
+  // ones after a changed node, runs as one pipeline fusing what it can
+  QVector<image_op::PipelineStage> stages;
+  int base = node;
+
+  while (isValid(base)) {
+    const auto& base_node = nodes_[static_cast<size_t>(base)];
+    if (!base_node.source.isNull() || base_node.inputs.size() != 1 || !memoizedResult(base_node.hash).isNull())
+      break;
+
+    stages.prepend({ base_node.name, base_node.parameters, base_node.selection });
+    base = base_node.inputs[0];
+  }
+
+  if (stages.size() > 1) {
+    QImage result = image_op::applyPipeline(evaluate(base), stages);
+    setResult(node, result);
+    return result;
+  }
+
+  QVector<QImage> input_images;
+
+  for (auto input : current.inputs)
+    input_images.append(evaluate(input));
+
+  QImage result = image_op::applyOperationInSelection(current.name, std::move(input_images), current.parameters,
+                                                      current.selection);
+  setResult(node, result);
+
+  return result;
+}
+
+void OperationGraph::setResult(int node, const QImage& image)
+{
+  if (!isValid(node) || image.isNull() || !nodes_[static_cast<size_t>(node)].source.isNull())
+    return;
+
+  // Results over the limit of the cache are not inserted, the last one is
+  // kept anyway so the next operation does not run the chain again
+  last_result_hash_ = nodes_[static_cast<size_t>(node)].hash;
+  last_result_ = image;
+  results_.insert(last_result_hash_, new QImage(image), costOf(image));
+}
+
+void OperationGraph::removeUnreachable(const QVector<int>& heads)
+{
+  std::vector<bool> reachable(nodes_.size(), false);
+  std::vector<int> pending(heads.begin(), heads.end());
+
+  while (!pending.empty()) {
+    int node = pending.back();
+    pending.pop_back();
+
+    if (!isValid(node) || reachable[static_cast<size_t>(node)])
+      continue;
+
+    reachable[static_cast<size_t>(node)] = true;
+    for (auto input : nodes_[static_cast<size_t>(node)].inputs)
+      pending.push_back(input);
+  }
+
+  for (size_t i = 0; i < nodes_.size(); i++) {
+    if (reachable[i] || nodes_[i].removed)
+      continue;
+
+    // Memoized results stay until the cache evicts them, other nodes
+    // may have the same hash
+    nodes_[i] = Node();
+    nodes_[i].removed = true;
+    free_nodes_.push_back(static_cast<int>(i));
+  }
+}
+
+int OperationGraph::setParameters(int head, int node, const QVariantList& parameters)
+{
+  auto path = chain(head);
+  int index = path.indexOf(node);
+
+  if (index <= 0)
+    return head;
+
+  // The new version of each node takes the new version of its predecessor
+  int previous_version = path[index - 1];
+
+  for (int i = index; i < path.size(); i++) {
+    const auto original = nodes_[static_cast<size_t>(path[i])];
+    auto inputs = original.inputs;
+    inputs[0] = previous_version;
+
+    previous_version = addOperation(original.name, i == index ? parameters : original.parameters, inputs,
+                                    original.selection);
+
+    if (previous_version < 0)
+      return head;
+  }
+
+  return previous_version;
+}
+
+QVector<int> OperationGraph::chain(int head) const
+{
+  QVector<int> path;
+
+  for (int node = head; isValid(node); ) {
+    path.prepend(node);
+    const auto& inputs = nodes_[static_cast<size_t>(node)].inputs;
+    node = inputs.isEmpty() ? -1 : inputs[0];
+  }
+
+  return path;
+}
+
+bool OperationGraph::isSource(int node) const
+{
+  return isValid(node) && nodes_[static_cast<size_t>(node)].inputs.isEmpty();
+}
+
+QString OperationGraph::name(int node) const
+{
+  return isValid(node) ? nodes_[static_cast<size_t>(node)].name : QString();
+}
+
+QVariantList OperationGraph::parameters(int node) const
+{
+  return isValid(node) ? nodes_[static_cast<size_t>(node)].parameters : QVariantList();
+}
+
+QVector<int> OperationGraph::inputs(int node) const
+{
+  return isValid(node) ? nodes_[static_cast<size_t>(node)].inputs : QVector<int>();
+}
+
+image_op::Selection OperationGraph::selection(int node) const
+{
+  return isValid(node) ? nodes_[static_cast<size_t>(node)].selection : image_op::Selection();
+}
+
+bool OperationGraph::isValid(int node) const
+{
+  return node >= 0 && static_cast<size_t>(node) < nodes_.size() && !nodes_[static_cast<size_t>(node)].removed;
+}
+
+int OperationGraph::insertNode(Node node)
+{
+  if (free_nodes_.empty()) {
+    nodes_.push_back(std::move(node));
+    return static_cast<int>(nodes_.size()) - 1;
+  }
+
+  int id = free_nodes_.back();
+  free_nodes_.pop_back();
+  nodes_[static_cast<size_t>(id)] = std::move(node);
+  return id;
+}
+
+QImage OperationGraph::memoizedResult(quint64 hash) const
+{
+  if (hash == last_result_hash_ && !last_result_.isNull())
+    return last_result_;
+
+  if (auto* result = results_.object(hash))
+    return *result;
+
+  return QImage();
+}
@@ -0,0 +1,464 @@
+#include "include/operation_registry.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include <QHash>
+
+#include "include/denoise.hpp"
+#include "include/histogram_cache.hpp"
+#include "include/image_operations.hpp"
+#include "include/integral_image.hpp"
+#include "include/morphology.hpp"
+#include "include/reference_operations.hpp"
+
+namespace image_op {
+
+namespace {
+
+/**
+ * Implementation of every operation, so the same registry can apply
+ * either the optimized functions or the reference ones
+ */
+struct Backend
+{
+  QImage (*mirrorHorizontally)(QImage);
+  QImage (*mirrorVertically)(QImage);
+  QImage (*convertColoredToGrayscale)(QImage);
+  QImage (*quantizeGrayscale)(QImage, int);
+  QImage (*adjustBrightness)(QImage, int);
+  QImage (*adjustContrast)(QImage, int);
+  QImage (*getNegativeImage)(QImage);
+  QImage (*equalizeHistogram)(QImage);
+  QImage (*matchGrayscaleHistogram)(QImage, QImage);
+  QImage (*zoomOutByFactors)(QImage, int, int);
+  QImage (*zoomIn2x2)(QImage);
+  QImage (*rotate90DegreesClockwise)(QImage);
+  QImage (*rotate90DegreesCounterClockwise)(QImage);
+  QImage (*applyConvolutionWith3x3Kernel)(QImage, QVector<QVector<double>>, bool);
+  QImage (*erodeImage)(QImage, int, int);
+  QImage (*dilateImage)(QImage, int, int);
+  QImage (*openImage)(QImage, int, int);
+  QImage (*closeImage)(QImage, int, int);
+  QImage (*boxBlur)(QImage, int, int);
+  QImage (*sauvolaThreshold)(QImage, int, double);
+  QImage (*bradleyThreshold)(QImage, int, double);
+  QImage (*otsuThreshold)(QImage, int);
+  QImage (*nonLocalMeansDenoise)(QImage, int, int, double);
+};
+
+const Backend kOptimizedBackend = {
+  image_op::mirrorHorizontally,
+  image_op::mirrorVertically,
+  image_op::convertColoredToGrayscale,
+  image_op::quantizeGrayscale,
+  image_op::adjustBrightness,
+  image_op::adjustContrast,
+  image_op::getNegativeImage,
+  image_op::equalizeHistogram,
+  image_op::matchGrayscaleHistogram,
+  image_op::zoomOutByFactors,
+  image_op::zoomIn2x2,
+  image_op::rotate90DegreesClockwise,
+  image_op::rotate90DegreesCounterClockwise,
+  image_op::applyConvolutionWith3x3Kernel,
+  image_op::erodeImage,
+  image_op::dilateImage,
+  image_op::openImage,
+  image_op::closeImage,
+  image_op::boxBlur,
+  image_op::sauvolaThreshold,
+  image_op::bradleyThreshold,
+  image_op::otsuThreshold,
+  image_op::nonLocalMeansDenoise
+};
+
+const Backend kReferenceBackend = {
+  reference::mirrorHorizontally,
+  reference::mirrorVertically,
+  reference::convertColoredToGrayscale,
+  reference::quantizeGrayscale,
+  reference::adjustBrightness,
+  reference::adjustContrast,
+  reference::getNegativeImage,
+  reference::equalizeHistogram,
+  reference::matchGrayscaleHistogram,
+  reference::zoomOutByFactors,
+  reference::zoomIn2x2,
+  reference::rotate90DegreesClockwise,
+  reference::rotate90DegreesCounterClockwise,
+  reference::applyConvolutionWith3x3Kernel,
+  reference::erodeImage,
+  reference::dilateImage,
+  reference::openImage,
+  reference::closeImage,
+  reference::boxBlur,
+  reference::sauvolaThreshold,
+  reference::bradleyThreshold,
+  reference::otsuThreshold,
+  reference::nonLocalMeansDenoise
+};
+
+using OperationFunction = std::function<QImage(const Backend&, const QVector<QImage>&, const QVariantList&)>;
+
+struct RegisteredOperation
+{
+  OperationInfo info;
+  OperationFunction apply;
+};
+
+const QVector<RegisteredOperation>& registeredOperations()
+{
+  // Rectangle of the morphological operations, a line if either side is 1
+  static const QVector<OperationParameter> kStructuringElementParameters = {
+    { "Element width", OperationParameter::Integer, 1, 65535 },
+    { "Element height", OperationParameter::Integer, 1, 65535 }
+  };
+
+  static const QVector<RegisteredOperation> operations = {
+    { { "mirror_horizontally", "Mirror horizontally", 1, {} },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList&) {
+        return backend.mirrorHorizontally(inputs[0]);
+      } },
+    { { "mirror_vertically", "Mirror vertically", 1, {} },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList&) {
+        return backend.mirrorVertically(inputs[0]);
+      } },
+    { { "grayscale", "Grayscale", 1, {} },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList&) {
+        return backend.convertColoredToGrayscale(inputs[0]);
+      } },
+    { { "quantize", "Quantize", 1, { { "Colors", OperationParameter::Integer, 1, 255 } } },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList& parameters) {
+        return backend.quantizeGrayscale(inputs[0], parameters[0].toInt());
+      } },
+    { { "brightness", "Brightness", 1, { { "Value", OperationParameter::Integer, -255, 255 } } },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList& parameters) {
+        return backend.adjustBrightness(inputs[0], parameters[0].toInt());
+      } },
+    { { "contrast", "Contrast", 1, { { "Factor", OperationParameter::Integer, 1, 255 } } },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList& parameters) {
+        return backend.adjustContrast(inputs[0], parameters[0].toInt());
+      } },
+    { { "negative", "Negative", 1, {} },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList&) {
+        return backend.getNegativeImage(inputs[0]);
+      } },
+    { { "equalize", "Equalize histogram", 1, {} },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList&) {
+        return backend.equalizeHistogram(inputs[0]);
+      } },
+    { { "match_histogram", "Match histogram", 2, {} },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList&) {
+        return backend.matchGrayscaleHistogram(inputs[0], inputs[1]);
+      } },
+    { { "zoom_out", "Zoom out", 1, { { "Factor on x axis", OperationParameter::Integer, 1, 65535 },
+        { "Factor on y axis", OperationParameter::Integer, 1, 65535 } } },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList& parameters) {
+        if (parameters[0].toInt() < 1 || parameters[1].toInt() < 1)
+          return QImage();
+        return backend.zoomOutByFactors(inputs[0], parameters[0].toInt(), parameters[1].toInt());
+      } },
+    { { "zoom_in", "Zoom in", 1, {} },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList&) {
+        return backend.zoomIn2x2(inputs[0]);
+      } },
+    { { "rotate_clockwise", "Rotate clockwise", 1, {} },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList&) {
+        return backend.rotate90DegreesClockwise(inputs[0]);
+      } },
+    { { "rotate_counter_clockwise", "Rotate counter-clockwise", 1, {} },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList&) {
+        return backend.rotate90DegreesCounterClockwise(inputs[0]);
+      } },
+    { { "convolution", "Convolution", 1,
+        { { "Kernel row 1, column 1", OperationParameter::Real, -1e6, 1e6 },
+          { "Kernel row 1, column 2", OperationParameter::Real, -1e6, 1e6 },
+          { "Kernel row 1, column 3", OperationParameter::Real, -1e6, 1e6 },
+          { "Kernel row 2, column 1", OperationParameter::Real, -1e6, 1e6 },
+          { "Kernel row 2, column 2", OperationParameter::Real, -1e6, 1e6 },
+          { "Kernel row 2, column 3", OperationParameter::Real, -1e6, 1e6 },
+          { "Kernel row 3, column 1", OperationParameter::Real, -1e6, 1e6 },
+          { "Kernel row 3, column 2", OperationParameter::Real, -1e6, 1e6 },
+          { "Kernel row 3, column 3", OperationParameter::Real, -1e6, 1e6 },
+          { "Add bias", OperationParameter::Boolean, 0, 1 } } },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList& parameters) {
+        QVector<QVector<double>> kernel;
+        for (int i = 0; i < 3; i++) {
+          kernel.append(QVector<double>(3));
+          for (int j = 0; j < 3; j++)
+            kernel[i][j] = parameters[i*3 + j].toDouble();
+        }
+        return backend.applyConvolutionWith3x3Kernel(inputs[0], kernel, parameters[9].toBool());
+      } },
+    { { "erode", "Erode", 1, kStructuringElementParameters },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList& parameters) {
+        if (parameters[0].toInt() < 1 || parameters[1].toInt() < 1)
+          return QImage();
+        return backend.erodeImage(inputs[0], parameters[0].toInt(), parameters[1].toInt());
+      } },
+    { { "dilate", "Dilate", 1, kStructuringElementParameters },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList& parameters) {
+        if (parameters[0].toInt() < 1 || parameters[1].toInt() < 1)
+          return QImage();
+        return backend.dilateImage(inputs[0], parameters[0].toInt(), parameters[1].toInt());
+      } },
+    { { "open", "Open", 1, kStructuringElementParameters },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList& parameters) {
+        if (parameters[0].toInt() < 1 || parameters[1].toInt() < 1)
+          return QImage();
+        return backend.openImage(inputs[0], parameters[0].toInt(), parameters[1].toInt());
+      } },
+    { { "close", "Close", 1, kStructuringElementParameters },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList& parameters) {
+        if (parameters[0].toInt() < 1 || parameters[1].toInt() < 1)
+          return QImage();
+        return backend.closeImage(inputs[0], parameters[0].toInt(), parameters[1].toInt());
+      } },
+    { { "box_blur", "Box blur", 1, { { "Box width", OperationParameter::Integer, 1, 65535 },
+        { "Box height", OperationParameter::Integer, 1, 65535 } } },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList& parameters) {
+        if (parameters[0].toInt() < 1 || parameters[1].toInt() < 1)
+          return QImage();
+        return backend.boxBlur(inputs[0], parameters[0].toInt(), parameters[1].toInt());
+      } },
+    { { "sauvola_threshold", "Sauvola threshold", 1, { { "Window size", OperationParameter::Integer, 1, 65535 },
+        { "k", OperationParameter::Real, 0, 1 } } },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList& parameters) {
+        if (parameters[0].toInt() < 1)
+          return QImage();
+        return backend.sauvolaThreshold(inputs[0], parameters[0].toInt(), parameters[1].toDouble());
+      } },
+    { { "bradley_threshold", "Bradley threshold", 1, { { "Window size", OperationParameter::Integer, 1, 65535 },
+        { "t", OperationParameter::Real, 0, 1 } } },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList& parameters) {
+        if (parameters[0].toInt() < 1)
+          return QImage();
+        return backend.bradleyThreshold(inputs[0], parameters[0].toInt(), parameters[1].toDouble());
+      } },
+    { { "otsu_threshold", "Otsu threshold", 1, { { "Classes", OperationParameter::Integer, 2, 16 } } },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList& parameters) {
+        if (parameters[0].toInt() < 2 || parameters[0].toInt() > 16)
+          return QImage();
+        return backend.otsuThreshold(inputs[0], parameters[0].toInt());
+      } },
+    { { "nlm_denoise", "Non-local means denoise", 1, { { "Search radius", OperationParameter::Integer, 1, 15 },
+        { "Patch radius", OperationParameter::Integer, 0, 7 },
+        { "Strength", OperationParameter::Real, 0.1, 255 } } },
+      [](const Backend& backend, const QVector<QImage>& inputs, const QVariantList& parameters) {
+        if (parameters[0].toInt() < 1 || parameters[1].toInt() < 0 || parameters[2].toDouble() <= 0)
+          return QImage();
+        return backend.nonLocalMeansDenoise(inputs[0], parameters[0].toInt(), parameters[1].toInt(),
+                                            parameters[2].toDouble());
+      } },
+  };
+
+  return operations;
+}
+
+const RegisteredOperation* findRegisteredOperation(const QString& name)
+{
+  for (const auto& operation : registeredOperations()) {
+    if (operation.info.name == name)
+      return &operation;
+  }
+
+  return nullptr;
+}
+
+using ToneCurveFunction = std::function<std::vector<int>(const QVariantList&, const HistogramInfo&)>;
+
+/**
+ * Tone curves of the point operations, whose result histogram follows from
+ * the histogram of their input, on the 0 to 255 scale. An empty curve means
+ * the result histogram cannot be derived from this input
+ */
+const QHash<QString, ToneCurveFunction>& toneCurves()
+{
+  auto curve = [](std::function<int(int)> tone_function) {
+    std::vector<int> tone_curve(256);
+    for (int i = 0; i < 256; i++)
+      tone_curve[static_cast<size_t>(i)] = std::max(0, std::min(255, tone_function(i)));
+    return tone_curve;
+  };
+
+  static const QHash<QString, ToneCurveFunction> tone_curves = {
+    { "quantize", [curve](const QVariantList& parameters, const HistogramInfo& input) {
+        // Quantization maps the luminance, the red channel only when grayscale
+        if (!input.grayscale)
+          return std::vector<int>();
+
+        // Range of the luminance of the tones present, like the statistics
+        auto luminance = [](int tone) { return 0.299 * tone + 0.587 * tone + 0.114 * tone; };
+        int minimum = 255;
+        int maximum = 0;
+        for (int tone = 0; tone < 256; tone++) {
+          if (input.histogram[static_cast<size_t>(tone)] > 0) {
+            int truncated_luminance = static_cast<int>(std::max(0.0, std::min(255.0, luminance(tone))));
+            minimum = std::min(minimum, truncated_luminance);
+            maximum = std::max(maximum, truncated_luminance);
+          }
+        }
+
+        int num_colors = parameters[0].toInt();
+        double step = num_colors > 1 ? (maximum - minimum) / (num_colors - 1.0) : 0;
+
+        return curve([=](int tone) {
+          double color = minimum;
+          if (step > 0)
+            color += std::round((luminance(tone) - minimum) / step) * step;
+          return static_cast<int>(std::max(0.0, std::min(255.0, color)));
+        });
+      } },
+    { "brightness", [curve](const QVariantList& parameters, const HistogramInfo&) {
+        int brightness_value = parameters[0].toInt();
+        return curve([brightness_value](int tone) { return tone + brightness_value; });
+      } },
+    { "contrast", [curve](const QVariantList& parameters, const HistogramInfo&) {
+        int contrast_factor = parameters[0].toInt();
+        return curve([contrast_factor](int tone) { return tone * contrast_factor; });
+      } },
+    { "negative", [curve](const QVariantList&, const HistogramInfo&) {
+        return curve([](int tone) { return 255 - tone; });
+      } },
+    { "equalize", [](const QVariantList&, const HistogramInfo& input) {
+        // Colored images are equalized by their luminance, which is not cached
+        if (!input.grayscale)
+          return std::vector<int>();
+        return equalizationCurve(input.histogram);
+      } },
+    { "otsu_threshold", [](const QVariantList& parameters, const HistogramInfo& input) {
+        // Like quantization, colored images are split by their luminance
+        if (!input.grayscale)
+          return std::vector<int>();
+        return otsuCurve(input.histogram, parameters[0].toInt());
+      } },
+  };
+
+  return tone_curves;
+}
+
+/**
+ * Carries the cached histogram of the input of a point operation forward
+ * to its result, so it never has to be scanned
+ */
+void propagateHistogram(const QString& name, const QVector<QImage>& inputs,
+                        const QVariantList& parameters, const QImage& result)
+{
+  ToneCurveFunction tone_curve_function = toneCurves().value(name);
+  if (result.isNull() || !tone_curve_function)
+    return;
+
+  // Deeper formats are binned to 0 to 255, where the curves are not exact
+  auto format = inputs[0].format();
+  if (format != QImage::Format_Grayscale8 && format != QImage::Format_RGB32 && format != QImage::Format_ARGB32)
+    return;
+
+  HistogramInfo input_info;
+  if (!findCachedHistogram(inputs[0], &input_info))
+    return;
+
+  auto tone_curve = tone_curve_function(parameters, input_info);
+  if (tone_curve.empty())
+    return;
+
+  // Curves apply to every channel alike, so grayscale images stay grayscale
+  cacheHistogram(result, { mapHistogram(input_info.histogram, tone_curve), input_info.grayscale });
+}
+
+/**
+ * The reference implementations read every pixel as QRgb, so inputs in
+ * other formats get the conversion the optimized operations would make
+ */
+QImage toReferenceFormat(const QImage& image)
+{
+  if (image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32)
+    return image;
+
+  return image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+}
+
+QImage applyWithBackend(const Backend& backend, const QString& name,
+                        const QVector<QImage>& inputs, const QVariantList& parameters)
+{
+  auto* operation = findRegisteredOperation(name);
+
+  if (!operation
+      || inputs.size() != operation->info.input_count
+      || parameters.size() != operation->info.parameters.size())
+    return QImage();
+
+  for (const auto& input : inputs) {
+    if (input.isNull())
+      return QImage();
+  }
+
+  return operation->apply(backend, inputs, parameters);
+}
+
+} // namespace
+
+const QVector<OperationInfo>& availableOperations()
+{
+  static const QVector<OperationInfo> operations = [] {
+    QVector<OperationInfo> infos;
+    for (const auto& operation : registeredOperations())
+      infos.append(operation.info);
+    return infos;
+  }();
+
+  return operations;
+}
+
+const OperationInfo* findOperation(const QString& name)
+{
+  auto* operation = findRegisteredOperation(name);
+  return operation ? &operation->info : nullptr;
+}
+
+QImage applyOperation(const QString& name, const QVector<QImage>& inputs, const QVariantList& parameters)
+{
+  QImage result = applyWithBackend(kOptimizedBackend, name, inputs, parameters);
+  propagateHistogram(name, inputs, parameters, result);
+  return result;
+}
+
+QImage applyReferenceOperation(const QString& name, const QVector<QImage>& inputs, const QVariantList& parameters)
+{
+  QVector<QImage> reference_inputs;
+  for (const auto& input : inputs)
+    reference_inputs.append(toReferenceFormat(input));
+
+  return applyWithBackend(kReferenceBackend, name, reference_inputs, parameters);
+}
+
+int referenceTolerance(const QString& name)
+{
+  // Optimized operations that are not bit-exact list their largest
+  // difference on any channel here
+  static const QHash<QString, int> tolerances = {
+    // Gray images are denoised on one channel instead of three equal ones,
+    // which can round the weights the other way
+    { "nlm_denoise", 1 }
+  };
+
+  return tolerances.value(name, 0);
+}
+
+QString describeOperation(const QString& name, const QVariantList& parameters)
+{
+  auto* operation = findOperation(name);
+  QString description = operation ? operation->title : name;
+
+  if (parameters.isEmpty())
+    return description;
+
+  QStringList values;
+  for (const auto& parameter : parameters)
+    values.append(parameter.toString());
+
+  return QString("%1 (%2)").arg(description, values.join(", "));
+}
+
+} // namespace image_op
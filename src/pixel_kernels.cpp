@@ -0,0 +1,850 @@
+#include "include/pixel_kernels.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#ifdef PHOTOCHOPP_X86
+#include <immintrin.h>
+#endif
+
+namespace image_op {
+
+namespace kernels {
+
+namespace {
+
+constexpr QRgb kAlphaMask = 0xff000000;
+
+// Scalar versions, also used for the pixels left after the vector loops
+
+void reverseRange(QRgb* row, int left, int right)
+{
+  // Reverses row[left, right)
+  while (right - left > 1)
+    std::swap(row[left++], row[--right]);
+}
+
+void mirrorScalar(QRgb* row, int width)
+{
+  reverseRange(row, 0, width);
+}
+
+void adjustBrightnessScalar(QRgb* row, int width, int brightness_value)
+{
+  for (int column_index = 0; column_index < width; column_index++) {
+    QRgb pixel = row[column_index];
+    int red = std::min(255, std::max(0, qRed(pixel) + brightness_value));
+    int green = std::min(255, std::max(0, qGreen(pixel) + brightness_value));
+    int blue = std::min(255, std::max(0, qBlue(pixel) + brightness_value));
+    row[column_index] = qRgb(red, green, blue);
+  }
+}
+
+void adjustContrastScalar(QRgb* row, int width, int contrast_factor)
+{
+  for (int column_index = 0; column_index < width; column_index++) {
+    QRgb pixel = row[column_index];
+    int red = std::min(255, std::max(0, qRed(pixel) * contrast_factor));
+    int green = std::min(255, std::max(0, qGreen(pixel) * contrast_factor));
+    int blue = std::min(255, std::max(0, qBlue(pixel) * contrast_factor));
+    row[column_index] = qRgb(red, green, blue);
+  }
+}
+
+void negateScalar(QRgb* row, int width)
+{
+  for (int column_index = 0; column_index < width; column_index++)
+    row[column_index] = (row[column_index] ^ 0x00ffffff) | kAlphaMask;
+}
+
+void minimumBytesScalar(const uchar* first, const uchar* second, uchar* result, int count)
+{
+  for (int index = 0; index < count; index++)
+    result[index] = std::min(first[index], second[index]);
+}
+
+void maximumBytesScalar(const uchar* first, const uchar* second, uchar* result, int count)
+{
+  for (int index = 0; index < count; index++)
+    result[index] = std::max(first[index], second[index]);
+}
+
+void compareColorsScalar(const QRgb* first, const QRgb* second, int count,
+                         quint64* squared_sum, int* maximum_difference)
+{
+  quint64 sum = 0;
+  int maximum = *maximum_difference;
+
+  for (int index = 0; index < count; index++) {
+    int red = std::abs(qRed(first[index]) - qRed(second[index]));
+    int green = std::abs(qGreen(first[index]) - qGreen(second[index]));
+    int blue = std::abs(qBlue(first[index]) - qBlue(second[index]));
+    sum += static_cast<quint64>(red * red + green * green + blue * blue);
+    maximum = std::max({ maximum, red, green, blue });
+  }
+
+  *squared_sum += sum;
+  *maximum_difference = maximum;
+}
+
+void deinterleaveScalar(const QRgb* row, uchar* red, uchar* green, uchar* blue, uchar* alpha, int count)
+{
+  for (int index = 0; index < count; index++) {
+    red[index] = static_cast<uchar>(qRed(row[index]));
+    green[index] = static_cast<uchar>(qGreen(row[index]));
+    blue[index] = static_cast<uchar>(qBlue(row[index]));
+  }
+
+  if (alpha) {
+    for (int index = 0; index < count; index++)
+      alpha[index] = static_cast<uchar>(qAlpha(row[index]));
+  }
+}
+
+void interleaveScalar(const uchar* red, const uchar* green, const uchar* blue, const uchar* alpha, QRgb* row,
+                      int count)
+{
+  for (int index = 0; index < count; index++)
+    row[index] = qRgba(red[index], green[index], blue[index], alpha ? alpha[index] : 255);
+}
+
+/**
+ * Value added to or subtracted from the color channels, leaving alpha
+ * untouched since it is overwritten afterwards
+ */
+int brightnessStep(int brightness_value)
+{
+  int step = std::min(255, std::abs(brightness_value));
+  return step | (step << 8) | (step << 16);
+}
+
+#ifdef PHOTOCHOPP_X86
+
+// Pixels compared before the 32-bit sums of squares of the vector versions
+// are widened to 64 bits, each lane adding at most 4 * 255^2 per vector
+constexpr int kComparedPixelsPerBlock = 16384;
+
+/**
+ * Largest of the bytes stored from a maximum register
+ */
+int largestByte(const uchar* bytes, int count)
+{
+  return *std::max_element(bytes, bytes + count);
+}
+
+// Channels multiplied by the contrast factor saturate when they are at
+// least 255 / factor + 1, below that the 16-bit product fits in a byte.
+// The vector versions only handle factors from 2 to 255
+
+PHOTOCHOPP_TARGET("sse2")
+void mirrorSse2(QRgb* row, int width)
+{
+  int left = 0;
+  int right = width;
+
+  for (; right - left >= 8; left += 4, right -= 4) {
+    __m128i left_pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + left));
+    __m128i right_pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + right - 4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(row + left), _mm_shuffle_epi32(right_pixels, 0x1b));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(row + right - 4), _mm_shuffle_epi32(left_pixels, 0x1b));
+  }
+
+  reverseRange(row, left, right);
+}
+
+PHOTOCHOPP_TARGET("sse2")
+void adjustBrightnessSse2(QRgb* row, int width, int brightness_value)
+{
+  const __m128i step = _mm_set1_epi32(brightnessStep(brightness_value));
+  const __m128i alpha = _mm_set1_epi32(static_cast<int>(kAlphaMask));
+  int column_index = 0;
+
+  for (; column_index + 4 <= width; column_index += 4) {
+    auto* pointer = reinterpret_cast<__m128i*>(row + column_index);
+    __m128i pixels = _mm_loadu_si128(pointer);
+    pixels = brightness_value >= 0 ? _mm_adds_epu8(pixels, step) : _mm_subs_epu8(pixels, step);
+    _mm_storeu_si128(pointer, _mm_or_si128(pixels, alpha));
+  }
+
+  adjustBrightnessScalar(row + column_index, width - column_index, brightness_value);
+}
+
+PHOTOCHOPP_TARGET("sse2")
+void adjustContrastSse2(QRgb* row, int width, int contrast_factor)
+{
+  if (contrast_factor < 2 || contrast_factor > 255) {
+    adjustContrastScalar(row, width, contrast_factor);
+    return;
+  }
+
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i factor = _mm_set1_epi16(static_cast<short>(contrast_factor));
+  const __m128i threshold = _mm_set1_epi8(static_cast<char>(255 / contrast_factor + 1));
+  const __m128i alpha = _mm_set1_epi32(static_cast<int>(kAlphaMask));
+  int column_index = 0;
+
+  for (; column_index + 4 <= width; column_index += 4) {
+    auto* pointer = reinterpret_cast<__m128i*>(row + column_index);
+    __m128i pixels = _mm_loadu_si128(pointer);
+    __m128i low = _mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), factor);
+    __m128i high = _mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), factor);
+    __m128i saturated = _mm_cmpeq_epi8(_mm_max_epu8(pixels, threshold), pixels);
+    __m128i result = _mm_or_si128(_mm_packus_epi16(low, high), saturated);
+    _mm_storeu_si128(pointer, _mm_or_si128(result, alpha));
+  }
+
+  adjustContrastScalar(row + column_index, width - column_index, contrast_factor);
+}
+
+PHOTOCHOPP_TARGET("sse2")
+void negateSse2(QRgb* row, int width)
+{
+  const __m128i colors = _mm_set1_epi32(0x00ffffff);
+  const __m128i alpha = _mm_set1_epi32(static_cast<int>(kAlphaMask));
+  int column_index = 0;
+
+  for (; column_index + 4 <= width; column_index += 4) {
+    auto* pointer = reinterpret_cast<__m128i*>(row + column_index);
+    __m128i pixels = _mm_xor_si128(_mm_loadu_si128(pointer), colors);
+    _mm_storeu_si128(pointer, _mm_or_si128(pixels, alpha));
+  }
+
+  negateScalar(row + column_index, width - column_index);
+}
+
+PHOTOCHOPP_TARGET("sse2")
+void minimumBytesSse2(const uchar* first, const uchar* second, uchar* result, int count)
+{
+  int index = 0;
+
+  for (; index + 16 <= count; index += 16) {
+    __m128i first_values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + index));
+    __m128i second_values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(second + index));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(result + index), _mm_min_epu8(first_values, second_values));
+  }
+
+  minimumBytesScalar(first + index, second + index, result + index, count - index);
+}
+
+PHOTOCHOPP_TARGET("sse2")
+void maximumBytesSse2(const uchar* first, const uchar* second, uchar* result, int count)
+{
+  int index = 0;
+
+  for (; index + 16 <= count; index += 16) {
+    __m128i first_values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + index));
+    __m128i second_values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(second + index));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(result + index), _mm_max_epu8(first_values, second_values));
+  }
+
+  maximumBytesScalar(first + index, second + index, result + index, count - index);
+}
+
+PHOTOCHOPP_TARGET("sse2")
+void compareColorsSse2(const QRgb* first, const QRgb* second, int count,
+                       quint64* squared_sum, int* maximum_difference)
+{
+  const __m128i color_mask = _mm_set1_epi32(0x00ffffff);
+  const __m128i zero = _mm_setzero_si128();
+  __m128i sums = zero;
+  __m128i maximums = zero;
+  int vector_count = count - count % 4;
+
+  for (int block_start = 0; block_start < vector_count; block_start += kComparedPixelsPerBlock) {
+    int block_end = std::min(vector_count, block_start + kComparedPixelsPerBlock);
+    __m128i block_sums = zero;
+
+    for (int index = block_start; index < block_end; index += 4) {
+      __m128i first_pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + index));
+      __m128i second_pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(second + index));
+      __m128i differences = _mm_or_si128(_mm_subs_epu8(first_pixels, second_pixels),
+                                         _mm_subs_epu8(second_pixels, first_pixels));
+      differences = _mm_and_si128(differences, color_mask);
+      maximums = _mm_max_epu8(maximums, differences);
+
+      __m128i low = _mm_unpacklo_epi8(differences, zero);
+      __m128i high = _mm_unpackhi_epi8(differences, zero);
+      block_sums = _mm_add_epi32(block_sums, _mm_add_epi32(_mm_madd_epi16(low, low), _mm_madd_epi16(high, high)));
+    }
+
+    sums = _mm_add_epi64(sums, _mm_add_epi64(_mm_unpacklo_epi32(block_sums, zero),
+                                             _mm_unpackhi_epi32(block_sums, zero)));
+  }
+
+  alignas(16) quint64 lanes[2];
+  alignas(16) uchar bytes[16];
+  _mm_store_si128(reinterpret_cast<__m128i*>(lanes), sums);
+  _mm_store_si128(reinterpret_cast<__m128i*>(bytes), maximums);
+  *squared_sum += lanes[0] + lanes[1];
+  *maximum_difference = std::max(*maximum_difference, largestByte(bytes, 16));
+
+  compareColorsScalar(first + vector_count, second + vector_count, count - vector_count,
+                      squared_sum, maximum_difference);
+}
+
+/**
+ * Bytes of the channel at the shift from 16 pixels: the channel is moved to
+ * the low byte of each 32-bit lane, then the lanes of the four vectors are
+ * packed to bytes, which keeps their order
+ */
+PHOTOCHOPP_TARGET("sse2")
+__m128i packChannelSse2(const __m128i* pixels, int shift)
+{
+  const __m128i byte_mask = _mm_set1_epi32(0xff);
+
+  __m128i lanes[4];
+  for (int part = 0; part < 4; part++)
+    lanes[part] = _mm_and_si128(_mm_srli_epi32(pixels[part], shift), byte_mask);
+
+  return _mm_packus_epi16(_mm_packs_epi32(lanes[0], lanes[1]), _mm_packs_epi32(lanes[2], lanes[3]));
+}
+
+PHOTOCHOPP_TARGET("sse2")
+void deinterleaveSse2(const QRgb* row, uchar* red, uchar* green, uchar* blue, uchar* alpha, int count)
+{
+  int index = 0;
+
+  for (; index + 16 <= count; index += 16) {
+    __m128i pixels[4];
+    for (int part = 0; part < 4; part++)
+      pixels[part] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + index + part * 4));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(blue + index), packChannelSse2(pixels, 0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(green + index), packChannelSse2(pixels, 8));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(red + index), packChannelSse2(pixels, 16));
+    if (alpha)
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(alpha + index), packChannelSse2(pixels, 24));
+  }
+
+  deinterleaveScalar(row + index, red + index, green + index, blue + index, alpha ? alpha + index : nullptr,
+                     count - index);
+}
+
+PHOTOCHOPP_TARGET("sse2")
+void interleaveSse2(const uchar* red, const uchar* green, const uchar* blue, const uchar* alpha, QRgb* row,
+                    int count)
+{
+  const __m128i opaque = _mm_set1_epi8(static_cast<char>(0xff));
+  int index = 0;
+
+  // Blue with green and red with alpha are paired first, then the pairs
+  for (; index + 16 <= count; index += 16) {
+    __m128i red_values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(red + index));
+    __m128i green_values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(green + index));
+    __m128i blue_values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blue + index));
+    __m128i alpha_values = alpha ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha + index)) : opaque;
+
+    __m128i blue_green_low = _mm_unpacklo_epi8(blue_values, green_values);
+    __m128i blue_green_high = _mm_unpackhi_epi8(blue_values, green_values);
+    __m128i red_alpha_low = _mm_unpacklo_epi8(red_values, alpha_values);
+    __m128i red_alpha_high = _mm_unpackhi_epi8(red_values, alpha_values);
+
+    auto* pointer = reinterpret_cast<__m128i*>(row + index);
+    _mm_storeu_si128(pointer, _mm_unpacklo_epi16(blue_green_low, red_alpha_low));
+    _mm_storeu_si128(pointer + 1, _mm_unpackhi_epi16(blue_green_low, red_alpha_low));
+    _mm_storeu_si128(pointer + 2, _mm_unpacklo_epi16(blue_green_high, red_alpha_high));
+    _mm_storeu_si128(pointer + 3, _mm_unpackhi_epi16(blue_green_high, red_alpha_high));
+  }
+
+  interleaveScalar(red + index, green + index, blue + index, alpha ? alpha + index : nullptr, row + index,
+                   count - index);
+}
+
+PHOTOCHOPP_TARGET("avx2")
+void mirrorAvx2(QRgb* row, int width)
+{
+  const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+  int left = 0;
+  int right = width;
+
+  for (; right - left >= 16; left += 8, right -= 8) {
+    __m256i left_pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + left));
+    __m256i right_pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + right - 8));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(row + left), _mm256_permutevar8x32_epi32(right_pixels, reverse));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(row + right - 8), _mm256_permutevar8x32_epi32(left_pixels, reverse));
+  }
+
+  reverseRange(row, left, right);
+}
+
+PHOTOCHOPP_TARGET("avx2")
+void adjustBrightnessAvx2(QRgb* row, int width, int brightness_value)
+{
+  const __m256i step = _mm256_set1_epi32(brightnessStep(brightness_value));
+  const __m256i alpha = _mm256_set1_epi32(static_cast<int>(kAlphaMask));
+  int column_index = 0;
+
+  for (; column_index + 8 <= width; column_index += 8) {
+    auto* pointer = reinterpret_cast<__m256i*>(row + column_index);
+    __m256i pixels = _mm256_loadu_si256(pointer);
+    pixels = brightness_value >= 0 ? _mm256_adds_epu8(pixels, step) : _mm256_subs_epu8(pixels, step);
+    _mm256_storeu_si256(pointer, _mm256_or_si256(pixels, alpha));
+  }
+
+  adjustBrightnessScalar(row + column_index, width - column_index, brightness_value);
+}
+
+PHOTOCHOPP_TARGET("avx2")
+void adjustContrastAvx2(QRgb* row, int width, int contrast_factor)
+{
+  if (contrast_factor < 2 || contrast_factor > 255) {
+    adjustContrastScalar(row, width, contrast_factor);
+    return;
+  }
+
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i factor = _mm256_set1_epi16(static_cast<short>(contrast_factor));
+  const __m256i threshold = _mm256_set1_epi8(static_cast<char>(255 / contrast_factor + 1));
+  const __m256i alpha = _mm256_set1_epi32(static_cast<int>(kAlphaMask));
+  int column_index = 0;
+
+  // Unpacking and packing both work within 128-bit lanes, so the order is kept
+  for (; column_index + 8 <= width; column_index += 8) {
+    auto* pointer = reinterpret_cast<__m256i*>(row + column_index);
+    __m256i pixels = _mm256_loadu_si256(pointer);
+    __m256i low = _mm256_mullo_epi16(_mm256_unpacklo_epi8(pixels, zero), factor);
+    __m256i high = _mm256_mullo_epi16(_mm256_unpackhi_epi8(pixels, zero), factor);
+    __m256i saturated = _mm256_cmpeq_epi8(_mm256_max_epu8(pixels, threshold), pixels);
+    __m256i result = _mm256_or_si256(_mm256_packus_epi16(low, high), saturated);
+    _mm256_storeu_si256(pointer, _mm256_or_si256(result, alpha));
+  }
+
+  adjustContrastScalar(row + column_index, width - column_index, contrast_factor);
+}
+
+PHOTOCHOPP_TARGET("avx2")
+void negateAvx2(QRgb* row, int width)
+{
+  const __m256i colors = _mm256_set1_epi32(0x00ffffff);
+  const __m256i alpha = _mm256_set1_epi32(static_cast<int>(kAlphaMask));
+  int column_index = 0;
+
+  for (; column_index + 8 <= width; column_index += 8) {
+    auto* pointer = reinterpret_cast<__m256i*>(row + column_index);
+    __m256i pixels = _mm256_xor_si256(_mm256_loadu_si256(pointer), colors);
+    _mm256_storeu_si256(pointer, _mm256_or_si256(pixels, alpha));
+  }
+
+  negateScalar(row + column_index, width - column_index);
+}
+
+PHOTOCHOPP_TARGET("avx2")
+void minimumBytesAvx2(const uchar* first, const uchar* second, uchar* result, int count)
+{
+  int index = 0;
+
+  for (; index + 32 <= count; index += 32) {
+    __m256i first_values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + index));
+    __m256i second_values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(second + index));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(result + index), _mm256_min_epu8(first_values, second_values));
+  }
+
+  minimumBytesScalar(first + index, second + index, result + index, count - index);
+}
+
+PHOTOCHOPP_TARGET("avx2")
+void maximumBytesAvx2(const uchar* first, const uchar* second, uchar* result, int count)
+{
+  int index = 0;
+
+  for (; index + 32 <= count; index += 32) {
+    __m256i first_values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + index));
+    __m256i second_values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(second + index));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(result + index), _mm256_max_epu8(first_values, second_values));
+  }
+
+  maximumBytesScalar(first + index, second + index, result + index, count - index);
+}
+
+PHOTOCHOPP_TARGET("avx2")
+void compareColorsAvx2(const QRgb* first, const QRgb* second, int count,
+                       quint64* squared_sum, int* maximum_difference)
+{
+  const __m256i color_mask = _mm256_set1_epi32(0x00ffffff);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i sums = zero;
+  __m256i maximums = zero;
+  int vector_count = count - count % 8;
+
+  for (int block_start = 0; block_start < vector_count; block_start += kComparedPixelsPerBlock) {
+    int block_end = std::min(vector_count, block_start + kComparedPixelsPerBlock);
+    __m256i block_sums = zero;
+
+    for (int index = block_start; index < block_end; index += 8) {
+      __m256i first_pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first + index));
+      __m256i second_pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(second + index));
+      __m256i differences = _mm256_or_si256(_mm256_subs_epu8(first_pixels, second_pixels),
+                                            _mm256_subs_epu8(second_pixels, first_pixels));
+      differences = _mm256_and_si256(differences, color_mask);
+      maximums = _mm256_max_epu8(maximums, differences);
+
+      __m256i low = _mm256_unpacklo_epi8(differences, zero);
+      __m256i high = _mm256_unpackhi_epi8(differences, zero);
+      block_sums = _mm256_add_epi32(block_sums,
+                                    _mm256_add_epi32(_mm256_madd_epi16(low, low), _mm256_madd_epi16(high, high)));
+    }
+
+    sums = _mm256_add_epi64(sums, _mm256_add_epi64(_mm256_unpacklo_epi32(block_sums, zero),
+                                                   _mm256_unpackhi_epi32(block_sums, zero)));
+  }
+
+  alignas(32) quint64 lanes[4];
+  alignas(32) uchar bytes[32];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), sums);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(bytes), maximums);
+  *squared_sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  *maximum_difference = std::max(*maximum_difference, largestByte(bytes, 32));
+
+  compareColorsScalar(first + vector_count, second + vector_count, count - vector_count,
+                      squared_sum, maximum_difference);
+}
+
+PHOTOCHOPP_TARGET("avx2")
+__m256i packChannelAvx2(const __m256i* pixels, int shift)
+{
+  const __m256i byte_mask = _mm256_set1_epi32(0xff);
+  // Packing works within 128-bit lanes, leaving groups of four pixels
+  // from the four vectors interleaved by lane
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+  __m256i lanes[4];
+  for (int part = 0; part < 4; part++)
+    lanes[part] = _mm256_and_si256(_mm256_srli_epi32(pixels[part], shift), byte_mask);
+
+  __m256i bytes = _mm256_packus_epi16(_mm256_packs_epi32(lanes[0], lanes[1]), _mm256_packs_epi32(lanes[2], lanes[3]));
+  return _mm256_permutevar8x32_epi32(bytes, order);
+}
+
+PHOTOCHOPP_TARGET("avx2")
+void deinterleaveAvx2(const QRgb* row, uchar* red, uchar* green, uchar* blue, uchar* alpha, int count)
+{
+  int index = 0;
+
+  for (; index + 32 <= count; index += 32) {
+    __m256i pixels[4];
+    for (int part = 0; part < 4; part++)
+      pixels[part] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + index + part * 8));
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(blue + index), packChannelAvx2(pixels, 0));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(green + index), packChannelAvx2(pixels, 8));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(red + index), packChannelAvx2(pixels, 16));
+    if (alpha)
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(alpha + index), packChannelAvx2(pixels, 24));
+  }
+
+  deinterleaveScalar(row + index, red + index, green + index, blue + index, alpha ? alpha + index : nullptr,
+                     count - index);
+}
+
+PHOTOCHOPP_TARGET("avx2")
+void interleaveAvx2(const uchar* red, const uchar* green, const uchar* blue, const uchar* alpha, QRgb* row,
+                    int count)
+{
+  const __m256i opaque = _mm256_set1_epi8(static_cast<char>(0xff));
+  int index = 0;
+
+  for (; index + 32 <= count; index += 32) {
+    __m256i red_values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(red + index));
+    __m256i green_values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(green + index));
+    __m256i blue_values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blue + index));
+    __m256i alpha_values = alpha ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(alpha + index)) : opaque;
+
+    __m256i blue_green_low = _mm256_unpacklo_epi8(blue_values, green_values);
+    __m256i blue_green_high = _mm256_unpackhi_epi8(blue_values, green_values);
+    __m256i red_alpha_low = _mm256_unpacklo_epi8(red_values, alpha_values);
+    __m256i red_alpha_high = _mm256_unpackhi_epi8(red_values, alpha_values);
+
+    // Pixels 0-3 and 16-19, 4-7 and 20-23, 8-11 and 24-27, 12-15 and 28-31
+    __m256i first = _mm256_unpacklo_epi16(blue_green_low, red_alpha_low);
+    __m256i second = _mm256_unpackhi_epi16(blue_green_low, red_alpha_low);
+    __m256i third = _mm256_unpacklo_epi16(blue_green_high, red_alpha_high);
+    __m256i fourth = _mm256_unpackhi_epi16(blue_green_high, red_alpha_high);
+
+    auto* pointer = reinterpret_cast<__m256i*>(row + index);
+    _mm256_storeu_si256(pointer, _mm256_permute2x128_si256(first, second, 0x20));
+    _mm256_storeu_si256(pointer + 1, _mm256_permute2x128_si256(third, fourth, 0x20));
+    _mm256_storeu_si256(pointer + 2, _mm256_permute2x128_si256(first, second, 0x31));
+    _mm256_storeu_si256(pointer + 3, _mm256_permute2x128_si256(third, fourth, 0x31));
+  }
+
+  interleaveScalar(red + index, green + index, blue + index, alpha ? alpha + index : nullptr, row + index,
+                   count - index);
+}
+
+PHOTOCHOPP_TARGET("avx512f,avx512bw")
+void mirrorAvx512(QRgb* row, int width)
+{
+  const __m512i reverse = _mm512_set_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  int left = 0;
+  int right = width;
+
+  for (; right - left >= 32; left += 16, right -= 16) {
+    __m512i left_pixels = _mm512_loadu_si512(row + left);
+    __m512i right_pixels = _mm512_loadu_si512(row + right - 16);
+    _mm512_storeu_si512(row + left, _mm512_permutex2var_epi32(right_pixels, reverse, right_pixels));
+    _mm512_storeu_si512(row + right - 16, _mm512_permutex2var_epi32(left_pixels, reverse, left_pixels));
+  }
+
+  reverseRange(row, left, right);
+}
+
+PHOTOCHOPP_TARGET("avx512f,avx512bw")
+void adjustBrightnessAvx512(QRgb* row, int width, int brightness_value)
+{
+  const __m512i step = _mm512_set1_epi32(brightnessStep(brightness_value));
+  const __m512i alpha = _mm512_set1_epi32(static_cast<int>(kAlphaMask));
+  int column_index = 0;
+
+  for (; column_index + 16 <= width; column_index += 16) {
+    QRgb* pointer = row + column_index;
+    __m512i pixels = _mm512_loadu_si512(pointer);
+    pixels = brightness_value >= 0 ? _mm512_adds_epu8(pixels, step) : _mm512_subs_epu8(pixels, step);
+    _mm512_storeu_si512(pointer, _mm512_or_si512(pixels, alpha));
+  }
+
+  adjustBrightnessScalar(row + column_index, width - column_index, brightness_value);
+}
+
+PHOTOCHOPP_TARGET("avx512f,avx512bw")
+void adjustContrastAvx512(QRgb* row, int width, int contrast_factor)
+{
+  if (contrast_factor < 2 || contrast_factor > 255) {
+    adjustContrastScalar(row, width, contrast_factor);
+    return;
+  }
+
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i factor = _mm512_set1_epi16(static_cast<short>(contrast_factor));
+  const __m512i threshold = _mm512_set1_epi8(static_cast<char>(255 / contrast_factor + 1));
+  const __m512i saturated_value = _mm512_set1_epi8(static_cast<char>(0xff));
+  const __m512i alpha = _mm512_set1_epi32(static_cast<int>(kAlphaMask));
+  int column_index = 0;
+
+  for (; column_index + 16 <= width; column_index += 16) {
+    QRgb* pointer = row + column_index;
+    __m512i pixels = _mm512_loadu_si512(pointer);
+    __m512i low = _mm512_mullo_epi16(_mm512_unpacklo_epi8(pixels, zero), factor);
+    __m512i high = _mm512_mullo_epi16(_mm512_unpackhi_epi8(pixels, zero), factor);
+    __mmask64 saturated = _mm512_cmpge_epu8_mask(pixels, threshold);
+    __m512i result = _mm512_mask_mov_epi8(_mm512_packus_epi16(low, high), saturated, saturated_value);
+    _mm512_storeu_si512(pointer, _mm512_or_si512(result, alpha));
+  }
+
+  adjustContrastScalar(row + column_index, width - column_index, contrast_factor);
+}
+
+PHOTOCHOPP_TARGET("avx512f,avx512bw")
+void negateAvx512(QRgb* row, int width)
+{
+  const __m512i colors = _mm512_set1_epi32(0x00ffffff);
+  const __m512i alpha = _mm512_set1_epi32(static_cast<int>(kAlphaMask));
+  int column_index = 0;
+
+  for (; column_index + 16 <= width; column_index += 16) {
+    QRgb* pointer = row + column_index;
+    __m512i pixels = _mm512_xor_si512(_mm512_loadu_si512(pointer), colors);
+    _mm512_storeu_si512(pointer, _mm512_or_si512(pixels, alpha));
+  }
+
+  negateScalar(row + column_index, width - column_index);
+}
+
+PHOTOCHOPP_TARGET("avx512f,avx512bw")
+void minimumBytesAvx512(const uchar* first, const uchar* second, uchar* result, int count)
+{
+  int index = 0;
+
+  for (; index + 64 <= count; index += 64) {
+    __m512i first_values = _mm512_loadu_si512(first + index);
+    __m512i second_values = _mm512_loadu_si512(second + index);
+    _mm512_storeu_si512(result + index, _mm512_min_epu8(first_values, second_values));
+  }
+
+  minimumBytesScalar(first + index, second + index, result + index, count - index);
+}
+
+PHOTOCHOPP_TARGET("avx512f,avx512bw")
+void maximumBytesAvx512(const uchar* first, const uchar* second, uchar* result, int count)
+{
+  int index = 0;
+
+  for (; index + 64 <= count; index += 64) {
+    __m512i first_values = _mm512_loadu_si512(first + index);
+    __m512i second_values = _mm512_loadu_si512(second + index);
+    _mm512_storeu_si512(result + index, _mm512_max_epu8(first_values, second_values));
+  }
+
+  maximumBytesScalar(first + index, second + index, result + index, count - index);
+}
+
+PHOTOCHOPP_TARGET("avx512f,avx512bw")
+void compareColorsAvx512(const QRgb* first, const QRgb* second, int count,
+                         quint64* squared_sum, int* maximum_difference)
+{
+  const __m512i color_mask = _mm512_set1_epi32(0x00ffffff);
+  const __m512i zero = _mm512_setzero_si512();
+  __m512i sums = zero;
+  __m512i maximums = zero;
+  int vector_count = count - count % 16;
+
+  for (int block_start = 0; block_start < vector_count; block_start += kComparedPixelsPerBlock) {
+    int block_end = std::min(vector_count, block_start + kComparedPixelsPerBlock);
+    __m512i block_sums = zero;
+
+    for (int index = block_start; index < block_end; index += 16) {
+      __m512i first_pixels = _mm512_loadu_si512(first + index);
+      __m512i second_pixels = _mm512_loadu_si512(second + index);
+      __m512i differences = _mm512_or_si512(_mm512_subs_epu8(first_pixels, second_pixels),
+                                            _mm512_subs_epu8(second_pixels, first_pixels));
+      differences = _mm512_and_si512(differences, color_mask);
+      maximums = _mm512_max_epu8(maximums, differences);
+
+      __m512i low = _mm512_unpacklo_epi8(differences, zero);
+      __m512i high = _mm512_unpackhi_epi8(differences, zero);
+      block_sums = _mm512_add_epi32(block_sums,
+                                    _mm512_add_epi32(_mm512_madd_epi16(low, low), _mm512_madd_epi16(high, high)));
+    }
+
+    sums = _mm512_add_epi64(sums, _mm512_add_epi64(_mm512_unpacklo_epi32(block_sums, zero),
+                                                   _mm512_unpackhi_epi32(block_sums, zero)));
+  }
+
+  alignas(64) quint64 lanes[8];
+  alignas(64) uchar bytes[64];
+  _mm512_store_si512(lanes, sums);
+  _mm512_store_si512(bytes, maximums);
+  for (quint64 lane : lanes)
+    *squared_sum += lane;
+  *maximum_difference = std::max(*maximum_difference, largestByte(bytes, 64));
+
+  compareColorsScalar(first + vector_count, second + vector_count, count - vector_count,
+                      squared_sum, maximum_difference);
+}
+
+
+PHOTOCHOPP_TARGET("avx512f,avx512bw")
+__m512i packChannelAvx512(const __m512i* pixels, int shift)
+{
+  const __m512i byte_mask = _mm512_set1_epi32(0xff);
+  // Each 128-bit lane ends up with four pixels of each vector, in order
+  const __m512i order = _mm512_setr_epi32(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+
+  __m512i lanes[4];
+  for (int part = 0; part < 4; part++)
+    lanes[part] = _mm512_and_si512(_mm512_srli_epi32(pixels[part], static_cast<unsigned int>(shift)), byte_mask);
+
+  __m512i bytes = _mm512_packus_epi16(_mm512_packs_epi32(lanes[0], lanes[1]), _mm512_packs_epi32(lanes[2], lanes[3]));
+  return _mm512_permutexvar_epi32(order, bytes);
+}
+
+PHOTOCHOPP_TARGET("avx512f,avx512bw")
+void deinterleaveAvx512(const QRgb* row, uchar* red, uchar* green, uchar* blue, uchar* alpha, int count)
+{
+  int index = 0;
+
+  for (; index + 64 <= count; index += 64) {
+    __m512i pixels[4];
+    for (int part = 0; part < 4; part++)
+      pixels[part] = _mm512_loadu_si512(row + index + part * 16);
+
+    _mm512_storeu_si512(blue + index, packChannelAvx512(pixels, 0));
+    _mm512_storeu_si512(green + index, packChannelAvx512(pixels, 8));
+    _mm512_storeu_si512(red + index, packChannelAvx512(pixels, 16));
+    if (alpha)
+      _mm512_storeu_si512(alpha + index, packChannelAvx512(pixels, 24));
+  }
+
+  deinterleaveScalar(row + index, red + index, green + index, blue + index, alpha ? alpha + index : nullptr,
+                     count - index);
+}
+
+PHOTOCHOPP_TARGET("avx512f,avx512bw")
+void interleaveAvx512(const uchar* red, const uchar* green, const uchar* blue, const uchar* alpha, QRgb* row,
+                      int count)
+{
+  const __m512i opaque = _mm512_set1_epi8(static_cast<char>(0xff));
+  int index = 0;
+
+  for (; index + 64 <= count; index += 64) {
+    __m512i red_values = _mm512_loadu_si512(red + index);
+    __m512i green_values = _mm512_loadu_si512(green + index);
+    __m512i blue_values = _mm512_loadu_si512(blue + index);
+    __m512i alpha_values = alpha ? _mm512_loadu_si512(alpha + index) : opaque;
+
+    __m512i blue_green_low = _mm512_unpacklo_epi8(blue_values, green_values);
+    __m512i blue_green_high = _mm512_unpackhi_epi8(blue_values, green_values);
+    __m512i red_alpha_low = _mm512_unpacklo_epi8(red_values, alpha_values);
+    __m512i red_alpha_high = _mm512_unpackhi_epi8(red_values, alpha_values);
+
+    // Lane n of each holds pixels 16n to 16n+3, 16n+4 to 16n+7 and so on
+    __m512i first = _mm512_unpacklo_epi16(blue_green_low, red_alpha_low);
+    __m512i second = _mm512_unpackhi_epi16(blue_green_low, red_alpha_low);
+    __m512i third = _mm512_unpacklo_epi16(blue_green_high, red_alpha_high);
+    __m512i fourth = _mm512_unpackhi_epi16(blue_green_high, red_alpha_high);
+
+    // Transposes the 4 x 4 lanes
+    __m512i first_second_low = _mm512_shuffle_i32x4(first, second, 0x44);
+    __m512i third_fourth_low = _mm512_shuffle_i32x4(third, fourth, 0x44);
+    __m512i first_second_high = _mm512_shuffle_i32x4(first, second, 0xee);
+    __m512i third_fourth_high = _mm512_shuffle_i32x4(third, fourth, 0xee);
+
+    QRgb* pointer = row + index;
+    _mm512_storeu_si512(pointer, _mm512_shuffle_i32x4(first_second_low, third_fourth_low, 0x88));
+    _mm512_storeu_si512(pointer + 16, _mm512_shuffle_i32x4(first_second_low, third_fourth_low, 0xdd));
+    _mm512_storeu_si512(pointer + 32, _mm512_shuffle_i32x4(first_second_high, third_fourth_high, 0x88));
+    _mm512_storeu_si512(pointer + 48, _mm512_shuffle_i32x4(first_second_high, third_fourth_high, 0xdd));
+  }
+
+  interleaveScalar(red + index, green + index, blue + index, alpha ? alpha + index : nullptr, row + index,
+                   count - index);
+}
+
+#endif
+
+const RowKernels kScalarKernels = { mirrorScalar, adjustBrightnessScalar, adjustContrastScalar, negateScalar,
+                                    minimumBytesScalar, maximumBytesScalar, compareColorsScalar,
+                                    deinterleaveScalar, interleaveScalar };
+
+#ifdef PHOTOCHOPP_X86
+const RowKernels kSse2Kernels = { mirrorSse2, adjustBrightnessSse2, adjustContrastSse2, negateSse2,
+                                  minimumBytesSse2, maximumBytesSse2, compareColorsSse2,
+                                  deinterleaveSse2, interleaveSse2 };
+const RowKernels kAvx2Kernels = { mirrorAvx2, adjustBrightnessAvx2, adjustContrastAvx2, negateAvx2,
+                                  minimumBytesAvx2, maximumBytesAvx2, compareColorsAvx2,
+                                  deinterleaveAvx2, interleaveAvx2 };
+const RowKernels kAvx512Kernels = { mirrorAvx512, adjustBrightnessAvx512, adjustContrastAvx512, negateAvx512,
+                                    minimumBytesAvx512, maximumBytesAvx512, compareColorsAvx512,
+                                    deinterleaveAvx512, interleaveAvx512 };
+#endif
+
+} // namespace
+
+const RowKernels& rowKernels()
+{
+  static const RowKernels& kernels = rowKernels(cpu::activeIsaLevel());
+  return kernels;
+}
+
+const RowKernels& rowKernels(cpu::IsaLevel level)
+{
+#ifdef PHOTOCHOPP_X86
+  switch (level) {
+  case cpu::IsaLevel::Avx512:
+    return kAvx512Kernels;
+  case cpu::IsaLevel::Avx2:
+    return kAvx2Kernels;
+  case cpu::IsaLevel::Sse2:
+    return kSse2Kernels;
+  case cpu::IsaLevel::Scalar:
+    break;
+  }
+#else
+  Q_UNUSED(level);
+#endif
+
+  return kScalarKernels;
+}
+
+} // namespace kernels
+
+} // namespace image_op
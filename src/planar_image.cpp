@@ -0,0 +1,64 @@
+#include "include/planar_image.hpp"
+
+#include "include/image_buffer_pool.hpp"
+#include "include/pixel_formats.hpp"
+#include "include/pixel_kernels.hpp"
+#include "include/profiler.hpp"
+
+namespace image_op {
+
+PlanarImage::PlanarImage():
+  width_(0),
+  height_(0),
+  has_alpha_(false)
+{
+}
+
+PlanarImage::PlanarImage(int width, int height, bool has_alpha):
+  width_(width),
+  height_(height),
+  has_alpha_(has_alpha),
+  planes_(pooledImage(width, height * (has_alpha ? 4 : 3), QImage::Format_Grayscale8))
+{
+}
+
+PlanarImage PlanarImage::fromImage(const QImage& image)
+{
+  PROFILE_SCOPE("PlanarImage::fromImage", "convert");
+
+  Q_ASSERT(image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32);
+
+  PlanarImage planar(image.width(), image.height(), image.format() == QImage::Format_ARGB32);
+  const auto& row_kernels = kernels::rowKernels();
+
+  for (int row_index = 0; row_index < planar.height_; row_index++) {
+    row_kernels.deinterleave(pixel_format::constRow<pixel_format::Argb32>(image, row_index),
+                             planar.row(Red, row_index), planar.row(Green, row_index), planar.row(Blue, row_index),
+                             planar.has_alpha_ ? planar.row(Alpha, row_index) : nullptr, planar.width_);
+  }
+
+  return planar;
+}
+
+QImage PlanarImage::toImage(QImage::Format format) const
+{
+  PROFILE_SCOPE("PlanarImage::toImage", "convert");
+
+  Q_ASSERT(format == QImage::Format_RGB32 || format == QImage::Format_ARGB32);
+
+  QImage image = pooledImage(width_, height_, format);
+  const auto& row_kernels = kernels::rowKernels();
+
+  // RGB32 must keep its alpha byte at 255
+  bool with_alpha = has_alpha_ && format == QImage::Format_ARGB32;
+
+  for (int row_index = 0; row_index < height_; row_index++) {
+    row_kernels.interleave(constRow(Red, row_index), constRow(Green, row_index), constRow(Blue, row_index),
+                           with_alpha ? constRow(Alpha, row_index) : nullptr,
+                           pixel_format::row<pixel_format::Argb32>(image, row_index), width_);
+  }
+
+  return image;
+}
+
+} // namespace image_op
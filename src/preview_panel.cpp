@@ -0,0 +1,170 @@
+#include "include/preview_panel.hpp"
+
+#include <cstring>
+
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QtConcurrent>
+
+#include "include/profiler.hpp"
+
+namespace {
+
+// Rows of the proxy processed between checks for cancellation
+constexpr int kStripHeight = 64;
+
+// Delay before committing values changed without dragging the slider
+constexpr int kCommitDelay = 400;
+
+} // namespace
+
+PreviewPanel::PreviewPanel(const QString& title, const QString& label, int minimum, int maximum, int value,
+                           const QImage& proxy, const QRect& region, PreviewFunction preview_function,
+                           TiledImageView* view, QWidget* parent):
+  QDialog(parent),
+  proxy_(proxy),
+  region_(region.intersected(proxy.rect())),
+  preview_function_(preview_function),
+  view_(view),
+  generation_(0),
+  preview_pending_(false),
+  committed_value_(value)
+{
+  setWindowTitle(title);
+  setAttribute(Qt::WA_DeleteOnClose);
+
+  // Regions are copied byte by byte, which needs whole bytes per pixel
+  if (!region.isNull() && proxy_.depth() < 8)
+    proxy_ = proxy_.convertToFormat(QImage::Format_RGB32);
+
+  slider_ = new QSlider(Qt::Horizontal, this);
+  slider_->setRange(minimum, maximum);
+  slider_->setValue(value);
+  slider_->setMinimumWidth(256);
+
+  spin_box_ = new QSpinBox(this);
+  spin_box_->setRange(minimum, maximum);
+  spin_box_->setValue(value);
+  spin_box_->setKeyboardTracking(false);
+
+  auto* buttons = new QDialogButtonBox(QDialogButtonBox::Close, this);
+
+  auto* form = new QFormLayout(this);
+  form->addRow(label, slider_);
+  form->addRow(QString(), spin_box_);
+  form->addRow(buttons);
+
+  commit_timer_.setSingleShot(true);
+  commit_timer_.setInterval(kCommitDelay);
+
+  connect(slider_, &QSlider::valueChanged, this, [this](int new_value) {
+    spin_box_->setValue(new_value);
+    schedulePreview();
+
+    // Keyboard and wheel changes have no release, commit once they settle
+    if (!slider_->isSliderDown())
+      commit_timer_.start();
+  });
+  connect(slider_, &QSlider::sliderReleased, this, &PreviewPanel::commitValue);
+  connect(spin_box_, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), slider_, &QSlider::setValue);
+  connect(&commit_timer_, &QTimer::timeout, this, &PreviewPanel::commitValue);
+  connect(&preview_watcher_, &QFutureWatcher<QImage>::finished, this, &PreviewPanel::previewFinished);
+  connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::close);
+}
+
+PreviewPanel::~PreviewPanel()
+{
+  generation_.fetchAndAddOrdered(1);
+  preview_watcher_.waitForFinished();
+}
+
+QImage PreviewPanel::createProxy(const QImage& image, const QSize& display_size)
+{
+  if (image.width() <= display_size.width() && image.height() <= display_size.height())
+    return image;
+
+  PROFILE_SCOPE("PreviewPanel::createProxy", "rescale");
+  return image.scaled(display_size, Qt::KeepAspectRatio, Qt::FastTransformation);
+}
+
+void PreviewPanel::schedulePreview()
+{
+  int generation = generation_.fetchAndAddOrdered(1) + 1;
+
+  // The running preview sees the new generation and stops at its next strip
+  if (preview_watcher_.isRunning()) {
+    preview_pending_ = true;
+    return;
+  }
+
+  preview_watcher_.setFuture(QtConcurrent::run(&PreviewPanel::computePreview, proxy_, region_, slider_->value(),
+                                               generation, &generation_, preview_function_));
+}
+
+void PreviewPanel::previewFinished()
+{
+  if (preview_pending_) {
+    preview_pending_ = false;
+    int generation = generation_.load();
+    preview_watcher_.setFuture(QtConcurrent::run(&PreviewPanel::computePreview, proxy_, region_, slider_->value(),
+                                                 generation, &generation_, preview_function_));
+    return;
+  }
+
+  QImage preview = preview_watcher_.result();
+
+  if (!preview.isNull() && view_)
+    view_->setImage(preview);
+}
+
+void PreviewPanel::commitValue()
+{
+  commit_timer_.stop();
+
+  int value = slider_->value();
+
+  if (value == committed_value_)
+    return;
+
+  committed_value_ = value;
+  emit valueCommitted(value);
+}
+
+QImage PreviewPanel::computePreview(QImage proxy, QRect region, int value, int generation,
+                                    const QAtomicInt* current_generation,
+                                    const PreviewFunction& preview_function)
+{
+  QImage preview;
+  bool in_region = !region.isNull();
+
+  // Pixels outside of the region keep the ones of the proxy
+  if (in_region)
+    preview = proxy.copy();
+  else
+    region = proxy.rect();
+
+  auto row_offset = static_cast<size_t>(region.x() * proxy.depth() / 8);
+
+  for (int row_index = region.top(); row_index <= region.bottom(); row_index += kStripHeight) {
+    if (current_generation->load() != generation)
+      return QImage();
+
+    int strip_height = std::min(kStripHeight, region.bottom() + 1 - row_index);
+    QImage strip = preview_function(proxy.copy(region.x(), row_index, region.width(), strip_height), value);
+
+    if (preview.isNull())
+      preview = QImage(proxy.width(), proxy.height(), strip.format());
+    else if (strip.format() != preview.format())
+      strip = strip.convertToFormat(preview.format());
+
+    // Only the pixels of the region, the padding of the strip rows would
+    // overwrite the ones after it
+    auto row_bytes = in_region ? static_cast<size_t>(region.width() * preview.depth() / 8)
+                               : static_cast<size_t>(std::min(strip.bytesPerLine(), preview.bytesPerLine()));
+
+    for (int i = 0; i < strip_height; i++)
+      std::memcpy(preview.scanLine(row_index + i) + row_offset, strip.constScanLine(i), row_bytes);
+  }
+
+  return preview;
+}
@@ -0,0 +1,240 @@
+#include "include/profiler.hpp"
+
+#include <algorithm>
+#include <map>
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QThread>
+
+namespace profiler {
+
+namespace {
+
+// Events kept before the oldest ones are overwritten
+constexpr int kRingBufferSize = 16384;
+
+struct ProfilerState
+{
+  ProfilerState():
+    events(kRingBufferSize),
+    next_event(0),
+    event_count(0),
+    enabled(1)
+  {
+    clock.start();
+  }
+
+  QElapsedTimer clock;
+  QMutex mutex;
+  std::vector<TraceEvent> events;
+  int next_event;
+  int event_count;
+  QStringList thread_names;
+  QAtomicInt enabled;
+};
+
+ProfilerState& state()
+{
+  static ProfilerState profiler_state;
+  return profiler_state;
+}
+
+// Index of the calling thread in thread_names, assigned on its first event
+thread_local int current_thread_index = -1;
+
+// Scopes open on the calling thread and the start of the outermost one
+thread_local int scope_depth = 0;
+thread_local qint64 outermost_start_ns = 0;
+
+/**
+ * Assigns an index and a name to the calling thread, must hold the mutex
+ */
+int threadIndex(ProfilerState& profiler_state)
+{
+  if (current_thread_index >= 0)
+    return current_thread_index;
+
+  QThread* thread = QThread::currentThread();
+  QString thread_name = thread->objectName();
+
+  if (QCoreApplication::instance() && thread == QCoreApplication::instance()->thread())
+    thread_name = "Main";
+  else if (thread_name.isEmpty())
+    thread_name = QString("Worker %1").arg(profiler_state.thread_names.size());
+
+  current_thread_index = profiler_state.thread_names.size();
+  profiler_state.thread_names.append(thread_name);
+
+  return current_thread_index;
+}
+
+} // namespace
+
+qint64 timestamp()
+{
+  return state().clock.nsecsElapsed();
+}
+
+void setEnabled(bool enabled)
+{
+  state().enabled.store(enabled ? 1 : 0);
+}
+
+bool isEnabled()
+{
+  return state().enabled.load() != 0;
+}
+
+void record(const char* name, const char* category, qint64 start_ns, qint64 duration_ns)
+{
+  auto& profiler_state = state();
+  QMutexLocker locker(&profiler_state.mutex);
+
+  profiler_state.events[profiler_state.next_event] =
+      { name, category, start_ns, duration_ns, threadIndex(profiler_state) };
+  profiler_state.next_event = (profiler_state.next_event + 1) % kRingBufferSize;
+  profiler_state.event_count = std::min(profiler_state.event_count + 1, kRingBufferSize);
+}
+
+std::vector<TraceEvent> events()
+{
+  auto& profiler_state = state();
+  QMutexLocker locker(&profiler_state.mutex);
+
+  std::vector<TraceEvent> recorded_events;
+  recorded_events.reserve(profiler_state.event_count);
+
+  int first_event = (profiler_state.next_event - profiler_state.event_count + kRingBufferSize) % kRingBufferSize;
+  for (int i = 0; i < profiler_state.event_count; i++)
+    recorded_events.push_back(profiler_state.events[(first_event + i) % kRingBufferSize]);
+
+  return recorded_events;
+}
+
+void clear()
+{
+  auto& profiler_state = state();
+  QMutexLocker locker(&profiler_state.mutex);
+
+  profiler_state.next_event = 0;
+  profiler_state.event_count = 0;
+}
+
+qint64 outermostScopeStart()
+{
+  return scope_depth > 0 ? outermost_start_ns : timestamp();
+}
+
+QString breakdown(qint64 since_ns)
+{
+  qint64 total_ns = timestamp() - since_ns;
+
+  // Nested events of the same category would be counted twice, only
+  // the outermost event of each category on each thread is summed. Scopes
+  // are recorded as they close, inner ones first, so the events are put
+  // back in the order they started, the outer one first on a tie
+  auto recorded_events = events();
+  std::stable_sort(recorded_events.begin(), recorded_events.end(), [](const TraceEvent& a, const TraceEvent& b) {
+    return a.start_ns != b.start_ns ? a.start_ns < b.start_ns : a.duration_ns > b.duration_ns;
+  });
+
+  std::map<QString, qint64> category_ns;
+  std::map<std::pair<int, QString>, qint64> category_end_ns;
+
+  for (const auto& event : recorded_events) {
+    if (event.start_ns < since_ns || qstrcmp(event.category, "ui") == 0)
+      continue;
+
+    auto key = std::make_pair(event.thread_index, QString(event.category));
+    qint64& end_ns = category_end_ns[key];
+
+    if (event.start_ns < end_ns)
+      continue;
+
+    end_ns = event.start_ns + event.duration_ns;
+    category_ns[key.second] += event.duration_ns;
+  }
+
+  QStringList parts;
+  for (const auto& category : category_ns)
+    parts.append(QString("%1 %2 ms").arg(category.first).arg(category.second / 1e6, 0, 'f', 1));
+
+  QString total = QString("total %1 ms").arg(total_ns / 1e6, 0, 'f', 1);
+  return parts.isEmpty() ? total : QString("%1: %2").arg(total, parts.join(", "));
+}
+
+bool writeChromeTrace(const QString& file_name)
+{
+  auto recorded_events = events();
+  QStringList thread_names;
+
+  {
+    auto& profiler_state = state();
+    QMutexLocker locker(&profiler_state.mutex);
+    thread_names = profiler_state.thread_names;
+  }
+
+  QJsonArray trace_events;
+
+  for (int i = 0; i < thread_names.size(); i++) {
+    QJsonObject metadata;
+    metadata["name"] = "thread_name";
+    metadata["ph"] = "M";
+    metadata["pid"] = 1;
+    metadata["tid"] = i;
+    metadata["args"] = QJsonObject{ { "name", thread_names[i] } };
+    trace_events.append(metadata);
+  }
+
+  // Complete events, timestamps in microseconds
+  for (const auto& event : recorded_events) {
+    QJsonObject trace_event;
+    trace_event["name"] = event.name;
+    trace_event["cat"] = event.category;
+    trace_event["ph"] = "X";
+    trace_event["ts"] = event.start_ns / 1e3;
+    trace_event["dur"] = event.duration_ns / 1e3;
+    trace_event["pid"] = 1;
+    trace_event["tid"] = event.thread_index;
+    trace_events.append(trace_event);
+  }
+
+  QJsonObject trace;
+  trace["traceEvents"] = trace_events;
+  trace["displayTimeUnit"] = "ms";
+
+  QFile file(file_name);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    return false;
+
+  return file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact)) >= 0;
+}
+
+ScopedTrace::ScopedTrace(const char* name, const char* category):
+  name_(name),
+  category_(category),
+  start_ns_(timestamp()),
+  enabled_(isEnabled())
+{
+  if (scope_depth++ == 0)
+    outermost_start_ns = start_ns_;
+}
+
+ScopedTrace::~ScopedTrace()
+{
+  scope_depth--;
+
+  if (enabled_)
+    record(name_, category_, start_ns_, timestamp() - start_ns_);
+}
+
+} // namespace profiler
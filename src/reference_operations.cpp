@@ -0,0 +1,838 @@
+#include "include/reference_operations.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace image_op {
+
+namespace reference {
+
+namespace {
+
+/**
+ * Darkest or lightest value of each channel under an element_width x
+ * element_height rectangle centered on each pixel, looked up pixel by pixel
+ */
+QImage filterRectangle(QImage image, int element_width, int element_height, bool minimum)
+{
+  int width = image.width();
+  int height = image.height();
+
+  QImage target_image(width, height, QImage::Format_RGB32);
+
+  for (int row_index = 0; row_index < height; row_index++) {
+    QRgb* target_line = reinterpret_cast<QRgb*>(target_image.scanLine(row_index));
+
+    for (int column_index = 0; column_index < width; column_index++) {
+      int first_row = std::max(0, row_index - element_height / 2);
+      int last_row = std::min(height - 1, row_index - element_height / 2 + element_height - 1);
+      int first_column = std::max(0, column_index - element_width / 2);
+      int last_column = std::min(width - 1, column_index - element_width / 2 + element_width - 1);
+
+      int red = minimum ? 255 : 0;
+      int green = red;
+      int blue = red;
+
+      for (int row = first_row; row <= last_row; row++) {
+        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row));
+        for (int column = first_column; column <= last_column; column++) {
+          QRgb pixel = line[column];
+          red = minimum ? std::min(red, qRed(pixel)) : std::max(red, qRed(pixel));
+          green = minimum ? std::min(green, qGreen(pixel)) : std::max(green, qGreen(pixel));
+          blue = minimum ? std::min(blue, qBlue(pixel)) : std::max(blue, qBlue(pixel));
+        }
+      }
+
+      target_line[column_index] = qRgb(red, green, blue);
+    }
+  }
+
+  return target_image;
+}
+
+/**
+ * Luminance of a pixel, exactly the gray value when it is already gray
+ */
+int pixelLuminance(QRgb pixel)
+{
+  if (qRed(pixel) == qGreen(pixel) && qGreen(pixel) == qBlue(pixel))
+    return qRed(pixel);
+
+  double luminance = 0.299 * qRed(pixel) + 0.587 * qGreen(pixel) + 0.114 * qBlue(pixel);
+  return static_cast<int>(luminance > 255 ? 255 : luminance);
+}
+
+/**
+ * Calls function(row_index, column_index, count, sum, sum_of_squares) with
+ * the luminance sums over the window_size square window centered on each
+ * pixel, looked up pixel by pixel
+ */
+template<typename Function>
+void forEachLuminanceWindow(QImage& image, int window_size, Function function)
+{
+  int width = image.width();
+  int height = image.height();
+
+  for (int row_index = 0; row_index < height; row_index++) {
+    for (int column_index = 0; column_index < width; column_index++) {
+      int first_row = std::max(0, row_index - window_size / 2);
+      int last_row = std::min(height - 1, row_index - window_size / 2 + window_size - 1);
+      int first_column = std::max(0, column_index - window_size / 2);
+      int last_column = std::min(width - 1, column_index - window_size / 2 + window_size - 1);
+
+      qint64 sum = 0;
+      qint64 sum_of_squares = 0;
+
+      for (int row = first_row; row <= last_row; row++) {
+        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row));
+        for (int column = first_column; column <= last_column; column++) {
+          qint64 luminance = pixelLuminance(line[column]);
+          sum += luminance;
+          sum_of_squares += luminance * luminance;
+        }
+      }
+
+      qint64 count = static_cast<qint64>(last_row - first_row + 1) * (last_column - first_column + 1);
+      function(row_index, column_index, count, sum, sum_of_squares);
+    }
+  }
+}
+
+} // namespace
+
+QImage mirrorHorizontally(QImage image)
+{
+  int width = image.width();
+  int height = image.height();
+
+  for (int row_index = 0; row_index < height; row_index++) {
+    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
+    for (int column_index = 0; column_index < width / 2; column_index++) {
+      std::swap(line[column_index], line[width - 1 - column_index]);
+    }
+  }
+
+  return image;
+}
+
+QImage mirrorVertically(QImage image)
+{
+  auto width = static_cast<size_t>(image.width());
+  auto height = image.height();
+  QRgb* buffer = new QRgb[width * sizeof(QRgb)];
+
+  try {
+    for (int row_index = 0; row_index < height / 2; row_index++) {
+      QRgb* first_line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
+      QRgb* second_line = reinterpret_cast<QRgb*>(image.scanLine(height - 1 - row_index));
+      std::memcpy(buffer, first_line, width * sizeof(QRgb));
+      std::memcpy(first_line, second_line, width * sizeof(QRgb));
+      std::memcpy(second_line, buffer, width * sizeof(QRgb));
+    }
+  } catch (...) {
+    delete[] buffer;
+    throw;
+  }
+
+  delete[] buffer;
+  return image;
+}
+
+QImage convertColoredToGrayscale(QImage image)
+{
+  if (image.isGrayscale())
+    return image;
+
+  int width = image.width();
+  int height = image.height();
+
+  for (int row_index = 0; row_index < height; row_index++) {
+    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
+    for (int column_index = 0; column_index < width; column_index++) {
+      auto* pixel = &line[column_index];
+      auto luminance = static_cast<int>(0.299 * qRed(*pixel) + 0.587 * qGreen(*pixel) + 0.114 * qBlue(*pixel));
+      *pixel = qRgb(luminance, luminance, luminance);
+    }
+  }
+
+  return image;
+}
+
+QImage quantizeGrayscale(QImage image, int num_colors)
+{
+  int width = image.width();
+  int height = image.height();
+
+  // Range of the luminance of the image
+  int minimum = 255;
+  int maximum = 0;
+
+  for (int row_index = 0; row_index < height; row_index++) {
+    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
+    for (int column_index = 0; column_index < width; column_index++) {
+      auto* pixel = &line[column_index];
+      auto luminance = static_cast<int>(0.299 * qRed(*pixel) + 0.587 * qGreen(*pixel) + 0.114 * qBlue(*pixel));
+      minimum = std::min(minimum, luminance);
+      maximum = std::max(maximum, luminance);
+    }
+  }
+
+  double step = 0;
+  if (num_colors > 1)
+    step = (maximum - minimum) / (num_colors - 1.0);
+
+  for (int row_index = 0; row_index < height; row_index++) {
+    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
+    for (int column_index = 0; column_index < width; column_index++) {
+      auto* pixel = &line[column_index];
+      auto luminance = 0.299 * qRed(*pixel) + 0.587 * qGreen(*pixel) + 0.114 * qBlue(*pixel);
+      auto color = minimum;
+      if (step > 0)
+        color = static_cast<int>(minimum + std::round((luminance - minimum) / step) * step);
+      *pixel = qRgb(color, color, color);
+    }
+  }
+
+  return image;
+}
+
+std::vector<int> generateGrayscaleHistogramData(QImage image)
+{
+  std::vector<int> histogram(256);
+  int width = image.width();
+  int height = image.height();
+
+  for (int row_index = 0; row_index < height; row_index++) {
+    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
+    for (int column_index = 0; column_index < width; column_index++) {
+      auto* pixel = &line[column_index];
+      // Since it is a grayscale image each channel has the same value
+      histogram[static_cast<size_t>(qRed(*pixel))]++;
+    }
+  }
+
+  return histogram;
+}
+
+QImage adjustBrightness(QImage image, int brightness_value)
+{
+  int width = image.width();
+  int height = image.height();
+
+  for (int row_index = 0; row_index < height; row_index++) {
+    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
+    for (int column_index = 0; column_index < width; column_index++) {
+      auto* pixel = &line[column_index];
+      auto red = qRed(*pixel) + brightness_value;
+      red = red > 255 ? 255 : red < 0 ? 0 : red;
+      auto green = qGreen(*pixel) + brightness_value;
+      green = green > 255 ? 255 : green < 0 ? 0 : green;
+      auto blue = qBlue(*pixel) + brightness_value;
+      blue = blue > 255 ? 255 : blue < 0 ? 0 : blue;
+      *pixel = qRgb(red, green, blue);
+    }
+  }
+
+  return image;
+}
+
+QImage adjustContrast(QImage image, int contrast_factor)
+{
+  int width = image.width();
+  int height = image.height();
+
+  for (int row_index = 0; row_index < height; row_index++) {
+    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
+    for (int column_index = 0; column_index < width; column_index++) {
+      auto* pixel = &line[column_index];
+      auto red = qRed(*pixel) * contrast_factor;
+      red = red > 255 ? 255 : red < 0 ? 0 : red;
+      auto green = qGreen(*pixel) * contrast_factor;
+      green = green > 255 ? 255 : green < 0 ? 0 : green;
+      auto blue = qBlue(*pixel) * contrast_factor;
+      blue = blue > 255 ? 255 : blue < 0 ? 0 : blue;
+      *pixel = qRgb(red, green, blue);
+    }
+  }
+
+  return image;
+}
+
+QImage getNegativeImage(QImage image)
+{
+  int width = image.width();
+  int height = image.height();
+
+  for (int row_index = 0; row_index < height; row_index++) {
+    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
+    for (int column_index = 0; column_index < width; column_index++) {
+      auto* pixel = &line[column_index];
+      auto red = 255 - qRed(*pixel);
+      auto green = 255 - qGreen(*pixel);
+      auto blue = 255 - qBlue(*pixel);
+      *pixel = qRgb(red, green, blue);
+    }
+  }
+
+  return image;
+}
+
+QImage equalizeHistogram(QImage image)
+{
+  // TODO(jfguimaraes) Implement L*a*b color space
+  int width = image.width();
+  int height = image.height();
+  std::vector<int> histogram_data;
+
+  if (image.isGrayscale())
+    histogram_data = generateGrayscaleHistogramData(image);
+  else
+    histogram_data = generateGrayscaleHistogramData(convertColoredToGrayscale(image));
+
+  std::vector<int> cumulative_histogram(256);
+  double alpha = 255.0 / (width * height);
+
+  // Generate cumulative histogram of luminance channel
+  cumulative_histogram[0] = static_cast<int>(std::round(alpha * histogram_data[0]));
+
+  for (size_t i = 1; i < 256; i++)
+    cumulative_histogram[i] = cumulative_histogram[i-1] + static_cast<int>(std::round(alpha * histogram_data[i]));
+
+  // Update pixel values
+  for (int row_index = 0; row_index < height; row_index++) {
+    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
+    for (int column_index = 0; column_index < width; column_index++) {
+      auto* pixel = &line[column_index];
+      auto red = cumulative_histogram[static_cast<size_t>(qRed(*pixel))];
+      auto green = cumulative_histogram[static_cast<size_t>(qGreen(*pixel))];
+      auto blue = cumulative_histogram[static_cast<size_t>(qBlue(*pixel))];
+      *pixel = qRgb(red, green, blue);
+    }
+  }
+
+  return image;
+}
+
+QImage matchGrayscaleHistogram(QImage original_image, QImage target_image)
+{
+  int width = original_image.width();
+  int height = original_image.height();
+
+  // Get histograms
+  auto original_histogram_data = generateGrayscaleHistogramData(original_image);
+  auto target_histogram_data = generateGrayscaleHistogramData(target_image);
+
+  // Get cumulative histograms
+  // TODO(jfguimaraes) Function for cumulative histograms
+  std::vector<int> original_cumulative_histogram(256);
+  double original_alpha = 255.0 / (width * height);
+
+  original_cumulative_histogram[0] = static_cast<int>(std::round(original_alpha * original_histogram_data[0]));
+
+  for (size_t i = 1; i < 256; i++) {
+    original_cumulative_histogram[i] = original_cumulative_histogram[i-1]
+        + static_cast<int>(std::round(original_alpha * original_histogram_data[i]));
+    original_cumulative_histogram[i] = original_cumulative_histogram[i] > 255 ?
+          255 : original_cumulative_histogram[i];
+  }
+
+  std::vector<int> target_cumulative_histogram(256);
+  double target_alpha = 255.0 / (target_image.width() * target_image.height());
+
+  target_cumulative_histogram[0] = static_cast<int>(std::round(target_alpha * target_histogram_data[0]));
+
+  for (size_t i = 1; i < 256; i++) {
+    target_cumulative_histogram[i] = target_cumulative_histogram[i-1]
+        + static_cast<int>(std::round(target_alpha * target_histogram_data[i]));
+    target_cumulative_histogram[i] = target_cumulative_histogram[i] > 255 ?
+          255 : target_cumulative_histogram[i];
+  }
+
+  // For each shade map the closest on the target image to the map function
+  std::vector<int> map_function(256);
+
+  // TODO(jfguimaraes) Optimize this
+  for (int i = 0; i < 256; i++) {
+    int original_shade = original_cumulative_histogram[static_cast<size_t>(i)];
+    int lowest_difference = 300;
+    int nearest_shade_index = 0;
+
+    for (int j = 0; j < 256; j++) {
+      int target_shade = target_cumulative_histogram[static_cast<size_t>(j)];
+
+      if (abs(target_shade - original_shade) < lowest_difference) {
+        lowest_difference = abs(target_shade - original_shade);
+        nearest_shade_index = j;
+      }
+
+      if (lowest_difference == 0)
+        break;
+    }
+
+    map_function[static_cast<size_t>(i)] = nearest_shade_index;
+  }
+
+  // Match histogram using the map function
+  for (int row_index = 0; row_index < height; row_index++) {
+    QRgb* line = reinterpret_cast<QRgb*>(original_image.scanLine(row_index));
+    for (int column_index = 0; column_index < width; column_index++) {
+      auto* pixel = &line[column_index];
+      // Since it is a grayscale image each channel has the same value
+      auto color = map_function[static_cast<size_t>(qRed(*pixel))];
+      *pixel = qRgb(color, color, color);
+    }
+  }
+
+  return original_image;
+}
+
+QImage zoomOutByFactors(QImage image, int sx, int sy)
+{
+  int original_width = image.width();
+  int original_height = image.height();
+
+  int target_width = static_cast<int>(ceil(original_width * 1.0 / sx));
+  int target_height = static_cast<int>(ceil(original_height * 1.0 / sy));
+
+  QImage target_image(target_width, target_height, QImage::Format_RGB32);
+
+  QVector<QRgb*> lines(sy);
+
+  for (int row_index = 0, target_row = 0; row_index < original_height; row_index += sy, target_row++) {
+    int rows_read = 0;
+
+    for (int row = row_index, i = 0; row < row_index + sy && row < original_height; row++, i++) {
+      lines[i] = reinterpret_cast<QRgb*>(image.scanLine(row));
+      rows_read++;
+    }
+
+    auto target_line = reinterpret_cast<QRgb*>(target_image.scanLine(target_row));
+
+    for (int column_index = 0, target_column = 0; column_index < original_width; column_index += sx, target_column++) {
+      int red = 0;
+      int green = 0;
+      int blue = 0;
+      int num_pixels = 0;
+
+      for (int column = column_index; column < column_index + sx && column < original_width; column++) {
+        for (int row = 0; row < rows_read; row++) {
+          num_pixels++;
+          red += qRed(lines[row][column]);
+          green += qGreen(lines[row][column]);
+          blue += qBlue(lines[row][column]);
+        }
+      }
+
+      red /= num_pixels;
+      green /= num_pixels;
+      blue /= num_pixels;
+
+      auto* pixel = &target_line[target_column];
+      *pixel = qRgb(red, green, blue);
+    }
+  }
+
+  return target_image;
+}
+
+QImage zoomIn2x2(QImage image)
+{
+  int original_width = image.width();
+  int original_height = image.height();
+
+  int target_width = 2 * original_width;
+  int target_height = 2 * original_height;
+
+  QImage target_image(target_width, target_height, QImage::Format_RGB32);
+
+  // Average of two colors
+  auto average = [](QRgb* a, QRgb* b){
+    auto red = (qRed(*a) + qRed(*b)) / 2;
+    auto green = (qGreen(*a) + qGreen(*b)) / 2;
+    auto blue = (qBlue(*a) + qBlue(*b)) / 2;
+    return qRgb(red, green, blue);
+  };
+
+  // Between columns
+  for (int row_index = 0; row_index < original_height; row_index++) {
+    int target_row = row_index * 2;
+    auto original_line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
+    auto target_line = reinterpret_cast<QRgb*>(target_image.scanLine(target_row));
+
+    for (int column_index = 0; column_index < original_width; column_index++) {
+      int target_column = column_index * 2;
+
+      // First pixel is equal
+      auto* original_pixel = &original_line[column_index];
+      auto* target_pixel = &target_line[target_column];
+      *target_pixel = *original_pixel;
+
+      // Second pixel is the medium between the current and the next (if it exists)
+      target_pixel = &target_line[target_column + 1];
+
+      if (column_index + 2 < original_width) {
+        auto* next_pixel = &original_line[column_index + 2];
+        *target_pixel = average(original_pixel, next_pixel);
+      } else {
+        *target_pixel = *original_pixel;
+      }
+    }
+  }
+
+  // Between lines
+  for (int row_index = 0; row_index < target_height; row_index += 2) {
+    auto current_line = reinterpret_cast<QRgb*>(target_image.scanLine(row_index));
+    auto target_line = reinterpret_cast<QRgb*>(target_image.scanLine(row_index + 1));
+
+    if (row_index + 2 >= target_height) {
+      std::memcpy(target_line, current_line, static_cast<size_t>(target_width) * sizeof(QRgb));
+      break;
+    }
+
+    auto next_line = reinterpret_cast<QRgb*>(target_image.scanLine(row_index + 2));
+
+    for (int column_index = 0; column_index < target_width; column_index++) {
+      auto* current_pixel = &current_line[column_index];
+      auto* target_pixel = &target_line[column_index];
+      auto* next_pixel = &next_line[column_index];
+
+      *target_pixel = average(current_pixel, next_pixel);
+    }
+  }
+
+  return target_image;
+}
+
+QImage rotate90DegreesClockwise(QImage image)
+{
+  int width = image.width();
+  int height = image.height();
+
+  // Target image has inverted dimensions
+  QImage target_image(height, width, QImage::Format_RGB32);
+
+  std::vector<QRgb*> original_image_lines;
+  std::vector<QRgb*> target_image_lines;
+
+  for (int i = 0; i < height; i++)
+    original_image_lines.emplace_back(reinterpret_cast<QRgb*>(image.scanLine(i)));
+
+  for (int i = 0; i < width; i++)
+    target_image_lines.emplace_back(reinterpret_cast<QRgb*>(target_image.scanLine(i)));
+
+  for (int row_index = 0; row_index < height; row_index++) {
+    for (int column_index = 0; column_index < width; column_index++) {
+      target_image_lines[static_cast<size_t>(column_index)][height - row_index - 1] =
+          original_image_lines[static_cast<size_t>(row_index)][static_cast<size_t>(column_index)];
+    }
+  }
+
+  return target_image;
+}
+
+QImage rotate90DegreesCounterClockwise(QImage image)
+{
+  int width = image.width();
+  int height = image.height();
+
+  // Target image has inverted dimensions
+  QImage target_image(height, width, QImage::Format_RGB32);
+
+  std::vector<QRgb*> original_image_lines;
+  std::vector<QRgb*> target_image_lines;
+
+  for (int i = 0; i < height; i++)
+    original_image_lines.emplace_back(reinterpret_cast<QRgb*>(image.scanLine(i)));
+
+  for (int i = 0; i < width; i++)
+    target_image_lines.emplace_back(reinterpret_cast<QRgb*>(target_image.scanLine(i)));
+
+  for (int row_index = 0; row_index < height; row_index++) {
+    for (int column_index = 0; column_index < width; column_index++) {
+      target_image_lines[static_cast<size_t>(width - column_index - 1)][static_cast<size_t>(row_index)] =
+          original_image_lines[static_cast<size_t>(row_index)][static_cast<size_t>(column_index)];
+    }
+  }
+
+  return target_image;
+}
+
+QImage applyConvolutionWith3x3Kernel(QImage image, QVector<QVector<double>> kernel, bool add_bias)
+{
+  int width = image.width();
+  int height = image.height();
+
+  QImage target_image(width, height, QImage::Format_RGB32);
+  target_image.fill(Qt::black);
+
+  double sum;
+  QVector<QRgb*> original_image_lines;
+  QVector<QRgb*> target_image_lines;
+
+  for (int i = 0; i < height; i++) {
+    original_image_lines.append(reinterpret_cast<QRgb*>(image.scanLine(i)));
+    target_image_lines.append(reinterpret_cast<QRgb*>(target_image.scanLine(i)));
+  }
+
+  for (int row = 1; row <= height - 2; row++) {
+    for (int column = 1; column <= width - 2; column++) {
+      sum = 0.0;
+
+      for (int k = -1; k <= 1; k++) {
+        for (int j = -1; j <= 1; j++) {
+          // Since it is a grayscale image each channel has the same value
+          sum += kernel[1+j][1+k] * qRed(original_image_lines[row-j][column-k]);
+        }
+      }
+
+      if (add_bias)
+        sum += 127;
+
+      sum = sum > 255 ? 255 : sum < 0 ? 0 : sum;
+      auto color = static_cast<int>(sum);
+
+      auto& pixel = target_image_lines[row][column];
+      pixel = qRgb(color, color, color);
+    }
+  }
+
+  return target_image;
+}
+
+QImage erodeImage(QImage image, int element_width, int element_height)
+{
+  return filterRectangle(image, element_width, element_height, true);
+}
+
+QImage dilateImage(QImage image, int element_width, int element_height)
+{
+  return filterRectangle(image, element_width, element_height, false);
+}
+
+QImage openImage(QImage image, int element_width, int element_height)
+{
+  return dilateImage(erodeImage(image, element_width, element_height), element_width, element_height);
+}
+
+QImage closeImage(QImage image, int element_width, int element_height)
+{
+  return erodeImage(dilateImage(image, element_width, element_height), element_width, element_height);
+}
+
+QImage boxBlur(QImage image, int box_width, int box_height)
+{
+  int width = image.width();
+  int height = image.height();
+
+  QImage target_image(width, height, QImage::Format_RGB32);
+
+  for (int row_index = 0; row_index < height; row_index++) {
+    QRgb* target_line = reinterpret_cast<QRgb*>(target_image.scanLine(row_index));
+
+    for (int column_index = 0; column_index < width; column_index++) {
+      int first_row = std::max(0, row_index - box_height / 2);
+      int last_row = std::min(height - 1, row_index - box_height / 2 + box_height - 1);
+      int first_column = std::max(0, column_index - box_width / 2);
+      int last_column = std::min(width - 1, column_index - box_width / 2 + box_width - 1);
+
+      qint64 red = 0;
+      qint64 green = 0;
+      qint64 blue = 0;
+
+      for (int row = first_row; row <= last_row; row++) {
+        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row));
+        for (int column = first_column; column <= last_column; column++) {
+          red += qRed(line[column]);
+          green += qGreen(line[column]);
+          blue += qBlue(line[column]);
+        }
+      }
+
+      qint64 count = static_cast<qint64>(last_row - first_row + 1) * (last_column - first_column + 1);
+      target_line[column_index] = qRgb(static_cast<int>((red + count / 2) / count),
+                                       static_cast<int>((green + count / 2) / count),
+                                       static_cast<int>((blue + count / 2) / count));
+    }
+  }
+
+  return target_image;
+}
+
+QImage sauvolaThreshold(QImage image, int window_size, double k)
+{
+  QImage target_image(image.width(), image.height(), QImage::Format_RGB32);
+
+  forEachLuminanceWindow(image, window_size, [&](int row_index, int column_index, qint64 count,
+                                                 qint64 sum, qint64 sum_of_squares) {
+    double mean = static_cast<double>(sum) / count;
+    double variance = std::max(0.0, sum_of_squares / static_cast<double>(count) - mean * mean);
+    double threshold = mean * (1 + k * (std::sqrt(variance) / 128 - 1));
+
+    QRgb pixel = reinterpret_cast<QRgb*>(image.scanLine(row_index))[column_index];
+    int color = pixelLuminance(pixel) > threshold ? 255 : 0;
+    reinterpret_cast<QRgb*>(target_image.scanLine(row_index))[column_index] = qRgb(color, color, color);
+  });
+
+  return target_image;
+}
+
+QImage bradleyThreshold(QImage image, int window_size, double t)
+{
+  QImage target_image(image.width(), image.height(), QImage::Format_RGB32);
+
+  forEachLuminanceWindow(image, window_size, [&](int row_index, int column_index, qint64 count, qint64 sum, qint64) {
+    QRgb pixel = reinterpret_cast<QRgb*>(image.scanLine(row_index))[column_index];
+    int color = pixelLuminance(pixel) * count > sum * (1 - t) ? 255 : 0;
+    reinterpret_cast<QRgb*>(target_image.scanLine(row_index))[column_index] = qRgb(color, color, color);
+  });
+
+  return target_image;
+}
+
+QImage otsuThreshold(QImage image, int class_count)
+{
+  int width = image.width();
+  int height = image.height();
+
+  bool grayscale = true;
+  for (int row_index = 0; row_index < height; row_index++) {
+    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
+    for (int column_index = 0; column_index < width; column_index++)
+      grayscale = grayscale && qRed(line[column_index]) == qGreen(line[column_index])
+                  && qGreen(line[column_index]) == qBlue(line[column_index]);
+  }
+
+  // Tone of each pixel, the luminance unless the image is grayscale
+  auto tone = [grayscale](QRgb pixel) {
+    if (grayscale)
+      return qRed(pixel);
+    return static_cast<int>(0.299 * qRed(pixel) + 0.587 * qGreen(pixel) + 0.114 * qBlue(pixel));
+  };
+
+  std::vector<qint64> histogram(256);
+  for (int row_index = 0; row_index < height; row_index++) {
+    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
+    for (int column_index = 0; column_index < width; column_index++)
+      histogram[static_cast<size_t>(tone(line[column_index]))]++;
+  }
+
+  // Squared sum of the tones of a class over its pixel count, summed tone
+  // by tone
+  auto class_term = [&](int first, int last) {
+    qint64 count = 0;
+    qint64 sum = 0;
+    for (int i = first; i <= last; i++) {
+      count += histogram[static_cast<size_t>(i)];
+      sum += i * histogram[static_cast<size_t>(i)];
+    }
+    if (count == 0)
+      return 0.0;
+    auto sum_value = static_cast<double>(sum);
+    return sum_value * sum_value / count;
+  };
+
+  // Largest sum of terms splitting tones 0 to last in c + 1 classes, with
+  // the last tone of the class before the last one
+  std::vector<std::vector<double>> best(static_cast<size_t>(class_count), std::vector<double>(256));
+  std::vector<std::vector<int>> split(static_cast<size_t>(class_count), std::vector<int>(256));
+
+  for (int last = 0; last < 256; last++)
+    best[0][static_cast<size_t>(last)] = class_term(0, last);
+
+  for (int c = 1; c < class_count; c++) {
+    for (int last = c; last < 256; last++) {
+      double best_value = -1;
+      for (int previous = c - 1; previous < last; previous++) {
+        double value = best[static_cast<size_t>(c - 1)][static_cast<size_t>(previous)] + class_term(previous + 1, last);
+        if (value > best_value) {
+          best_value = value;
+          split[static_cast<size_t>(c)][static_cast<size_t>(last)] = previous;
+        }
+      }
+      best[static_cast<size_t>(c)][static_cast<size_t>(last)] = best_value;
+    }
+  }
+
+  std::vector<int> thresholds(static_cast<size_t>(class_count - 1));
+  int last = 255;
+  for (int c = class_count - 1; c > 0; c--) {
+    last = split[static_cast<size_t>(c)][static_cast<size_t>(last)];
+    thresholds[static_cast<size_t>(c - 1)] = last;
+  }
+
+  // Classes get gray levels evenly spaced from black to white
+  int steps = class_count - 1;
+  for (int row_index = 0; row_index < height; row_index++) {
+    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(row_index));
+    for (int column_index = 0; column_index < width; column_index++) {
+      auto* pixel = &line[column_index];
+      int class_index = 0;
+      while (class_index < steps && tone(*pixel) > thresholds[static_cast<size_t>(class_index)])
+        class_index++;
+      int color = steps > 0 ? (class_index * 255 + steps / 2) / steps : 0;
+      *pixel = qRgba(color, color, color, qAlpha(*pixel));
+    }
+  }
+
+  return image;
+}
+
+QImage nonLocalMeansDenoise(QImage image, int search_radius, int patch_radius, double strength)
+{
+  int width = image.width();
+  int height = image.height();
+
+  QImage target_image(width, height, image.format());
+
+  auto pixel_at = [&](int row, int column) {
+    row = std::min(height - 1, std::max(0, row));
+    column = std::min(width - 1, std::max(0, column));
+    return reinterpret_cast<const QRgb*>(image.constScanLine(row))[column];
+  };
+
+  int patch_size = 2 * patch_radius + 1;
+  double value_count = 3.0 * patch_size * patch_size;
+
+  for (int row_index = 0; row_index < height; row_index++) {
+    QRgb* target_line = reinterpret_cast<QRgb*>(target_image.scanLine(row_index));
+
+    for (int column_index = 0; column_index < width; column_index++) {
+      double weight_sum = 0;
+      double red = 0;
+      double green = 0;
+      double blue = 0;
+
+      for (int dy = -search_radius; dy <= search_radius; dy++) {
+        for (int dx = -search_radius; dx <= search_radius; dx++) {
+          qint64 distance = 0;
+          for (int py = -patch_radius; py <= patch_radius; py++) {
+            for (int px = -patch_radius; px <= patch_radius; px++) {
+              QRgb first = pixel_at(row_index + py, column_index + px);
+              QRgb second = pixel_at(row_index + dy + py, column_index + dx + px);
+              distance += (qRed(first) - qRed(second)) * (qRed(first) - qRed(second))
+                  + (qGreen(first) - qGreen(second)) * (qGreen(first) - qGreen(second))
+                  + (qBlue(first) - qBlue(second)) * (qBlue(first) - qBlue(second));
+            }
+          }
+
+          double weight = std::exp(-distance / (value_count * strength * strength));
+          QRgb neighbour = pixel_at(row_index + dy, column_index + dx);
+          weight_sum += weight;
+          red += weight * qRed(neighbour);
+          green += weight * qGreen(neighbour);
+          blue += weight * qBlue(neighbour);
+        }
+      }
+
+      target_line[column_index] = qRgba(static_cast<int>(red / weight_sum), static_cast<int>(green / weight_sum),
+                                        static_cast<int>(blue / weight_sum), qAlpha(pixel_at(row_index, column_index)));
+    }
+  }
+
+  return target_image;
+}
+
+} // namespace reference
+
+} // namespace image_op
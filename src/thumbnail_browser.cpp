@@ -0,0 +1,110 @@
+#include "include/thumbnail_browser.hpp"
+
+#include <QDir>
+#include <QIcon>
+#include <QImageReader>
+#include <QPixmap>
+#include <QStandardPaths>
+#include <QVBoxLayout>
+#include <QtConcurrent>
+
+namespace {
+
+// Largest side of the thumbnails
+constexpr int kThumbnailSize = 128;
+
+/**
+ * Where the thumbnails are kept between sessions
+ */
+QString thumbnailDirectory()
+{
+  return QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("thumbnails");
+}
+
+/**
+ * Name filters of the formats QImageReader can decode
+ */
+QStringList imageNameFilters()
+{
+  QStringList name_filters;
+  for (const QByteArray& format : QImageReader::supportedImageFormats())
+    name_filters.append("*." + QString::fromLatin1(format));
+  return name_filters;
+}
+
+} // namespace
+
+ThumbnailBrowser::ThumbnailBrowser(QWidget* parent):
+  QWidget(parent),
+  cache_(thumbnailDirectory(), kThumbnailSize),
+  generation_(0)
+{
+  folder_label_ = new QLabel(tr("No folder"));
+  folder_label_->setTextInteractionFlags(Qt::TextSelectableByMouse);
+
+  list_ = new QListWidget;
+  list_->setViewMode(QListView::IconMode);
+  list_->setIconSize(QSize(kThumbnailSize, kThumbnailSize));
+  list_->setGridSize(QSize(kThumbnailSize + 16, kThumbnailSize + 32));
+  list_->setResizeMode(QListView::Adjust);
+  list_->setMovement(QListView::Static);
+  list_->setUniformItemSizes(true);
+
+  auto* layout = new QVBoxLayout(this);
+  layout->addWidget(folder_label_);
+  layout->addWidget(list_);
+
+  connect(list_, &QListWidget::itemActivated, this, [this](QListWidgetItem* item) {
+    emit fileActivated(item->data(Qt::UserRole).toString());
+  });
+
+  // Queued, since the workers emit it from their threads
+  connect(this, &ThumbnailBrowser::thumbnailLoaded, this, &ThumbnailBrowser::showThumbnail, Qt::QueuedConnection);
+}
+
+ThumbnailBrowser::~ThumbnailBrowser()
+{
+  // The workers use the cache and emit from this object
+  generation_.fetchAndAddOrdered(1);
+  pool_.clear();
+  pool_.waitForDone();
+}
+
+void ThumbnailBrowser::setFolder(const QString& folder)
+{
+  int generation = generation_.fetchAndAddOrdered(1) + 1;
+  pool_.clear();
+
+  folder_ = folder;
+  folder_label_->setText(QDir::toNativeSeparators(folder));
+  list_->clear();
+
+  const QFileInfoList files = QDir(folder).entryInfoList(imageNameFilters(), QDir::Files | QDir::Readable,
+                                                         QDir::Name | QDir::IgnoreCase);
+
+  for (int row = 0; row < files.size(); row++) {
+    QString file_name = files[row].absoluteFilePath();
+
+    auto* item = new QListWidgetItem(files[row].fileName(), list_);
+    item->setData(Qt::UserRole, file_name);
+    item->setToolTip(QDir::toNativeSeparators(file_name));
+
+    // Started in the order of the list, so the first ones show first
+    QtConcurrent::run(&pool_, [this, generation, row, file_name]() {
+      if (generation_.load() != generation)
+        return;
+
+      QImage thumbnail = cache_.thumbnail(file_name);
+      if (!thumbnail.isNull())
+        emit thumbnailLoaded(generation, row, thumbnail);
+    });
+  }
+}
+
+void ThumbnailBrowser::showThumbnail(int generation, int row, const QImage& thumbnail)
+{
+  if (generation != generation_.load() || row >= list_->count())
+    return;
+
+  list_->item(row)->setIcon(QIcon(QPixmap::fromImage(thumbnail)));
+}
@@ -0,0 +1,171 @@
+#include "include/thumbnail_cache.hpp"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QSaveFile>
+
+#include "include/profiler.hpp"
+
+namespace {
+
+const char kIndexFileName[] = "index";
+
+/**
+ * Entry of a file in the index, changing whenever the file may have
+ */
+QString indexKey(const QFileInfo& file_info)
+{
+  return QString("%1\n%2\n%3").arg(file_info.absoluteFilePath()).arg(file_info.size())
+                              .arg(file_info.lastModified().toMSecsSinceEpoch());
+}
+
+/**
+ * Decodes the image at reduced resolution. Decoders that support scaled
+ * reads, like the JPEG one, skip most of the full resolution work, images
+ * from the others are scaled once decoded
+ */
+QImage decodeThumbnail(const QString& file_name, int size)
+{
+  PROFILE_SCOPE("decodeThumbnail", "decode");
+
+  QImageReader reader(file_name);
+  reader.setAutoTransform(true);
+
+  QSize image_size = reader.size();
+  if (image_size.isValid() && (image_size.width() > size || image_size.height() > size))
+    reader.setScaledSize(image_size.scaled(size, size, Qt::KeepAspectRatio).expandedTo(QSize(1, 1)));
+
+  QImage image = reader.read();
+  if (image.width() > size || image.height() > size)
+    image = image.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+  return image;
+}
+
+} // namespace
+
+ThumbnailCache::ThumbnailCache(const QString& directory, int size):
+  directory_(QDir(directory).filePath(QString::number(size))),
+  size_(size),
+  index_loaded_(false)
+{
+  QDir().mkpath(directory_);
+}
+
+QImage ThumbnailCache::thumbnail(const QString& file_name)
+{
+  QByteArray content_hash = contentHash(QFileInfo(file_name));
+  if (content_hash.isEmpty())
+    return QImage();
+
+  QString cached_file_name = QDir(directory_).filePath(QString::fromLatin1(content_hash) + ".png");
+  QImage cached_thumbnail(cached_file_name);
+  if (!cached_thumbnail.isNull())
+    return cached_thumbnail;
+
+  QImage thumbnail = decodeThumbnail(file_name, size_);
+  if (thumbnail.isNull())
+    return thumbnail;
+
+  // Written aside then renamed, so no thread reads a partial file
+  QSaveFile file(cached_file_name);
+  if (file.open(QIODevice::WriteOnly) && thumbnail.save(&file, "PNG"))
+    file.commit();
+
+  return thumbnail;
+}
+
+QByteArray ThumbnailCache::contentHash(const QFileInfo& file_info)
+{
+  QString key = indexKey(file_info);
+
+  {
+    QMutexLocker locker(&mutex_);
+    loadIndex();
+    QByteArray content_hash = index_.value(key);
+    if (!content_hash.isEmpty())
+      return content_hash;
+  }
+
+  QFile file(file_info.absoluteFilePath());
+  if (!file.open(QIODevice::ReadOnly))
+    return QByteArray();
+
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  if (!hash.addData(&file))
+    return QByteArray();
+
+  QByteArray content_hash = hash.result().toHex();
+
+  QMutexLocker locker(&mutex_);
+  index_.insert(key, content_hash);
+
+  QFile index_file(QDir(directory_).filePath(kIndexFileName));
+  if (index_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+    QDataStream stream(&index_file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << key << content_hash;
+  }
+
+  return content_hash;
+}
+
+void ThumbnailCache::loadIndex()
+{
+  if (index_loaded_)
+    return;
+
+  index_loaded_ = true;
+
+  QFile index_file(QDir(directory_).filePath(kIndexFileName));
+  if (!index_file.open(QIODevice::ReadOnly))
+    return;
+
+  QDataStream stream(&index_file);
+  stream.setVersion(QDataStream::Qt_5_0);
+  int record_count = 0;
+
+  while (!stream.atEnd()) {
+    QString key;
+    QByteArray content_hash;
+    stream >> key >> content_hash;
+
+    // A record cut short, by a crash while appending, ends the index
+    if (stream.status() != QDataStream::Ok)
+      break;
+
+    record_count++;
+
+    // Files changed or removed since have entries no lookup reaches
+    if (indexKey(QFileInfo(key.section('\n', 0, -3))) == key)
+      index_.insert(key, content_hash);
+  }
+
+  index_file.close();
+
+  // Appending on every new file would otherwise grow it with every edit
+  if (record_count > index_.size())
+    writeIndex();
+}
+
+void ThumbnailCache::writeIndex()
+{
+  QSaveFile index_file(QDir(directory_).filePath(kIndexFileName));
+  if (!index_file.open(QIODevice::WriteOnly))
+    return;
+
+  QDataStream stream(&index_file);
+  stream.setVersion(QDataStream::Qt_5_0);
+
+  for (auto entry = index_.constBegin(); entry != index_.constEnd(); ++entry)
+    stream << entry.key() << entry.value();
+
+  if (stream.status() == QDataStream::Ok)
+    index_file.commit();
+}
@@ -0,0 +1,479 @@
+#include "include/tile_pipeline.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include <QRect>
+#include <QtConcurrent>
+
+#include "include/denoise.hpp"
+#include "include/image_buffer_pool.hpp"
+#include "include/image_operations.hpp"
+#include "include/image_statistics.hpp"
+#include "include/integral_image.hpp"
+#include "include/morphology.hpp"
+#include "include/operation_registry.hpp"
+#include "include/pixel_formats.hpp"
+#include "include/profiler.hpp"
+
+namespace image_op {
+
+namespace {
+
+// Cache the buffers of a tile are sized for, a common L2 size per core
+constexpr int kTileCacheBytes = 256 * 1024;
+
+// Buffers of a tile alive at once: the input of a stage, its result and
+// the previous result still being released
+constexpr int kLiveTileBuffers = 3;
+
+constexpr int kMinimumTileSize = 16;
+
+// Rows each thread copies around a selection written to a new image
+constexpr int kCopyBandRows = 64;
+
+/**
+ * Stage of a fused segment, applied on each tile
+ */
+struct TileStage
+{
+  // Pixels read around each output pixel
+  int halo;
+  std::function<QImage(QImage)> apply;
+};
+
+/**
+ * Tile version of a stage, taking the tile by value so point operations
+ * change it in place
+ * @param whole_input Complete input of the stage, null unless the stage
+ * starts a segment. Stages that need it, like quantization spanning the
+ * range of its input, cannot be fused after other stages
+ * @return false if the stage cannot run on tiles
+ */
+bool makeTileStage(const PipelineStage& stage, const QImage& whole_input, TileStage* tile_stage)
+{
+  const auto& parameters = stage.parameters;
+
+  if (stage.name == "grayscale") {
+    if (whole_input.isNull())
+      return false;
+
+    // Gray images are kept as they are, which only the whole input tells,
+    // gray tiles of a colored image are converted like the rest
+    if (whole_input.isGrayscale())
+      *tile_stage = { 0, [](QImage tile) { return tile; } };
+    else
+      *tile_stage = { 0, [](QImage tile) { return convertToLuminance(std::move(tile)); } };
+  } else if (stage.name == "brightness") {
+    int brightness_value = parameters[0].toInt();
+    *tile_stage = { 0, [brightness_value](QImage tile) { return adjustBrightness(std::move(tile), brightness_value); } };
+  } else if (stage.name == "contrast") {
+    int contrast_factor = parameters[0].toInt();
+    *tile_stage = { 0, [contrast_factor](QImage tile) { return adjustContrast(std::move(tile), contrast_factor); } };
+  } else if (stage.name == "negative") {
+    *tile_stage = { 0, [](QImage tile) { return getNegativeImage(std::move(tile)); } };
+  } else if (stage.name == "quantize") {
+    if (whole_input.isNull())
+      return false;
+
+    int num_colors = parameters[0].toInt();
+    auto luminance = imageStatistics(whole_input).luminance;
+    *tile_stage = { 0, [num_colors, luminance](QImage tile) {
+      return quantizeGrayscale(std::move(tile), num_colors, luminance.minimum, luminance.maximum);
+    } };
+  } else if (stage.name == "otsu_threshold") {
+    int class_count = parameters[0].toInt();
+    if (whole_input.isNull() || class_count < 2 || class_count > 16)
+      return false;
+
+    // Thresholds come from the histogram of the whole input
+    auto statistics = imageStatistics(whole_input);
+    bool use_luminance = !statistics.grayscale;
+    auto tone_curve = otsuCurve(use_luminance ? statistics.luminance.histogram : statistics.red.histogram,
+                                class_count);
+    *tile_stage = { 0, [tone_curve, use_luminance](QImage tile) {
+      return mapGrayTones(std::move(tile), tone_curve, use_luminance);
+    } };
+  } else if (stage.name == "convolution") {
+    QVector<QVector<double>> kernel;
+    for (int i = 0; i < 3; i++) {
+      kernel.append(QVector<double>(3));
+      for (int j = 0; j < 3; j++)
+        kernel[i][j] = parameters[i*3 + j].toDouble();
+    }
+
+    bool add_bias = parameters[9].toBool();
+    *tile_stage = { 1, [kernel, add_bias](QImage tile) {
+      return applyConvolutionWith3x3Kernel(std::move(tile), kernel, add_bias);
+    } };
+  } else if (stage.name == "erode" || stage.name == "dilate" || stage.name == "open" || stage.name == "close") {
+    int element_width = parameters[0].toInt();
+    int element_height = parameters[1].toInt();
+    if (element_width < 1 || element_height < 1)
+      return false;
+
+    // Pixels outside of the image are ignored, as they are outside of
+    // the tile, so borders match once the reach of the element is read
+    int reach = std::max(element_width, element_height) / 2;
+    auto filter = stage.name == "erode" ? erodeImage
+                  : stage.name == "dilate" ? dilateImage
+                  : stage.name == "open" ? openImage
+                  : closeImage;
+    bool twice = stage.name == "open" || stage.name == "close";
+
+    *tile_stage = { twice ? 2 * reach : reach, [filter, element_width, element_height](QImage tile) {
+      return filter(std::move(tile), element_width, element_height);
+    } };
+  } else if (stage.name == "box_blur") {
+    int box_width = parameters[0].toInt();
+    int box_height = parameters[1].toInt();
+    if (box_width < 1 || box_height < 1)
+      return false;
+
+    // Boxes are clipped to the image, as they are to the tile
+    *tile_stage = { std::max(box_width, box_height) / 2, [box_width, box_height](QImage tile) {
+      return boxBlur(std::move(tile), box_width, box_height);
+    } };
+  } else if (stage.name == "sauvola_threshold" || stage.name == "bradley_threshold") {
+    int window_size = parameters[0].toInt();
+    double factor = parameters[1].toDouble();
+    if (window_size < 1)
+      return false;
+
+    auto threshold = stage.name == "sauvola_threshold" ? sauvolaThreshold : bradleyThreshold;
+    *tile_stage = { window_size / 2, [threshold, window_size, factor](QImage tile) {
+      return threshold(std::move(tile), window_size, factor);
+    } };
+  } else if (stage.name == "nlm_denoise") {
+    int search_radius = parameters[0].toInt();
+    int patch_radius = parameters[1].toInt();
+    double strength = parameters[2].toDouble();
+    if (search_radius < 1 || patch_radius < 0 || strength <= 0)
+      return false;
+
+    // Edges repeat past the image but not past the tile, so the halo
+    // covers every patch of every offset a kept pixel compares
+    *tile_stage = { search_radius + patch_radius, [search_radius, patch_radius, strength](QImage tile) {
+      return nonLocalMeansDenoise(std::move(tile), search_radius, patch_radius, strength);
+    } };
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * Runs fused stages tile by tile, each tile read with the halo of all the
+ * stages, so its pixels near the edges of the image see the same borders
+ * they would on the whole image and the others are cropped
+ * @param destination Image the tiles are written to if it has the size and
+ * format of the result, null to write them to a new one
+ */
+QImage runSegment(const QImage& input, const std::vector<TileStage>& stages, int tile_size, QImage* destination)
+{
+  PROFILE_SCOPE("image_op::runSegment", "compute");
+
+  int halo = 0;
+  for (const auto& stage : stages)
+    halo += stage.halo;
+
+  // The format of the output follows from the format of the input
+  QImage probe = input.copy(0, 0, 1, 1);
+  for (const auto& stage : stages)
+    probe = stage.apply(std::move(probe));
+
+  QImage output;
+  uchar* output_bits;
+
+  // Taken once, scanLine would detach from every thread. The pixels of the
+  // destination are taken before output shares them, which would detach it
+  if (destination && destination->size() == input.size() && destination->format() == probe.format()) {
+    output_bits = destination->bits();
+    output = *destination;
+  } else {
+    output = pooledImage(input.width(), input.height(), probe.format());
+    if (output.isNull())
+      return output;
+    output_bits = output.bits();
+  }
+
+  int output_bytes_per_line = output.bytesPerLine();
+  int bytes_per_pixel = output.depth() / 8;
+
+  if (tile_size <= 0) {
+    int pixel_bytes = std::max(input.depth(), output.depth()) / 8;
+    int padded_size = static_cast<int>(std::sqrt(kTileCacheBytes / (kLiveTileBuffers * pixel_bytes)));
+    tile_size = std::max(kMinimumTileSize, (padded_size - 2 * halo) / kMinimumTileSize * kMinimumTileSize);
+  }
+
+  std::vector<QRect> tiles;
+  for (int y = 0; y < input.height(); y += tile_size) {
+    for (int x = 0; x < input.width(); x += tile_size)
+      tiles.emplace_back(x, y, std::min(tile_size, input.width() - x), std::min(tile_size, input.height() - y));
+  }
+
+  QtConcurrent::blockingMap(tiles, [&](const QRect& tile) {
+    QRect padded_tile = tile.adjusted(-halo, -halo, halo, halo).intersected(input.rect());
+
+    QImage current = input.copy(padded_tile);
+    for (const auto& stage : stages)
+      current = stage.apply(std::move(current));
+
+    auto row_bytes = static_cast<size_t>(tile.width() * bytes_per_pixel);
+    int column_offset = (tile.x() - padded_tile.x()) * bytes_per_pixel;
+
+    for (int row_index = 0; row_index < tile.height(); row_index++) {
+      std::memcpy(output_bits + static_cast<qint64>(tile.y() + row_index) * output_bytes_per_line
+                  + tile.x() * bytes_per_pixel,
+                  current.constScanLine(tile.y() - padded_tile.y() + row_index) + column_offset,
+                  row_bytes);
+    }
+  });
+
+  return output;
+}
+
+/**
+ * Mixes each channel of the result into the original by the weight of the
+ * mask, rounding to the nearest value
+ */
+template<typename Format>
+typename Format::Pixel blendPixel(typename Format::Pixel original, typename Format::Pixel result, int weight)
+{
+  auto blend = [weight](int original_value, int result_value) {
+    return static_cast<typename Format::Channel>((original_value * (255 - weight) + result_value * weight + 127) / 255);
+  };
+
+  return Format::pixel(blend(Format::red(original), Format::red(result)),
+                       blend(Format::green(original), Format::green(result)),
+                       blend(Format::blue(original), Format::blue(result)),
+                       blend(Format::alpha(original), Format::alpha(result)));
+}
+
+} // namespace
+
+QImage applyPipeline(const QImage& image, const QVector<PipelineStage>& stages, int tile_size)
+{
+  return applyPipelineTo(image, stages, nullptr, tile_size);
+}
+
+QImage applyPipelineTo(const QImage& image, const QVector<PipelineStage>& stages, QImage* destination, int tile_size)
+{
+  PROFILE_SCOPE("image_op::applyPipeline", "compute");
+
+  if (image.isNull())
+    return QImage();
+
+  for (const auto& stage : stages) {
+    auto* operation = findOperation(stage.name);
+    if (!operation || operation->input_count != 1 || operation->parameters.size() != stage.parameters.size())
+      return QImage();
+  }
+
+  QImage current = image;
+  int index = 0;
+
+  while (index < stages.size()) {
+    // Gathers the stages that can be fused from here on
+    std::vector<TileStage> segment;
+    TileStage tile_stage;
+
+    while (index < stages.size() && stages[index].selection.rect.isNull()
+           && makeTileStage(stages[index], segment.empty() ? current : QImage(), &tile_stage)) {
+      segment.push_back(tile_stage);
+      index++;
+    }
+
+    if (segment.empty() && !stages[index].selection.rect.isNull()) {
+      // Results of earlier stages are only held here, moving them in lets
+      // the selection be written in place instead of on a copy
+      QVector<QImage> inputs;
+      inputs.append(std::move(current));
+      current = applyOperationInSelection(stages[index].name, std::move(inputs), stages[index].parameters,
+                                          stages[index].selection);
+      index++;
+    } else if (!segment.empty()) {
+      // Only the last segment gives the result
+      current = runSegment(current, segment, tile_size, index == stages.size() ? destination : nullptr);
+    } else {
+      current = applyOperation(stages[index].name, { current }, stages[index].parameters);
+      index++;
+    }
+
+    if (current.isNull())
+      return current;
+  }
+
+  return current;
+}
+
+QImage applyOperationInSelection(const QString& name, QVector<QImage> inputs, const QVariantList& parameters,
+                                 const Selection& selection)
+{
+  PROFILE_SCOPE("image_op::applyOperationInSelection", "compute");
+
+  if (selection.rect.isNull())
+    return applyOperation(name, inputs, parameters);
+
+  auto* operation = findOperation(name);
+  if (!operation || inputs.size() != operation->input_count || operation->parameters.size() != parameters.size()
+      || inputs[0].isNull())
+    return QImage();
+
+  const QImage& mask = selection.mask;
+  if (!mask.isNull() && (mask.size() != selection.rect.size() || mask.format() != QImage::Format_Grayscale8))
+    return QImage();
+
+  QImage output = std::move(inputs[0]);
+  QRect region = selection.rect.intersected(output.rect());
+  if (region.isEmpty())
+    return output;
+
+  // Stages that run on tiles read the halo around the region, so pixels
+  // near its edges see the same neighbors they would on the whole image
+  QImage region_image = output.copy(region);
+  QImage result;
+  TileStage tile_stage;
+
+  if (operation->input_count == 1 && makeTileStage({ name, parameters, {} }, region_image, &tile_stage)) {
+    QRect padded_region = region.adjusted(-tile_stage.halo, -tile_stage.halo, tile_stage.halo, tile_stage.halo)
+                                .intersected(output.rect());
+    result = tile_stage.apply(padded_region == region ? region_image : output.copy(padded_region));
+    if (padded_region != region)
+      result = result.copy(region.translated(-padded_region.topLeft()));
+  } else {
+    inputs[0] = region_image;
+    result = applyOperation(name, inputs, parameters);
+  }
+
+  if (result.size() != region.size())
+    return QImage();
+
+  // Formats the operations do not run on natively come back converted
+  if (output.format() != result.format())
+    output = output.convertToFormat(result.format());
+
+  QPoint mask_offset = region.topLeft() - selection.rect.topLeft();
+
+  visitPixelFormat(output, [&](auto format) {
+    using Format = decltype(format);
+    using Pixel = typename Format::Pixel;
+
+    // The visit may have converted the output to a format it runs on
+    if (result.format() != output.format())
+      result = result.convertToFormat(output.format());
+
+    // An input other images share is not detached, which would copy the
+    // selected pixels only to overwrite them: only the pixels around the
+    // selection are copied to a new image, and masks blend with the input
+    bool in_place = output.isDetached();
+    QImage original;
+    if (!in_place) {
+      original = std::move(output);
+      output = pooledImage(original.width(), original.height(), original.format());
+      if (output.isNull())
+        return;
+
+      output.setDotsPerMeterX(original.dotsPerMeterX());
+      output.setDotsPerMeterY(original.dotsPerMeterY());
+      for (const auto& key : original.textKeys())
+        output.setText(key, original.text(key));
+    }
+
+    // Taken once, scanLine would detach from every thread
+    uchar* output_bits = output.bits();
+    const uchar* original_bits = in_place ? output_bits : original.constBits();
+    int output_bytes_per_line = output.bytesPerLine();
+    int original_bytes_per_line = in_place ? output_bytes_per_line : original.bytesPerLine();
+
+    auto write_row = [&](int row_index) {
+      auto* output_row = reinterpret_cast<Pixel*>(output_bits
+                                                  + static_cast<qint64>(row_index) * output_bytes_per_line);
+      const auto* original_row = reinterpret_cast<const Pixel*>(original_bits
+                                                                + static_cast<qint64>(row_index)
+                                                                  * original_bytes_per_line);
+      bool selected = row_index >= region.top() && row_index <= region.bottom();
+      int region_end = region.x() + region.width();
+
+      if (!in_place) {
+        std::copy(original_row, original_row + (selected ? region.x() : output.width()), output_row);
+        if (selected)
+          std::copy(original_row + region_end, original_row + output.width(), output_row + region_end);
+      }
+
+      if (!selected)
+        return;
+
+      output_row += region.x();
+      original_row += region.x();
+      const auto* result_row = pixel_format::constRow<Format>(result, row_index - region.y());
+
+      if (mask.isNull()) {
+        std::copy(result_row, result_row + region.width(), output_row);
+        return;
+      }
+
+      const uchar* mask_row = mask.constScanLine(mask_offset.y() + row_index - region.y()) + mask_offset.x();
+      for (int col_index = 0; col_index < region.width(); col_index++)
+        output_row[col_index] = blendPixel<Format>(original_row[col_index], result_row[col_index], mask_row[col_index]);
+    };
+
+    if (in_place) {
+      for (int row_index = region.top(); row_index <= region.bottom(); row_index++)
+        write_row(row_index);
+      return;
+    }
+
+    std::vector<int> bands;
+    for (int row_index = 0; row_index < output.height(); row_index += kCopyBandRows)
+      bands.push_back(row_index);
+
+    QtConcurrent::blockingMap(bands, [&](int first_row) {
+      for (int row_index = first_row; row_index < std::min(first_row + kCopyBandRows, output.height()); row_index++)
+        write_row(row_index);
+    });
+  });
+
+  return output;
+}
+
+bool parsePipelineStages(const QString& text, QVector<PipelineStage>* stages, QString* error)
+{
+  for (const auto& stage_text : text.split(',', QString::SkipEmptyParts)) {
+    QStringList parts = stage_text.trimmed().split(':');
+    auto* operation = findOperation(parts.takeFirst());
+    if (!operation) {
+      *error = QString("Unknown operation in %1").arg(stage_text);
+      return false;
+    }
+
+    PipelineStage stage{ operation->name, {}, {} };
+    for (int i = 0; i < parts.size(); i++) {
+      bool ok = true;
+      auto type = i < operation->parameters.size() ? operation->parameters[i].type
+                                                   : OperationParameter::Real;
+
+      if (type == OperationParameter::Boolean)
+        stage.parameters.append(parts[i] == "1" || parts[i] == "true");
+      else if (type == OperationParameter::Real)
+        stage.parameters.append(parts[i].toDouble(&ok));
+      else
+        stage.parameters.append(parts[i].toInt(&ok));
+
+      if (!ok) {
+        *error = QString("Invalid parameter %1 of %2").arg(parts[i], operation->name);
+        return false;
+      }
+    }
+
+    stages->append(stage);
+  }
+
+  return true;
+}
+
+} // namespace image_op
@@ -0,0 +1,450 @@
+#include "include/tiled_image_view.hpp"
+
+#include <cmath>
+
+#include <QApplication>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QScrollBar>
+#include <QWheelEvent>
+
+#include "include/profiler.hpp"
+
+namespace {
+
+// Default memory cost of the tile cache of each view, in kilobytes
+constexpr int kDefaultTileCacheLimit = 128 * 1024;
+
+quint64 tileKey(int level, int tile_column, int tile_row)
+{
+  return (static_cast<quint64>(level) << 56)
+      | (static_cast<quint64>(tile_row) << 28)
+      | static_cast<quint64>(tile_column);
+}
+
+// Pixels of the source image a tile of the given level is rendered from
+QRect tileSourceRect(int level, int tile_column, int tile_row)
+{
+  int source_tile_size = TiledImageView::kTileSize << level;
+  return QRect(tile_column * source_tile_size, tile_row * source_tile_size, source_tile_size, source_tile_size);
+}
+
+// Size of the image at the given reduction level
+QSize levelSize(const QImage& image, int level)
+{
+  int divisor = 1 << level;
+  return QSize((image.width() + divisor - 1) / divisor, (image.height() + divisor - 1) / divisor);
+}
+
+bool isRgb32Layout(QImage::Format format)
+{
+  return format == QImage::Format_RGB32
+      || format == QImage::Format_ARGB32
+      || format == QImage::Format_ARGB32_Premultiplied;
+}
+
+} // namespace
+
+TiledImageView::TiledImageView(QWidget* parent):
+  QAbstractScrollArea(parent),
+  tile_cache_(kDefaultTileCacheLimit),
+  zoom_(1.0),
+  fit_to_window_(false),
+  selection_enabled_(false)
+{
+  setBackgroundRole(QPalette::Dark);
+  viewport()->setBackgroundRole(QPalette::Dark);
+
+  rubber_band_ = new QRubberBand(QRubberBand::Rectangle, viewport());
+}
+
+void TiledImageView::setImage(const QImage& image)
+{
+  // A selection only makes sense on an image of the same size
+  if (image.size() != image_.size())
+    setSelection(QRect());
+
+  image_ = image;
+  tile_cache_.clear();
+  updateScrollBars();
+  viewport()->update();
+}
+
+void TiledImageView::updateImage(const QImage& image, const QRect& dirty_rect)
+{
+  if (image.size() != image_.size() || image.format() != image_.format() || image_.isNull()) {
+    setImage(image);
+    return;
+  }
+
+  image_ = image;
+
+  QRect dirty_region = dirty_rect.intersected(image_.rect());
+  if (dirty_region.isEmpty())
+    return;
+
+  // Tiles of every level sampled from the dirty pixels are stale, the
+  // others are still what this version of the image would render
+  for (auto key : tile_cache_.keys()) {
+    auto level = static_cast<int>(key >> 56);
+    auto tile_row = static_cast<int>((key >> 28) & 0xFFFFFFF);
+    auto tile_column = static_cast<int>(key & 0xFFFFFFF);
+
+    if (tileSourceRect(level, tile_column, tile_row).intersects(dirty_region))
+      tile_cache_.remove(key);
+  }
+
+  viewport()->update(mapFromImage(dirty_region));
+}
+
+void TiledImageView::clear()
+{
+  setImage(QImage());
+}
+
+const QImage& TiledImageView::image() const
+{
+  return image_;
+}
+
+void TiledImageView::setFitToWindow(bool fit_to_window)
+{
+  // Leaving fit to window goes back to original size, a manual zoom is kept
+  if (fit_to_window_ && !fit_to_window)
+    zoom_ = 1.0;
+
+  fit_to_window_ = fit_to_window;
+
+  updateScrollBars();
+  viewport()->update();
+}
+
+void TiledImageView::setZoom(double zoom)
+{
+  fit_to_window_ = false;
+  zoom_ = zoom;
+  updateScrollBars();
+  viewport()->update();
+}
+
+double TiledImageView::zoom() const
+{
+  return zoom_;
+}
+
+void TiledImageView::setTileCacheLimit(int kilobytes)
+{
+  tile_cache_.setMaxCost(kilobytes);
+}
+
+void TiledImageView::setSelectionEnabled(bool enabled)
+{
+  selection_enabled_ = enabled;
+  viewport()->setCursor(enabled ? Qt::CrossCursor : Qt::ArrowCursor);
+}
+
+QRect TiledImageView::selection() const
+{
+  return selection_;
+}
+
+void TiledImageView::setSelection(const QRect& selection)
+{
+  QRect clipped_selection = selection.intersected(image_.rect());
+  if (clipped_selection.isEmpty())
+    clipped_selection = QRect();
+
+  if (clipped_selection == selection_)
+    return;
+
+  selection_ = clipped_selection;
+  viewport()->update();
+  emit selectionChanged(selection_);
+}
+
+int TiledImageView::levelForZoom() const
+{
+  int level = 0;
+
+  // Stop reducing once the level is a single pixel wide or high
+  while (zoom_ * (1 << (level + 1)) <= 1.0
+         && (image_.width() >> (level + 1)) > 0
+         && (image_.height() >> (level + 1)) > 0)
+    level++;
+
+  return level;
+}
+
+const QPixmap* TiledImageView::tile(int level, int tile_column, int tile_row)
+{
+  auto key = tileKey(level, tile_column, tile_row);
+  auto* cached_tile = tile_cache_.object(key);
+
+  if (cached_tile)
+    return cached_tile;
+
+  QImage tile_image = renderTile(level, tile_column, tile_row);
+  PROFILE_SCOPE("TiledImageView::convertTile", "convert");
+
+  auto* new_tile = new QPixmap(QPixmap::fromImage(tile_image));
+  int cost = std::max(1, new_tile->width() * new_tile->height() * 4 / 1024);
+
+  // QCache takes ownership, deleting the tile right away if it does not fit
+  if (!tile_cache_.insert(key, new_tile, cost))
+    return nullptr;
+
+  return new_tile;
+}
+
+QImage TiledImageView::renderTile(int level, int tile_column, int tile_row) const
+{
+  QSize size = levelSize(image_, level);
+  QRect tile_rect = QRect(tile_column * kTileSize, tile_row * kTileSize, kTileSize, kTileSize)
+      .intersected(QRect(QPoint(0, 0), size));
+
+  if (level == 0)
+    return image_.copy(tile_rect);
+
+  PROFILE_SCOPE("TiledImageView::renderTile", "rescale");
+
+  // Each pixel of the reduced level averages four samples spread over the
+  // 2^level x 2^level block it covers, so the cost only depends on the tile size
+  int step = 1 << level;
+  int half_step = step / 2;
+  int width = image_.width();
+  int height = image_.height();
+  bool fast_path = isRgb32Layout(image_.format());
+
+  QImage tile_image(tile_rect.size(), image_.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+
+  auto sample = [&](int x, int y) {
+    x = std::min(x, width - 1);
+    y = std::min(y, height - 1);
+    if (fast_path)
+      return reinterpret_cast<const QRgb*>(image_.constScanLine(y))[x];
+    return image_.pixel(x, y);
+  };
+
+  for (int row_index = 0; row_index < tile_rect.height(); row_index++) {
+    auto* target_line = reinterpret_cast<QRgb*>(tile_image.scanLine(row_index));
+    int y = (tile_rect.top() + row_index) * step;
+
+    for (int column_index = 0; column_index < tile_rect.width(); column_index++) {
+      int x = (tile_rect.left() + column_index) * step;
+
+      QRgb samples[4] = {
+        sample(x, y), sample(x + half_step, y),
+        sample(x, y + half_step), sample(x + half_step, y + half_step)
+      };
+
+      int red = 0;
+      int green = 0;
+      int blue = 0;
+      int alpha = 0;
+
+      for (auto color : samples) {
+        red += qRed(color);
+        green += qGreen(color);
+        blue += qBlue(color);
+        alpha += qAlpha(color);
+      }
+
+      target_line[column_index] = qRgba(red / 4, green / 4, blue / 4, alpha / 4);
+    }
+  }
+
+  return tile_image;
+}
+
+void TiledImageView::updateScrollBars()
+{
+  QSize viewport_size = viewport()->size();
+
+  if (image_.isNull()) {
+    horizontalScrollBar()->setRange(0, 0);
+    verticalScrollBar()->setRange(0, 0);
+    return;
+  }
+
+  if (fit_to_window_) {
+    zoom_ = std::min(viewport_size.width() * 1.0 / image_.width(),
+                     viewport_size.height() * 1.0 / image_.height());
+    zoom_ = std::max(zoom_, 1e-6);
+  }
+
+  auto zoomed_width = static_cast<int>(std::ceil(image_.width() * zoom_));
+  auto zoomed_height = static_cast<int>(std::ceil(image_.height() * zoom_));
+
+  horizontalScrollBar()->setPageStep(viewport_size.width());
+  horizontalScrollBar()->setSingleStep(kTileSize / 4);
+  horizontalScrollBar()->setRange(0, std::max(0, zoomed_width - viewport_size.width()));
+
+  verticalScrollBar()->setPageStep(viewport_size.height());
+  verticalScrollBar()->setSingleStep(kTileSize / 4);
+  verticalScrollBar()->setRange(0, std::max(0, zoomed_height - viewport_size.height()));
+}
+
+void TiledImageView::paintEvent(QPaintEvent* event)
+{
+  QPainter painter(viewport());
+  painter.fillRect(event->rect(), palette().dark());
+
+  if (image_.isNull())
+    return;
+
+  painter.setRenderHint(QPainter::SmoothPixmapTransform);
+
+  int level = levelForZoom();
+  QSize size = levelSize(image_, level);
+
+  // Screen pixels per pixel of the reduced level
+  double scale = zoom_ * (1 << level);
+
+  QPointF origin = imageOrigin();
+  double origin_x = origin.x();
+  double origin_y = origin.y();
+
+  // Visible area in coordinates of the reduced level
+  QRect exposed = event->rect();
+  int first_column = std::max(0, static_cast<int>(std::floor((exposed.left() - origin_x) / scale)) / kTileSize);
+  int first_row = std::max(0, static_cast<int>(std::floor((exposed.top() - origin_y) / scale)) / kTileSize);
+  int last_column = std::min((size.width() - 1) / kTileSize,
+                             static_cast<int>(std::floor((exposed.right() + 1 - origin_x) / scale)) / kTileSize);
+  int last_row = std::min((size.height() - 1) / kTileSize,
+                          static_cast<int>(std::floor((exposed.bottom() + 1 - origin_y) / scale)) / kTileSize);
+
+  for (int tile_row = first_row; tile_row <= last_row; tile_row++) {
+    for (int tile_column = first_column; tile_column <= last_column; tile_column++) {
+      const QPixmap* tile_pixmap = tile(level, tile_column, tile_row);
+
+      if (!tile_pixmap)
+        continue;
+
+      QRectF target(origin_x + tile_column * kTileSize * scale,
+                    origin_y + tile_row * kTileSize * scale,
+                    tile_pixmap->width() * scale,
+                    tile_pixmap->height() * scale);
+      painter.drawPixmap(target, *tile_pixmap, QRectF(tile_pixmap->rect()));
+    }
+  }
+
+  if (!selection_.isNull()) {
+    // Dashes over a solid line stay visible on dark and light images
+    QRectF outline(origin_x + selection_.x() * zoom_, origin_y + selection_.y() * zoom_,
+                   selection_.width() * zoom_, selection_.height() * zoom_);
+    painter.setRenderHint(QPainter::Antialiasing, false);
+    painter.setPen(QPen(Qt::white, 0));
+    painter.drawRect(outline);
+    painter.setPen(QPen(Qt::black, 0, Qt::DashLine));
+    painter.drawRect(outline);
+  }
+}
+
+void TiledImageView::resizeEvent(QResizeEvent* event)
+{
+  QAbstractScrollArea::resizeEvent(event);
+  updateScrollBars();
+}
+
+void TiledImageView::wheelEvent(QWheelEvent* event)
+{
+  if (image_.isNull() || !(event->modifiers() & Qt::ControlModifier)) {
+    QAbstractScrollArea::wheelEvent(event);
+    return;
+  }
+
+  // Zoom keeping the point under the cursor in place
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+  QPointF cursor = event->position();
+#else
+  QPointF cursor = event->posF();
+#endif
+  double image_x = (horizontalScrollBar()->value() + cursor.x()) / zoom_;
+  double image_y = (verticalScrollBar()->value() + cursor.y()) / zoom_;
+
+  double factor = event->angleDelta().y() > 0 ? 1.25 : 0.8;
+  setZoom(std::min(32.0, std::max(1e-3, zoom_ * factor)));
+
+  horizontalScrollBar()->setValue(static_cast<int>(image_x * zoom_ - cursor.x()));
+  verticalScrollBar()->setValue(static_cast<int>(image_y * zoom_ - cursor.y()));
+  event->accept();
+}
+
+void TiledImageView::scrollContentsBy(int dx, int dy)
+{
+  Q_UNUSED(dx);
+  Q_UNUSED(dy);
+  viewport()->update();
+}
+
+void TiledImageView::mousePressEvent(QMouseEvent* event)
+{
+  if (!selection_enabled_ || image_.isNull() || event->button() != Qt::LeftButton) {
+    QAbstractScrollArea::mousePressEvent(event);
+    return;
+  }
+
+  drag_start_ = event->pos();
+  rubber_band_->setGeometry(QRect(drag_start_, QSize()));
+  rubber_band_->show();
+  event->accept();
+}
+
+void TiledImageView::mouseMoveEvent(QMouseEvent* event)
+{
+  if (!rubber_band_->isVisible()) {
+    QAbstractScrollArea::mouseMoveEvent(event);
+    return;
+  }
+
+  rubber_band_->setGeometry(QRect(drag_start_, event->pos()).normalized());
+  event->accept();
+}
+
+void TiledImageView::mouseReleaseEvent(QMouseEvent* event)
+{
+  if (!rubber_band_->isVisible() || event->button() != Qt::LeftButton) {
+    QAbstractScrollArea::mouseReleaseEvent(event);
+    return;
+  }
+
+  rubber_band_->hide();
+
+  // Pixels the band touches are selected, a click without dragging clears
+  QPoint start = mapToImage(drag_start_);
+  QPoint end = mapToImage(event->pos());
+  bool dragged = (event->pos() - drag_start_).manhattanLength() >= QApplication::startDragDistance();
+  setSelection(dragged ? QRect(start, end).normalized() : QRect());
+  event->accept();
+}
+
+QPointF TiledImageView::imageOrigin() const
+{
+  // Center the image when it is smaller than the viewport
+  double zoomed_width = image_.width() * zoom_;
+  double zoomed_height = image_.height() * zoom_;
+  double origin_x = zoomed_width < viewport()->width() ?
+        (viewport()->width() - zoomed_width) / 2 : -horizontalScrollBar()->value();
+  double origin_y = zoomed_height < viewport()->height() ?
+        (viewport()->height() - zoomed_height) / 2 : -verticalScrollBar()->value();
+
+  return QPointF(origin_x, origin_y);
+}
+
+QRect TiledImageView::mapFromImage(const QRect& rect) const
+{
+  QPointF origin = imageOrigin();
+  QRectF mapped(origin.x() + rect.x() * zoom_, origin.y() + rect.y() * zoom_,
+                rect.width() * zoom_, rect.height() * zoom_);
+
+  // Rounded outwards, with a pixel more for the smoothing of the edges
+  return mapped.toAlignedRect().adjusted(-1, -1, 1, 1);
+}
+
+QPoint TiledImageView::mapToImage(const QPoint& point) const
+{
+  QPointF origin = imageOrigin();
+  return QPoint(static_cast<int>(std::floor((point.x() - origin.x()) / zoom_)),
+                static_cast<int>(std::floor((point.y() - origin.y()) / zoom_)));
+}
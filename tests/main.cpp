@@ -0,0 +1,484 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QThread>
+
+#include "include/cpu_features.hpp"
+#include "include/edit_history.hpp"
+#include "include/histogram_cache.hpp"
+#include "include/image_comparison.hpp"
+#include "include/operation_registry.hpp"
+#include "include/profiler.hpp"
+#include "include/tile_pipeline.hpp"
+
+namespace {
+
+// Formats the reference implementation can be checked on without losing
+// precision
+const std::vector<QImage::Format> kEightBitFormats = {
+  QImage::Format_Grayscale8,
+  QImage::Format_RGB32,
+  QImage::Format_ARGB32,
+  QImage::Format_ARGB32_Premultiplied
+};
+
+/**
+ * Random image of a random size up to max_size on each side, grayscale
+ * a third of the time since several operations assume it, and another
+ * third colored with a gray left half, which only the whole image tells
+ * apart from a gray one
+ */
+QImage createRandomImage(std::mt19937& generator, int max_size)
+{
+  std::uniform_int_distribution<int> size_distribution(1, max_size);
+  std::uniform_int_distribution<int> channel_distribution(0, 255);
+  std::uniform_int_distribution<size_t> format_distribution(0, kEightBitFormats.size() - 1);
+
+  int tones = static_cast<int>(generator() % 3);
+  QImage image(size_distribution(generator), size_distribution(generator), QImage::Format_ARGB32);
+
+  for (int row_index = 0; row_index < image.height(); row_index++) {
+    auto* row = reinterpret_cast<QRgb*>(image.scanLine(row_index));
+
+    for (int col_index = 0; col_index < image.width(); col_index++) {
+      bool grayscale = tones == 0 || (tones == 2 && col_index < image.width() / 2);
+      int red = channel_distribution(generator);
+      int green = grayscale ? red : channel_distribution(generator);
+      int blue = grayscale ? red : channel_distribution(generator);
+      row[col_index] = qRgba(red, green, blue, channel_distribution(generator));
+    }
+  }
+
+  return image.convertToFormat(kEightBitFormats[format_distribution(generator)]);
+}
+
+/**
+ * Random parameters within the range of each one, factors of zoom out,
+ * structuring elements and windows are limited to the image size
+ */
+QVariantList randomParameters(std::mt19937& generator, const image_op::OperationInfo& operation, const QImage& image)
+{
+  QVariantList parameters;
+
+  for (int i = 0; i < operation.parameters.size(); i++) {
+    const auto& parameter = operation.parameters[i];
+
+    if (parameter.type == image_op::OperationParameter::Boolean) {
+      parameters.append(generator() % 2 == 0);
+    } else if (parameter.type == image_op::OperationParameter::Real) {
+      // Kept small so kernel results are not all saturated
+      double minimum = std::max(-2.0, parameter.minimum);
+      double maximum = std::min(2.0, parameter.maximum);
+      parameters.append(std::uniform_real_distribution<double>(minimum, maximum)(generator));
+    } else {
+      int maximum = static_cast<int>(parameter.maximum);
+      if (QStringList({ "zoom_out", "erode", "dilate", "open", "close", "box_blur" }).contains(operation.name))
+        maximum = i == 0 ? image.width() : image.height();
+      else if (operation.name.endsWith("_threshold"))
+        maximum = std::max(image.width(), image.height());
+      // The reference compares every patch pixel of every offset
+      else if (operation.name == "nlm_denoise")
+        maximum = std::min(maximum, 2);
+
+      parameters.append(std::uniform_int_distribution<int>(static_cast<int>(parameter.minimum), maximum)(generator));
+    }
+  }
+
+  return parameters;
+}
+
+/**
+ * Runs random images and parameters through the optimized and the reference
+ * implementation of every operation, comparing the results
+ * @return Number of operations with a case over their tolerance
+ */
+int verifyOperations(const QStringList& operation_names, int iterations, quint32 seed)
+{
+  int failures = 0;
+
+  for (const auto& operation : image_op::availableOperations()) {
+    if (!operation_names.isEmpty() && !operation_names.contains(operation.name))
+      continue;
+
+    int tolerance = image_op::referenceTolerance(operation.name);
+    int max_difference = 0;
+    double min_psnr = std::numeric_limits<double>::infinity();
+
+    for (int iteration = 0; iteration < iterations; iteration++) {
+      // Each case has its own seed so failures can be reproduced alone
+      quint32 case_seed = seed + static_cast<quint32>(iteration);
+      std::mt19937 generator(case_seed);
+
+      QVector<QImage> inputs;
+      for (int i = 0; i < operation.input_count; i++)
+        inputs.append(createRandomImage(generator, 300));
+
+      QVariantList parameters = randomParameters(generator, operation, inputs[0]);
+
+      QImage optimized = image_op::applyOperation(operation.name, inputs, parameters);
+      QImage reference = image_op::applyReferenceOperation(operation.name, inputs, parameters);
+      // Alpha is left out of the comparison since the reference makes every pixel opaque
+      auto comparison = image_op::compareImages(optimized, reference);
+      int difference = comparison.pixel_count > 0 ? comparison.maximum_difference : -1;
+
+      if (difference < 0 || difference > tolerance) {
+        failures++;
+        std::printf("FAIL %-26s seed %u, %dx%d, %s: %s\n", qPrintable(operation.name), case_seed,
+                    inputs[0].width(), inputs[0].height(),
+                    qPrintable(image_op::describeOperation(operation.name, parameters)),
+                    difference < 0 ? "size differs"
+                                   : qPrintable(QString("difference %1 over %2").arg(difference).arg(tolerance)));
+        break;
+      }
+
+      max_difference = std::max(max_difference, difference);
+      min_psnr = std::min(min_psnr, comparison.peak_signal_to_noise_ratio);
+    }
+
+    std::printf("%-26s max difference %d, tolerance %d, min PSNR %.1f dB\n", qPrintable(operation.name),
+                max_difference, tolerance, min_psnr);
+    std::fflush(stdout);
+  }
+
+  return failures;
+}
+
+/**
+ * Runs random images and parameters through every operation with one
+ * input, applied to the whole image and fused tile by tile on small tiles,
+ * which must give the same pixels
+ * @return Number of operations with a case that differs
+ */
+int verifyPipelines(const QStringList& operation_names, int iterations, quint32 seed)
+{
+  int failures = 0;
+
+  for (const auto& operation : image_op::availableOperations()) {
+    if (operation.input_count != 1 || (!operation_names.isEmpty() && !operation_names.contains(operation.name)))
+      continue;
+
+    for (int iteration = 0; iteration < iterations; iteration++) {
+      quint32 case_seed = seed + static_cast<quint32>(iteration);
+      std::mt19937 generator(case_seed);
+
+      QImage image = createRandomImage(generator, 300);
+      QVariantList parameters = randomParameters(generator, operation, image);
+      int tile_size = std::uniform_int_distribution<int>(16, 64)(generator);
+
+      QImage whole = image_op::applyOperation(operation.name, { image }, parameters);
+      QImage fused = image_op::applyPipeline(image, { { operation.name, parameters, {} } }, tile_size);
+      auto comparison = image_op::compareImages(whole, fused);
+
+      if (comparison.pixel_count == 0 || comparison.maximum_difference != 0 || whole.format() != fused.format()) {
+        failures++;
+        std::printf("FAIL %-26s fused, seed %u, %dx%d, %d pixel tiles, %s\n", qPrintable(operation.name),
+                    case_seed, image.width(), image.height(), tile_size,
+                    qPrintable(image_op::describeOperation(operation.name, parameters)));
+        break;
+      }
+    }
+  }
+
+  return failures;
+}
+
+/**
+ * Runs random images, whose histogram is cached first, through every
+ * operation with one input. Point operations carry the histogram forward
+ * to their result from a tone curve, which must give the histogram scanned
+ * from the pixels of the result
+ * @return Number of operations with a case that differs
+ */
+int verifyHistograms(const QStringList& operation_names, int iterations, quint32 seed)
+{
+  int failures = 0;
+
+  for (const auto& operation : image_op::availableOperations()) {
+    if (operation.input_count != 1 || (!operation_names.isEmpty() && !operation_names.contains(operation.name)))
+      continue;
+
+    for (int iteration = 0; iteration < iterations; iteration++) {
+      quint32 case_seed = seed + static_cast<quint32>(iteration);
+      std::mt19937 generator(case_seed);
+
+      QImage image = createRandomImage(generator, 300);
+      QVariantList parameters = randomParameters(generator, operation, image);
+      image_op::cachedHistogram(image);
+
+      QImage result = image_op::applyOperation(operation.name, { image }, parameters);
+      image_op::HistogramInfo propagated;
+      if (result.isNull() || !image_op::findCachedHistogram(result, &propagated))
+        continue;
+
+      // A copy has a cache key of its own, so its histogram is scanned
+      auto scanned = image_op::cachedHistogram(result.copy());
+
+      if (propagated.histogram != scanned.histogram || propagated.grayscale != scanned.grayscale) {
+        failures++;
+        std::printf("FAIL %-26s histogram, seed %u, %dx%d, %s\n", qPrintable(operation.name), case_seed,
+                    image.width(), image.height(), qPrintable(image_op::describeOperation(operation.name, parameters)));
+        break;
+      }
+    }
+  }
+
+  return failures;
+}
+
+/**
+ * Whether both images have the same size, format, color table and pixels
+ */
+bool identicalImages(const QImage& a, const QImage& b)
+{
+  if (a.size() != b.size() || a.format() != b.format() || a.colorTable() != b.colorTable())
+    return false;
+
+  auto row_bytes = static_cast<size_t>((a.width() * a.depth() + 7) / 8);
+  for (int row_index = 0; row_index < a.height(); row_index++) {
+    if (std::memcmp(a.constScanLine(row_index), b.constScanLine(row_index), row_bytes) != 0)
+      return false;
+  }
+
+  return true;
+}
+
+/**
+ * Pixel of the result mixed into the original by the weight of a mask, as
+ * selections with a mask are blended
+ */
+QRgb blendRgb(QRgb original, QRgb result, int weight)
+{
+  auto blend = [weight](int original_value, int result_value) {
+    return (original_value * (255 - weight) + result_value * weight + 127) / 255;
+  };
+
+  return qRgba(blend(qRed(original), qRed(result)), blend(qGreen(original), qGreen(result)),
+               blend(qBlue(original), qBlue(result)), blend(qAlpha(original), qAlpha(result)));
+}
+
+/**
+ * Runs random images and parameters through every operation with one
+ * input that keeps the size of the image, applied to a random selection,
+ * half of the time with a random mask. Outside the selection the pixels
+ * must be the ones of the input, left as it was, and inside they must be
+ * the result on the whole image, or on the selection alone for operations
+ * taking statistics of it, blended by the mask
+ * @return Number of operations with a case that differs
+ */
+int verifySelections(const QStringList& operation_names, int iterations, quint32 seed)
+{
+  int failures = 0;
+
+  for (const auto& operation : image_op::availableOperations()) {
+    if (operation.input_count != 1 || (!operation_names.isEmpty() && !operation_names.contains(operation.name)))
+      continue;
+
+    for (int iteration = 0; iteration < iterations; iteration++) {
+      quint32 case_seed = seed + static_cast<quint32>(iteration);
+      std::mt19937 generator(case_seed);
+
+      QImage image = createRandomImage(generator, 300);
+      QVariantList parameters = randomParameters(generator, operation, image);
+
+      // Operations changing the size cannot run in a selection
+      QImage whole = image_op::applyOperation(operation.name, { image }, parameters);
+      if (whole.size() != image.size())
+        break;
+
+      int x = std::uniform_int_distribution<int>(0, image.width() - 1)(generator);
+      int y = std::uniform_int_distribution<int>(0, image.height() - 1)(generator);
+      QRect selection(x, y, std::uniform_int_distribution<int>(1, image.width() - x)(generator),
+                      std::uniform_int_distribution<int>(1, image.height() - y)(generator));
+
+      QImage mask;
+      if (generator() % 2 == 0) {
+        mask = QImage(selection.size(), QImage::Format_Grayscale8);
+        for (int row_index = 0; row_index < mask.height(); row_index++) {
+          for (int col_index = 0; col_index < mask.width(); col_index++)
+            mask.scanLine(row_index)[col_index] = static_cast<uchar>(generator() % 256);
+        }
+      }
+
+      QImage input = image.copy();
+      QImage result = image_op::applyOperationInSelection(operation.name, { image }, parameters, { selection, mask });
+      QImage alone = image_op::applyOperation(operation.name, { image.copy(selection) }, parameters);
+
+      bool unchanged = !result.isNull() && identicalImages(image, input);
+      bool matches_whole = unchanged;
+      bool matches_alone = unchanged && alone.size() == selection.size();
+
+      if (unchanged) {
+        QImage original = image.convertToFormat(result.format());
+        whole = whole.convertToFormat(result.format());
+        alone = alone.convertToFormat(result.format());
+
+        for (int row_index = 0; row_index < image.height(); row_index++) {
+          for (int col_index = 0; col_index < image.width(); col_index++) {
+            QRgb pixel = result.pixel(col_index, row_index);
+            QRgb original_pixel = original.pixel(col_index, row_index);
+
+            if (!selection.contains(col_index, row_index)) {
+              unchanged = unchanged && pixel == original_pixel;
+              continue;
+            }
+
+            int weight = mask.isNull() ? 255
+                                       : mask.constScanLine(row_index - selection.y())[col_index - selection.x()];
+            matches_whole = matches_whole
+                            && pixel == blendRgb(original_pixel, whole.pixel(col_index, row_index), weight);
+            matches_alone = matches_alone
+                            && pixel == blendRgb(original_pixel, alone.pixel(col_index - selection.x(),
+                                                                             row_index - selection.y()), weight);
+          }
+        }
+      }
+
+      if (!unchanged || (!matches_whole && !matches_alone)) {
+        failures++;
+        std::printf("FAIL %-26s selection, seed %u, %dx%d, %d,%d %dx%d%s, %s: %s\n", qPrintable(operation.name),
+                    case_seed, image.width(), image.height(), selection.x(), selection.y(), selection.width(),
+                    selection.height(), mask.isNull() ? "" : " masked",
+                    qPrintable(image_op::describeOperation(operation.name, parameters)),
+                    unchanged ? "selected pixels differ" : "pixels outside the selection changed");
+        break;
+      }
+    }
+  }
+
+  return failures;
+}
+
+/**
+ * Records edits changing some tiles, the format and only the color table
+ * of an image, then undoes and redoes each of them, with the entries in
+ * memory and spilled to disk, checking the image returns to the one
+ * before and after the edit
+ * @return Number of edits that do not round trip
+ */
+int verifyEditHistory(quint32 seed)
+{
+  std::mt19937 generator(seed);
+  QImage image = createRandomImage(generator, 600);
+  QImage indexed = image.convertToFormat(QImage::Format_Indexed8);
+  QImage inverted_palette = indexed.copy();
+  for (int i = 0; i < inverted_palette.colorCount(); i++)
+    inverted_palette.setColor(i, inverted_palette.color(i) ^ 0x00ffffff);
+
+  QRect selection(image.width() / 4, image.height() / 4, image.width() / 2 + 1, image.height() / 2 + 1);
+
+  struct Edit
+  {
+    const char* description;
+    QImage before;
+    QImage after;
+  };
+
+  std::vector<Edit> edits = {
+    { "negative in selection", image, image_op::applyOperationInSelection("negative", { image }, {},
+                                                                          { selection, QImage() }) },
+    { "indexed to RGB32", indexed, image },
+    { "RGB32 to indexed", image, indexed },
+    { "indexed palette", indexed, inverted_palette }
+  };
+
+  int failures = 0;
+
+  for (const auto& edit : edits) {
+    for (qint64 memory_limit : { EditHistory::kDefaultMemoryLimit, qint64(0) }) {
+      EditHistory history(memory_limit);
+      history.record(edit.before, edit.after, edit.description);
+
+      QImage current = edit.after;
+      QRect restored_region;
+      bool undone = history.undo(current, &restored_region) && identicalImages(current, edit.before);
+      bool redone = undone && history.redo(current, &restored_region) && identicalImages(current, edit.after);
+
+      if (!redone) {
+        failures++;
+        std::printf("FAIL history %s, seed %u, %dx%d, %s, %s\n", edit.description, seed, image.width(),
+                    image.height(), memory_limit == 0 ? "spilled" : "in memory", undone ? "redo" : "undo");
+      }
+    }
+  }
+
+  return failures;
+}
+
+/**
+ * Times a scope holding a nested one of the same category, which the
+ * breakdown must count once, for the duration of the outer scope
+ * @return 1 if the breakdown counts another duration
+ */
+int verifyProfilerBreakdown()
+{
+  profiler::setEnabled(true);
+  qint64 since_ns = profiler::timestamp();
+
+  {
+    PROFILE_SCOPE("outer", "compute");
+    {
+      PROFILE_SCOPE("inner", "compute");
+    }
+
+    // Keeps the outer scope clearly longer than the inner one
+    QThread::msleep(20);
+  }
+
+  qint64 outer_ns = -1;
+  for (const auto& event : profiler::events()) {
+    if (event.start_ns >= since_ns && qstrcmp(event.name, "outer") == 0)
+      outer_ns = event.duration_ns;
+  }
+
+  QString expected = QString("compute %1 ms").arg(outer_ns / 1e6, 0, 'f', 1);
+  QString breakdown = profiler::breakdown(since_ns);
+
+  if (outer_ns < 0 || !breakdown.contains(expected)) {
+    std::printf("FAIL profiler breakdown \"%s\", expected %s\n", qPrintable(breakdown), qPrintable(expected));
+    return 1;
+  }
+
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("photochopp_tests");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Compares the results of every operation with the reference implementation, "
+                                   "with the tile pipeline and in selections on random images and "
+                                   "parameters, and the histograms carried forward to their results, then "
+                                   "checks the undo history and the profiler");
+  parser.addHelpOption();
+
+  QCommandLineOption iterations_option("iterations", "Random cases per operation.", "count", "50");
+  QCommandLineOption seed_option("seed", "Seed of the first case.", "seed", "1");
+  QCommandLineOption operations_option("operations", "Comma separated operation names, all if empty.", "list");
+  parser.addOptions({ iterations_option, seed_option, operations_option });
+  parser.process(app);
+
+  QStringList operation_names = parser.value(operations_option).split(',', QString::SkipEmptyParts);
+  int iterations = std::max(1, parser.value(iterations_option).toInt());
+  quint32 seed = parser.value(seed_option).toUInt();
+
+  std::printf("Verifying kernels for %s\n", cpu::isaLevelName(cpu::activeIsaLevel()));
+  int failures = verifyOperations(operation_names, iterations, seed);
+  failures += verifyPipelines(operation_names, iterations, seed);
+  failures += verifySelections(operation_names, iterations, seed);
+  failures += verifyHistograms(operation_names, iterations, seed);
+  failures += verifyEditHistory(seed);
+  failures += verifyProfilerBreakdown();
+  std::printf("%d operation(s) failed\n", failures);
+
+  return failures == 0 ? 0 : 1;
+}
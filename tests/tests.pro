@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# Tests of the image processing core, mostly
+# differential ones of the optimized operations
+# against the reference implementation, run with
+# "make check"
+#
+#-------------------------------------------------
+
+QT       += core gui concurrent
+
+TARGET = photochopp_tests
+TEMPLATE = app
+
+# Adds the check target, failing when the program exits non-zero
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../src/core.pri)
+
+SOURCES += \
+    main.cpp
@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# Client of the job server, PhotoChopp --serve, that
+# also measures its throughput and latency
+#
+#-------------------------------------------------
+
+QT       += core gui concurrent network
+
+TARGET = photochopp_client
+TEMPLATE = app
+
+CONFIG += console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../../src/core.pri)
+
+SOURCES += \
+    main.cpp \
+    ../../src/job_protocol.cpp
+
+HEADERS += \
+    ../../include/job_protocol.hpp
@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <QAtomicInt>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImage>
+#include <QJsonObject>
+#include <QLocalSocket>
+#include <QSharedMemory>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+#include "include/job_protocol.hpp"
+
+namespace {
+
+// Longest wait for the reply to a job
+constexpr int kReplyTimeoutMs = 60000;
+
+struct ClientOptions
+{
+  QString server_name;
+  QString operations;
+  // Absolute, since the server resolves them from its own directory
+  QString input;
+  QString output;
+  bool shared_memory;
+  int jobs;
+};
+
+/**
+ * What one connection measured
+ */
+struct ConnectionResult
+{
+  // Round trip of each job, from sending it to receiving its reply
+  std::vector<double> latencies_ms;
+  // Time the server reported for the jobs, added up
+  double server_ms;
+  int failures;
+  QString error;
+};
+
+/**
+ * Sends jobs one after the other on a connection of its own until the
+ * shared counter reaches the number of jobs
+ * @param image Input sent through shared memory, null to send the file name
+ */
+ConnectionResult runConnection(const ClientOptions& options, int connection, const QImage& image,
+                               QAtomicInt* next_job)
+{
+  ConnectionResult result{ {}, 0, 0, {} };
+
+  QLocalSocket socket;
+  socket.connectToServer(options.server_name);
+  if (!socket.waitForConnected()) {
+    result.error = socket.errorString();
+    return result;
+  }
+
+  QJsonObject job;
+  job["operations"] = options.operations;
+  if (!options.output.isEmpty())
+    job["output"] = options.output;
+
+  // Written once and sent with every job of the connection
+  QSharedMemory shared_memory(QString("photochopp-client-%1-%2").arg(QCoreApplication::applicationPid())
+                                                                .arg(connection));
+  if (!image.isNull()) {
+    QByteArray pixels = job_protocol::imagePixels(image);
+    if (!shared_memory.create(pixels.size())) {
+      result.error = shared_memory.errorString();
+      return result;
+    }
+
+    shared_memory.lock();
+    std::memcpy(shared_memory.data(), pixels.constData(), static_cast<size_t>(pixels.size()));
+    shared_memory.unlock();
+
+    job["shared_memory"] = shared_memory.key();
+    job_protocol::describeImage(image, &job);
+  } else {
+    job["input"] = options.input;
+  }
+
+  for (int job_index = next_job->fetchAndAddOrdered(1); job_index < options.jobs;
+       job_index = next_job->fetchAndAddOrdered(1)) {
+    job["id"] = job_index;
+
+    QElapsedTimer timer;
+    timer.start();
+    job_protocol::writeMessage(&socket, job);
+
+    QJsonObject reply;
+    QByteArray payload;
+    if (!job_protocol::waitForMessage(&socket, &reply, &payload, kReplyTimeoutMs)) {
+      result.error = QString("No reply to job %1: %2").arg(job_index).arg(socket.errorString());
+      return result;
+    }
+
+    result.latencies_ms.push_back(timer.nsecsElapsed() / 1e6);
+    result.server_ms += reply["milliseconds"].toDouble();
+
+    if (!reply["ok"].toBool()) {
+      result.failures++;
+      if (result.error.isEmpty())
+        result.error = reply["error"].toString();
+    }
+  }
+
+  return result;
+}
+
+double percentile(const std::vector<double>& sorted_values, double fraction)
+{
+  size_t index = std::min(sorted_values.size() - 1, static_cast<size_t>(fraction * sorted_values.size()));
+  return sorted_values[index];
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("photochopp_client");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Sends jobs to PhotoChopp --serve, measuring throughput and latency "
+                                   "when sending many");
+  parser.addHelpOption();
+
+  QCommandLineOption server_option("server", "Name of the local socket of the server.", "name",
+                                   job_protocol::kDefaultServerName);
+  QCommandLineOption operations_option("operations", "Comma separated operations with their parameters "
+                                       "after colons, like equalize,box_blur:5:5.", "list");
+  QCommandLineOption input_option("input", "Image the operations are applied to.", "file");
+  QCommandLineOption output_option("output", "File the server writes the result to, otherwise the "
+                                   "pixels are sent back.", "file");
+  QCommandLineOption shared_memory_option("shared-memory", "Decodes the input here and hands the pixels "
+                                          "to the server through shared memory.");
+  QCommandLineOption jobs_option("jobs", "Jobs sent in total.", "count", "1");
+  QCommandLineOption connections_option("connections", "Connections sending jobs at once, each waiting "
+                                        "for the reply before the next job.", "count", "1");
+  parser.addOptions({ server_option, operations_option, input_option, output_option, shared_memory_option,
+                      jobs_option, connections_option });
+  parser.process(app);
+
+  ClientOptions options;
+  options.server_name = parser.value(server_option);
+  options.operations = parser.value(operations_option);
+  options.input = QFileInfo(parser.value(input_option)).absoluteFilePath();
+  options.output = parser.isSet(output_option) ? QFileInfo(parser.value(output_option)).absoluteFilePath()
+                                               : QString();
+  options.shared_memory = parser.isSet(shared_memory_option);
+  options.jobs = std::max(1, parser.value(jobs_option).toInt());
+  int connections = std::max(1, std::min(options.jobs, parser.value(connections_option).toInt()));
+
+  if (!parser.isSet(input_option)) {
+    std::fprintf(stderr, "No input given\n");
+    return 1;
+  }
+
+  QImage image;
+  if (options.shared_memory) {
+    image = QImage(options.input);
+    if (image.isNull()) {
+      std::fprintf(stderr, "Cannot read %s\n", qPrintable(options.input));
+      return 1;
+    }
+  }
+
+  QThreadPool pool;
+  pool.setMaxThreadCount(connections);
+  QAtomicInt next_job(0);
+
+  QElapsedTimer timer;
+  timer.start();
+
+  QVector<QFuture<ConnectionResult>> futures;
+  for (int connection = 0; connection < connections; connection++)
+    futures.append(QtConcurrent::run(&pool, runConnection, options, connection, image, &next_job));
+
+  std::vector<double> latencies_ms;
+  double server_ms = 0;
+  int failures = 0;
+
+  for (auto& future : futures) {
+    ConnectionResult result = future.result();
+    if (!result.error.isEmpty())
+      std::fprintf(stderr, "%s\n", qPrintable(result.error));
+
+    latencies_ms.insert(latencies_ms.end(), result.latencies_ms.begin(), result.latencies_ms.end());
+    server_ms += result.server_ms;
+    failures += result.failures;
+  }
+
+  double seconds = timer.nsecsElapsed() / 1e9;
+
+  if (latencies_ms.empty()) {
+    std::fprintf(stderr, "No job completed\n");
+    return 1;
+  }
+
+  std::sort(latencies_ms.begin(), latencies_ms.end());
+  int completed = static_cast<int>(latencies_ms.size());
+
+  std::printf("%d job(s), %d failed, %d connection(s)\n", completed, failures, connections);
+  std::printf("Throughput %.1f jobs/s\n", completed / std::max(seconds, 1e-9));
+  std::printf("Latency median %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms\n", percentile(latencies_ms, 0.5),
+              percentile(latencies_ms, 0.95), percentile(latencies_ms, 0.99), latencies_ms.back());
+  std::printf("Server time mean %.2f ms\n", server_ms / completed);
+
+  return failures == 0 && completed == options.jobs ? 0 : 1;
+}